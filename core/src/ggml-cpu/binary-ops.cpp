@@ -22,27 +22,172 @@ static inline float op_div(float a, float b) {
     return a / b;
 }
 
+// SIMD lanes for the f32/f16/bf16 kernels below
+// every storage type is widened to f32 lanes on load and narrowed back on store, so mixed-type
+// combinations (e.g. f16 activations + f32 bias) are converted in registers instead of per element
+#if defined(__AVX2__) && defined(__F16C__)
+#define GGML_BINARY_OP_SIMD
+
+typedef __m256 bop_vec_t;
+static constexpr int BOP_EPR = 8;
+
+static inline bop_vec_t bop_load(const float * p) {
+    return _mm256_loadu_ps(p);
+}
+
+static inline bop_vec_t bop_load(const ggml_fp16_t * p) {
+    return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *) p));
+}
+
+static inline bop_vec_t bop_load(const ggml_bf16_t * p) {
+    return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) p)), 16));
+}
+
+static inline void bop_store(float * p, bop_vec_t v) {
+    _mm256_storeu_ps(p, v);
+}
+
+static inline void bop_store(ggml_fp16_t * p, bop_vec_t v) {
+    _mm_storeu_si128((__m128i *) p, _mm256_cvtps_ph(v, 0));
+}
+
+static inline void bop_store(ggml_bf16_t * p, bop_vec_t v) {
+    // round to nearest even and quiet NaNs, same as GGML_FP32_TO_BF16
+    const __m256i u    = _mm256_castps_si256(v);
+    const __m256i lsb  = _mm256_and_si256(_mm256_srli_epi32(u, 16), _mm256_set1_epi32(1));
+    const __m256i rne  = _mm256_srli_epi32(_mm256_add_epi32(u, _mm256_add_epi32(lsb, _mm256_set1_epi32(0x7fff))), 16);
+    const __m256i qnan = _mm256_or_si256(_mm256_srli_epi32(u, 16), _mm256_set1_epi32(64));
+    const __m256i nan  = _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+    const __m256i r    = _mm256_blendv_epi8(rne, qnan, nan);
+
+    // packus works per 128-bit half, gather the two low quadwords into the low half
+    const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(r, r), 0x08);
+    _mm_storeu_si128((__m128i *) p, _mm256_castsi256_si128(packed));
+}
+
+static inline bop_vec_t bop_set1(float v) {
+    return _mm256_set1_ps(v);
+}
+
+template <float (*op)(float, float)>
+static inline bop_vec_t bop_apply(bop_vec_t a, bop_vec_t b) {
+    if constexpr (op == op_add) {
+        return _mm256_add_ps(a, b);
+    } else if constexpr (op == op_sub) {
+        return _mm256_sub_ps(a, b);
+    } else if constexpr (op == op_mul) {
+        return _mm256_mul_ps(a, b);
+    } else {
+        return _mm256_div_ps(a, b);
+    }
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__) && !defined(_MSC_VER)
+#define GGML_BINARY_OP_SIMD
+
+typedef float32x4_t bop_vec_t;
+static constexpr int BOP_EPR = 4;
+
+static inline bop_vec_t bop_load(const float * p) {
+    return vld1q_f32(p);
+}
+
+static inline bop_vec_t bop_load(const ggml_fp16_t * p) {
+    return vcvt_f32_f16(vld1_f16((const __fp16 *) p));
+}
+
+static inline bop_vec_t bop_load(const ggml_bf16_t * p) {
+    return vreinterpretq_f32_u32(vshll_n_u16(vld1_u16((const uint16_t *) p), 16));
+}
+
+static inline void bop_store(float * p, bop_vec_t v) {
+    vst1q_f32(p, v);
+}
+
+static inline void bop_store(ggml_fp16_t * p, bop_vec_t v) {
+    vst1_f16((__fp16 *) p, vcvt_f16_f32(v));
+}
+
+static inline void bop_store(ggml_bf16_t * p, bop_vec_t v) {
+    // round to nearest even and quiet NaNs, same as GGML_FP32_TO_BF16
+    const uint32x4_t u    = vreinterpretq_u32_f32(v);
+    const uint32x4_t lsb  = vandq_u32(vshrq_n_u32(u, 16), vdupq_n_u32(1));
+    const uint32x4_t rne  = vshrq_n_u32(vaddq_u32(u, vaddq_u32(lsb, vdupq_n_u32(0x7fff))), 16);
+    const uint32x4_t qnan = vorrq_u32(vshrq_n_u32(u, 16), vdupq_n_u32(64));
+    const uint32x4_t nan  = vmvnq_u32(vceqq_f32(v, v));
+
+    vst1_u16((uint16_t *) p, vmovn_u32(vbslq_u32(nan, qnan, rne)));
+}
+
+static inline bop_vec_t bop_set1(float v) {
+    return vdupq_n_f32(v);
+}
+
+template <float (*op)(float, float)>
+static inline bop_vec_t bop_apply(bop_vec_t a, bop_vec_t b) {
+    if constexpr (op == op_add) {
+        return vaddq_f32(a, b);
+    } else if constexpr (op == op_sub) {
+        return vsubq_f32(a, b);
+    } else if constexpr (op == op_mul) {
+        return vmulq_f32(a, b);
+    } else {
+        return vdivq_f32(a, b);
+    }
+}
+#endif
+
 template <float (*op)(float, float), typename src0_t, typename src1_t, typename dst_t>
 static inline void vec_binary_op_contiguous(const int64_t n, dst_t * z, const src0_t * x, const src1_t * y) {
     constexpr auto src0_to_f32 = type_conversion_table<src0_t>::to_f32;
     constexpr auto src1_to_f32 = type_conversion_table<src1_t>::to_f32;
     constexpr auto f32_to_dst  = type_conversion_table<dst_t >::from_f32;
 
-    for (int i = 0; i < n; i++) {
+    int64_t i = 0;
+
+#if defined(GGML_BINARY_OP_SIMD)
+    for (; i + BOP_EPR <= n; i += BOP_EPR) {
+        bop_store(z + i, bop_apply<op>(bop_load(x + i), bop_load(y + i)));
+    }
+#endif
+
+    for (; i < n; i++) {
         z[i] = f32_to_dst(op(src0_to_f32(x[i]), src1_to_f32(y[i])));
     }
 }
 
+// src1 has a single element per row (ne10 == 1), e.g. a per-token scale
+template <float (*op)(float, float), typename src0_t, typename dst_t>
+static inline void vec_binary_op_scalar(const int64_t n, dst_t * z, const src0_t * x, const float y) {
+    constexpr auto src0_to_f32 = type_conversion_table<src0_t>::to_f32;
+    constexpr auto f32_to_dst  = type_conversion_table<dst_t >::from_f32;
+
+    int64_t i = 0;
+
+#if defined(GGML_BINARY_OP_SIMD)
+    const bop_vec_t vy = bop_set1(y);
+
+    for (; i + BOP_EPR <= n; i += BOP_EPR) {
+        bop_store(z + i, bop_apply<op>(bop_load(x + i), vy));
+    }
+#endif
+
+    for (; i < n; i++) {
+        z[i] = f32_to_dst(op(src0_to_f32(x[i]), y));
+    }
+}
+
 template <float (*op)(float, float), typename src0_t, typename src1_t, typename dst_t>
 static inline void vec_binary_op_non_contiguous(const int64_t n, const int64_t ne10, const int64_t nb10, dst_t * z, const src0_t * x, const src1_t * y) {
     constexpr auto src0_to_f32 = type_conversion_table<src0_t>::to_f32;
     constexpr auto src1_to_f32 = type_conversion_table<src1_t>::to_f32;
     constexpr auto f32_to_dst  = type_conversion_table<dst_t >::from_f32;
 
-    for (int i = 0; i < n; i++) {
-        int i10 = i % ne10;
-        const src1_t * y_ptr = (const src1_t *)((const char *)y + i10*nb10);
-        z[i] = f32_to_dst(op(src0_to_f32(x[i]), src1_to_f32(*y_ptr)));
+    // n is a multiple of ne10 (ggml_can_repeat), so walk src1 once per repetition instead of i % ne10
+    for (int64_t i0 = 0; i0 < n; i0 += ne10) {
+        for (int64_t i10 = 0; i10 < ne10; i10++) {
+            const src1_t * y_ptr = (const src1_t *)((const char *)y + i10*nb10);
+            z[i0 + i10] = f32_to_dst(op(src0_to_f32(x[i0 + i10]), src1_to_f32(*y_ptr)));
+        }
     }
 }
 
@@ -90,7 +235,10 @@ static void apply_binary_op(const ggml_compute_params * params, ggml_tensor * ds
         const src0_t * src0_ptr = (const src0_t *) ((const char *) src0->data + i03*nb03 + i02*nb02 + i01*nb01);
         const src1_t * src1_ptr = (const src1_t *) ((const char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11);
 
-        if (is_src1_contiguous_rows) {
+        if (is_src1_contiguous_rows && ne10 == 1) {
+            // one src1 value per row: broadcast it in registers instead of ne00 calls of length 1
+            vec_binary_op_scalar<op>(ne00, dst_ptr, src0_ptr, type_conversion_table<src1_t>::to_f32(*src1_ptr));
+        } else if (is_src1_contiguous_rows) {
             // src1 is broadcastable across src0 and dst in i1, i2, i3
             const int64_t nr0 = ne00 / ne10;
 
@@ -1136,6 +1136,34 @@ void ggml_set_f32_nd(const struct ggml_tensor * tensor, int i0, int i1, int i2,
 
 // ggml_compute_forward_mul_mat
 
+// number of src1 values widened to f32 at a time when src1 is f16/bf16 and needs converting to
+// vec_dot_type - a multiple of every block size, small enough to live on the stack
+#define GGML_MUL_MAT_SRC1_CVT_CHUNK 1024
+
+// convert n values of a src1 row to vec_dot_type
+// f16/bf16 activations go through f32 in chunks, so no f32 copy of src1 is ever materialized
+static void ggml_mul_mat_src1_from_row(
+        const enum ggml_type src1_type, const enum ggml_type vec_dot_type,
+        const char * x, char * y, const int64_t n) {
+    ggml_from_float_t const from_float = type_traits_cpu[vec_dot_type].from_float;
+
+    if (src1_type == GGML_TYPE_F32) {
+        from_float((const float *) x, y, n);
+        return;
+    }
+
+    ggml_to_float_t const to_float = ggml_get_type_traits(src1_type)->to_float;
+    GGML_ASSERT(to_float != NULL);
+
+    float tmp[GGML_MUL_MAT_SRC1_CVT_CHUNK];
+
+    for (int64_t i = 0; i < n; i += GGML_MUL_MAT_SRC1_CVT_CHUNK) {
+        const int64_t nc = MIN(GGML_MUL_MAT_SRC1_CVT_CHUNK, n - i);
+        to_float(x + i*ggml_type_size(src1_type), tmp, nc);
+        from_float(tmp, y + ggml_row_size(vec_dot_type, i), nc);
+    }
+}
+
 static void ggml_compute_forward_mul_mat_one_chunk(
     const struct ggml_compute_params * params,
     struct ggml_tensor * dst,
@@ -1226,6 +1254,83 @@ static void ggml_compute_forward_mul_mat_one_chunk(
     }
 }
 
+// GEMV path for a single src1 column (batch-of-one queries)
+// the matmul is bound by streaming src0 from DRAM, so instead of the chunk queue and 16x16 tiling
+// each thread walks one contiguous slab of src0 rows and prefetches GGML_GEMV_PREFETCH_BYTES ahead
+// of the row being computed. Matrices too large to stay cached between calls are prefetched with
+// a non-temporal hint so they do not evict the activations
+#define GGML_GEMV_PREFETCH_BYTES 2048
+#define GGML_GEMV_NT_MIN_BYTES   (8u*1024*1024)
+
+#if defined(__GNUC__) || defined(__clang__)
+#define GGML_GEMV_PREFETCH(p)    __builtin_prefetch((p), 0, 3)
+#define GGML_GEMV_PREFETCH_NT(p) __builtin_prefetch((p), 0, 0)
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define GGML_GEMV_PREFETCH(p)    _mm_prefetch((const char *)(p), _MM_HINT_T0)
+#define GGML_GEMV_PREFETCH_NT(p) _mm_prefetch((const char *)(p), _MM_HINT_NTA)
+#else
+#define GGML_GEMV_PREFETCH(p)    ((void)(p))
+#define GGML_GEMV_PREFETCH_NT(p) ((void)(p))
+#endif
+
+static bool ggml_mul_mat_use_gemv(const struct ggml_tensor * src0, const struct ggml_tensor * src1) {
+    return src1->ne[1] == 1 && src1->ne[2] == 1 && src1->ne[3] == 1 &&
+           src0->ne[2] == 1 && src0->ne[3] == 1 &&
+           ggml_is_contiguous(src0);
+}
+
+static void ggml_compute_forward_mul_mat_gemv(
+    const struct ggml_compute_params * params,
+    struct ggml_tensor * dst,
+    const void * vec) {
+
+    const struct ggml_tensor * src0 = dst->src[0];
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    const int64_t ne00 = src0->ne[0];
+    const int64_t nr0  = src0->ne[1];
+    const size_t  nb01 = src0->nb[1];
+
+    ggml_vec_dot_t const vec_dot = type_traits_cpu[src0->type].vec_dot;
+
+    // slab boundaries on multiples of 16 rows keep threads off each other's dst cache lines
+    const int64_t dr = (((nr0 + nth - 1)/nth) + 15) & ~(int64_t) 15;
+
+    const int64_t ir0_start = MIN(dr*ith, nr0);
+    const int64_t ir0_end   = MIN(ir0_start + dr, nr0);
+
+    if (ir0_start >= ir0_end) {
+        return;
+    }
+
+    const char * src0_data = (const char *) src0->data;
+    float      * dst_col   = (float *) dst->data;
+
+    const bool non_temporal = ggml_nbytes(src0) >= GGML_GEMV_NT_MIN_BYTES;
+
+    const char * pf     = src0_data + ir0_start*nb01;
+    const char * pf_end = src0_data + ir0_end*nb01;
+
+    for (int64_t ir0 = ir0_start; ir0 < ir0_end; ++ir0) {
+        const char * src0_row = src0_data + ir0*nb01;
+
+        const char * pf_want = MIN(src0_row + nb01 + GGML_GEMV_PREFETCH_BYTES, pf_end);
+        if (non_temporal) {
+            for (; pf < pf_want; pf += GGML_CACHE_LINE) {
+                GGML_GEMV_PREFETCH_NT(pf);
+            }
+        } else {
+            for (; pf < pf_want; pf += GGML_CACHE_LINE) {
+                GGML_GEMV_PREFETCH(pf);
+            }
+        }
+
+        vec_dot(ne00, &dst_col[ir0], 0, src0_row, 0, vec, 0, 1);
+    }
+}
+
 void ggml_compute_forward_mul_mat(
         const struct ggml_compute_params * params,
               struct ggml_tensor * dst) {
@@ -1239,7 +1344,6 @@ void ggml_compute_forward_mul_mat(
     const int nth = params->nth;
 
     enum ggml_type           const vec_dot_type         = type_traits_cpu[src0->type].vec_dot_type;
-    ggml_from_float_t        const from_float           = type_traits_cpu[vec_dot_type].from_float;
     int64_t                  const vec_dot_num_rows     = type_traits_cpu[src0->type].nrows;
 
     GGML_ASSERT(ne0 == ne01);
@@ -1297,14 +1401,15 @@ UseGgmlGemm1:;
         const size_t nbw3 = nbw2*ne12;
 
         assert(params->wsize >= ne13*nbw3);
-        GGML_ASSERT(src1->type == GGML_TYPE_F32);
+        GGML_ASSERT(src1->type == GGML_TYPE_F32 || src1->type == GGML_TYPE_F16 || src1->type == GGML_TYPE_BF16);
 
     #if 0
         for (int64_t i13 = 0; i13 < ne13; ++i13) {
             for (int64_t i12 = 0; i12 < ne12; ++i12) {
                 for (int64_t i11 = ith; i11 < ne11; i11 += nth) {
-                    from_float((float *)((char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11),
-                               (void *)               (wdata + i13*nbw3 + i12*nbw2 + i11*nbw1),
+                    ggml_mul_mat_src1_from_row(src1->type, vec_dot_type,
+                               (const char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11,
+                               (char *)       wdata      + i13*nbw3 + i12*nbw2 + i11*nbw1,
                                 ne10);
                 }
             }
@@ -1316,8 +1421,9 @@ UseGgmlGemm1:;
                     size_t bs = ggml_blck_size(vec_dot_type);
                     int64_t ne10_block_start = (ith * ne10/bs) / nth;
                     int64_t ne10_block_end   = ((ith + 1) * ne10/bs) / nth;
-                    from_float((float *)((char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11 + ne10_block_start*bs*nb10),
-                               (void *)               (wdata + i13*nbw3 + i12*nbw2 + i11*nbw1 + ne10_block_start*nbw0),
+                    ggml_mul_mat_src1_from_row(src1->type, vec_dot_type,
+                               (const char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11 + ne10_block_start*bs*nb10,
+                               (char *)       wdata      + i13*nbw3 + i12*nbw2 + i11*nbw1 + ne10_block_start*nbw0,
                                (ne10_block_end - ne10_block_start) * bs);
                 }
             }
@@ -1356,6 +1462,11 @@ UseGgmlGemm1:;
 UseGgmlGemm2:;
 #endif
 
+    if (ggml_mul_mat_use_gemv(src0, src1)) {
+        ggml_compute_forward_mul_mat_gemv(params, dst, src1->type == vec_dot_type ? src1->data : params->wdata);
+        return;
+    }
+
     // This is the size of the first dimension of the result, so we can iterate that way. (see the ASSERT above, these are the same numbers)
     const int64_t nr0 = ne0;
 
@@ -1518,7 +1629,6 @@ static void ggml_compute_forward_mul_mat_id(
     const bool src1_cont = ggml_is_contiguous(src1);
 
     enum ggml_type    const vec_dot_type    = type_traits_cpu[type].vec_dot_type;
-    ggml_from_float_t const from_float      = type_traits_cpu[vec_dot_type].from_float;
 
     // we don't support permuted src0 or src1
     GGML_ASSERT(nb00 == ggml_type_size(type));
@@ -1560,14 +1670,15 @@ static void ggml_compute_forward_mul_mat_id(
         const size_t nbw3 = nbw2*ne12;
 
         assert(params->wsize >= ne13*nbw3);
-        GGML_ASSERT(src1->type == GGML_TYPE_F32);
+        GGML_ASSERT(src1->type == GGML_TYPE_F32 || src1->type == GGML_TYPE_F16 || src1->type == GGML_TYPE_BF16);
 
 #if 0
         for (int64_t i13 = 0; i13 < ne13; ++i13) {
             for (int64_t i12 = ith; i12 < ne12; i12 += nth) {
                 for (int64_t i11 = 0; i11 < ne11; ++i11) {
-                    from_float((float *)((char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11),
-                               (void *)               (wdata + i13*nbw3 + i12*nbw2 + i11*nbw1),
+                    ggml_mul_mat_src1_from_row(src1->type, vec_dot_type,
+                               (const char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11,
+                               (char *)       wdata      + i13*nbw3 + i12*nbw2 + i11*nbw1,
                                ne10);
                 }
             }
@@ -1579,8 +1690,9 @@ static void ggml_compute_forward_mul_mat_id(
                     size_t bs = ggml_blck_size(vec_dot_type);
                     int64_t ne10_block_start = (ith * ne10/bs) / nth;
                     int64_t ne10_block_end   = ((ith + 1) * ne10/bs) / nth;
-                    from_float((float *)((char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11 + ne10_block_start*bs*nb10),
-                               (void *)               (wdata + i13*nbw3 + i12*nbw2 + i11*nbw1 + ne10_block_start*nbw0),
+                    ggml_mul_mat_src1_from_row(src1->type, vec_dot_type,
+                               (const char *) src1->data + i13*nb13 + i12*nb12 + i11*nb11 + ne10_block_start*bs*nb10,
+                               (char *)       wdata      + i13*nbw3 + i12*nbw2 + i11*nbw1 + ne10_block_start*nbw0,
                                (ne10_block_end - ne10_block_start) * bs);
                 }
             }
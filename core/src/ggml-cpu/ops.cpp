@@ -10,6 +10,7 @@
 #include <algorithm>
 #include <cfloat>
 #include <cmath>
+#include <type_traits>
 
 // ggml_compute_forward_dup
 
@@ -3686,6 +3687,61 @@ static void ggml_compute_forward_norm_f32(
     }
 }
 
+// f16/bf16 hidden states: mean, variance and the normalization are all done in f32,
+// only the row loads and the final store use the storage type
+template<typename T>
+static void ggml_compute_forward_norm_lp(
+        const ggml_compute_params * params,
+        ggml_tensor * dst) {
+
+    const ggml_tensor * src0 = dst->src[0];
+
+    GGML_ASSERT(ggml_are_same_shape(src0, dst));
+    GGML_ASSERT(src0->type == dst->type);
+
+    GGML_ASSERT(src0->nb[0] == sizeof(T));
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    GGML_TENSOR_UNARY_OP_LOCALS
+
+    float eps;
+    memcpy(&eps, dst->op_params, sizeof(float));
+
+    GGML_ASSERT(eps >= 0.0f);
+
+    constexpr auto to_f32   = type_conversion_table<T>::to_f32;
+    constexpr auto from_f32 = type_conversion_table<T>::from_f32;
+
+    for (int64_t i03 = 0; i03 < ne03; i03++) {
+        for (int64_t i02 = 0; i02 < ne02; i02++) {
+            for (int64_t i01 = ith; i01 < ne01; i01 += nth) {
+                const T * x = (const T *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+                      T * y = (T *)       ((char *)  dst->data + i01*nb1  + i02*nb2  + i03*nb3);
+
+                ggml_float sum = 0.0;
+                for (int64_t i00 = 0; i00 < ne00; i00++) {
+                    sum += (ggml_float) to_f32(x[i00]);
+                }
+                const float mean = sum/ne00;
+
+                ggml_float sum2 = 0.0;
+                for (int64_t i00 = 0; i00 < ne00; i00++) {
+                    const float v = to_f32(x[i00]) - mean;
+                    sum2 += (ggml_float)(v*v);
+                }
+                const float variance = sum2/ne00;
+
+                const float scale = 1.0f/sqrtf(variance + eps);
+                for (int64_t i00 = 0; i00 < ne00; i00++) {
+                    y[i00] = from_f32((to_f32(x[i00]) - mean)*scale);
+                }
+            }
+        }
+    }
+}
+
 void ggml_compute_forward_norm(
         const ggml_compute_params * params,
         ggml_tensor * dst) {
@@ -3697,6 +3753,14 @@ void ggml_compute_forward_norm(
             {
                 ggml_compute_forward_norm_f32(params, dst);
             } break;
+        case GGML_TYPE_F16:
+            {
+                ggml_compute_forward_norm_lp<ggml_fp16_t>(params, dst);
+            } break;
+        case GGML_TYPE_BF16:
+            {
+                ggml_compute_forward_norm_lp<ggml_bf16_t>(params, dst);
+            } break;
         default:
             {
                 GGML_ABORT("fatal error");
@@ -3757,6 +3821,59 @@ static void ggml_compute_forward_rms_norm_f32(
     }
 }
 
+// f16/bf16 variant of rms_norm, accumulated in f32 like ggml_compute_forward_norm_lp
+template<typename T>
+static void ggml_compute_forward_rms_norm_lp(
+        const ggml_compute_params * params,
+        ggml_tensor * dst) {
+
+    const ggml_tensor * src0 = dst->src[0];
+
+    GGML_ASSERT(ggml_are_same_shape(src0, dst));
+    GGML_ASSERT(src0->type == dst->type);
+
+    GGML_ASSERT(src0->nb[0] == sizeof(T));
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    GGML_TENSOR_UNARY_OP_LOCALS
+
+    float eps;
+    memcpy(&eps, dst->op_params, sizeof(float));
+
+    GGML_ASSERT(eps >= 0.0f);
+
+    constexpr auto to_f32   = type_conversion_table<T>::to_f32;
+    constexpr auto from_f32 = type_conversion_table<T>::from_f32;
+
+    for (int64_t i03 = 0; i03 < ne03; i03++) {
+        for (int64_t i02 = 0; i02 < ne02; i02++) {
+            for (int64_t i01 = ith; i01 < ne01; i01 += nth) {
+                const T * x = (const T *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+                      T * y = (T *)       ((char *)  dst->data + i01*nb1  + i02*nb2  + i03*nb3);
+
+                ggml_float sum = 0.0;
+                for (int64_t i00 = 0; i00 < ne00; i00++) {
+                    const float v = to_f32(x[i00]);
+                    sum += (ggml_float)(v*v);
+                }
+
+                const float mean = sum/ne00;
+
+                const float scale = 1.0f/sqrtf(mean + eps);
+
+                // if you hit this, likely you got an inf somewhere earlier
+                assert(scale > 0.0f);
+
+                for (int64_t i00 = 0; i00 < ne00; i00++) {
+                    y[i00] = from_f32(to_f32(x[i00])*scale);
+                }
+            }
+        }
+    }
+}
+
 void ggml_compute_forward_rms_norm(
         const ggml_compute_params * params,
         ggml_tensor * dst) {
@@ -3768,6 +3885,14 @@ void ggml_compute_forward_rms_norm(
             {
                 ggml_compute_forward_rms_norm_f32(params, dst);
             } break;
+        case GGML_TYPE_F16:
+            {
+                ggml_compute_forward_rms_norm_lp<ggml_fp16_t>(params, dst);
+            } break;
+        case GGML_TYPE_BF16:
+            {
+                ggml_compute_forward_rms_norm_lp<ggml_bf16_t>(params, dst);
+            } break;
         default:
             {
                 GGML_ABORT("fatal error");
@@ -5221,7 +5346,17 @@ void ggml_compute_forward_diag_mask_zero(
 
 // ggml_compute_forward_soft_max
 
-static void ggml_compute_forward_soft_max_f32(
+// src0 and dst are f32, or both f16/bf16 hidden states: f16/bf16 rows are widened into the f32
+// work row, scaled, masked, exponentiated and summed there, and narrowed once on the final store
+static inline void ggml_soft_max_load_row(int64_t n, float * y, const float * x)       { ggml_vec_cpy_f32(n, y, x); }
+static inline void ggml_soft_max_load_row(int64_t n, float * y, const ggml_fp16_t * x) { ggml_cpu_fp16_to_fp32(x, y, n); }
+static inline void ggml_soft_max_load_row(int64_t n, float * y, const ggml_bf16_t * x) { ggml_cpu_bf16_to_fp32(x, y, n); }
+
+static inline void ggml_soft_max_store_row(int64_t n, ggml_fp16_t * y, const float * x) { ggml_cpu_fp32_to_fp16(x, y, n); }
+static inline void ggml_soft_max_store_row(int64_t n, ggml_bf16_t * y, const float * x) { ggml_cpu_fp32_to_bf16(x, y, n); }
+
+template <typename T>
+static void ggml_compute_forward_soft_max_impl(
         const ggml_compute_params * params,
               ggml_tensor * dst) {
 
@@ -5276,14 +5411,14 @@ static void ggml_compute_forward_soft_max_f32(
                 const uint32_t h = i02; // head
                 const float slope = (max_bias > 0.0f) ? h < n_head_log2 ? powf(m0, h + 1) : powf(m1, 2*(h - n_head_log2) + 1) : 1.0f;
 
-                float * sp = (float *)((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
-                float * dp = (float *)((char *)  dst->data + i01*nb1  + i02*nb2  + i03*nb3);
+                const T * sp = (const T *)((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+                      T * dp = (T *)      ((char *)  dst->data + i01*nb1  + i02*nb2  + i03*nb3);
 
                 // broadcast the mask across rows
                 ggml_fp16_t * mp_f16 = src1 ? (ggml_fp16_t *)((char *) src1->data + i11*nb11 + i12*nb12 + i13*nb13) : NULL;
                 float       * mp_f32 = src1 ? (float       *)((char *) src1->data + i11*nb11 + i12*nb12 + i13*nb13) : NULL;
 
-                ggml_vec_cpy_f32  (ne00, wp, sp);
+                ggml_soft_max_load_row(ne00, wp, sp);
                 ggml_vec_scale_f32(ne00, wp, scale);
                 if (mp_f32) {
                     if (use_f16) {
@@ -5312,7 +5447,10 @@ static void ggml_compute_forward_soft_max_f32(
                     max = MAX(max, sk[i02]);
                 }
 
-                ggml_float sum = ggml_vec_soft_max_f32(ne00, dp, wp, max);
+                // f32 rows are exponentiated straight into dst, f16/bf16 rows in the work row
+                float * ep = std::is_same<T, float>::value ? (float *) dp : wp;
+
+                ggml_float sum = ggml_vec_soft_max_f32(ne00, ep, wp, max);
                 assert(sum > 0.0);
 
                 if (sk) {
@@ -5320,14 +5458,18 @@ static void ggml_compute_forward_soft_max_f32(
                 }
 
                 sum = 1.0/sum;
-                ggml_vec_scale_f32(ne00, dp, sum);
+                ggml_vec_scale_f32(ne00, ep, sum);
 
 #ifndef NDEBUG
                 for (int i = 0; i < ne00; ++i) {
-                    assert(!isnan(dp[i]));
-                    assert(!isinf(dp[i]));
+                    assert(!isnan(ep[i]));
+                    assert(!isinf(ep[i]));
                 }
 #endif
+
+                if constexpr (!std::is_same<T, float>::value) {
+                    ggml_soft_max_store_row(ne00, dp, ep);
+                }
             }
         }
     }
@@ -5339,10 +5481,20 @@ void ggml_compute_forward_soft_max(
 
     const ggml_tensor * src0 = dst->src[0];
 
+    GGML_ASSERT(src0->type == dst->type);
+
     switch (src0->type) {
         case GGML_TYPE_F32:
             {
-                ggml_compute_forward_soft_max_f32(params, dst);
+                ggml_compute_forward_soft_max_impl<float>(params, dst);
+            } break;
+        case GGML_TYPE_F16:
+            {
+                ggml_compute_forward_soft_max_impl<ggml_fp16_t>(params, dst);
+            } break;
+        case GGML_TYPE_BF16:
+            {
+                ggml_compute_forward_soft_max_impl<ggml_bf16_t>(params, dst);
             } break;
         default:
             {
@@ -8105,6 +8257,66 @@ void ggml_compute_forward_top_k(
     }
 }
 
+// K.Q dot of the flash-attn kernels. with DK_T known at compile time and a whole number of SIMD steps,
+// f16 and f32 K rows are dotted inline with a fixed trip count and no leftover loop, accumulating in the
+// same order as ggml_vec_dot_f16/f32; anything else goes through the type's vec_dot with the runtime DK
+template <int64_t DK_T>
+static inline float ggml_fa_kq_dot(ggml_vec_dot_t vec_dot, ggml_type type, int64_t DK, const void * k, const void * q) {
+#if defined(GGML_SIMD) && !defined(__ARM_FEATURE_SVE) && !defined(__riscv_v_intrinsic)
+    if constexpr (DK_T > 0 && DK_T % GGML_F16_STEP == 0) {
+        if (type == GGML_TYPE_F16) {
+            const ggml_fp16_t * x = (const ggml_fp16_t *) k;
+            const ggml_fp16_t * y = (const ggml_fp16_t *) q;
+
+            GGML_F16_VEC sum[GGML_F16_ARR] = { GGML_F16_VEC_ZERO };
+            GGML_F16_VEC ax[GGML_F16_ARR];
+            GGML_F16_VEC ay[GGML_F16_ARR];
+
+            for (int64_t i = 0; i < DK_T; i += GGML_F16_STEP) {
+                for (int j = 0; j < GGML_F16_ARR; j++) {
+                    ax[j] = GGML_F16_VEC_LOAD(x + i + j*GGML_F16_EPR, j);
+                    ay[j] = GGML_F16_VEC_LOAD(y + i + j*GGML_F16_EPR, j);
+
+                    sum[j] = GGML_F16_VEC_FMA(sum[j], ax[j], ay[j]);
+                }
+            }
+
+            ggml_float sumf = 0.0;
+            GGML_F16_VEC_REDUCE(sumf, sum);
+            return (float) sumf;
+        }
+    }
+    if constexpr (DK_T > 0 && DK_T % GGML_F32_STEP == 0) {
+        if (type == GGML_TYPE_F32) {
+            const float * x = (const float *) k;
+            const float * y = (const float *) q;
+
+            GGML_F32_VEC sum[GGML_F32_ARR] = { GGML_F32_VEC_ZERO };
+            GGML_F32_VEC ax[GGML_F32_ARR];
+            GGML_F32_VEC ay[GGML_F32_ARR];
+
+            for (int64_t i = 0; i < DK_T; i += GGML_F32_STEP) {
+                for (int j = 0; j < GGML_F32_ARR; j++) {
+                    ax[j] = GGML_F32_VEC_LOAD(x + i + j*GGML_F32_EPR);
+                    ay[j] = GGML_F32_VEC_LOAD(y + i + j*GGML_F32_EPR);
+
+                    sum[j] = GGML_F32_VEC_FMA(sum[j], ax[j], ay[j]);
+                }
+            }
+
+            float sumf = 0.0f;
+            GGML_F32_VEC_REDUCE(sumf, sum);
+            return sumf;
+        }
+    }
+#endif
+    float s;
+    vec_dot(DK, &s, 0, k, 0, q, 0, 1);
+    return s;
+}
+
+// DK_T/DV_T != 0 fix the head sizes at compile time, 0 means read them from the tensors
+template <int64_t DK_T, int64_t DV_T>
 static void ggml_compute_forward_flash_attn_ext_f16_one_chunk(
         const ggml_compute_params * params,
         ggml_tensor * dst,
@@ -8128,8 +8340,8 @@ static void ggml_compute_forward_flash_attn_ext_f16_one_chunk(
     GGML_TENSOR_LOCALS(int64_t, ne,  dst, ne)
     GGML_TENSOR_LOCALS(size_t,  nb,  dst, nb)
 
-    const int64_t DK = nek0;
-    const int64_t DV = nev0;
+    const int64_t DK = DK_T > 0 ? DK_T : nek0;
+    const int64_t DV = DV_T > 0 ? DV_T : nev0;
     const int64_t N  = neq1;
 
     GGML_ASSERT(ne0 == DV);
@@ -8235,10 +8447,9 @@ static void ggml_compute_forward_flash_attn_ext_f16_one_chunk(
                 continue;
             }
 
-            float s; // KQ value
-
             const char * k_data = (const char *) k->data + ( ic*nbk1 + ik2*nbk2 + ik3*nbk3);
-            kq_vec_dot(DK, &s, 0, k_data, 0, Q_q, 0, 1);
+
+            float s = ggml_fa_kq_dot<DK_T>(kq_vec_dot, k->type, DK, k_data, Q_q); // KQ value
 
             s = s*scale; // scale KQ value
 
@@ -8343,10 +8554,16 @@ static void ggml_compute_forward_flash_attn_ext_f16_one_chunk(
     }
 }
 
+// same as above for DK_T/DV_T; the tile sizes must not exceed ggml_fa_tile_config,
+// which is what the work buffer is sized for
+template <int64_t DK_T, int64_t DV_T, int Q_TILE_SZ, int KV_TILE_SZ>
 static void ggml_compute_forward_flash_attn_ext_tiled(
         const ggml_compute_params * params,
         ggml_tensor * dst,
         int ir0, int ir1) {
+    static_assert(Q_TILE_SZ  <= (int) ggml_fa_tile_config::Q,  "Q tile larger than the work buffer");
+    static_assert(KV_TILE_SZ <= (int) ggml_fa_tile_config::KV, "KV tile larger than the work buffer");
+
     const ggml_tensor * q     = dst->src[0];
     const ggml_tensor * k     = dst->src[1];
     const ggml_tensor * v     = dst->src[2];
@@ -8362,8 +8579,8 @@ static void ggml_compute_forward_flash_attn_ext_tiled(
     GGML_TENSOR_LOCALS(int64_t, ne,  dst, ne)
     GGML_TENSOR_LOCALS(size_t,  nb,  dst, nb)
 
-    const int64_t DK = nek0;
-    const int64_t DV = nev0;
+    const int64_t DK = DK_T > 0 ? DK_T : nek0;
+    const int64_t DV = DV_T > 0 ? DV_T : nev0;
     const int64_t N  = neq1;
 
     GGML_ASSERT(ne0 == DV);
@@ -8421,9 +8638,6 @@ static void ggml_compute_forward_flash_attn_ext_tiled(
 
     int ith = params->ith;
 
-    static constexpr int Q_TILE_SZ  = ggml_fa_tile_config::Q;
-    static constexpr int KV_TILE_SZ = ggml_fa_tile_config::KV;
-
     GGML_ASSERT(nek1 % KV_TILE_SZ == 0 && "KV sequence length must be divisible by KV_TILE_SZ");
 
     int ir = ir0;
@@ -8509,9 +8723,7 @@ static void ggml_compute_forward_flash_attn_ext_tiled(
                 const void * q_row = (const char *)Q_q + tq * DK * kv_type_size;
                 for (int tk = 0; tk < KV_TILE_SZ; tk++) {
                     const void * k_row = (const char *) k->data + ((ic + tk)*nbk1 + ik2*nbk2 + ik3*nbk3);
-                    float s;
-                    kv_vec_dot(DK, &s, 0, k_row, 0, q_row, 0, 1);
-                    KQ[tq * KV_TILE_SZ + tk] = s * scale;
+                    KQ[tq * KV_TILE_SZ + tk] = ggml_fa_kq_dot<DK_T>(kv_vec_dot, kv_type, DK, k_row, q_row) * scale;
                 }
             }
 
@@ -8689,6 +8901,52 @@ static void ggml_flash_attn_ext_reduce_partials(
     }
 }
 
+typedef void (*ggml_fa_one_chunk_t)(const ggml_compute_params *, ggml_tensor *, int, int, int64_t, int64_t, float *, int64_t);
+typedef void (*ggml_fa_tiled_t)    (const ggml_compute_params *, ggml_tensor *, int, int);
+
+// embedding/encoder models almost always use one of these head sizes, so they get
+// kernels with DK/DV known at compile time; anything else goes to the generic <0, 0> instance
+static ggml_fa_one_chunk_t ggml_fa_select_one_chunk(int64_t DK, int64_t DV) {
+    if (DK == DV) {
+        switch (DK) {
+            case  32: return ggml_compute_forward_flash_attn_ext_f16_one_chunk< 32,  32>;
+            case  64: return ggml_compute_forward_flash_attn_ext_f16_one_chunk< 64,  64>;
+            case 128: return ggml_compute_forward_flash_attn_ext_f16_one_chunk<128, 128>;
+            default:  break;
+        }
+    }
+    return ggml_compute_forward_flash_attn_ext_f16_one_chunk<0, 0>;
+}
+
+template <int KV_TILE_SZ>
+static ggml_fa_tiled_t ggml_fa_select_tiled_kv(int64_t DK, int64_t DV) {
+    static constexpr int Q_TILE_SZ = ggml_fa_tile_config::Q;
+
+    if (DK == DV) {
+        switch (DK) {
+            case  32: return ggml_compute_forward_flash_attn_ext_tiled< 32,  32, Q_TILE_SZ, KV_TILE_SZ>;
+            case  64: return ggml_compute_forward_flash_attn_ext_tiled< 64,  64, Q_TILE_SZ, KV_TILE_SZ>;
+            case 128: return ggml_compute_forward_flash_attn_ext_tiled<128, 128, Q_TILE_SZ, KV_TILE_SZ>;
+            default:  break;
+        }
+    }
+    return ggml_compute_forward_flash_attn_ext_tiled<0, 0, Q_TILE_SZ, KV_TILE_SZ>;
+}
+
+// returns nullptr if n_kv cannot be split into whole KV tiles
+// the half-size KV tile keeps unpadded sequence lengths (multiples of 8) on the tiled path
+static ggml_fa_tiled_t ggml_fa_select_tiled(int64_t DK, int64_t DV, int64_t n_kv) {
+    static constexpr int KV_TILE_SZ = ggml_fa_tile_config::KV;
+
+    if (n_kv % KV_TILE_SZ == 0) {
+        return ggml_fa_select_tiled_kv<KV_TILE_SZ>(DK, DV);
+    }
+    if (n_kv % (KV_TILE_SZ/2) == 0) {
+        return ggml_fa_select_tiled_kv<KV_TILE_SZ/2>(DK, DV);
+    }
+    return nullptr;
+}
+
 static void ggml_compute_forward_flash_attn_ext_f16(
         const ggml_compute_params * params,
         ggml_tensor * dst) {
@@ -8738,6 +8996,9 @@ static void ggml_compute_forward_flash_attn_ext_f16(
     const bool use_ref = params->use_ref;
 
     const bool kv_is_f32_or_f16 = (k->type == GGML_TYPE_F32 || k->type == GGML_TYPE_F16);
+
+    const ggml_fa_one_chunk_t fa_one_chunk = use_ref ? ggml_compute_forward_flash_attn_ext_f16_one_chunk<0, 0> : ggml_fa_select_one_chunk(DK, DV);
+
     const bool use_split_kv_path = !use_ref && (neq1 == 1 && neq3 == 1) && kv_is_f32_or_f16 && (k->type == v->type) && q->type == GGML_TYPE_F32 && nek1 >= 512;
 
     if (use_split_kv_path) {
@@ -8755,7 +9016,7 @@ static void ggml_compute_forward_flash_attn_ext_f16(
 
         if (ic_start < nek1) {
             for (int64_t q_head = 0; q_head < neq2; q_head++) {
-                ggml_compute_forward_flash_attn_ext_f16_one_chunk(
+                fa_one_chunk(
                     params, dst, q_head, q_head + 1, ic_start, ic_end,
                     chunk_partials, partial_stride);
             }
@@ -8794,14 +9055,12 @@ static void ggml_compute_forward_flash_attn_ext_f16(
 
         const int64_t dr = (nr + nchunk - 1) / nchunk;
 
-        static constexpr int64_t KV_TILE_SZ = ggml_fa_tile_config::KV;
         static constexpr int64_t Q_TILE_SZ  = ggml_fa_tile_config::Q;
-        const bool use_tiled = !use_ref &&
+        const ggml_fa_tiled_t fa_tiled = !use_ref &&
                                (q->type == GGML_TYPE_F32 &&
                                 kv_is_f32_or_f16 &&
                                 k->type == v->type &&
-                                nek1 % KV_TILE_SZ == 0 &&
-                                neq1 >= Q_TILE_SZ);
+                                neq1 >= Q_TILE_SZ) ? ggml_fa_select_tiled(DK, DV, nek1) : nullptr;
 
         int current_chunk = ith;
 
@@ -8809,10 +9068,10 @@ static void ggml_compute_forward_flash_attn_ext_f16(
             const int64_t ir0 = dr * current_chunk;
             const int64_t ir1 = MIN(ir0 + dr, nr);
 
-            if (use_tiled) {
-                ggml_compute_forward_flash_attn_ext_tiled(params, dst, ir0, ir1);
+            if (fa_tiled) {
+                fa_tiled(params, dst, ir0, ir1);
             } else {
-                ggml_compute_forward_flash_attn_ext_f16_one_chunk(params, dst, ir0, ir1, 0, nek1, nullptr, 0);
+                fa_one_chunk(params, dst, ir0, ir1, 0, nek1, nullptr, 0);
             }
 
             current_chunk = ggml_threadpool_chunk_add(params->threadpool, 1);
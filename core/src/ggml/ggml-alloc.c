@@ -465,6 +465,17 @@ struct hash_node {
     int buffer_id;
     struct buffer_address addr;
     bool allocated;
+    int interval; // index into galloc->intervals + 1, 0 = none
+};
+
+// a block handed out by the dynamic allocator, live from the step that allocates it to the step that frees it
+// tensors that reuse a parent in place share the parent's interval
+struct tensor_interval {
+    int buffer_id;
+    size_t size;   // aligned
+    int start;     // 0 = leafs and inputs, i + 1 = node i
+    int end;       // step that frees it, INT_MAX if never freed
+    size_t offset; // assigned by the planner
 };
 
 struct tensor_alloc {
@@ -496,6 +507,15 @@ struct ggml_gallocr {
 
     struct leaf_alloc * leaf_allocs; // [n_leafs]
     int n_leafs;
+
+    bool planner;
+    int step; // of the graph being allocated
+
+    struct tensor_interval * intervals; // [n_intervals]
+    int n_intervals;
+    int max_intervals;
+
+    struct ggml_gallocr_stats stats;
 };
 
 ggml_gallocr_t ggml_gallocr_new_n(ggml_backend_buffer_type_t * bufts, int n_bufs) {
@@ -579,9 +599,18 @@ void ggml_gallocr_free(ggml_gallocr_t galloc) {
     free(galloc->buf_tallocs);
     free(galloc->node_allocs);
     free(galloc->leaf_allocs);
+    free(galloc->intervals);
     free(galloc);
 }
 
+void ggml_gallocr_set_planner(ggml_gallocr_t galloc, bool enable) {
+    galloc->planner = enable;
+}
+
+void ggml_gallocr_get_stats(ggml_gallocr_t galloc, struct ggml_gallocr_stats * stats) {
+    *stats = galloc->stats;
+}
+
 typedef struct ggml_gallocr * ggml_gallocr_t;
 
 static struct hash_node * ggml_gallocr_hash_get(ggml_gallocr_t galloc, struct ggml_tensor * t) {
@@ -623,6 +652,26 @@ static void ggml_gallocr_free_extra_space(ggml_gallocr_t galloc, struct ggml_ten
     }
 }
 
+static int ggml_gallocr_new_interval(ggml_gallocr_t galloc, int buffer_id, size_t size) {
+    if (galloc->n_intervals == galloc->max_intervals) {
+        galloc->max_intervals = MAX(64, 2*galloc->max_intervals);
+        galloc->intervals = realloc(galloc->intervals, galloc->max_intervals * sizeof(struct tensor_interval));
+        GGML_ASSERT(galloc->intervals != NULL);
+    }
+    struct tensor_interval * iv = &galloc->intervals[galloc->n_intervals++];
+    iv->buffer_id = buffer_id;
+    iv->size = aligned_offset(NULL, size, galloc->buf_tallocs[buffer_id]->alignment);
+    iv->start = galloc->step;
+    iv->end = INT_MAX;
+    iv->offset = 0;
+    return galloc->n_intervals;
+}
+
+static void ggml_gallocr_count_inplace(ggml_gallocr_t galloc, struct ggml_tensor * node, int buffer_id) {
+    galloc->stats.n_inplace++;
+    galloc->stats.inplace_bytes += ggml_backend_buft_get_alloc_size(galloc->bufts[buffer_id], node);
+}
+
 static void ggml_gallocr_allocate_node(ggml_gallocr_t galloc, struct ggml_tensor * node, int buffer_id) {
     GGML_ASSERT(buffer_id >= 0);
     struct hash_node * hn = ggml_gallocr_hash_get(galloc, node);
@@ -666,17 +715,21 @@ static void ggml_gallocr_allocate_node(ggml_gallocr_t galloc, struct ggml_tensor
                             assert(view_src_hn->addr.chunk == p_hn->addr.chunk && view_src_hn->addr.offset == p_hn->addr.offset);
                             hn->buffer_id = p_hn->buffer_id;
                             hn->addr = p_hn->addr;
+                            hn->interval = view_src_hn->interval;
                             p_hn->allocated = false; // avoid freeing the parent
                             view_src_hn->allocated = false;
                             ggml_gallocr_free_extra_space(galloc, node, view_src);
+                            ggml_gallocr_count_inplace(galloc, node, hn->buffer_id);
                             return;
                         }
                     } else {
                         AT_PRINTF("reusing parent %s for %s\n", parent->name, node->name);
                         hn->buffer_id = p_hn->buffer_id;
                         hn->addr = p_hn->addr;
+                        hn->interval = p_hn->interval;
                         p_hn->allocated = false; // avoid freeing the parent
                         ggml_gallocr_free_extra_space(galloc, node, parent);
+                        ggml_gallocr_count_inplace(galloc, node, hn->buffer_id);
                         return;
                     }
                 }
@@ -688,6 +741,7 @@ static void ggml_gallocr_allocate_node(ggml_gallocr_t galloc, struct ggml_tensor
         size_t size = ggml_backend_buft_get_alloc_size(buft, node);
         hn->buffer_id = buffer_id;
         hn->addr = ggml_dyn_tallocr_alloc(alloc, size, node);
+        hn->interval = ggml_gallocr_new_interval(galloc, buffer_id, size);
     }
 }
 
@@ -712,6 +766,9 @@ static void ggml_gallocr_free_node(ggml_gallocr_t galloc, struct ggml_tensor * n
 
     ggml_dyn_tallocr_free_bytes(alloc, hn->addr, size);
     hn->allocated = false;
+    if (hn->interval > 0) {
+        galloc->intervals[hn->interval - 1].end = galloc->step;
+    }
 }
 
 static int get_node_buffer_id(const int * node_buffer_ids, int i) {
@@ -723,6 +780,10 @@ static void ggml_gallocr_alloc_graph_impl(ggml_gallocr_t galloc, struct ggml_cgr
     ggml_hash_set_reset(&galloc->hash_set);
     memset(galloc->hash_values, 0, sizeof(struct hash_node) * galloc->hash_set.size);
 
+    galloc->n_intervals = 0;
+    galloc->step = 0;
+    memset(&galloc->stats, 0, sizeof(galloc->stats));
+
     // allocate leafs
     // these may be tensors that the application is not using in the graph, but may still want to allocate for other purposes
     for (int i = 0; i < graph->n_leafs; i++) {
@@ -767,6 +828,7 @@ static void ggml_gallocr_alloc_graph_impl(ggml_gallocr_t galloc, struct ggml_cgr
     for (int i = 0; i < graph->n_nodes; i++) {
         struct ggml_tensor * node = graph->nodes[i];
         int buffer_id = get_node_buffer_id(node_buffer_ids, i);
+        galloc->step = i + 1;
 
         // allocate parents (only leafs need to be allocated at this point)
         for (int j = 0; j < GGML_MAX_SRC; j++) {
@@ -825,6 +887,176 @@ static void ggml_gallocr_alloc_graph_impl(ggml_gallocr_t galloc, struct ggml_cgr
     }
 }
 
+// lifetime planner
+
+static int ggml_interval_size_cmp(const void * a, const void * b) {
+    const struct tensor_interval * ia = *(const struct tensor_interval * const *)a;
+    const struct tensor_interval * ib = *(const struct tensor_interval * const *)b;
+    if (ia->size != ib->size) {
+        return ia->size > ib->size ? -1 : 1;
+    }
+    return ia->start != ib->start ? (ia->start < ib->start ? -1 : 1) : 0;
+}
+
+static int ggml_free_block_offset_cmp(const void * a, const void * b) {
+    const struct free_block * ba = (const struct free_block *)a;
+    const struct free_block * bb = (const struct free_block *)b;
+    return ba->offset != bb->offset ? (ba->offset < bb->offset ? -1 : 1) : 0;
+}
+
+static bool ggml_intervals_overlap(const struct tensor_interval * a, const struct tensor_interval * b) {
+    // a tensor freed at a step is still read by that step's node, which is allocated before the free
+    return a->start <= b->end && b->start <= a->end;
+}
+
+// peak over the steps of the total size of the live intervals
+// note: the tail that an in-place reuse of a larger view source frees early is counted until the whole block is freed
+static size_t ggml_intervals_lower_bound(struct tensor_interval ** iv, int n, int n_steps, int64_t * live) {
+    memset(live, 0, (n_steps + 1) * sizeof(int64_t));
+    for (int i = 0; i < n; i++) {
+        live[iv[i]->start] += iv[i]->size;
+        if (iv[i]->end < n_steps) {
+            live[iv[i]->end + 1] -= iv[i]->size;
+        }
+    }
+    int64_t cur = 0;
+    int64_t peak = 0;
+    for (int s = 0; s < n_steps; s++) {
+        cur += live[s];
+        peak = MAX(peak, cur);
+    }
+    return (size_t)peak;
+}
+
+// best-fit decreasing: the largest blocks are placed first, each in the tightest gap left between the placed blocks that
+// are live at the same time, or above all of them
+static size_t ggml_intervals_plan(struct tensor_interval ** iv, int n, struct free_block * busy) {
+    qsort(iv, n, sizeof(iv[0]), ggml_interval_size_cmp);
+
+    size_t total = 0;
+    for (int k = 0; k < n; k++) {
+        int n_busy = 0;
+        for (int j = 0; j < k; j++) {
+            if (ggml_intervals_overlap(iv[j], iv[k])) {
+                busy[n_busy].offset = iv[j]->offset;
+                busy[n_busy].size = iv[j]->size;
+                n_busy++;
+            }
+        }
+        qsort(busy, n_busy, sizeof(busy[0]), ggml_free_block_offset_cmp);
+
+        size_t best_offset = SIZE_MAX;
+        size_t best_gap = SIZE_MAX;
+        size_t top = 0;
+        for (int b = 0; b < n_busy; b++) {
+            if (busy[b].offset > top) {
+                size_t gap = busy[b].offset - top;
+                if (gap >= iv[k]->size && gap < best_gap) {
+                    best_offset = top;
+                    best_gap = gap;
+                }
+            }
+            top = MAX(top, busy[b].offset + busy[b].size);
+        }
+        iv[k]->offset = best_offset != SIZE_MAX ? best_offset : top;
+        total = MAX(total, iv[k]->offset + iv[k]->size);
+    }
+    return total;
+}
+
+// moves the tensors of an allocator to their planned offsets, all in one chunk
+static void ggml_gallocr_apply_plan(ggml_gallocr_t galloc, struct ggml_dyn_tallocr * alloc, size_t size) {
+    ggml_dyn_tallocr_reset(alloc);
+    int chunk_id = ggml_dyn_tallocr_new_chunk(alloc, size);
+    struct tallocr_chunk * chunk = alloc->chunks[chunk_id];
+    chunk->free_blocks[0].offset = size;
+    chunk->free_blocks[0].size -= size;
+    chunk->max_size = size;
+
+    for (size_t i = 0; i < galloc->hash_set.size; i++) {
+        if (!ggml_bitset_get(galloc->hash_set.used, i)) {
+            continue;
+        }
+        struct hash_node * hn = &galloc->hash_values[i];
+        if (hn->interval == 0) {
+            continue;
+        }
+        const struct tensor_interval * iv = &galloc->intervals[hn->interval - 1];
+        if (galloc->buf_tallocs[iv->buffer_id] == alloc) {
+            hn->addr.chunk = chunk_id;
+            hn->addr.offset = iv->offset;
+        }
+    }
+}
+
+// fills the statistics of the graph just allocated and, with the planner enabled, replaces the greedy offsets of each
+// allocator with the lifetime plan when it needs less memory
+static void ggml_gallocr_plan(ggml_gallocr_t galloc, int n_steps) {
+    struct ggml_gallocr_stats * stats = &galloc->stats;
+    stats->n_tensors = galloc->n_intervals + stats->n_inplace;
+
+    struct tensor_interval ** iv = malloc(MAX(1, galloc->n_intervals) * sizeof(struct tensor_interval *));
+    struct free_block * busy = malloc(MAX(1, galloc->n_intervals) * sizeof(struct free_block));
+    int64_t * live = malloc((n_steps + 1) * sizeof(int64_t));
+    GGML_ASSERT(iv != NULL && busy != NULL && live != NULL);
+
+    for (int i = 0; i < galloc->n_buffers; i++) {
+        struct ggml_dyn_tallocr * alloc = galloc->buf_tallocs[i];
+
+        // buffers of the same type share an allocator
+        bool seen = false;
+        for (int j = 0; j < i; j++) {
+            if (galloc->buf_tallocs[j] == alloc) {
+                seen = true;
+                break;
+            }
+        }
+        if (seen) {
+            continue;
+        }
+
+        int n = 0;
+        for (int k = 0; k < galloc->n_intervals; k++) {
+            if (galloc->buf_tallocs[galloc->intervals[k].buffer_id] == alloc) {
+                iv[n++] = &galloc->intervals[k];
+            }
+        }
+
+        size_t greedy = 0;
+        for (int c = 0; c < alloc->n_chunks; c++) {
+            greedy += alloc->chunks[c]->max_size;
+        }
+        size_t size = greedy;
+        stats->size_greedy += greedy;
+        stats->lower_bound += ggml_intervals_lower_bound(iv, n, n_steps, live);
+
+        if (galloc->planner && n > 0) {
+            size_t planned = ggml_intervals_plan(iv, n, busy);
+            stats->size_planned += planned;
+            // the plan is a single chunk, larger allocations stay split across chunks by the greedy allocator
+            if (planned < greedy && planned <= alloc->max_chunk_size) {
+                ggml_gallocr_apply_plan(galloc, alloc, planned);
+                size = planned;
+            }
+        }
+        stats->size += size;
+    }
+
+    free(iv);
+    free(busy);
+    free(live);
+
+    stats->fragmentation = stats->size > stats->lower_bound ? 1.0 - (double)stats->lower_bound / stats->size : 0.0;
+
+#ifndef NDEBUG
+    if (galloc->planner) {
+        GGML_LOG_DEBUG("%s: %d tensors (%d in place): greedy %.2f MiB, planned %.2f MiB, lower bound %.2f MiB, fragmentation %.1f%%\n",
+            __func__, stats->n_tensors, stats->n_inplace, stats->size_greedy / 1024.0 / 1024.0, stats->size_planned / 1024.0 / 1024.0,
+            stats->lower_bound / 1024.0 / 1024.0, 100.0 * stats->fragmentation);
+    }
+#endif
+}
+
 static bool ggml_gallocr_reserve_n_impl(
         ggml_gallocr_t galloc, struct ggml_cgraph * graph, const int * node_buffer_ids, const int * leaf_buffer_ids, bool no_alloc) {
     size_t min_hash_size = graph->n_nodes + graph->n_leafs;
@@ -849,6 +1081,7 @@ static bool ggml_gallocr_reserve_n_impl(
 
     // allocate in hash table
     ggml_gallocr_alloc_graph_impl(galloc, graph, node_buffer_ids, leaf_buffer_ids);
+    ggml_gallocr_plan(galloc, graph->n_nodes + 1);
 
     // set the node_allocs from the hash table
     if (galloc->n_nodes < graph->n_nodes) {
@@ -0,0 +1,202 @@
+// SIMD binary ops against a scalar reference: add, sub, mul and div over every f32/f16/bf16 type
+// combination the CPU backend supports, with row lengths that are not a multiple of the vector width,
+// src1 broadcast along each dim, one src1 value per row, and a transposed (non-contiguous) src1.
+// the reference widens both operands to f32, applies the op and narrows with ggml_fp32_to_fp16/bf16,
+// which is what the kernels promise to match bit for bit
+//
+// usage: test-binary-ops
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+enum bop { BOP_ADD, BOP_SUB, BOP_MUL, BOP_DIV };
+
+static const char * bop_name(bop op) {
+    switch (op) {
+        case BOP_ADD: return "add";
+        case BOP_SUB: return "sub";
+        case BOP_MUL: return "mul";
+        case BOP_DIV: return "div";
+    }
+    return "?";
+}
+
+static float bop_ref(bop op, float a, float b) {
+    switch (op) {
+        case BOP_ADD: return a + b;
+        case BOP_SUB: return a - b;
+        case BOP_MUL: return a * b;
+        case BOP_DIV: return a / b;
+    }
+    return 0.0f;
+}
+
+static float get_f32(const ggml_tensor * t, int64_t i0, int64_t i1, int64_t i2, int64_t i3) {
+    const char * p = (const char *) t->data + i0*t->nb[0] + i1*t->nb[1] + i2*t->nb[2] + i3*t->nb[3];
+    switch (t->type) {
+        case GGML_TYPE_F32:  return *(const float *) p;
+        case GGML_TYPE_F16:  return ggml_fp16_to_fp32(*(const ggml_fp16_t *) p);
+        case GGML_TYPE_BF16: return ggml_bf16_to_fp32(*(const ggml_bf16_t *) p);
+        default:             return NAN;
+    }
+}
+
+// the reference result stored in type, as raw bits
+static uint32_t to_bits(ggml_type type, float v) {
+    switch (type) {
+        case GGML_TYPE_F32:  { uint32_t u; memcpy(&u, &v, sizeof(u)); return u; }
+        case GGML_TYPE_F16:  { ggml_fp16_t h = ggml_fp32_to_fp16(v); return h; }
+        case GGML_TYPE_BF16: { ggml_bf16_t b = ggml_fp32_to_bf16(v); return b.bits; }
+        default:             return 0;
+    }
+}
+
+static uint32_t get_bits(const ggml_tensor * t, int64_t i0, int64_t i1, int64_t i2, int64_t i3) {
+    const char * p = (const char *) t->data + i0*t->nb[0] + i1*t->nb[1] + i2*t->nb[2] + i3*t->nb[3];
+    uint32_t u = 0;
+    memcpy(&u, p, ggml_type_size(t->type));
+    return u;
+}
+
+static void fill(ggml_tensor * t, std::mt19937 & rng) {
+    std::uniform_real_distribution<float> dist(0.5f, 4.0f); // away from 0 so div stays finite
+    std::bernoulli_distribution neg(0.5);
+
+    std::vector<float> v(ggml_nelements(t));
+    for (size_t i = 0; i < v.size(); ++i) {
+        v[i] = neg(rng) ? -dist(rng) : dist(rng);
+    }
+    // a few values that overflow f16 or are not finite
+    if (v.size() > 16) {
+        v[3]  = 1e6f;
+        v[7]  = -INFINITY;
+        v[11] = NAN;
+    }
+    switch (t->type) {
+        case GGML_TYPE_F32:  memcpy(t->data, v.data(), v.size()*sizeof(float)); break;
+        case GGML_TYPE_F16:  ggml_fp32_to_fp16_row(v.data(), (ggml_fp16_t *) t->data, (int64_t) v.size()); break;
+        case GGML_TYPE_BF16: ggml_fp32_to_bf16_row(v.data(), (ggml_bf16_t *) t->data, (int64_t) v.size()); break;
+        default: break;
+    }
+}
+
+struct bop_shape {
+    const char * name;
+    int64_t ne0[4]; // src0
+    int64_t ne1[4]; // src1, before the optional transpose
+    bool transpose; // src1 is a transposed view: not contiguous in dim 0
+};
+
+struct bop_types {
+    ggml_type src0, src1, dst;
+};
+
+int main() {
+    const bop_shape shapes[] = {
+        { "same",          { 37,  5, 3, 2 }, { 37, 5, 3, 2 }, false }, // 37: 4 x 8 lanes + a tail of 5
+        { "row-bcast",     { 37,  5, 3, 2 }, { 37, 1, 1, 1 }, false }, // one bias row for every token
+        { "dim0-bcast",    { 39,  4, 2, 1 }, { 13, 4, 1, 1 }, false }, // src1 repeated 3 times along a row
+        { "dim23-bcast",   { 20,  3, 4, 2 }, { 20, 3, 1, 2 }, false },
+        { "scalar-row",    { 53,  6, 2, 1 }, {  1, 6, 2, 1 }, false }, // one src1 value per row
+        { "short-rows",    {  3, 17, 1, 1 }, {  3, 17, 1, 1 }, false }, // shorter than a vector
+        { "non-contig",    { 29,  7, 1, 1 }, {  7, 29, 1, 1 }, true  },
+        { "non-contig-bc", { 29,  7, 2, 1 }, {  7, 29, 1, 1 }, true  },
+    };
+
+    const bop_types types[] = {
+        { GGML_TYPE_F32,  GGML_TYPE_F32,  GGML_TYPE_F32  },
+        { GGML_TYPE_F16,  GGML_TYPE_F16,  GGML_TYPE_F16  },
+        { GGML_TYPE_BF16, GGML_TYPE_BF16, GGML_TYPE_BF16 },
+        { GGML_TYPE_F16,  GGML_TYPE_F32,  GGML_TYPE_F16  },
+        { GGML_TYPE_BF16, GGML_TYPE_F32,  GGML_TYPE_BF16 },
+        { GGML_TYPE_F16,  GGML_TYPE_F32,  GGML_TYPE_F32  }, // add only, through ggml_add_cast
+        { GGML_TYPE_BF16, GGML_TYPE_F32,  GGML_TYPE_F32  },
+    };
+
+    std::mt19937 rng(42);
+
+    int n_cases = 0;
+    int n_failed = 0;
+    for (const bop_types & ty : types) {
+        for (bop op : { BOP_ADD, BOP_SUB, BOP_MUL, BOP_DIV }) {
+            if (ty.dst != ty.src0 && op != BOP_ADD) {
+                continue;
+            }
+            for (const bop_shape & sh : shapes) {
+                ggml_init_params ip = {
+                    /*.mem_size   =*/ 1024*1024,
+                    /*.mem_buffer =*/ nullptr,
+                    /*.no_alloc   =*/ false,
+                };
+                ggml_context * ctx = ggml_init(ip);
+
+                ggml_tensor * a = ggml_new_tensor(ctx, ty.src0, 4, sh.ne0);
+                ggml_tensor * b = ggml_new_tensor(ctx, ty.src1, 4, sh.ne1);
+                fill(a, rng);
+                fill(b, rng);
+                if (sh.transpose) {
+                    b = ggml_transpose(ctx, b);
+                }
+
+                // ggml_add_cast only broadcasts whole rows
+                if (ty.dst != ty.src0 && b->ne[0] != a->ne[0]) {
+                    ggml_free(ctx);
+                    continue;
+                }
+
+                ggml_tensor * out = nullptr;
+                switch (op) {
+                    case BOP_ADD: out = ty.dst != ty.src0 ? ggml_add_cast(ctx, a, b, ty.dst) : ggml_add(ctx, a, b); break;
+                    case BOP_SUB: out = ggml_sub(ctx, a, b); break;
+                    case BOP_MUL: out = ggml_mul(ctx, a, b); break;
+                    case BOP_DIV: out = ggml_div(ctx, a, b); break;
+                }
+
+                ggml_cgraph * gf = ggml_new_graph(ctx);
+                ggml_build_forward_expand(gf, out);
+                ggml_graph_compute_with_ctx(ctx, gf, 2);
+
+                int64_t n_diff = 0;
+                for (int64_t i3 = 0; i3 < out->ne[3]; ++i3) {
+                    for (int64_t i2 = 0; i2 < out->ne[2]; ++i2) {
+                        for (int64_t i1 = 0; i1 < out->ne[1]; ++i1) {
+                            for (int64_t i0 = 0; i0 < out->ne[0]; ++i0) {
+                                const float x = get_f32(a, i0, i1, i2, i3);
+                                const float y = get_f32(b, i0 % b->ne[0], i1 % b->ne[1], i2 % b->ne[2], i3 % b->ne[3]);
+                                const uint32_t want = to_bits(ty.dst, bop_ref(op, x, y));
+                                const uint32_t got  = get_bits(out, i0, i1, i2, i3);
+                                // every NaN is accepted as long as the result is a NaN
+                                const bool both_nan = std::isnan(bop_ref(op, x, y)) && std::isnan(get_f32(out, i0, i1, i2, i3));
+                                if (want != got && !both_nan) {
+                                    if (n_diff == 0) {
+                                        fprintf(stderr, "%s %s+%s->%s %s: [%lld, %lld, %lld, %lld] 0x%x, want 0x%x\n",
+                                                bop_name(op), ggml_type_name(ty.src0), ggml_type_name(ty.src1), ggml_type_name(ty.dst),
+                                                sh.name, (long long) i0, (long long) i1, (long long) i2, (long long) i3, got, want);
+                                    }
+                                    n_diff++;
+                                }
+                            }
+                        }
+                    }
+                }
+
+                n_cases++;
+                if (n_diff > 0) {
+                    n_failed++;
+                }
+
+                ggml_free(ctx);
+            }
+        }
+    }
+
+    printf("%d cases, %d failed\n", n_cases, n_failed);
+
+    return n_failed == 0 ? 0 : 1;
+}
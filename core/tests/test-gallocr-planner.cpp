@@ -0,0 +1,325 @@
+// graph allocator lifetime planner (ggml_gallocr_set_planner) against the greedy allocator
+//
+// 1. reserves a BERT-shaped encoder graph and prints the greedy size, the planned size and the
+//    live-tensor lower bound
+// 2. allocates random graphs with the planner on and checks for each one that the reserved size is
+//    within [lower bound, greedy], that no two tensors live at the same time overlap, and that the
+//    outputs are bit-identical to a run with the planner off
+//
+// usage: test-gallocr-planner [n_tokens n_seqs n_layers [n_graphs]]
+
+#include "ggml.h"
+#include "ggml-alloc.h"
+#include "ggml-backend.h"
+#include "ggml-cpu.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <vector>
+
+static void print_stats(const char * name, const ggml_gallocr_stats & st) {
+    printf("%-8s reserved %9.2f MiB, greedy %9.2f MiB, planned %9.2f MiB, lower bound %9.2f MiB, "
+           "%d tensors, %d in place\n", name,
+           st.size/1048576.0, st.size_greedy/1048576.0, st.size_planned/1048576.0, st.lower_bound/1048576.0,
+           st.n_tensors, st.n_inplace);
+}
+
+//
+// encoder
+//
+
+static bool test_encoder(ggml_backend_t backend, int n_tokens, int n_seqs, int n_layers) {
+    const int n_embd = 768, n_head = 12, n_ff = 3072;
+    const int d_head = n_embd/n_head;
+    const int n      = n_tokens*n_seqs;
+
+    // weights live in their own buffer, as loaded model weights would
+    ggml_init_params wp = { ggml_tensor_overhead()*8*n_layers, nullptr, true };
+    ggml_context * ctx_w = ggml_init(wp);
+
+    struct layer { ggml_tensor * wq, * wk, * wv, * wo, * w1, * w2; };
+    std::vector<layer> layers(n_layers);
+    for (auto & l : layers) {
+        l.wq = ggml_new_tensor_2d(ctx_w, GGML_TYPE_F16, n_embd, n_embd);
+        l.wk = ggml_new_tensor_2d(ctx_w, GGML_TYPE_F16, n_embd, n_embd);
+        l.wv = ggml_new_tensor_2d(ctx_w, GGML_TYPE_F16, n_embd, n_embd);
+        l.wo = ggml_new_tensor_2d(ctx_w, GGML_TYPE_F16, n_embd, n_embd);
+        l.w1 = ggml_new_tensor_2d(ctx_w, GGML_TYPE_F16, n_embd, n_ff);
+        l.w2 = ggml_new_tensor_2d(ctx_w, GGML_TYPE_F16, n_ff, n_embd);
+    }
+    ggml_backend_buffer_t wbuf = ggml_backend_alloc_ctx_tensors(ctx_w, backend);
+
+    ggml_init_params ip = { ggml_tensor_overhead()*64*n_layers + ggml_graph_overhead(), nullptr, true };
+    ggml_context * ctx = ggml_init(ip);
+
+    ggml_tensor * x = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, n_embd, n);
+    ggml_set_input(x);
+
+    for (const auto & l : layers) {
+        ggml_tensor * q = ggml_permute(ctx, ggml_reshape_4d(ctx, ggml_mul_mat(ctx, l.wq, x), d_head, n_head, n_tokens, n_seqs), 0, 2, 1, 3);
+        ggml_tensor * k = ggml_permute(ctx, ggml_reshape_4d(ctx, ggml_mul_mat(ctx, l.wk, x), d_head, n_head, n_tokens, n_seqs), 0, 2, 1, 3);
+        ggml_tensor * v = ggml_cont(ctx, ggml_permute(ctx, ggml_reshape_4d(ctx, ggml_mul_mat(ctx, l.wv, x), d_head, n_head, n_tokens, n_seqs), 1, 2, 0, 3));
+
+        ggml_tensor * kq  = ggml_soft_max_ext(ctx, ggml_mul_mat(ctx, k, q), nullptr, 1.0f/sqrtf((float) d_head), 0.0f);
+        ggml_tensor * kqv = ggml_cont_2d(ctx, ggml_permute(ctx, ggml_mul_mat(ctx, v, kq), 0, 2, 1, 3), n_embd, n);
+
+        x = ggml_norm(ctx, ggml_add(ctx, ggml_mul_mat(ctx, l.wo, kqv), x), 1e-12f);
+
+        ggml_tensor * ff = ggml_mul_mat(ctx, l.w2, ggml_gelu(ctx, ggml_mul_mat(ctx, l.w1, x)));
+        x = ggml_norm(ctx, ggml_add(ctx, ff, x), 1e-12f);
+    }
+    ggml_set_output(x);
+
+    ggml_cgraph * gf = ggml_new_graph_custom(ctx, 64*n_layers, false);
+    ggml_build_forward_expand(gf, x);
+
+    ggml_gallocr_t galloc = ggml_gallocr_new(ggml_backend_get_default_buffer_type(backend));
+    ggml_gallocr_set_planner(galloc, true);
+    const bool ok = ggml_gallocr_reserve(galloc, gf);
+
+    ggml_gallocr_stats st = {};
+    if (ok) {
+        ggml_gallocr_get_stats(galloc, &st);
+        printf("encoder: %d layers, %d x %d tokens\n", n_layers, n_seqs, n_tokens);
+        print_stats("encoder", st);
+    } else {
+        fprintf(stderr, "encoder: reserve failed\n");
+    }
+
+    ggml_gallocr_free(galloc);
+    ggml_free(ctx);
+    ggml_backend_buffer_free(wbuf);
+    ggml_free(ctx_w);
+
+    return ok && st.size <= st.size_greedy && st.size >= st.lower_bound;
+}
+
+//
+// random graphs
+//
+
+struct rand_graph {
+    ggml_context * ctx = nullptr;
+    ggml_cgraph  * gf  = nullptr;
+    std::vector<ggml_tensor *> inputs;
+    std::vector<ggml_tensor *> outputs;
+};
+
+static rand_graph build_random(uint32_t seed) {
+    std::mt19937 rng(seed);
+
+    rand_graph g;
+    ggml_init_params ip = { ggml_tensor_overhead()*1024 + ggml_graph_overhead(), nullptr, true };
+    g.ctx = ggml_init(ip);
+
+    auto pick = [&](int n) { return (int) (rng() % n); };
+    const int dims[] = { 16, 32, 64, 96, 128, 256 };
+
+    std::vector<ggml_tensor *> pool;
+    auto input = [&](int64_t ne0, int64_t ne1) {
+        ggml_tensor * t = ggml_new_tensor_2d(g.ctx, GGML_TYPE_F32, ne0, ne1);
+        ggml_set_input(t);
+        g.inputs.push_back(t);
+        return t;
+    };
+    for (int i = 0; i < 2; ++i) {
+        pool.push_back(input(dims[pick(6)], dims[pick(6)]));
+    }
+
+    const int n_ops = 8 + pick(56);
+    for (int i = 0; i < n_ops; ++i) {
+        // mostly recent tensors, sometimes an old one, so lifetimes vary
+        ggml_tensor * a = pool[pick(4) == 0 ? pick((int) pool.size()) : (int) pool.size() - 1 - pick(std::min<int>(3, (int) pool.size()))];
+        ggml_tensor * t = nullptr;
+        switch (pick(8)) {
+            case 0: t = ggml_scale(g.ctx, a, 0.5f); break;
+            case 1: t = ggml_gelu(g.ctx, a); break;
+            case 2: t = ggml_norm(g.ctx, a, 1e-5f); break;
+            case 3: t = ggml_soft_max(g.ctx, a); break;
+            case 4: t = ggml_cont(g.ctx, ggml_transpose(g.ctx, a)); break;
+            case 5: t = ggml_mul_mat(g.ctx, input(a->ne[0], dims[pick(6)]), a); break;
+            default: {
+                ggml_tensor * b = nullptr;
+                for (ggml_tensor * c : pool) {
+                    if (c != a && ggml_are_same_shape(a, c) && pick(2) == 0) {
+                        b = c;
+                    }
+                }
+                t = pick(2) ? ggml_add(g.ctx, a, b ? b : a) : ggml_mul(g.ctx, a, b ? b : a);
+            } break;
+        }
+        pool.push_back(t);
+    }
+
+    g.outputs.push_back(pool.back());
+    if (pick(2)) {
+        g.outputs.push_back(pool[2 + pick((int) pool.size() - 2)]);
+    }
+
+    g.gf = ggml_new_graph(g.ctx);
+    for (ggml_tensor * t : g.outputs) {
+        ggml_set_output(t);
+        ggml_build_forward_expand(g.gf, t);
+    }
+    return g;
+}
+
+static ggml_tensor * mem_owner(ggml_tensor * t) {
+    return t->view_src ? t->view_src : t;
+}
+
+// two tensors placed by the allocator overlap while both are live; a child that took over its
+// parent's memory in place at the parent's last use is the one allowed case
+static bool check_overlap(const rand_graph & g) {
+    const int n_nodes = ggml_graph_n_nodes(g.gf);
+
+    struct life { int first, last; };
+    std::map<ggml_tensor *, life> lives;
+    // inputs are placed before the first node and freed after their last use like the rest
+    for (ggml_tensor * t : g.inputs) {
+        if (t->data) {
+            lives[t] = { -1, -1 };
+        }
+    }
+    for (int i = 0; i < n_nodes; ++i) {
+        ggml_tensor * node = ggml_graph_node(g.gf, i);
+        ggml_tensor * own  = mem_owner(node);
+        if (!lives.count(own)) {
+            lives[own] = { i, i };
+        }
+        lives[own].last = std::max(lives[own].last, i);
+        for (int s = 0; s < GGML_MAX_SRC && node->src[s]; ++s) {
+            lives[mem_owner(node->src[s])].last = std::max(lives[mem_owner(node->src[s])].last, i);
+        }
+    }
+    for (ggml_tensor * t : g.outputs) {
+        lives[mem_owner(t)].last = n_nodes;
+    }
+
+    std::vector<std::pair<ggml_tensor *, life>> ts(lives.begin(), lives.end());
+    for (size_t i = 0; i < ts.size(); ++i) {
+        for (size_t j = i + 1; j < ts.size(); ++j) {
+            ggml_tensor * a = ts[i].first;
+            ggml_tensor * b = ts[j].first;
+            const life la = ts[i].second, lb = ts[j].second;
+            if (la.last < lb.first || lb.last < la.first) {
+                continue;
+            }
+            const char * a0 = (const char *) a->data, * a1 = a0 + ggml_nbytes(a);
+            const char * b0 = (const char *) b->data, * b1 = b0 + ggml_nbytes(b);
+            if (a1 <= b0 || b1 <= a0) {
+                continue;
+            }
+            if (a->data == b->data && (la.last == lb.first || lb.last == la.first)) {
+                continue;
+            }
+            fprintf(stderr, "overlap: %s [%d, %d] and %s [%d, %d]\n", a->name, la.first, la.last, b->name, lb.first, lb.last);
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::vector<std::vector<float>> run_random(ggml_backend_t backend, const rand_graph & g, bool planner,
+                                                  uint32_t seed, ggml_gallocr_stats * st, bool * overlap_ok) {
+    ggml_gallocr_t galloc = ggml_gallocr_new(ggml_backend_get_default_buffer_type(backend));
+    ggml_gallocr_set_planner(galloc, planner);
+    if (!ggml_gallocr_alloc_graph(galloc, g.gf)) {
+        fprintf(stderr, "random graph: allocation failed\n");
+        exit(1);
+    }
+    if (st) {
+        ggml_gallocr_get_stats(galloc, st);
+    }
+    if (overlap_ok) {
+        *overlap_ok = check_overlap(g);
+    }
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    for (ggml_tensor * t : g.inputs) {
+        if (!t->buffer) {
+            continue; // not reachable from the outputs
+        }
+        std::vector<float> v(ggml_nelements(t));
+        for (float & x : v) {
+            x = dist(rng);
+        }
+        ggml_backend_tensor_set(t, v.data(), 0, ggml_nbytes(t));
+    }
+    ggml_backend_graph_compute(backend, g.gf);
+
+    std::vector<std::vector<float>> out;
+    for (ggml_tensor * t : g.outputs) {
+        out.emplace_back(ggml_nelements(t));
+        ggml_backend_tensor_get(t, out.back().data(), 0, ggml_nbytes(t));
+    }
+    ggml_gallocr_free(galloc);
+    return out;
+}
+
+static bool test_random(ggml_backend_t backend, int n_graphs) {
+    std::mt19937 rng(1234);
+
+    int n_smaller = 0, n_equal = 0, n_larger = 0, n_failed = 0;
+    size_t sum_greedy = 0, sum_size = 0, sum_bound = 0;
+    for (int i = 0; i < n_graphs; ++i) {
+        // the same graph built twice, since allocating it sets the tensors' data for good
+        const uint32_t seed = rng();
+        rand_graph g  = build_random(seed);
+        rand_graph g2 = build_random(seed);
+
+        ggml_gallocr_stats st = {};
+        bool overlap_ok = true;
+        const auto planned = run_random(backend, g,  true,  seed, &st, &overlap_ok);
+        const auto greedy  = run_random(backend, g2, false, seed, nullptr, nullptr);
+
+        bool same = planned.size() == greedy.size();
+        for (size_t o = 0; same && o < planned.size(); ++o) {
+            same = memcmp(planned[o].data(), greedy[o].data(), planned[o].size()*sizeof(float)) == 0;
+        }
+
+        n_smaller += st.size_planned <  st.size_greedy;
+        n_equal   += st.size_planned == st.size_greedy;
+        n_larger  += st.size_planned >  st.size_greedy;
+        sum_greedy += st.size_greedy;
+        sum_size   += st.size;
+        sum_bound  += st.lower_bound;
+
+        if (!overlap_ok || !same || st.size > st.size_greedy || st.size < st.lower_bound) {
+            fprintf(stderr, "random graph %d: %s%s%s\n", i, overlap_ok ? "" : "overlapping tensors ",
+                    same ? "" : "outputs differ ", st.size > st.size_greedy || st.size < st.lower_bound ? "size out of bounds" : "");
+            n_failed++;
+        }
+        ggml_free(g.ctx);
+        ggml_free(g2.ctx);
+    }
+
+    printf("random: %d graphs, planner smaller than greedy on %d, equal on %d, larger (greedy kept) on %d; "
+           "total greedy %.2f MiB, reserved %.2f MiB, lower bound %.2f MiB; %d failed\n",
+           n_graphs, n_smaller, n_equal, n_larger, sum_greedy/1048576.0, sum_size/1048576.0, sum_bound/1048576.0, n_failed);
+
+    return n_failed == 0;
+}
+
+int main(int argc, char ** argv) {
+    const int n_tokens = argc > 3 ? atoi(argv[1]) : 128;
+    const int n_seqs   = argc > 3 ? atoi(argv[2]) : 8;
+    const int n_layers = argc > 3 ? atoi(argv[3]) : 12;
+    const int n_graphs = argc > 4 ? atoi(argv[4]) : 300;
+
+    ggml_backend_t backend = ggml_backend_cpu_init();
+    ggml_backend_cpu_set_n_threads(backend, 1);
+
+    bool ok = test_encoder(backend, n_tokens, n_seqs, n_layers);
+    ok = test_random(backend, n_graphs) && ok;
+
+    ggml_backend_free(backend);
+
+    return ok ? 0 : 1;
+}
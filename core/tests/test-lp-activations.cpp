@@ -0,0 +1,169 @@
+// f16/bf16 hidden states against f32: an encoder-shaped stack of layers (norm, attention softmax,
+// f16 weight matmul, residual add) is run with the hidden states stored in each type, and the outputs are
+// compared with the f32 run by cosine similarity per token. also prints the compute buffer each
+// storage type needs and the time per pass
+//
+// usage: test-lp-activations [n_embd n_tokens n_layers]
+
+#include "ggml.h"
+#include "ggml-alloc.h"
+#include "ggml-backend.h"
+#include "ggml-cpu.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+struct lp_result {
+    std::vector<float> out;     // [n_tokens, n_embd]
+    size_t             buf_size = 0;
+    double             t_ms     = 0.0;
+};
+
+static lp_result run(ggml_backend_t backend, ggml_type type, int n_embd, int n_tokens, int n_layers,
+                     const std::vector<float> & x0, const std::vector<std::vector<float>> & weights) {
+    // weights get their own buffer; the graph tensors are placed by the graph allocator
+    ggml_init_params wp = {
+        /*.mem_size   =*/ ggml_tensor_overhead()*n_layers,
+        /*.mem_buffer =*/ nullptr,
+        /*.no_alloc   =*/ true,
+    };
+    ggml_context * ctx_w = ggml_init(wp);
+
+    std::vector<ggml_tensor *> w(n_layers);
+    for (int il = 0; il < n_layers; ++il) {
+        w[il] = ggml_new_tensor_2d(ctx_w, GGML_TYPE_F16, n_embd, n_embd);
+    }
+
+    ggml_init_params ip = {
+        /*.mem_size   =*/ ggml_tensor_overhead()*(16*n_layers + 16) + ggml_graph_overhead(),
+        /*.mem_buffer =*/ nullptr,
+        /*.no_alloc   =*/ true,
+    };
+    ggml_context * ctx = ggml_init(ip);
+
+    ggml_tensor * inp = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, n_embd, n_tokens);
+    ggml_set_input(inp);
+
+    // the hidden states and attention weights are stored in type; matmuls accumulate in f32
+    ggml_tensor * x = type == GGML_TYPE_F32 ? inp : ggml_cast(ctx, inp, type);
+    for (int il = 0; il < n_layers; ++il) {
+        ggml_tensor * h  = ggml_norm(ctx, x, 1e-5f);
+        ggml_tensor * kq = ggml_mul_mat(ctx, h, h);
+        if (type != GGML_TYPE_F32) {
+            kq = ggml_cast(ctx, kq, type);
+        }
+        kq = ggml_soft_max_ext(ctx, kq, nullptr, 1.0f/sqrtf((float) n_embd), 0.0f);
+        ggml_tensor * kqv = ggml_mul_mat(ctx, ggml_cont(ctx, ggml_transpose(ctx, h)), kq);
+        x = ggml_add(ctx, x, ggml_mul_mat(ctx, w[il], kqv));
+    }
+    ggml_tensor * out = type == GGML_TYPE_F32 ? x : ggml_cast(ctx, x, GGML_TYPE_F32);
+    ggml_set_output(out);
+
+    ggml_cgraph * gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, out);
+
+    ggml_backend_buffer_t wbuf = ggml_backend_alloc_ctx_tensors(ctx_w, backend);
+    std::vector<ggml_fp16_t> tmp((size_t) n_embd*n_embd);
+    for (int il = 0; il < n_layers; ++il) {
+        ggml_fp32_to_fp16_row(weights[il].data(), tmp.data(), (int64_t) tmp.size());
+        ggml_backend_tensor_set(w[il], tmp.data(), 0, tmp.size()*sizeof(ggml_fp16_t));
+    }
+
+    ggml_gallocr_t galloc = ggml_gallocr_new(ggml_backend_get_default_buffer_type(backend));
+    if (!ggml_gallocr_alloc_graph(galloc, gf)) {
+        fprintf(stderr, "failed to allocate the graph\n");
+        exit(1);
+    }
+    ggml_backend_tensor_set(inp, x0.data(), 0, x0.size()*sizeof(float));
+
+    lp_result res;
+    res.buf_size = ggml_gallocr_get_buffer_size(galloc, 0);
+
+    ggml_backend_graph_compute(backend, gf);
+
+    const int n_iter = 10;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < n_iter; ++i) {
+        ggml_backend_graph_compute(backend, gf);
+    }
+    res.t_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count()/n_iter;
+
+    res.out.resize((size_t) n_embd*n_tokens);
+    ggml_backend_tensor_get(out, res.out.data(), 0, res.out.size()*sizeof(float));
+
+    ggml_gallocr_free(galloc);
+    ggml_backend_buffer_free(wbuf);
+    ggml_free(ctx);
+    ggml_free(ctx_w);
+
+    return res;
+}
+
+int main(int argc, char ** argv) {
+    const int n_embd   = argc > 3 ? atoi(argv[1]) : 384;
+    const int n_tokens = argc > 3 ? atoi(argv[2]) : 256;
+    const int n_layers = argc > 3 ? atoi(argv[3]) : 6;
+
+    std::mt19937 rng(42);
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+
+    std::vector<float> x0((size_t) n_embd*n_tokens);
+    for (float & v : x0) {
+        v = dist(rng);
+    }
+    std::vector<std::vector<float>> weights(n_layers, std::vector<float>((size_t) n_embd*n_embd));
+    for (auto & w : weights) {
+        for (float & v : w) {
+            v = dist(rng)/sqrtf((float) n_embd);
+        }
+    }
+
+    ggml_backend_t backend = ggml_backend_cpu_init();
+    ggml_backend_cpu_set_n_threads(backend, 4);
+
+    const lp_result ref = run(backend, GGML_TYPE_F32, n_embd, n_tokens, n_layers, x0, weights);
+    printf("%-5s compute buffer %8.2f MiB, %7.3f ms/pass\n", "f32", ref.buf_size/1048576.0, ref.t_ms);
+
+    bool ok = true;
+    for (ggml_type type : { GGML_TYPE_F16, GGML_TYPE_BF16 }) {
+        const lp_result res = run(backend, type, n_embd, n_tokens, n_layers, x0, weights);
+
+        double min_cos = 1.0, sum_cos = 0.0;
+        for (int t = 0; t < n_tokens; ++t) {
+            const float * a = ref.out.data() + (size_t) t*n_embd;
+            const float * b = res.out.data() + (size_t) t*n_embd;
+            double dot = 0.0, na = 0.0, nb = 0.0;
+            for (int i = 0; i < n_embd; ++i) {
+                dot += (double) a[i]*b[i];
+                na  += (double) a[i]*a[i];
+                nb  += (double) b[i]*b[i];
+            }
+            const double cos = dot/sqrt(na*nb);
+            min_cos  = std::min(min_cos, cos);
+            sum_cos += cos;
+        }
+
+        // bf16 keeps 8 mantissa bits to f16's 11
+        const double min_allowed = type == GGML_TYPE_F16 ? 0.999 : 0.99;
+
+        printf("%-5s compute buffer %8.2f MiB, %7.3f ms/pass, cosine to f32: mean %.6f, min %.6f\n",
+               ggml_type_name(type), res.buf_size/1048576.0, res.t_ms, sum_cos/n_tokens, min_cos);
+
+        if (!(min_cos >= min_allowed)) {
+            fprintf(stderr, "%s: cosine drift %.6f below %.3f\n", ggml_type_name(type), min_cos, min_allowed);
+            ok = false;
+        }
+        if (res.buf_size >= ref.buf_size) {
+            fprintf(stderr, "%s: compute buffer is not smaller than f32\n", ggml_type_name(type));
+            ok = false;
+        }
+    }
+
+    ggml_backend_free(backend);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+// streaming GEMV path of mul_mat against the regular tiled path: a single src1 column takes the GEMV
+// path, the same column repeated twice takes the regular one, and column 0 of both must match bit for
+// bit, since both end in the same vec_dot over the same converted src1. covers f32, f16, bf16 and
+// quantized weights, row counts that do not split evenly into the 16-row slabs of each thread, and a
+// matrix large enough for the non-temporal prefetch
+//
+// usage: test-mul-mat-gemv
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+struct gemv_case {
+    ggml_type type;
+    int64_t   n_cols; // ne00
+    int64_t   n_rows; // ne01
+    int       n_threads;
+};
+
+// dst [n_rows, n_src1] = src0 [n_cols, n_rows] x src1 [n_cols, n_src1], src1 holding n_src1 copies of x
+static std::vector<float> run(const gemv_case & c, const std::vector<float> & w, const std::vector<float> & x, int n_src1) {
+    const size_t w_size = ggml_row_size(c.type, c.n_cols)*c.n_rows;
+
+    ggml_init_params ip = {
+        /*.mem_size   =*/ w_size + (size_t) (c.n_cols + c.n_rows)*n_src1*sizeof(float) + 64*ggml_tensor_overhead() + ggml_graph_overhead() + 1024*1024,
+        /*.mem_buffer =*/ nullptr,
+        /*.no_alloc   =*/ false,
+    };
+    ggml_context * ctx = ggml_init(ip);
+
+    ggml_tensor * src0 = ggml_new_tensor_2d(ctx, c.type, c.n_cols, c.n_rows);
+    switch (c.type) {
+        case GGML_TYPE_F32:  memcpy(src0->data, w.data(), w.size()*sizeof(float)); break;
+        case GGML_TYPE_F16:  ggml_fp32_to_fp16_row(w.data(), (ggml_fp16_t *) src0->data, (int64_t) w.size()); break;
+        case GGML_TYPE_BF16: ggml_fp32_to_bf16_row(w.data(), (ggml_bf16_t *) src0->data, (int64_t) w.size()); break;
+        default:             ggml_quantize_chunk(c.type, w.data(), src0->data, 0, c.n_rows, c.n_cols, nullptr); break;
+    }
+
+    ggml_tensor * src1 = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, c.n_cols, n_src1);
+    for (int i = 0; i < n_src1; ++i) {
+        memcpy((char *) src1->data + i*src1->nb[1], x.data(), x.size()*sizeof(float));
+    }
+
+    ggml_tensor * out = ggml_mul_mat(ctx, src0, src1);
+
+    ggml_cgraph * gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, out);
+    ggml_graph_compute_with_ctx(ctx, gf, c.n_threads);
+
+    std::vector<float> res(c.n_rows);
+    memcpy(res.data(), out->data, res.size()*sizeof(float));
+
+    ggml_free(ctx);
+
+    return res;
+}
+
+int main() {
+    const gemv_case cases[] = {
+        { GGML_TYPE_F32,    64,    1, 1 },
+        { GGML_TYPE_F32,   384,   17, 3 }, // fewer rows than one slab per thread
+        { GGML_TYPE_F32,   384,  101, 4 },
+        { GGML_TYPE_F32,  4096,  601, 3 }, // 9.4 MiB: non-temporal prefetch
+        { GGML_TYPE_F16,   384,   33, 2 },
+        { GGML_TYPE_F16,  1024, 1031, 3 },
+        { GGML_TYPE_BF16,  384,   49, 3 },
+        { GGML_TYPE_Q8_0,  384,   97, 3 },
+        { GGML_TYPE_Q4_0,  512,   15, 2 },
+        { GGML_TYPE_Q4_0,  768,  769, 4 },
+        { GGML_TYPE_Q4_K,  512,  129, 3 },
+        { GGML_TYPE_Q6_K,  768,   63, 2 },
+    };
+
+    std::mt19937 rng(42);
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+
+    int n_failed = 0;
+    for (const gemv_case & c : cases) {
+        std::vector<float> w((size_t) c.n_cols*c.n_rows);
+        std::vector<float> x(c.n_cols);
+        for (float & v : w) { v = dist(rng); }
+        for (float & v : x) { v = dist(rng); }
+
+        const std::vector<float> gemv = run(c, w, x, 1);
+        const std::vector<float> ref  = run(c, w, x, 2);
+
+        int64_t n_diff = 0;
+        double  max_err = 0.0;
+        for (int64_t i = 0; i < c.n_rows; ++i) {
+            if (memcmp(&gemv[i], &ref[i], sizeof(float)) != 0) {
+                n_diff++;
+                max_err = std::max(max_err, (double) fabsf(gemv[i] - ref[i]));
+            }
+        }
+
+        printf("%-5s %5lld x %5lld, %d threads: %lld of %lld rows differ, max abs err %.2e\n",
+               ggml_type_name(c.type), (long long) c.n_rows, (long long) c.n_cols, c.n_threads,
+               (long long) n_diff, (long long) c.n_rows, max_err);
+
+        if (n_diff > 0) {
+            n_failed++;
+        }
+    }
+
+    return n_failed == 0 ? 0 : 1;
+}
@@ -6,7 +6,7 @@
  */
 
 // Export main functions
-export { embed, autoEmbed, getSupportedProviders, createProvider } from './main.js';
+export { embed, autoEmbed, getSupportedProviders, createProvider, getProviderHealth } from './main.js';
 
 // Export types
 export type { 
@@ -14,8 +14,10 @@ export type {
   EmbedInput, 
   EmbedResult, 
   BatchEmbedResult, 
-  ProviderType 
+  ProviderType,
+  AutoEmbedOptions
 } from './src/types/index.js';
+export type { ProviderHealthSnapshot } from './src/util/provider-health.js';
 
 // Export provider factory for advanced usage
 export { EmbeddingFactory } from './src/factory/EmbeddingFactory.js';
@@ -1,7 +1,10 @@
 import * as dotenv from 'dotenv';
 import { EmbeddingFactory } from '@src/factory/EmbeddingFactory.js';
-import type { EmbedConfig, EmbedInput, EmbedResult, BatchEmbedResult } from '@src/types/index.js';
+import type { EmbedConfig, EmbedInput, EmbedResult, BatchEmbedResult, AutoEmbedOptions } from '@src/types/index.js';
 import { Logger } from '@src/util/logger.js';
+import { providerHealth } from '@src/util/provider-health.js';
+import { hedge } from '@src/util/hedge.js';
+import type { ProviderHealthSnapshot } from '@src/util/provider-health.js';
 
 // Load environment variables
 dotenv.config();
@@ -50,11 +53,16 @@ export async function embed(
 /**
  * Convenience function for quick embedding with auto-detection
  * 
+ * Providers that keep failing are benched for a while, and with `hedge` the next provider
+ * is raced once the preferred one runs past its usual latency.
+ * 
  * @param input - Text or file to embed
+ * @param options - Latency and hedging options
  * @returns Promise<EmbedResult | BatchEmbedResult>
  */
 export async function autoEmbed(
-  input: EmbedInput | EmbedInput[]
+  input: EmbedInput | EmbedInput[],
+  options: AutoEmbedOptions = {}
 ): Promise<EmbedResult | BatchEmbedResult> {
   logger.info('Auto-detecting best provider...');
   
@@ -66,23 +74,41 @@ export async function autoEmbed(
     { provider: 'mistral' as const, model: 'mistral-embed', apiKey: process.env.MISTRAL_API_KEY || undefined },
   ];
   
+  const candidates: EmbedConfig[] = [];
   for (const config of providers) {
-    try {
-      // Llama.cpp provider doesn't need API key and should be tried first
-      if (config.provider === 'llamacpp' || config.apiKey) {
-        logger.info(`Trying provider: ${config.provider}`);
-        // Create a clean config object without undefined properties
-        const cleanConfig: EmbedConfig = {
-          provider: config.provider,
-          model: config.model,
-        };
-        
-        if (config.apiKey) {
-          cleanConfig.apiKey = config.apiKey;
-        }
-        
-        return await embed(cleanConfig, input);
+    // Llama.cpp provider doesn't need API key and should be tried first
+    if (config.provider === 'llamacpp' || config.apiKey) {
+      // Create a clean config object without undefined properties
+      const cleanConfig: EmbedConfig = {
+        provider: config.provider,
+        model: config.model,
+      };
+      
+      if (config.apiKey) {
+        cleanConfig.apiKey = config.apiKey;
       }
+      
+      candidates.push(cleanConfig);
+    }
+  }
+  
+  const ordered = orderByHealth(candidates, options.latencySloMs);
+  if (ordered.length === 0) {
+    throw new Error('No available embedding provider found');
+  }
+  
+  if (options.hedge) {
+    return hedge(ordered, (config, signal) => timedEmbed({ ...config, signal }, input), {
+      percentile: options.hedgePercentile ?? 0.95,
+      fallbackDelayMs: options.hedgeDelayMs ?? 1000,
+      maxHedges: options.maxHedges ?? 1,
+    });
+  }
+  
+  for (const config of ordered) {
+    try {
+      logger.info(`Trying provider: ${config.provider}`);
+      return await timedEmbed(config, input);
     } catch (error: unknown) {
       const errorMessage = error instanceof Error ? error.message : String(error);
       logger.warn(`Provider ${config.provider} failed: ${errorMessage}`);
@@ -93,6 +119,53 @@ export async function autoEmbed(
   throw new Error('No available embedding provider found');
 }
 
+/**
+ * Keep preference order, but move benched providers and (with an SLO) slow ones to the back
+ */
+function orderByHealth(candidates: EmbedConfig[], latencySloMs?: number): EmbedConfig[] {
+  const rank = (config: EmbedConfig): number => {
+    if (!providerHealth.isHealthy(config)) {
+      return 2;
+    }
+    const expected = providerHealth.expectedLatency(config);
+    return latencySloMs !== undefined && expected !== null && expected > latencySloMs ? 1 : 0;
+  };
+  
+  // Array.prototype.sort is stable, so equal ranks keep their preference order
+  return candidates
+    .map(config => ({ config, rank: rank(config) }))
+    .sort((a, b) => a.rank - b.rank)
+    .map(entry => entry.config);
+}
+
+/**
+ * embed() that feeds the outcome into the provider health stats
+ */
+async function timedEmbed(
+  config: EmbedConfig,
+  input: EmbedInput | EmbedInput[]
+): Promise<EmbedResult | BatchEmbedResult> {
+  const started = Date.now();
+  try {
+    const result = await embed(config, input);
+    providerHealth.recordSuccess(config, Date.now() - started);
+    return result;
+  } catch (error: unknown) {
+    // Losing a hedge race is not the provider's fault
+    if (!config.signal?.aborted) {
+      providerHealth.recordFailure(config);
+    }
+    throw error;
+  }
+}
+
+/**
+ * Latency and health stats gathered by autoEmbed
+ */
+export function getProviderHealth(): ProviderHealthSnapshot[] {
+  return providerHealth.snapshot();
+}
+
 /**
  * Get supported providers
  */
@@ -108,4 +181,5 @@ export function createProvider(config: EmbedConfig) {
 }
 
 // Export types for external use
-export type { EmbedConfig, EmbedInput, EmbedResult, BatchEmbedResult, ProviderType } from './src/types/index.js';
\ No newline at end of file
+export type { EmbedConfig, EmbedInput, EmbedResult, BatchEmbedResult, ProviderType, AutoEmbedOptions } from './src/types/index.js';
+export type { ProviderHealthSnapshot } from './src/util/provider-health.js';
\ No newline at end of file
@@ -3,10 +3,23 @@
     {
       "target_name": "llama_embedding",
       "sources": [
-        "llama_embedding_simple.cpp"
+        "llama_embedding_simple.cpp",
+        "src/vecbox-base64.cpp",
+        "src/vecbox-ctx-pool.cpp",
+        "src/vecbox-dedup.cpp",
+        "src/vecbox-engine.cpp",
+        "src/vecbox-json.cpp",
+        "src/vecbox-kmeans.cpp",
+        "src/vecbox-metrics.cpp",
+        "src/vecbox-mmr.cpp",
+        "src/vecbox-projection.cpp",
+        "src/vecbox-registry.cpp",
+        "src/vecbox-similarity.cpp",
+        "src/vecbox-tokenizer.cpp"
       ],
       "include_dirs": [
         "<!@(node -p \"require('node-addon-api').include\")",
+        "src",
         "../core/src",
         "../core/src/include",
         "../core/src/ggml",
@@ -33,6 +46,20 @@
         "-lm"
       ],
       "conditions": [
+        ["OS!='win'", {
+          "libraries": [
+            "<(module_root_dir)/../core/build/lib/libllamacpp_core.a"
+          ]
+        }],
+        ["OS=='linux'", {
+          "sources": [
+            "src/vecbox-event.cpp",
+            "src/vecbox-shm.cpp"
+          ],
+          "libraries": [
+            "-fopenmp"
+          ]
+        }],
         ["OS=='mac'", {
           "defines": [
             "GGML_USE_ACCELERATE"
@@ -49,6 +76,9 @@
             "GGML_USE_CPU_HBM",
             "_CRT_SECURE_NO_WARNINGS"
           ],
+          "libraries": [
+            "<(module_root_dir)/../core/build/lib/Release/llamacpp_core.lib"
+          ],
           "msvs_settings": {
             "ExceptionHandling": 1
           }
@@ -61,5 +91,47 @@
         "-fno-exceptions"
       ]
     }
+  ],
+  "conditions": [
+    ["OS=='linux'", {
+      "targets": [
+        {
+          "target_name": "vecbox_server",
+          "type": "executable",
+          "sources": [
+            "server/vecbox-server.cpp",
+            "src/vecbox-base64.cpp",
+            "src/vecbox-ctx-pool.cpp",
+            "src/vecbox-engine.cpp",
+            "src/vecbox-event.cpp",
+            "src/vecbox-json.cpp",
+            "src/vecbox-metrics.cpp",
+            "src/vecbox-projection.cpp",
+            "src/vecbox-shm.cpp",
+            "src/vecbox-tokenizer.cpp"
+          ],
+          "include_dirs": [
+            "src",
+            "../core/src/include",
+            "../core/src/ggml",
+            "../core/src/ggml-cpu"
+          ],
+          "cflags_cc": [
+            "-std=c++17",
+            "-fexceptions",
+            "-O3",
+            "-pthread"
+          ],
+          "cflags_cc!": [
+            "-fno-exceptions"
+          ],
+          "libraries": [
+            "<(module_root_dir)/../core/build/lib/libllamacpp_core.a",
+            "-pthread",
+            "-fopenmp"
+          ]
+        }
+      ]
+    }]
   ]
 }
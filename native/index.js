@@ -13,11 +13,26 @@ try {
 console.log(`Native binding loaded from: ${binding ? 'success' : 'failed'}`);
 
 class LlamaEmbedding {
-  constructor(modelPath) {
-    this.modelPtr = binding.createModel(modelPath);
+  /**
+   * `options.dimensions` truncates Matryoshka embeddings to their first N dimensions;
+   * `options.projection` applies a PCA fitted with fitPca (a .vbproj path, or true for the
+   * model's sidecar). Either way the engine returns the reduced vectors.
+   * `options.dedup` ({ threshold, action: 'reuse' | 'skip' }) checks each text against the
+   * earlier ones before inference: a near-duplicate gets the earlier embedding back, or null.
+   */
+  constructor(modelPath, options = {}) {
+    this.modelPtr = binding.createModel(modelPath, options);
     if (!this.modelPtr) {
       throw new Error('Failed to load model');
     }
+    this.skipsDuplicates = !!options.dedup && options.dedup.action === 'skip';
+  }
+
+  // wrap a model handle that is already loaded (e.g. from a ModelRegistry)
+  static fromHandle(modelPtr) {
+    const embedding = Object.create(LlamaEmbedding.prototype);
+    embedding.modelPtr = modelPtr;
+    return embedding;
   }
 
   embed(text) {
@@ -26,13 +41,51 @@ class LlamaEmbedding {
     }
     
     const embedding = binding.getEmbedding(this.modelPtr, text);
-    if (!embedding) {
+    if (!embedding && !this.skipsDuplicates) {
       throw new Error('Failed to generate embedding');
     }
     
     return embedding;
   }
 
+  /**
+   * Token ids the model sees for `text`, as an Int32Array. Models with a WordPiece vocab use
+   * the compiled tokenizer cached next to the model file (`<model>.vbtok`).
+   */
+  tokenize(text) {
+    return binding.tokenize(this.modelPtr, text);
+  }
+
+  /**
+   * Load and warm `newPath` in the background, then switch to it; requests already
+   * queued finish on the old model, which is freed after them. With `shadow: true`
+   * the new model only runs on a `sampleRate` share of traffic for comparison
+   * (see shadowStats/promoteShadow).
+   */
+  swapModel(newPath, options = {}) {
+    return binding.swapModel(this.modelPtr, newPath, options);
+  }
+
+  /**
+   * Take the first-request costs up front: touch every page of the tokenizer and run one dummy
+   * batch of `maxBatch` x `maxSeqLen` tokens. Resolves with the time spent on each step.
+   */
+  warmup(options = {}) {
+    return binding.warmup(this.modelPtr, options);
+  }
+
+  shadowStats() {
+    return binding.shadowStats(this.modelPtr);
+  }
+
+  promoteShadow() {
+    binding.promoteShadow(this.modelPtr);
+  }
+
+  dropShadow() {
+    binding.dropShadow(this.modelPtr);
+  }
+
   close() {
     if (this.modelPtr) {
       binding.destroyModel(this.modelPtr);
@@ -41,11 +94,316 @@ class LlamaEmbedding {
   }
 }
 
-function create(modelPath) {
-  return new LlamaEmbedding(modelPath);
+function swapModel(embedding, newPath, options = {}) {
+  return embedding.swapModel(newPath, options);
+}
+
+// Several models under one memory budget: least recently used unpinned models are
+// evicted to make room, and cold models load in the background
+class ModelRegistry {
+  constructor(options = {}) {
+    this.registryPtr = binding.registryCreate(options);
+  }
+
+  add(name, modelPath, options = {}) {
+    binding.registryAdd(this.registryPtr, name, modelPath, !!options.pinned);
+  }
+
+  remove(name) {
+    binding.registryRemove(this.registryPtr, name);
+  }
+
+  pin(name, pinned = true) {
+    binding.registryPin(this.registryPtr, name, pinned);
+  }
+
+  // resolves with a LlamaEmbedding; close() it when done so eviction can free the model
+  async acquire(name) {
+    return LlamaEmbedding.fromHandle(await binding.registryAcquire(this.registryPtr, name));
+  }
+
+  list() {
+    return binding.registryList(this.registryPtr);
+  }
+
+  usedBytes() {
+    return binding.registryUsedBytes(this.registryPtr);
+  }
+
+  close() {
+    if (this.registryPtr) {
+      binding.registryDestroy(this.registryPtr);
+      this.registryPtr = null;
+    }
+  }
+}
+
+// Near-duplicate detection for ingestion, ahead of any provider: MinHash signatures over word
+// shingles, bucketed by LSH, compared against the most recent `capacity` texts indexed (65536)
+class NearDuplicateIndex {
+  constructor(options = {}) {
+    this.dedupPtr = binding.dedupCreate(options);
+  }
+
+  /**
+   * Returns { duplicateOf: Int32Array, jaccard: Float32Array }: for each text, the position
+   * (counting every text added so far) of the earlier text it repeats, or -1 for a new one
+   * or one without words, with the estimated Jaccard similarity of their shingles.
+   */
+  add(texts) {
+    return binding.dedupAdd(this.dedupPtr, texts);
+  }
+
+  close() {
+    if (this.dedupPtr) {
+      binding.dedupDestroy(this.dedupPtr);
+      this.dedupPtr = null;
+    }
+  }
+}
+
+// Shared-memory transport (Linux): serve a loaded model to co-located processes,
+// or connect to a sidecar such as `vecbox_server --shm`
+class ShmServer {
+  constructor(embedding, socketPath, options = {}) {
+    if (!binding.shmServe) {
+      throw new Error('Shared-memory transport is only available on Linux');
+    }
+    this.serverPtr = binding.shmServe(embedding.modelPtr, socketPath, options);
+  }
+
+  close() {
+    if (this.serverPtr) {
+      binding.shmStop(this.serverPtr);
+      this.serverPtr = null;
+    }
+  }
+}
+
+class ShmClient {
+  constructor(socketPath) {
+    if (!binding.shmConnect) {
+      throw new Error('Shared-memory transport is only available on Linux');
+    }
+    this.clientPtr = binding.shmConnect(socketPath);
+  }
+
+  /**
+   * Resolves with one Float32Array per text. The wait for the server runs off the main thread;
+   * requests from one client are sent one at a time.
+   */
+  embedBatch(texts, options = {}) {
+    if (!Array.isArray(texts)) {
+      throw new Error('Texts must be an array of strings');
+    }
+
+    return binding.shmEmbed(this.clientPtr, texts, !!options.normalize, !!options.quantized, options.priority === 'bulk');
+  }
+
+  async embed(text, options = {}) {
+    return (await this.embedBatch([text], options))[0];
+  }
+
+  close() {
+    if (this.clientPtr) {
+      binding.shmClose(this.clientPtr);
+      this.clientPtr = null;
+    }
+  }
+}
+
+/**
+ * Serialize embeddings to JSON with shortest round-trip float formatting.
+ * Pass `precision` for fixed decimals, or `target` to write into an existing
+ * Buffer (returns the byte count instead of a string).
+ */
+function embeddingsToJson(embeddings, options = {}) {
+  const precision = options.precision === undefined ? -1 : options.precision;
+
+  if (options.target) {
+    return binding.writeEmbeddingsJson(embeddings, options.target, precision);
+  }
+
+  const batch = Array.isArray(embeddings) && embeddings.length > 0 && typeof embeddings[0] !== 'number';
+  const rows = batch ? embeddings : [embeddings];
+  const dimensions = rows.reduce((max, row) => Math.max(max, row.length), 0);
+  const target = Buffer.allocUnsafe(binding.embeddingsJsonMaxSize(rows.length, dimensions, precision));
+  const length = binding.writeEmbeddingsJson(embeddings, target, precision);
+  return target.toString('latin1', 0, length);
+}
+
+// Rows as one flat typed array: a flat array is taken as is, an array of rows is packed
+function packRows(rows, dimensions) {
+  if (ArrayBuffer.isView(rows)) {
+    if (!dimensions) {
+      throw new Error('dimensions is required for flat embeddings');
+    }
+    return { data: rows, dimensions, rows: rows.length / dimensions };
+  }
+
+  if (rows.length === 0) {
+    return { data: new Float32Array(0), dimensions: dimensions || 1, rows: 0 };
+  }
+
+  const dims = rows[0].length;
+  const Type = ArrayBuffer.isView(rows[0]) ? rows[0].constructor : Float32Array;
+  const data = new Type(rows.length * dims);
+  rows.forEach((row, i) => {
+    if (row.length !== dims) {
+      throw new Error(`row ${i} has ${row.length} dimensions, expected ${dims}`);
+    }
+    data.set(row, i * dims);
+  });
+  return { data, dimensions: dims, rows: rows.length };
+}
+
+/**
+ * Cosine similarity between every row of `a` and every row of `b` (or of `a`
+ * with itself), computed natively with blocked matrix multiplies off the main
+ * thread. Rows are Float32Array, Uint16Array (float16 bits) or Int8Array, either as an
+ * array of rows or one flat array with `dimensions`.
+ *
+ * Resolves to { rows, cols, data } with data[i * cols + j]. With `threshold`,
+ * only the pairs scoring at least that much are returned as { i, j, score }, or
+ * handed to `onPairs(i, j, score)` block by block as they are found, resolving
+ * once the last block is delivered; comparing `a` with itself reports each pair
+ * once with i < j. If onPairs throws, the remaining blocks are dropped and the
+ * promise rejects with that error.
+ */
+async function similarityMatrix(a, b, options) {
+  if (options === undefined && b && !Array.isArray(b) && !ArrayBuffer.isView(b)) {
+    options = b;
+    b = null;
+  }
+  options = options || {};
+
+  const left = packRows(a, options.dimensions);
+  const right = b ? packRows(b, left.dimensions) : null;
+  const result = await binding.similarityMatrix(left.data, right && right.data, { ...options, dimensions: left.dimensions });
+
+  if (options.threshold !== undefined) {
+    return result;
+  }
+  return { rows: left.rows, cols: right ? right.rows : left.rows, data: result };
+}
+
+/**
+ * k-means clustering (k-means++ seeding, Lloyd or mini-batch updates) run
+ * natively off the main thread. `data` is an array of rows, a flat
+ * Float32Array with `dimensions`, or the path of a file of packed float32 rows,
+ * which is memory-mapped rather than read into the heap.
+ *
+ * Resolves to { centroids: Float32Array[], labels: Int32Array, inertia, iterations }.
+ */
+async function kmeans(data, options = {}) {
+  let input = data;
+  let dimensions = options.dimensions;
+  if (typeof data !== 'string') {
+    const packed = packRows(data, dimensions);
+    if (!(packed.data instanceof Float32Array)) {
+      throw new Error('kmeans expects float32 rows');
+    }
+    input = packed.data;
+    dimensions = packed.dimensions;
+  } else if (!dimensions) {
+    throw new Error('dimensions is required for a file of rows');
+  }
+
+  const result = await binding.kmeans(input, { ...options, dimensions });
+  const centroids = [];
+  for (let c = 0; c < result.centroids.length / dimensions; c++) {
+    centroids.push(result.centroids.subarray(c * dimensions, (c + 1) * dimensions));
+  }
+  return { ...result, centroids };
+}
+
+/**
+ * Maximal marginal relevance re-ranking: picks `k` candidates that are relevant
+ * to `query` but not redundant with each other, trading the two off with
+ * `lambda` (1 = relevance only, 0 = diversity only). Scores are cosine
+ * similarities computed natively.
+ *
+ * `candidates` is an array of rows, a flat Float32Array, or { rows, ids } to
+ * re-rank search hits in place: `rows` is the whole vector store and `ids` the
+ * hit row numbers (an Int32Array, or one per query). Passing an array of
+ * queries ranks them all in one call, spread over `options.threads`.
+ *
+ * Returns { ids: Int32Array, scores: Float32Array } in selection order, with
+ * ids as row numbers of the candidate rows, or an array of those for a batch.
+ */
+function mmr(query, candidates, k = 10, lambda = 0.5, options = {}) {
+  const batch = Array.isArray(query) && typeof query[0] !== 'number';
+  const queries = packRows(batch ? query : [query]);
+  if (!(queries.data instanceof Float32Array)) {
+    throw new Error('mmr expects float32 vectors');
+  }
+
+  const source = candidates && !Array.isArray(candidates) && !ArrayBuffer.isView(candidates)
+    ? candidates
+    : { rows: candidates };
+  const rows = packRows(source.rows, queries.dimensions);
+  if (!(rows.data instanceof Float32Array) || rows.dimensions !== queries.dimensions) {
+    throw new Error(`mmr expects float32 rows of ${queries.dimensions} dimensions`);
+  }
+
+  let ids = source.ids || null;
+  if (ids && !Array.isArray(ids)) {
+    ids = new Array(queries.rows).fill(ids);
+  }
+
+  const results = binding.mmr(queries.data, rows.data, ids, {
+    dimensions: queries.dimensions,
+    k,
+    lambda,
+    threads: options.threads
+  });
+  return batch ? results : results[0];
+}
+
+/**
+ * Fit a PCA projection to `components` dimensions on sample embeddings with
+ * randomized SVD. Pass `modelPath` to store it as that model's sidecar, which
+ * create(modelPath, { projection: true }) then applies right after pooling.
+ *
+ * Returns { components: Float32Array, mean: Float32Array, variance: Float32Array }.
+ */
+function fitPca(samples, options = {}) {
+  const packed = packRows(samples, options.dimensions);
+  if (!(packed.data instanceof Float32Array)) {
+    throw new Error('fitPca expects float32 rows');
+  }
+
+  const path = options.modelPath ? binding.projectionSidecar(options.modelPath) : options.path;
+  return binding.fitPca(packed.data, { ...options, dimensions: packed.dimensions, path });
+}
+
+/**
+ * Engine metrics aggregated across threads: { counters, gauges, histograms }.
+ * Pass { format: 'prometheus' } for the text exposition format instead.
+ */
+function getMetrics(options = {}) {
+  if (options.format === 'prometheus') {
+    return binding.getMetricsText();
+  }
+  return binding.getMetrics();
+}
+
+function create(modelPath, options = {}) {
+  return new LlamaEmbedding(modelPath, options);
 }
 
 module.exports = {
   create,
-  LlamaEmbedding
+  embeddingsToJson,
+  fitPca,
+  getMetrics,
+  kmeans,
+  mmr,
+  similarityMatrix,
+  swapModel,
+  LlamaEmbedding,
+  ModelRegistry,
+  NearDuplicateIndex,
+  ShmServer,
+  ShmClient
 };
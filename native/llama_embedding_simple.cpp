@@ -1,23 +1,94 @@
 #include <napi.h>
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <memory>
+#include <atomic>
 #include <cmath>
+#include <cstring>
 
 // Minimal includes for embedding generation
 #include "ggml.h"
+#include "vecbox-base64.h"
+#include "vecbox-dedup.h"
+#include "vecbox-engine.h"
+#include "vecbox-json.h"
+#include "vecbox-kmeans.h"
+#include "vecbox-metrics.h"
+#include "vecbox-mmr.h"
+#include "vecbox-projection.h"
+#include "vecbox-registry.h"
+#include "vecbox-similarity.h"
+
+#ifdef __linux__
+#include "vecbox-shm.h"
+#endif
 
 struct ModelData {
-    void* model_ptr;
+    std::shared_ptr<vecbox_model> model;
     int n_embd;
+    
+    // hot swap: a candidate compared on sampled traffic, and the batchers serving this model
+    std::shared_ptr<vecbox_shadow> shadow;
+    std::vector<std::weak_ptr<vecbox_batcher>> batchers;
+    
+    // a swap in flight owns the deletion if the model is destroyed before it finishes
+    int pendingSwaps = 0;
+    bool destroyed = false;
+    
+    // near-duplicates of earlier texts reuse their embedding, or are skipped
+    std::shared_ptr<vecbox_dedup_index> dedup;
+    bool dedupSkip = false;
+    
+    // registry handles are freed by their External's finalizer; destroying one only drops
+    // its references, so an unclosed handle still releases its registry model when collected
+    bool gcOwned = false;
 };
 
+// Frees a destroyed handle, or only drops its references if its finalizer will free it
+static void FreeModelData(ModelData* modelData) {
+    if (!modelData->gcOwned) {
+        delete modelData;
+        return;
+    }
+    modelData->model.reset();
+    modelData->shadow.reset();
+    modelData->dedup.reset();
+    modelData->batchers.clear();
+}
+
 // Helper function to throw N-API error
 Napi::Error throwNapiError(Napi::Env env, const std::string& message) {
     return Napi::Error::New(env, message);
 }
 
-// Create model from GGUF file (simplified version)
+// Near-duplicate index options: { threshold?, numPerm?, bands?, shingle?, capacity?, seed? }
+static vecbox_dedup_params ReadDedupParams(Napi::Object options) {
+    vecbox_dedup_params params;
+    if (options.Has("threshold")) {
+        params.threshold = options.Get("threshold").ToNumber().FloatValue();
+    }
+    if (options.Has("numPerm")) {
+        params.num_perm = options.Get("numPerm").ToNumber().Int32Value();
+    }
+    if (options.Has("bands")) {
+        params.bands = options.Get("bands").ToNumber().Int32Value();
+    }
+    if (options.Has("shingle")) {
+        params.shingle = options.Get("shingle").ToNumber().Int32Value();
+    }
+    if (options.Has("capacity")) {
+        params.capacity = options.Get("capacity").ToNumber().Int64Value();
+    }
+    if (options.Has("seed")) {
+        params.seed = (uint64_t) options.Get("seed").ToNumber().Int64Value();
+    }
+    return params;
+}
+
+// Create model from GGUF file: (modelPath, options?) with options
+// { dimensions?: number (Matryoshka truncation), projection?: string | true (PCA sidecar),
+//   dedup?: { action?: 'reuse' | 'skip', threshold?, numPerm?, bands?, shingle?, capacity? } }
 Napi::Value CreateModel(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     
@@ -31,16 +102,45 @@ Napi::Value CreateModel(const Napi::CallbackInfo& info) {
     
     std::string modelPath = info[0].As<Napi::String>().Utf8Value();
     
-    // For now, create a simple mock model
+    // Shared with the standalone server through the native engine
     ModelData* modelData = new ModelData();
-    modelData->model_ptr = nullptr; // Mock
-    modelData->n_embd = 768; // Mock dimensions
+    try {
+        vecbox_model_params params;
+        if (info.Length() > 1 && info[1].IsObject()) {
+            Napi::Object options = info[1].As<Napi::Object>();
+            if (options.Has("dimensions") && options.Get("dimensions").IsNumber()) {
+                params.truncate = options.Get("dimensions").As<Napi::Number>().Int32Value();
+            }
+            Napi::Value projection = options.Get("projection");
+            if (projection.IsString()) {
+                params.projection = vecbox_projection_load(projection.As<Napi::String>().Utf8Value());
+            } else if (projection.IsBoolean() && projection.As<Napi::Boolean>().Value()) {
+                params.projection = vecbox_projection_load(vecbox_projection_sidecar(modelPath));
+            }
+        }
+        modelData->model = vecbox_model_load(modelPath, params);
+        modelData->n_embd = modelData->model->n_embd;
+        
+        if (info.Length() > 1 && info[1].IsObject() && info[1].As<Napi::Object>().Get("dedup").IsObject()) {
+            Napi::Object dedup = info[1].As<Napi::Object>().Get("dedup").As<Napi::Object>();
+            vecbox_dedup_params dedupParams = ReadDedupParams(dedup);
+            modelData->dedupSkip = dedup.Get("action").ToString().Utf8Value() == "skip";
+            // only kept to be handed back to duplicates
+            dedupParams.n_embd = modelData->dedupSkip ? 0 : modelData->n_embd;
+            modelData->dedup = std::make_shared<vecbox_dedup_index>(dedupParams);
+        }
+    } catch (const std::exception& e) {
+        delete modelData;
+        throw throwNapiError(env, e.what());
+    }
     
     // Return as external pointer
     return Napi::External<ModelData>::New(env, modelData);
 }
 
 // Generate embedding for text (simplified version)
+// With dedup enabled, a near-duplicate of an earlier text gets that text's embedding back
+// (action 'reuse') or null (action 'skip') without running the model
 Napi::Value GetEmbedding(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     
@@ -59,17 +159,44 @@ Napi::Value GetEmbedding(const Napi::CallbackInfo& info) {
     ModelData* modelData = info[0].As<Napi::External<ModelData>>().Data(); // get pointer, passed through js
     std::string text = info[1].As<Napi::String>().Utf8Value();
     
-    // Generate mock embedding based on text hash
     int dimensions = modelData->n_embd;
+    
+    // a text without words has no signature and always runs the model
+    std::vector<uint32_t> signature;
+    bool hasSignature = false;
+    if (modelData->dedup) {
+        signature.resize(modelData->dedup->params().num_perm);
+        hasSignature = modelData->dedup->signature(text, signature.data());
+    }
+    if (hasSignature) {
+        vecbox_dedup_match match = modelData->dedup->find(signature.data());
+        if (match.id >= 0) {
+            if (modelData->dedupSkip) {
+                vecbox_metrics_add(VECBOX_COUNTER_NEAR_DUPLICATES);
+                return env.Null();
+            }
+            // the match may have been evicted since; then embed as usual
+            Napi::Float32Array reused = Napi::Float32Array::New(env, dimensions);
+            if (modelData->dedup->embedding(match.id, reused.Data())) {
+                vecbox_metrics_add(VECBOX_COUNTER_NEAR_DUPLICATES);
+                return reused;
+            }
+        }
+    }
+    
     Napi::Float32Array embeddingArray = Napi::Float32Array::New(env, dimensions);
     
-    // Simple hash-based embedding generation for testing
-    for (int i = 0; i < dimensions; i++) {
-        float value = 0.0f;
-        for (char c : text) {
-            value += (float)c * (i + 1) * 0.001f;
+    modelData->model->embed(&text, 1, embeddingArray.Data());
+    
+    if (hasSignature) {
+        modelData->dedup->insert(signature.data(), embeddingArray.Data());
+    }
+    
+    if (modelData->shadow) {
+        try {
+            modelData->shadow->observe(&text, 1, embeddingArray.Data(), dimensions);
+        } catch (const std::exception&) {
         }
-        embeddingArray[i] = sin(value) * 0.1f;
     }
     
     return embeddingArray;
@@ -89,12 +216,1393 @@ Napi::Value DestroyModel(const Napi::CallbackInfo& info) {
     
     ModelData* modelData = info[0].As<Napi::External<ModelData>>().Data();
     
-    if (modelData) {
-        delete modelData;
+    if (modelData && modelData->pendingSwaps > 0) {
+        modelData->destroyed = true;
+    } else if (modelData && !modelData->destroyed) {
+        modelData->destroyed = true;
+        FreeModelData(modelData);
+    }
+    
+    return env.Null();
+}
+
+// Switch a model handle, and the batchers serving it, to another model with the same dimensions
+static void PromoteModel(ModelData* modelData, std::shared_ptr<vecbox_model> model) {
+    modelData->model = model;
+    modelData->shadow.reset();
+    if (modelData->dedup) {
+        // kept embeddings came from the old model
+        modelData->dedup->clear();
+    }
+    for (auto& weak : modelData->batchers) {
+        if (auto batcher = weak.lock()) {
+            batcher->swap_model(model);
+            batcher->set_shadow(nullptr);
+        }
+    }
+}
+
+// Loads and warms the new model on the libuv pool, then swaps (or shadows) on the JS thread
+class SwapModelWorker : public Napi::AsyncWorker {
+public:
+    SwapModelWorker(Napi::Env env, ModelData* modelData, const std::string& path,
+                    std::vector<std::string> warmup, bool shadow, double sampleRate)
+        : Napi::AsyncWorker(env), deferred(Napi::Promise::Deferred::New(env)), modelData(modelData),
+          path(path), warmup(std::move(warmup)), shadow(shadow), sampleRate(sampleRate) {
+        // the new model gets the same truncation or PCA, so the dimensions keep matching
+        params.projection = modelData->model->projection;
+        modelData->pendingSwaps++;
+    }
+    
+    Napi::Promise Promise() { return deferred.Promise(); }
+    
+    void Execute() override {
+        try {
+            model = vecbox_model_load_warm(path, warmup, params);
+        } catch (const std::exception& e) {
+            SetError(e.what());
+        }
+    }
+    
+    void OnOK() override {
+        Napi::Env env = Env();
+        if (!Release()) {
+            deferred.Reject(Napi::Error::New(env, "model was destroyed during the swap").Value());
+            return;
+        }
+        if (model->n_embd != modelData->n_embd) {
+            deferred.Reject(Napi::Error::New(env, "new model has " + std::to_string(model->n_embd) +
+                " dimensions, serving " + std::to_string(modelData->n_embd)).Value());
+            return;
+        }
+        
+        if (shadow) {
+            modelData->shadow = std::make_shared<vecbox_shadow>(model, sampleRate);
+            for (auto& weak : modelData->batchers) {
+                if (auto batcher = weak.lock()) {
+                    batcher->set_shadow(modelData->shadow);
+                }
+            }
+        } else {
+            // requests already queued finish on the old model, which is freed after them
+            PromoteModel(modelData, model);
+        }
+        deferred.Resolve(Env().Undefined());
+    }
+    
+    void OnError(const Napi::Error& error) override {
+        Release();
+        deferred.Reject(error.Value());
+    }
+    
+private:
+    // false if the handle was destroyed meanwhile (and is now freed)
+    bool Release() {
+        modelData->pendingSwaps--;
+        if (!modelData->destroyed) {
+            return true;
+        }
+        if (modelData->pendingSwaps == 0) {
+            FreeModelData(modelData);
+        }
+        return false;
+    }
+    
+    Napi::Promise::Deferred deferred;
+    ModelData* modelData;
+    std::string path;
+    std::vector<std::string> warmup;
+    vecbox_model_params params;
+    bool shadow;
+    double sampleRate;
+    std::shared_ptr<vecbox_model> model;
+};
+
+// Replace a loaded model without dropping requests: (modelPtr, newPath, options?) -> Promise
+// options: { warmup?: string[], shadow?: boolean, sampleRate?: number }
+Napi::Value SwapModel(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsExternal() || !info[1].IsString()) {
+        throw throwNapiError(env, "Expected 2 arguments: modelPtr, newPath");
+    }
+    
+    ModelData* modelData = info[0].As<Napi::External<ModelData>>().Data();
+    std::string path = info[1].As<Napi::String>().Utf8Value();
+    
+    std::vector<std::string> warmup = { "warmup" };
+    bool shadow = false;
+    double sampleRate = 0.01;
+    if (info.Length() > 2 && info[2].IsObject()) {
+        Napi::Object options = info[2].As<Napi::Object>();
+        if (options.Has("warmup") && options.Get("warmup").IsArray()) {
+            Napi::Array texts = options.Get("warmup").As<Napi::Array>();
+            warmup.clear();
+            for (uint32_t i = 0; i < texts.Length(); i++) {
+                warmup.push_back(texts.Get(i).ToString().Utf8Value());
+            }
+        }
+        shadow = options.Has("shadow") && options.Get("shadow").ToBoolean().Value();
+        if (options.Has("sampleRate")) {
+            sampleRate = options.Get("sampleRate").As<Napi::Number>().DoubleValue();
+        }
+    }
+    
+    if (!(sampleRate >= 0.0 && sampleRate <= 1.0)) {
+        throw throwNapiError(env, "sampleRate must be between 0 and 1");
+    }
+    
+    SwapModelWorker* worker = new SwapModelWorker(env, modelData, path, std::move(warmup), shadow, sampleRate);
+    worker->Queue();
+    return worker->Promise();
+}
+
+static ModelData* GetShadowedModel(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsExternal()) {
+        throw throwNapiError(env, "Expected 1 argument: modelPtr");
+    }
+    
+    return info[0].As<Napi::External<ModelData>>().Data();
+}
+
+// Switch to the shadow model after comparing it on live traffic
+Napi::Value PromoteShadow(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    ModelData* modelData = GetShadowedModel(info);
+    if (!modelData->shadow) {
+        throw throwNapiError(env, "no shadow model to promote");
+    }
+    PromoteModel(modelData, modelData->shadow->model());
+    
+    return env.Null();
+}
+
+Napi::Value DropShadow(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    ModelData* modelData = GetShadowedModel(info);
+    modelData->shadow.reset();
+    for (auto& weak : modelData->batchers) {
+        if (auto batcher = weak.lock()) {
+            batcher->set_shadow(nullptr);
+        }
+    }
+    
+    return env.Null();
+}
+
+// { texts, dropped, meanCosine, minCosine } for the shadow model, or null
+Napi::Value ShadowStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    ModelData* modelData = GetShadowedModel(info);
+    if (!modelData->shadow) {
+        return env.Null();
+    }
+    
+    vecbox_shadow_stats stats = modelData->shadow->stats();
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("texts", Napi::Number::New(env, (double) stats.n_texts));
+    result.Set("dropped", Napi::Number::New(env, (double) stats.n_dropped));
+    result.Set("meanCosine", stats.n_texts > 0 ? Napi::Number::New(env, stats.sum_cos / stats.n_texts) : env.Null());
+    result.Set("minCosine", stats.n_texts > 0 ? Napi::Number::New(env, stats.min_cos) : env.Null());
+    return result;
+}
+
+// Runs the warmup on the libuv pool; the model is held so closing the handle meanwhile is safe
+class WarmupWorker : public Napi::AsyncWorker {
+public:
+    WarmupWorker(Napi::Env env, std::shared_ptr<vecbox_model> model, const vecbox_warmup_params& params)
+        : Napi::AsyncWorker(env), deferred(Napi::Promise::Deferred::New(env)), model(std::move(model)), params(params) {}
+    
+    Napi::Promise Promise() { return deferred.Promise(); }
+    
+    void Execute() override {
+        try {
+            report = model->warmup(params);
+        } catch (const std::exception& e) {
+            SetError(e.what());
+        }
+    }
+    
+    void OnOK() override {
+        Napi::Env env = Env();
+        
+        Napi::Object out = Napi::Object::New(env);
+        out.Set("prefaultMs", Napi::Number::New(env, report.t_prefault_us / 1000.0));
+        out.Set("dummyPassMs", Napi::Number::New(env, report.t_dummy_pass_us / 1000.0));
+        out.Set("prefaultBytes", Napi::Number::New(env, (double) report.prefault_bytes));
+        deferred.Resolve(out);
+    }
+    
+    void OnError(const Napi::Error& error) override {
+        deferred.Reject(error.Value());
+    }
+    
+private:
+    Napi::Promise::Deferred deferred;
+    std::shared_ptr<vecbox_model> model;
+    vecbox_warmup_params params;
+    vecbox_warmup_report report;
+};
+
+// Warm a model up before its first request: (modelPtr, { maxBatch?, maxSeqLen? }) -> Promise of
+// { prefaultMs, dummyPassMs, prefaultBytes }
+Napi::Value Warmup(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsExternal()) {
+        throw throwNapiError(env, "Expected 1 argument: modelPtr");
+    }
+    
+    ModelData* modelData = info[0].As<Napi::External<ModelData>>().Data();
+    
+    vecbox_warmup_params params;
+    if (info.Length() > 1 && info[1].IsObject()) {
+        Napi::Object options = info[1].As<Napi::Object>();
+        if (options.Has("maxBatch")) {
+            params.max_batch = options.Get("maxBatch").ToNumber().Int32Value();
+        }
+        if (options.Has("maxSeqLen")) {
+            params.max_seq_len = options.Get("maxSeqLen").ToNumber().Int32Value();
+        }
+    }
+    
+    WarmupWorker* worker = new WarmupWorker(env, modelData->model, params);
+    worker->Queue();
+    return worker->Promise();
+}
+
+// Token ids the model would see for text: (modelPtr, text) -> Int32Array
+Napi::Value Tokenize(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsExternal() || !info[1].IsString()) {
+        throw throwNapiError(env, "Expected 2 arguments: modelPtr, text");
     }
     
+    ModelData* modelData = info[0].As<Napi::External<ModelData>>().Data();
+    std::vector<int32_t> tokens;
+    modelData->model->tokenize(info[1].As<Napi::String>().Utf8Value(), tokens);
+    
+    Napi::Int32Array out = Napi::Int32Array::New(env, tokens.size());
+    std::memcpy(out.Data(), tokens.data(), tokens.size() * sizeof(int32_t));
+    return out;
+}
+
+// Decode one base64 string of little-endian float32 into a Float32Array
+static Napi::Float32Array DecodeBase64F32Value(Napi::Env env, Napi::Value value) {
+    if (!value.IsString()) {
+        throw throwNapiError(env, "base64 data must be a string");
+    }
+    
+    // base64 is pure ASCII, so latin1 extraction skips UTF-8 transcoding
+    static thread_local std::vector<char> scratch;
+    size_t length = 0;
+    napi_get_value_string_latin1(env, value, nullptr, 0, &length);
+    scratch.resize(length + 1);
+    napi_get_value_string_latin1(env, value, scratch.data(), scratch.size(), &length);
+    
+    int64_t bytes = vecbox_base64_decoded_size(scratch.data(), length);
+    if (bytes < 0 || bytes % sizeof(float) != 0) {
+        throw throwNapiError(env, "invalid base64 float32 data");
+    }
+    
+    Napi::Float32Array embeddingArray = Napi::Float32Array::New(env, bytes / sizeof(float));
+    if (vecbox_base64_decode(scratch.data(), length, (uint8_t*) embeddingArray.Data()) != bytes) {
+        throw throwNapiError(env, "invalid base64 float32 data");
+    }
+    
+    return embeddingArray;
+}
+
+// Decode base64 embeddings (string or array of strings) into Float32Arrays
+Napi::Value DecodeBase64F32(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1) {
+        throw throwNapiError(env, "Expected 1 argument: data");
+    }
+    
+    if (!info[0].IsArray()) {
+        return DecodeBase64F32Value(env, info[0]);
+    }
+    
+    Napi::Array input = info[0].As<Napi::Array>();
+    Napi::Array output = Napi::Array::New(env, input.Length());
+    for (uint32_t i = 0; i < input.Length(); i++) {
+        output.Set(i, DecodeBase64F32Value(env, input.Get(i)));
+    }
+    
+    return output;
+}
+
+// Read one embedding (Float32Array or number[]) as float32
+static void ReadEmbeddingRow(Napi::Env env, Napi::Value value, std::vector<float>& row) {
+    if (value.IsTypedArray() && value.As<Napi::TypedArray>().TypedArrayType() == napi_float32_array) {
+        Napi::Float32Array typed = value.As<Napi::Float32Array>();
+        row.assign(typed.Data(), typed.Data() + typed.ElementLength());
+        return;
+    }
+    
+    if (!value.IsArray()) {
+        throw throwNapiError(env, "embeddings must be Float32Array or number[]");
+    }
+    
+    Napi::Array array = value.As<Napi::Array>();
+    row.resize(array.Length());
+    for (uint32_t i = 0; i < array.Length(); i++) {
+        row[i] = array.Get(i).As<Napi::Number>().FloatValue();
+    }
+}
+
+// Serialize embeddings as JSON directly into a caller-provided buffer
+// (embeddings, target, precision?) -> bytes written; precision < 0 means shortest round-trip
+Napi::Value WriteEmbeddingsJson(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2) {
+        throw throwNapiError(env, "Expected 2 arguments: embeddings, target");
+    }
+    
+    if (!info[1].IsTypedArray() || info[1].As<Napi::TypedArray>().TypedArrayType() != napi_uint8_array) {
+        throw throwNapiError(env, "target must be a Buffer or Uint8Array");
+    }
+    
+    Napi::Uint8Array target = info[1].As<Napi::Uint8Array>();
+    int precision = info.Length() > 2 && info[2].IsNumber() ? info[2].As<Napi::Number>().Int32Value() : -1;
+    
+    // A Float32Array is one embedding; an array whose items are embeddings is a batch
+    bool batch = info[0].IsArray() && info[0].As<Napi::Array>().Length() > 0 &&
+                 !info[0].As<Napi::Array>().Get((uint32_t) 0).IsNumber();
+    
+    std::vector<Napi::Value> items;
+    if (batch) {
+        Napi::Array array = info[0].As<Napi::Array>();
+        for (uint32_t i = 0; i < array.Length(); i++) {
+            items.push_back(array.Get(i));
+        }
+    } else {
+        items.push_back(info[0]);
+    }
+    
+    char* begin = (char*) target.Data();
+    char* end = begin + target.ByteLength();
+    char* out = begin;
+    
+    std::vector<float> row;
+    if (batch) {
+        if (out == end) {
+            throw Napi::RangeError::New(env, "target buffer too small");
+        }
+        *out++ = '[';
+    }
+    for (size_t i = 0; i < items.size(); i++) {
+        ReadEmbeddingRow(env, items[i], row);
+        
+        // room for the row, a separator and the closing bracket of the batch
+        if ((size_t) (end - out) < vecbox_json_floats_max_size(row.size(), precision) + 2) {
+            throw Napi::RangeError::New(env, "target buffer too small");
+        }
+        if (i > 0) {
+            *out++ = ',';
+        }
+        out = vecbox_json_write_floats(out, row.data(), row.size(), precision);
+    }
+    if (batch) {
+        *out++ = ']';
+    }
+    
+    return Napi::Number::New(env, (double) (out - begin));
+}
+
+// Upper bound on the bytes WriteEmbeddingsJson needs: (count, dimensions, precision?)
+Napi::Value EmbeddingsJsonMaxSize(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+        throw throwNapiError(env, "Expected 2 arguments: count, dimensions");
+    }
+    
+    size_t count = info[0].As<Napi::Number>().Uint32Value();
+    size_t dimensions = info[1].As<Napi::Number>().Uint32Value();
+    int precision = info.Length() > 2 && info[2].IsNumber() ? info[2].As<Napi::Number>().Int32Value() : -1;
+    
+    return Napi::Number::New(env, (double) (count * (vecbox_json_floats_max_size(dimensions, precision) + 1) + 2));
+}
+
+// Flat row-major embeddings: Float32Array, Uint16Array (float16 bits) or Int8Array
+static vecbox_sim_rows ReadSimilarityRows(Napi::Env env, Napi::Value value, int32_t dimensions) {
+    if (!value.IsTypedArray()) {
+        throw throwNapiError(env, "embeddings must be a Float32Array, Uint16Array (float16) or Int8Array");
+    }
+    
+    Napi::TypedArray typed = value.As<Napi::TypedArray>();
+    vecbox_sim_rows rows;
+    switch (typed.TypedArrayType()) {
+        case napi_float32_array: rows.type = VECBOX_SIM_F32; break;
+        case napi_uint16_array:  rows.type = VECBOX_SIM_F16; break;
+        case napi_int8_array:    rows.type = VECBOX_SIM_I8;  break;
+        default:
+            throw throwNapiError(env, "embeddings must be a Float32Array, Uint16Array (float16) or Int8Array");
+    }
+    
+    if (dimensions <= 0 || typed.ElementLength() % dimensions != 0) {
+        throw throwNapiError(env, "embedding length is not a multiple of dimensions");
+    }
+    
+    rows.data = (const uint8_t*) typed.ArrayBuffer().Data() + typed.ByteOffset();
+    rows.n_rows = (int64_t) (typed.ElementLength() / dimensions);
+    rows.n_embd = dimensions;
+    return rows;
+}
+
+// All-pairs similarity on the libuv pool; the inputs and the output matrix are kept alive until it
+// finishes. With onPairs each block of pairs is handed back to the JS thread as soon as it is found
+class SimilarityWorker : public Napi::AsyncProgressQueueWorker<vecbox_sim_pair> {
+public:
+    SimilarityWorker(Napi::Env env, const vecbox_sim_params& params)
+        : Napi::AsyncProgressQueueWorker<vecbox_sim_pair>(env), deferred(Napi::Promise::Deferred::New(env)), params(params) {}
+    
+    Napi::Promise Promise() { return deferred.Promise(); }
+    
+    void SetInputs(Napi::Value valueA, const vecbox_sim_rows& rowsA, Napi::Value valueB, const vecbox_sim_rows* rowsB) {
+        inputA = Napi::Persistent(valueA.As<Napi::Object>());
+        a = rowsA;
+        self = rowsB == nullptr;
+        if (!self) {
+            inputB = Napi::Persistent(valueB.As<Napi::Object>());
+            b = *rowsB;
+        }
+    }
+    
+    void SetOutput(Napi::Float32Array array) {
+        output = Napi::Persistent(array);
+        out = array.Data();
+    }
+    
+    void SetThreshold(float value, Napi::Value callback) {
+        thresholded = true;
+        threshold = value;
+        if (callback.IsFunction()) {
+            onPairs = Napi::Persistent(callback.As<Napi::Function>());
+        }
+    }
+    
+    void Execute(const ExecutionProgress& progress) override {
+        try {
+            if (!thresholded) {
+                vecbox_similarity_matrix(a, self ? nullptr : &b, out, params);
+                return;
+            }
+            vecbox_similarity_threshold(a, self ? nullptr : &b, threshold,
+                [&](const vecbox_sim_pair* block, size_t n) {
+                    if (stopped) {
+                        throw std::runtime_error("onPairs threw");
+                    }
+                    if (onPairs.IsEmpty()) {
+                        pairs.insert(pairs.end(), block, block + n);
+                    } else {
+                        progress.Send(block, n);
+                    }
+                }, params);
+        } catch (const std::exception& e) {
+            SetError(e.what());
+        }
+    }
+    
+    void OnProgress(const vecbox_sim_pair* block, size_t n) override {
+        if (stopped) {
+            return;
+        }
+        Napi::Env env = Env();
+        Napi::HandleScope scope(env);
+        onPairs.Call({ PairArray<Napi::Int32Array>(env, block, n, &vecbox_sim_pair::i),
+                       PairArray<Napi::Int32Array>(env, block, n, &vecbox_sim_pair::j),
+                       PairArray<Napi::Float32Array>(env, block, n, &vecbox_sim_pair::score) });
+        // the rest of the blocks are dropped and the promise rejects with what onPairs threw
+        if (env.IsExceptionPending()) {
+            pairsError = env.GetAndClearPendingException();
+            stopped = true;
+        }
+    }
+    
+    void OnOK() override {
+        Napi::Env env = Env();
+        
+        if (!pairsError.IsEmpty()) {
+            deferred.Reject(pairsError.Value());
+            return;
+        }
+        if (!thresholded) {
+            deferred.Resolve(output.Value());
+            return;
+        }
+        if (!onPairs.IsEmpty()) {
+            deferred.Resolve(env.Undefined());
+            return;
+        }
+        
+        Napi::Object result = Napi::Object::New(env);
+        result.Set("i", PairArray<Napi::Int32Array>(env, pairs.data(), pairs.size(), &vecbox_sim_pair::i));
+        result.Set("j", PairArray<Napi::Int32Array>(env, pairs.data(), pairs.size(), &vecbox_sim_pair::j));
+        result.Set("score", PairArray<Napi::Float32Array>(env, pairs.data(), pairs.size(), &vecbox_sim_pair::score));
+        deferred.Resolve(result);
+    }
+    
+    void OnError(const Napi::Error& error) override {
+        deferred.Reject(pairsError.IsEmpty() ? error.Value() : pairsError.Value());
+    }
+    
+private:
+    // one field of every pair as a typed array
+    template <typename A, typename T>
+    static A PairArray(Napi::Env env, const vecbox_sim_pair* pairs, size_t n, T vecbox_sim_pair::* field) {
+        A array = A::New(env, n);
+        for (size_t k = 0; k < n; k++) {
+            array[k] = pairs[k].*field;
+        }
+        return array;
+    }
+    
+    Napi::Promise::Deferred deferred;
+    vecbox_sim_params params;
+    
+    Napi::ObjectReference inputA;
+    Napi::ObjectReference inputB;
+    vecbox_sim_rows a;
+    vecbox_sim_rows b;
+    bool self = true;
+    
+    Napi::Reference<Napi::Float32Array> output;
+    float* out = nullptr;
+    
+    bool thresholded = false;
+    float threshold = 0.0f;
+    Napi::FunctionReference onPairs;
+    std::vector<vecbox_sim_pair> pairs;
+    
+    std::atomic<bool> stopped{false}; // onPairs threw
+    Napi::Error pairsError;
+};
+
+// All-pairs similarity: (a, b | null, options) -> Promise with options
+// { dimensions, normalize?, threshold?, blockRows?, threads?, onPairs? }
+// Without threshold resolves to a Float32Array [rowsA * rowsB]; with threshold resolves to
+// { i: Int32Array, j: Int32Array, score: Float32Array }, or passes each block of pairs to onPairs
+// and resolves once the last block has been handed over
+Napi::Value SimilarityMatrix(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 3 || !info[2].IsObject()) {
+        throw throwNapiError(env, "Expected 3 arguments: a, b, options");
+    }
+    
+    Napi::Object options = info[2].As<Napi::Object>();
+    int32_t dimensions = options.Get("dimensions").ToNumber().Int32Value();
+    
+    vecbox_sim_rows a = ReadSimilarityRows(env, info[0], dimensions);
+    vecbox_sim_rows b;
+    bool self = info[1].IsNull() || info[1].IsUndefined();
+    if (!self) {
+        b = ReadSimilarityRows(env, info[1], dimensions);
+    }
+    
+    vecbox_sim_params params;
+    if (options.Has("normalize")) {
+        params.normalize = options.Get("normalize").ToBoolean().Value();
+    }
+    if (options.Has("blockRows")) {
+        params.block_rows = options.Get("blockRows").ToNumber().Int32Value();
+    }
+    if (options.Has("threads")) {
+        params.n_threads = options.Get("threads").ToNumber().Int32Value();
+    }
+    
+    SimilarityWorker* worker = new SimilarityWorker(env, params);
+    worker->SetInputs(info[0], a, info[1], self ? nullptr : &b);
+    
+    if (options.Has("threshold") && !options.Get("threshold").IsUndefined()) {
+        worker->SetThreshold(options.Get("threshold").ToNumber().FloatValue(), options.Get("onPairs"));
+    } else {
+        int64_t cols = self ? a.n_rows : b.n_rows;
+        worker->SetOutput(Napi::Float32Array::New(env, (size_t) (a.n_rows * cols)));
+    }
+    
+    worker->Queue();
+    return worker->Promise();
+}
+
+// Clusters on the libuv pool; the input array is kept alive (or the file mapped) until it finishes
+class KmeansWorker : public Napi::AsyncWorker {
+public:
+    KmeansWorker(Napi::Env env, const vecbox_kmeans_params& params, int32_t dimensions)
+        : Napi::AsyncWorker(env), deferred(Napi::Promise::Deferred::New(env)), params(params), dimensions(dimensions) {}
+    
+    Napi::Promise Promise() { return deferred.Promise(); }
+    
+    void SetRows(Napi::Float32Array array) {
+        input = Napi::Persistent(array);
+        data = array.Data();
+        rows = (int64_t) (array.ElementLength() / dimensions);
+    }
+    
+    void SetPath(const std::string& value) {
+        path = value;
+    }
+    
+    void Execute() override {
+        try {
+            if (!path.empty()) {
+                vecbox_mapped_rows mapped(path, dimensions);
+                result = vecbox_kmeans(mapped.data(), mapped.n_rows(), dimensions, params);
+            } else {
+                result = vecbox_kmeans(data, rows, dimensions, params);
+            }
+        } catch (const std::exception& e) {
+            SetError(e.what());
+        }
+    }
+    
+    void OnOK() override {
+        Napi::Env env = Env();
+        
+        Napi::Float32Array centroids = Napi::Float32Array::New(env, result.centroids.size());
+        std::memcpy(centroids.Data(), result.centroids.data(), result.centroids.size() * sizeof(float));
+        Napi::Int32Array labels = Napi::Int32Array::New(env, result.labels.size());
+        std::memcpy(labels.Data(), result.labels.data(), result.labels.size() * sizeof(int32_t));
+        
+        Napi::Object out = Napi::Object::New(env);
+        out.Set("centroids", centroids);
+        out.Set("labels", labels);
+        out.Set("inertia", Napi::Number::New(env, result.inertia));
+        out.Set("iterations", Napi::Number::New(env, result.n_iter));
+        deferred.Resolve(out);
+    }
+    
+    void OnError(const Napi::Error& error) override {
+        deferred.Reject(error.Value());
+    }
+    
+private:
+    Napi::Promise::Deferred deferred;
+    vecbox_kmeans_params params;
+    int32_t dimensions;
+    
+    Napi::Reference<Napi::Float32Array> input;
+    const float* data = nullptr;
+    int64_t rows = 0;
+    std::string path;
+    
+    vecbox_kmeans_result result;
+};
+
+// k-means: (data: Float32Array | path of packed float32 rows, options) -> Promise
+// options: { k, dimensions, maxIter?, tol?, batchSize?, initSample?, spherical?, threads?, seed? }
+Napi::Value Kmeans(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[1].IsObject()) {
+        throw throwNapiError(env, "Expected 2 arguments: data, options");
+    }
+    
+    Napi::Object options = info[1].As<Napi::Object>();
+    int32_t dimensions = options.Get("dimensions").ToNumber().Int32Value();
+    if (dimensions <= 0) {
+        throw throwNapiError(env, "dimensions must be positive");
+    }
+    
+    vecbox_kmeans_params params;
+    params.k = options.Get("k").ToNumber().Int32Value();
+    if (options.Has("maxIter")) {
+        params.max_iter = options.Get("maxIter").ToNumber().Int32Value();
+    }
+    if (options.Has("tol")) {
+        params.tol = options.Get("tol").ToNumber().DoubleValue();
+    }
+    if (options.Has("batchSize")) {
+        params.batch_size = options.Get("batchSize").ToNumber().Int32Value();
+    }
+    if (options.Has("initSample")) {
+        params.init_sample = options.Get("initSample").ToNumber().Int32Value();
+    }
+    if (options.Has("spherical")) {
+        params.spherical = options.Get("spherical").ToBoolean().Value();
+    }
+    if (options.Has("threads")) {
+        params.n_threads = options.Get("threads").ToNumber().Int32Value();
+    }
+    if (options.Has("seed")) {
+        params.seed = (uint64_t) options.Get("seed").ToNumber().Int64Value();
+    }
+    
+    KmeansWorker* worker = new KmeansWorker(env, params, dimensions);
+    if (info[0].IsString()) {
+        worker->SetPath(info[0].As<Napi::String>().Utf8Value());
+    } else if (info[0].IsTypedArray() && info[0].As<Napi::TypedArray>().TypedArrayType() == napi_float32_array) {
+        Napi::Float32Array array = info[0].As<Napi::Float32Array>();
+        if (array.ElementLength() % dimensions != 0) {
+            delete worker;
+            throw throwNapiError(env, "data length is not a multiple of dimensions");
+        }
+        worker->SetRows(array);
+    } else {
+        delete worker;
+        throw throwNapiError(env, "data must be a Float32Array or a file path");
+    }
+    
+    worker->Queue();
+    return worker->Promise();
+}
+
+// Near-duplicate index for ingestion pipelines, independent of any model: add(texts) reports
+// which texts repeat an earlier one, so their embedding calls can be skipped
+Napi::Value DedupCreate(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    vecbox_dedup_params params;
+    if (info.Length() > 0 && info[0].IsObject()) {
+        params = ReadDedupParams(info[0].As<Napi::Object>());
+    }
+    
+    try {
+        return Napi::External<vecbox_dedup_index>::New(env, new vecbox_dedup_index(params));
+    } catch (const std::exception& e) {
+        throw throwNapiError(env, e.what());
+    }
+}
+
+Napi::Value DedupDestroy(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsExternal()) {
+        throw throwNapiError(env, "Expected 1 argument: dedupPtr");
+    }
+    delete info[0].As<Napi::External<vecbox_dedup_index>>().Data();
+    
+    return env.Null();
+}
+
+// (dedupPtr, texts) -> { duplicateOf: Int32Array, jaccard: Float32Array }
+// duplicateOf is the id of the earlier text (ids count every text added, from 0), or -1 for a
+// new text, which is indexed so later texts can match it, or for a text without words
+Napi::Value DedupAdd(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsExternal() || !info[1].IsArray()) {
+        throw throwNapiError(env, "Expected 2 arguments: dedupPtr, texts");
+    }
+    
+    vecbox_dedup_index* index = info[0].As<Napi::External<vecbox_dedup_index>>().Data();
+    Napi::Array texts = info[1].As<Napi::Array>();
+    
+    Napi::Int32Array duplicateOf = Napi::Int32Array::New(env, texts.Length());
+    Napi::Float32Array jaccard = Napi::Float32Array::New(env, texts.Length());
+    for (uint32_t i = 0; i < texts.Length(); i++) {
+        Napi::Value text = texts.Get(i);
+        if (!text.IsString()) {
+            throw throwNapiError(env, "texts must be strings");
+        }
+        vecbox_dedup_match match = index->add(text.As<Napi::String>().Utf8Value());
+        duplicateOf[i] = (int32_t) match.id;
+        jaccard[i] = match.jaccard;
+        if (match.id >= 0) {
+            vecbox_metrics_add(VECBOX_COUNTER_NEAR_DUPLICATES);
+        }
+    }
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("duplicateOf", duplicateOf);
+    result.Set("jaccard", jaccard);
+    return result;
+}
+
+// Maximal marginal relevance: (queries: Float32Array [n * dimensions], rows: Float32Array,
+// ids: null | Int32Array[] with one list of candidate rows per query, options) with options
+// { dimensions, k, lambda?, threads? } -> [{ ids: Int32Array, scores: Float32Array }] per query
+// Candidates are read in place from rows, so search hits need no gathering into new arrays
+Napi::Value Mmr(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 4 || !info[0].IsTypedArray() || !info[1].IsTypedArray() || !info[3].IsObject()) {
+        throw throwNapiError(env, "Expected 4 arguments: queries, rows, ids, options");
+    }
+    
+    Napi::TypedArray queries = info[0].As<Napi::TypedArray>();
+    Napi::TypedArray rows = info[1].As<Napi::TypedArray>();
+    if (queries.TypedArrayType() != napi_float32_array || rows.TypedArrayType() != napi_float32_array) {
+        throw throwNapiError(env, "queries and rows must be Float32Arrays");
+    }
+    
+    Napi::Object options = info[3].As<Napi::Object>();
+    int32_t dimensions = options.Get("dimensions").ToNumber().Int32Value();
+    if (dimensions <= 0 || queries.ElementLength() % dimensions != 0 || rows.ElementLength() % dimensions != 0) {
+        throw throwNapiError(env, "query and row lengths must be multiples of dimensions");
+    }
+    
+    vecbox_mmr_params params;
+    params.k = options.Get("k").ToNumber().Int32Value();
+    if (options.Has("lambda")) {
+        params.lambda = options.Get("lambda").ToNumber().FloatValue();
+    }
+    if (options.Has("threads")) {
+        params.n_threads = options.Get("threads").ToNumber().Int32Value();
+    }
+    
+    const float* queryData = queries.As<Napi::Float32Array>().Data();
+    int64_t nQueries = (int64_t) (queries.ElementLength() / dimensions);
+    
+    vecbox_mmr_candidates all;
+    all.rows = rows.As<Napi::Float32Array>().Data();
+    all.n_rows = (int64_t) (rows.ElementLength() / dimensions);
+    
+    std::vector<vecbox_mmr_candidates> cand(nQueries, all);
+    if (!info[2].IsNull() && !info[2].IsUndefined()) {
+        if (!info[2].IsArray() || info[2].As<Napi::Array>().Length() != (uint32_t) nQueries) {
+            throw throwNapiError(env, "ids must be an array with one Int32Array per query");
+        }
+        Napi::Array ids = info[2].As<Napi::Array>();
+        for (int64_t q = 0; q < nQueries; q++) {
+            Napi::Value list = ids.Get((uint32_t) q);
+            if (!list.IsTypedArray() || list.As<Napi::TypedArray>().TypedArrayType() != napi_int32_array) {
+                throw throwNapiError(env, "ids must be an array with one Int32Array per query");
+            }
+            Napi::Int32Array typed = list.As<Napi::Int32Array>();
+            cand[q].ids = typed.Data();
+            cand[q].n_ids = (int64_t) typed.ElementLength();
+        }
+    }
+    
+    std::vector<vecbox_mmr_result> results;
+    try {
+        results = vecbox_mmr_batch(queryData, nQueries, dimensions, cand.data(), params);
+    } catch (const std::exception& e) {
+        throw throwNapiError(env, e.what());
+    }
+    
+    Napi::Array out = Napi::Array::New(env, results.size());
+    for (size_t q = 0; q < results.size(); q++) {
+        Napi::Int32Array ids = Napi::Int32Array::New(env, results[q].ids.size());
+        Napi::Float32Array scores = Napi::Float32Array::New(env, results[q].scores.size());
+        std::copy(results[q].ids.begin(), results[q].ids.end(), ids.Data());
+        std::copy(results[q].scores.begin(), results[q].scores.end(), scores.Data());
+        
+        Napi::Object result = Napi::Object::New(env);
+        result.Set("ids", ids);
+        result.Set("scores", scores);
+        out.Set((uint32_t) q, result);
+    }
+    return out;
+}
+
+// Fit a PCA projection on sample embeddings: (samples: Float32Array, options) with options
+// { dimensions, components, oversample?, powerIters?, seed?, path? } -> { components, mean, variance }
+// The projection is written to `path` (e.g. the model's .vbproj sidecar) when given
+Napi::Value FitPca(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[1].IsObject()) {
+        throw throwNapiError(env, "Expected 2 arguments: samples, options");
+    }
+    if (!info[0].IsTypedArray() || info[0].As<Napi::TypedArray>().TypedArrayType() != napi_float32_array) {
+        throw throwNapiError(env, "samples must be a Float32Array");
+    }
+    
+    Napi::Float32Array samples = info[0].As<Napi::Float32Array>();
+    Napi::Object options = info[1].As<Napi::Object>();
+    int32_t dimensions = options.Get("dimensions").ToNumber().Int32Value();
+    int32_t components = options.Get("components").ToNumber().Int32Value();
+    if (dimensions <= 0 || samples.ElementLength() % dimensions != 0) {
+        throw throwNapiError(env, "samples length is not a multiple of dimensions");
+    }
+    
+    vecbox_pca_params params;
+    if (options.Has("oversample")) {
+        params.oversample = options.Get("oversample").ToNumber().Int32Value();
+    }
+    if (options.Has("powerIters")) {
+        params.power_iters = options.Get("powerIters").ToNumber().Int32Value();
+    }
+    if (options.Has("seed")) {
+        params.seed = (uint64_t) options.Get("seed").ToNumber().Int64Value();
+    }
+    
+    std::shared_ptr<vecbox_projection> proj;
+    try {
+        proj = vecbox_projection_fit_pca(samples.Data(), (int64_t) (samples.ElementLength() / dimensions),
+                                         dimensions, components, params);
+        if (options.Has("path") && options.Get("path").IsString()) {
+            vecbox_projection_save(*proj, options.Get("path").As<Napi::String>().Utf8Value());
+        }
+    } catch (const std::exception& e) {
+        throw throwNapiError(env, e.what());
+    }
+    
+    Napi::Float32Array outComponents = Napi::Float32Array::New(env, proj->components.size());
+    std::memcpy(outComponents.Data(), proj->components.data(), proj->components.size() * sizeof(float));
+    Napi::Float32Array mean = Napi::Float32Array::New(env, proj->mean.size());
+    std::memcpy(mean.Data(), proj->mean.data(), proj->mean.size() * sizeof(float));
+    Napi::Float32Array variance = Napi::Float32Array::New(env, proj->variance.size());
+    std::memcpy(variance.Data(), proj->variance.data(), proj->variance.size() * sizeof(float));
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("components", outComponents);
+    result.Set("mean", mean);
+    result.Set("variance", variance);
+    return result;
+}
+
+// Sidecar path the PCA projection of a model is stored at
+Napi::Value ProjectionSidecar(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString()) {
+        throw throwNapiError(env, "Expected 1 argument: modelPath");
+    }
+    
+    return Napi::String::New(env, vecbox_projection_sidecar(info[0].As<Napi::String>().Utf8Value()));
+}
+
+// Engine metrics aggregated over all threads, as a plain object
+Napi::Value GetMetrics(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    const vecbox_metrics_snapshot snapshot = vecbox_metrics_collect();
+    
+    Napi::Object counters = Napi::Object::New(env);
+    for (int i = 0; i < VECBOX_COUNTER_COUNT; ++i) {
+        const vecbox_counter counter = (vecbox_counter) i;
+        const bool us = counter == VECBOX_COUNTER_WORKER_BUSY_US || counter == VECBOX_COUNTER_WORKER_IDLE_US;
+        counters.Set(vecbox_counter_name(counter), Napi::Number::New(env, us ? snapshot.counters[i] * 1e-6 : (double) snapshot.counters[i]));
+    }
+    
+    Napi::Object gauges = Napi::Object::New(env);
+    for (int i = 0; i < VECBOX_GAUGE_COUNT; ++i) {
+        gauges.Set(vecbox_gauge_name((vecbox_gauge) i), Napi::Number::New(env, (double) snapshot.gauges[i]));
+    }
+    gauges.Set("worker_utilization", Napi::Number::New(env, snapshot.worker_utilization()));
+    gauges.Set("resident_memory_bytes", Napi::Number::New(env, (double) snapshot.rss_bytes));
+    gauges.Set("uptime_seconds", Napi::Number::New(env, snapshot.uptime_s));
+    
+    Napi::Object histograms = Napi::Object::New(env);
+    for (int h = 0; h < VECBOX_HIST_COUNT; ++h) {
+        const vecbox_histogram_snapshot& hs = snapshot.hists[h];
+        
+        Napi::Array buckets = Napi::Array::New(env, hs.bounds.size() + 1);
+        for (size_t b = 0; b <= hs.bounds.size(); ++b) {
+            Napi::Object bucket = Napi::Object::New(env);
+            bucket.Set("le", Napi::Number::New(env, b < hs.bounds.size() ? hs.bounds[b] : INFINITY));
+            bucket.Set("count", Napi::Number::New(env, (double) hs.counts[b]));
+            buckets.Set(b, bucket);
+        }
+        
+        Napi::Object hist = Napi::Object::New(env);
+        hist.Set("buckets", buckets);
+        hist.Set("count", Napi::Number::New(env, (double) hs.count));
+        hist.Set("sum", Napi::Number::New(env, hs.sum));
+        histograms.Set(vecbox_hist_name((vecbox_hist) h), hist);
+    }
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("counters", counters);
+    result.Set("gauges", gauges);
+    result.Set("histograms", histograms);
+    return result;
+}
+
+// Engine metrics in Prometheus text exposition format
+Napi::Value GetMetricsText(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    std::string text;
+    vecbox_metrics_write_prometheus(text, vecbox_metrics_collect());
+    return Napi::String::New(env, text);
+}
+
+// Model registry: several models under one memory budget, loaded in the background
+struct RegistryData {
+    std::unique_ptr<vecbox_model_registry> registry;
+    
+    // settles acquires on the JS thread; one per registry, ref'd only while acquires are
+    // pending so an idle registry does not keep the process alive
+    Napi::ThreadSafeFunction tsfn;
+    std::shared_ptr<size_t> pendingAcquires = std::make_shared<size_t>(0);
+};
+
+Napi::Value RegistryCreate(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    vecbox_registry_params params;
+    if (info.Length() > 0 && info[0].IsObject()) {
+        Napi::Object options = info[0].As<Napi::Object>();
+        if (options.Has("budgetBytes")) {
+            Napi::Value budget = options.Get("budgetBytes");
+            if (!budget.IsNumber() || budget.As<Napi::Number>().DoubleValue() < 0) {
+                throw Napi::TypeError::New(env, "budgetBytes must be a non-negative number");
+            }
+            params.budget_bytes = (size_t) budget.As<Napi::Number>().Int64Value();
+        }
+    }
+    
+    RegistryData* registryData = new RegistryData();
+    registryData->registry.reset(new vecbox_model_registry(params));
+    registryData->tsfn = Napi::ThreadSafeFunction::New(
+        env, Napi::Function::New(env, [](const Napi::CallbackInfo&) {}), "registryAcquire", 0, 1);
+    registryData->tsfn.Unref(env);
+    
+    return Napi::External<RegistryData>::New(env, registryData);
+}
+
+static RegistryData* GetRegistry(const Napi::CallbackInfo& info, size_t nargs, const char* usage) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < nargs || !info[0].IsExternal()) {
+        throw throwNapiError(env, usage);
+    }
+    for (size_t i = 1; i < nargs; i++) {
+        if (!info[i].IsString()) {
+            throw throwNapiError(env, usage);
+        }
+    }
+    
+    return info[0].As<Napi::External<RegistryData>>().Data();
+}
+
+Napi::Value RegistryDestroy(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    RegistryData* registryData = GetRegistry(info, 1, "Expected 1 argument: registryPtr");
+    // acquires settled while the loader stops are still delivered before the tsfn goes away
+    registryData->registry.reset();
+    registryData->tsfn.Release();
+    delete registryData;
+    
+    return env.Null();
+}
+
+Napi::Value RegistryAdd(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    vecbox_model_registry* registry = GetRegistry(info, 3, "Expected 3 arguments: registryPtr, name, modelPath")->registry.get();
+    std::string name = info[1].As<Napi::String>().Utf8Value();
+    std::string path = info[2].As<Napi::String>().Utf8Value();
+    bool pinned = info.Length() > 3 && info[3].ToBoolean().Value();
+    
+    try {
+        registry->add(name, path, pinned);
+    } catch (const std::exception& e) {
+        throw throwNapiError(env, e.what());
+    }
+    
+    return env.Null();
+}
+
+Napi::Value RegistryRemove(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    vecbox_model_registry* registry = GetRegistry(info, 2, "Expected 2 arguments: registryPtr, name")->registry.get();
+    registry->remove(info[1].As<Napi::String>().Utf8Value());
+    
+    return env.Null();
+}
+
+Napi::Value RegistryPin(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    vecbox_model_registry* registry = GetRegistry(info, 2, "Expected 3 arguments: registryPtr, name, pinned")->registry.get();
+    bool pinned = info.Length() > 2 && info[2].ToBoolean().Value();
+    
+    try {
+        registry->pin(info[1].As<Napi::String>().Utf8Value(), pinned);
+    } catch (const std::exception& e) {
+        throw throwNapiError(env, e.what());
+    }
+    
+    return env.Null();
+}
+
+// Resolves with a model handle usable with getEmbedding once the model is loaded
+Napi::Value RegistryAcquire(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    RegistryData* registryData = GetRegistry(info, 2, "Expected 2 arguments: registryPtr, name");
+    std::string name = info[1].As<Napi::String>().Utf8Value();
+    
+    Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+    
+    if ((*registryData->pendingAcquires)++ == 0) {
+        registryData->tsfn.Ref(env);
+    }
+    
+    // the load may finish on the registry's loader thread; hop back to the JS thread to settle
+    Napi::ThreadSafeFunction tsfn = registryData->tsfn;
+    std::shared_ptr<size_t> pending = registryData->pendingAcquires;
+    registryData->registry->acquire(name, [deferred, tsfn, pending](std::shared_ptr<vecbox_model> model, const std::string& error) mutable {
+        tsfn.BlockingCall([deferred, model, error, tsfn, pending](Napi::Env env, Napi::Function) mutable {
+            if (--*pending == 0) {
+                tsfn.Unref(env);
+            }
+            if (!error.empty()) {
+                deferred.Reject(Napi::Error::New(env, error).Value());
+                return;
+            }
+            // the handle holds the model, and its registry charge, until closed or collected
+            ModelData* modelData = new ModelData();
+            modelData->model = model;
+            modelData->n_embd = model->n_embd;
+            modelData->gcOwned = true;
+            deferred.Resolve(Napi::External<ModelData>::New(env, modelData, [](Napi::Env, ModelData* modelData) {
+                if (modelData->pendingSwaps > 0) {
+                    // the swap in flight frees it when it finishes
+                    modelData->gcOwned = false;
+                    modelData->destroyed = true;
+                } else {
+                    delete modelData;
+                }
+            }));
+        });
+    });
+    
+    return deferred.Promise();
+}
+
+Napi::Value RegistryList(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    vecbox_model_registry* registry = GetRegistry(info, 1, "Expected 1 argument: registryPtr")->registry.get();
+    static const char* states[] = { "unloaded", "loading", "loaded" };
+    
+    std::vector<vecbox_registry_entry_info> entries = registry->list();
+    Napi::Array result = Napi::Array::New(env, entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        Napi::Object entry = Napi::Object::New(env);
+        entry.Set("name", Napi::String::New(env, entries[i].name));
+        entry.Set("path", Napi::String::New(env, entries[i].path));
+        entry.Set("state", Napi::String::New(env, states[entries[i].state]));
+        entry.Set("pinned", Napi::Boolean::New(env, entries[i].pinned));
+        entry.Set("bytes", Napi::Number::New(env, (double) entries[i].bytes));
+        result.Set(i, entry);
+    }
+    
+    return result;
+}
+
+Napi::Value RegistryUsedBytes(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    vecbox_model_registry* registry = GetRegistry(info, 1, "Expected 1 argument: registryPtr")->registry.get();
+    return Napi::Number::New(env, (double) registry->used_bytes());
+}
+
+#ifdef __linux__
+// Shared-memory transport: the addon can host a sidecar endpoint for a loaded model,
+// or connect to one served by another process (e.g. vecbox_server --shm)
+struct ShmServerData {
+    std::shared_ptr<vecbox_batcher> batcher;
+    std::unique_ptr<vecbox_shm_server> server;
+};
+
+struct ShmClientData {
+    std::shared_ptr<vecbox_shm_client> client;
+};
+
+// Serve a loaded model over the shared-memory transport
+Napi::Value ShmServe(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2) {
+        throw throwNapiError(env, "Expected 2 arguments: modelPtr, socketPath");
+    }
+    
+    if (!info[0].IsExternal()) {
+        throw throwNapiError(env, "modelPtr must be external pointer");
+    }
+    
+    if (!info[1].IsString()) {
+        throw throwNapiError(env, "socketPath must be a string");
+    }
+    
+    ModelData* modelData = info[0].As<Napi::External<ModelData>>().Data();
+    std::string socketPath = info[1].As<Napi::String>().Utf8Value();
+    
+    vecbox_batcher_params batchParams;
+    vecbox_shm_server_params shmParams;
+    if (info.Length() > 2 && info[2].IsObject()) {
+        Napi::Object options = info[2].As<Napi::Object>();
+        if (options.Has("maxBatch")) {
+            batchParams.max_batch = options.Get("maxBatch").As<Napi::Number>().Int32Value();
+        }
+        if (options.Has("maxWaitUs")) {
+            batchParams.max_wait_us = options.Get("maxWaitUs").As<Napi::Number>().Int32Value();
+        }
+        if (options.Has("maxBulkBatch")) {
+            batchParams.max_bulk_batch = options.Get("maxBulkBatch").As<Napi::Number>().Int32Value();
+        }
+        if (options.Has("ringCapacity")) {
+            shmParams.ring_capacity = options.Get("ringCapacity").As<Napi::Number>().Uint32Value();
+        }
+    }
+    
+    ShmServerData* serverData = new ShmServerData();
+    try {
+        serverData->batcher = std::make_shared<vecbox_batcher>(modelData->model, batchParams);
+        serverData->batcher->set_shadow(modelData->shadow);
+        serverData->server.reset(new vecbox_shm_server(*serverData->batcher, socketPath, shmParams));
+    } catch (const std::exception& e) {
+        delete serverData;
+        throw throwNapiError(env, e.what());
+    }
+    
+    // swaps of this model reach the server too
+    auto& batchers = modelData->batchers;
+    batchers.erase(std::remove_if(batchers.begin(), batchers.end(),
+        [](const std::weak_ptr<vecbox_batcher>& weak) { return weak.expired(); }), batchers.end());
+    batchers.push_back(serverData->batcher);
+    
+    return Napi::External<ShmServerData>::New(env, serverData);
+}
+
+// Stop serving; requests already queued are finished first
+Napi::Value ShmStop(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsExternal()) {
+        throw throwNapiError(env, "Expected 1 argument: serverPtr");
+    }
+    
+    ShmServerData* serverData = info[0].As<Napi::External<ShmServerData>>().Data();
+    if (serverData) {
+        serverData->server.reset();
+        delete serverData;
+    }
+    
+    return env.Null();
+}
+
+// Connect to a shared-memory embedding server
+Napi::Value ShmConnect(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString()) {
+        throw throwNapiError(env, "Expected 1 argument: socketPath");
+    }
+    
+    std::string socketPath = info[0].As<Napi::String>().Utf8Value();
+    
+    ShmClientData* clientData = new ShmClientData();
+    try {
+        clientData->client = std::make_shared<vecbox_shm_client>(socketPath);
+    } catch (const std::exception& e) {
+        delete clientData;
+        throw throwNapiError(env, e.what());
+    }
+    
+    return Napi::External<ShmClientData>::New(env, clientData);
+}
+
+// Waits for the server on the libuv pool; the client is held so closing the handle meanwhile is safe
+class ShmEmbedWorker : public Napi::AsyncWorker {
+public:
+    ShmEmbedWorker(Napi::Env env, std::shared_ptr<vecbox_shm_client> client, std::vector<std::string> texts,
+                   bool normalize, bool quantized, bool bulk)
+        : Napi::AsyncWorker(env), deferred(Napi::Promise::Deferred::New(env)), client(std::move(client)),
+          texts(std::move(texts)), normalize(normalize), quantized(quantized), bulk(bulk) {}
+    
+    Napi::Promise Promise() { return deferred.Promise(); }
+    
+    void Execute() override {
+        try {
+            result = client->embed(texts, normalize, quantized, bulk);
+        } catch (const std::exception& e) {
+            SetError(e.what());
+        }
+    }
+    
+    void OnOK() override {
+        Napi::Env env = Env();
+        
+        Napi::Array embeddings = Napi::Array::New(env, result.n);
+        for (int32_t i = 0; i < result.n; i++) {
+            Napi::Float32Array row = Napi::Float32Array::New(env, result.n_embd);
+            memcpy(row.Data(), result.embd.data() + (size_t) i * result.n_embd, result.n_embd * sizeof(float));
+            embeddings.Set(i, row);
+        }
+        deferred.Resolve(embeddings);
+    }
+    
+    void OnError(const Napi::Error& error) override {
+        deferred.Reject(error.Value());
+    }
+    
+private:
+    Napi::Promise::Deferred deferred;
+    std::shared_ptr<vecbox_shm_client> client;
+    std::vector<std::string> texts;
+    bool normalize;
+    bool quantized;
+    bool bulk;
+    vecbox_shm_result result;
+};
+
+// Embed texts through a shared-memory connection: (clientPtr, texts, normalize?, quantized?, bulk?)
+// -> Promise of one Float32Array per text
+Napi::Value ShmEmbed(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2) {
+        throw throwNapiError(env, "Expected 2 arguments: clientPtr, texts");
+    }
+    
+    if (!info[0].IsExternal()) {
+        throw throwNapiError(env, "clientPtr must be external pointer");
+    }
+    
+    if (!info[1].IsArray()) {
+        throw throwNapiError(env, "texts must be an array of strings");
+    }
+    
+    ShmClientData* clientData = info[0].As<Napi::External<ShmClientData>>().Data();
+    Napi::Array textArray = info[1].As<Napi::Array>();
+    bool normalize = info.Length() > 2 && info[2].ToBoolean().Value();
+    bool quantized = info.Length() > 3 && info[3].ToBoolean().Value();
+    bool bulk = info.Length() > 4 && info[4].ToBoolean().Value();
+    
+    std::vector<std::string> texts;
+    texts.reserve(textArray.Length());
+    for (uint32_t i = 0; i < textArray.Length(); i++) {
+        Napi::Value value = textArray.Get(i);
+        if (!value.IsString()) {
+            throw throwNapiError(env, "texts must be an array of strings");
+        }
+        texts.push_back(value.As<Napi::String>().Utf8Value());
+    }
+    
+    if (!clientData->client) {
+        throw throwNapiError(env, "Shared-memory client is closed");
+    }
+    
+    ShmEmbedWorker* worker = new ShmEmbedWorker(env, clientData->client, std::move(texts), normalize, quantized, bulk);
+    worker->Queue();
+    return worker->Promise();
+}
+
+// Close a shared-memory connection
+Napi::Value ShmClose(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsExternal()) {
+        throw throwNapiError(env, "Expected 1 argument: clientPtr");
+    }
+    
+    // an embed still waiting on the server keeps its own reference
+    delete info[0].As<Napi::External<ShmClientData>>().Data();
+    
     return env.Null();
 }
+#endif
 
 // Module initialization
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
@@ -104,6 +1612,72 @@ Napi::Object Init(Napi::Env env, Napi::Object exports) {
                 Napi::Function::New(env, GetEmbedding));
     exports.Set(Napi::String::New(env, "destroyModel"), 
                 Napi::Function::New(env, DestroyModel));
+    exports.Set(Napi::String::New(env, "swapModel"), 
+                Napi::Function::New(env, SwapModel));
+    exports.Set(Napi::String::New(env, "promoteShadow"), 
+                Napi::Function::New(env, PromoteShadow));
+    exports.Set(Napi::String::New(env, "dropShadow"), 
+                Napi::Function::New(env, DropShadow));
+    exports.Set(Napi::String::New(env, "shadowStats"), 
+                Napi::Function::New(env, ShadowStats));
+    exports.Set(Napi::String::New(env, "warmup"), 
+                Napi::Function::New(env, Warmup));
+    exports.Set(Napi::String::New(env, "tokenize"), 
+                Napi::Function::New(env, Tokenize));
+    exports.Set(Napi::String::New(env, "decodeBase64F32"), 
+                Napi::Function::New(env, DecodeBase64F32));
+    exports.Set(Napi::String::New(env, "writeEmbeddingsJson"), 
+                Napi::Function::New(env, WriteEmbeddingsJson));
+    exports.Set(Napi::String::New(env, "embeddingsJsonMaxSize"), 
+                Napi::Function::New(env, EmbeddingsJsonMaxSize));
+    exports.Set(Napi::String::New(env, "similarityMatrix"), 
+                Napi::Function::New(env, SimilarityMatrix));
+    exports.Set(Napi::String::New(env, "fitPca"), 
+                Napi::Function::New(env, FitPca));
+    exports.Set(Napi::String::New(env, "projectionSidecar"), 
+                Napi::Function::New(env, ProjectionSidecar));
+    exports.Set(Napi::String::New(env, "kmeans"), 
+                Napi::Function::New(env, Kmeans));
+    exports.Set(Napi::String::New(env, "dedupCreate"), 
+                Napi::Function::New(env, DedupCreate));
+    exports.Set(Napi::String::New(env, "dedupDestroy"), 
+                Napi::Function::New(env, DedupDestroy));
+    exports.Set(Napi::String::New(env, "dedupAdd"), 
+                Napi::Function::New(env, DedupAdd));
+    exports.Set(Napi::String::New(env, "mmr"), 
+                Napi::Function::New(env, Mmr));
+    exports.Set(Napi::String::New(env, "getMetrics"), 
+                Napi::Function::New(env, GetMetrics));
+    exports.Set(Napi::String::New(env, "getMetricsText"), 
+                Napi::Function::New(env, GetMetricsText));
+    exports.Set(Napi::String::New(env, "registryCreate"), 
+                Napi::Function::New(env, RegistryCreate));
+    exports.Set(Napi::String::New(env, "registryDestroy"), 
+                Napi::Function::New(env, RegistryDestroy));
+    exports.Set(Napi::String::New(env, "registryAdd"), 
+                Napi::Function::New(env, RegistryAdd));
+    exports.Set(Napi::String::New(env, "registryRemove"), 
+                Napi::Function::New(env, RegistryRemove));
+    exports.Set(Napi::String::New(env, "registryPin"), 
+                Napi::Function::New(env, RegistryPin));
+    exports.Set(Napi::String::New(env, "registryAcquire"), 
+                Napi::Function::New(env, RegistryAcquire));
+    exports.Set(Napi::String::New(env, "registryList"), 
+                Napi::Function::New(env, RegistryList));
+    exports.Set(Napi::String::New(env, "registryUsedBytes"), 
+                Napi::Function::New(env, RegistryUsedBytes));
+#ifdef __linux__
+    exports.Set(Napi::String::New(env, "shmServe"), 
+                Napi::Function::New(env, ShmServe));
+    exports.Set(Napi::String::New(env, "shmStop"), 
+                Napi::Function::New(env, ShmStop));
+    exports.Set(Napi::String::New(env, "shmConnect"), 
+                Napi::Function::New(env, ShmConnect));
+    exports.Set(Napi::String::New(env, "shmEmbed"), 
+                Napi::Function::New(env, ShmEmbed));
+    exports.Set(Napi::String::New(env, "shmClose"), 
+                Napi::Function::New(env, ShmClose));
+#endif
     
     return exports;
 }
@@ -0,0 +1,991 @@
+// standalone embedding server
+//
+// HTTP/1.1 over TCP or a Unix domain socket, single epoll event loop, with requests from all
+// connections coalesced by the dynamic batcher. Embedding responses are chunked, or sent with a
+// Content-Length to HTTP/1.0 clients. Speaks the protocol of LlamaCppProvider's HTTP fallback:
+//
+//   POST /embeddings  {"model": "...", "input": "text" | ["a", "b"], "normalize": true}
+//                  -> {"model": "...", "dimensions": N, "embeddings": [[...], ...]}
+//                     with "encoding_format": "base64" each row is a base64 string of
+//                     little-endian float32 instead of a number array
+//                     "priority": "bulk" queues behind interactive traffic, "tenant" shares the
+//                     batcher fairly between callers of the same priority
+//   GET  /health   -> {"status": "ok"}
+//   GET  /metrics  -> Prometheus text exposition
+//
+// with --shm PATH the same batcher is also reachable over the shared-memory transport
+// (vecbox-shm.h), for co-located clients that should skip HTTP and JSON entirely
+//
+// the engine's encoder is still a placeholder: it returns a deterministic sine of the token ids
+// as 768-dimensional vectors instead of running the model's weights, see vecbox-engine.cpp
+//
+// SIGHUP reloads --model in the background and swaps it in without dropping requests, e.g. after
+// replacing the file with a new quantization
+//
+// usage: vecbox_server --model model.gguf [--host 127.0.0.1] [--port 8080] [--unix /path.sock]
+//                      [--shm /path.sock] [--max-batch 32] [--max-wait-us 2000] [--max-bulk-batch 0]
+//                      [--max-body 16777216] [--truncate N | --projection model.gguf.vbproj]
+//                      [--warmup 512]
+
+#include "vecbox-base64.h"
+#include "vecbox-engine.h"
+#include "vecbox-event.h"
+#include "vecbox-json.h"
+#include "vecbox-metrics.h"
+#include "vecbox-projection.h"
+#include "vecbox-shm.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t ID_LISTEN = 0;
+constexpr uint64_t ID_EVENT  = 1;
+constexpr uint64_t ID_SIGNAL = 2;
+constexpr uint64_t ID_FIRST  = 3;
+
+constexpr size_t MAX_HEADER_BYTES = 16*1024;
+constexpr size_t STREAM_LOW_WATER = 64*1024; // refill the output buffer when it drops below this
+constexpr size_t READ_CHUNK       = 64*1024;
+
+struct server_params {
+    std::string model;
+    std::string host = "127.0.0.1";
+    int         port = 8080;
+    std::string unix_path;
+    std::string shm_path;
+    size_t      max_body = 16*1024*1024;
+    bool        metrics  = true;
+
+    std::string projection; // PCA sidecar
+
+    int32_t warmup_seq_len = 0; // > 0: warm up for --max-batch texts of this many tokens, at start and on reload
+
+    vecbox_batcher_params batch;
+    vecbox_model_params   model_params; // also used when SIGHUP reloads
+};
+
+void warmup_model(vecbox_model & model, const server_params & params) {
+    vecbox_warmup_params warmup;
+    warmup.max_batch   = params.batch.max_batch;
+    warmup.max_seq_len = params.warmup_seq_len;
+
+    const vecbox_warmup_report r = model.warmup(warmup);
+    fprintf(stderr, "vecbox_server: warmup %d x %d tokens: prefault %.1f ms (%.1f MiB), dummy pass %.1f ms\n",
+        warmup.max_batch, warmup.max_seq_len,
+        r.t_prefault_us/1000.0, r.prefault_bytes/1048576.0,
+        r.t_dummy_pass_us/1000.0);
+}
+
+// loads --model and warms it up, logging where the cold start time goes
+std::shared_ptr<vecbox_model> start_model(const server_params & params) {
+    const int64_t t0 = vecbox_time_us();
+    auto model = vecbox_model_load(params.model, params.model_params);
+    const int64_t t1 = vecbox_time_us();
+    if (params.warmup_seq_len > 0) {
+        warmup_model(*model, params);
+    }
+    const int64_t t2 = vecbox_time_us();
+    fprintf(stderr, "vecbox_server: cold start %.1f ms: load %.1f ms, warmup %.1f ms\n",
+        (t2 - t0)/1000.0, (t1 - t0)/1000.0, (t2 - t1)/1000.0);
+    return model;
+}
+
+struct server_metrics {
+    uint64_t n_requests     = 0;
+    uint64_t n_errors       = 0;
+    uint64_t n_connections  = 0;
+};
+
+struct http_request {
+    std::string method;
+    std::string path;
+    bool        keep_alive = true;
+    bool        http10     = false; // no chunked responses
+    size_t      header_len = 0;
+    size_t      body_len   = 0;
+};
+
+struct connection {
+    int fd = -1;
+
+    std::string in;
+    std::string out;
+    size_t      out_off = 0;
+
+    bool busy        = false; // an embedding job is in flight, hold back pipelined requests
+    bool keep_alive  = true;
+    bool http10      = false; // the request in flight is HTTP/1.0: answer with Content-Length
+    bool close_after = false; // peer half-closed: finish the response in flight, then close
+
+    uint32_t events = EPOLLIN | EPOLLRDHUP;
+
+    // response body still being serialized
+    std::shared_ptr<vecbox_embd_job> stream;
+    std::string                      stream_model;
+    bool                             stream_base64 = false;
+    size_t                           stream_row = 0;
+    uint64_t                         stream_seq = 0; // matches completions to the job in flight
+};
+
+class server {
+public:
+    server(const server_params & params, vecbox_batcher & batcher)
+        : params(params), batcher(batcher), completions(std::make_shared<vecbox_completion_queue>()) {}
+
+    ~server() {
+        if (reload_thread.joinable()) {
+            reload_thread.join();
+        }
+        for (auto & it : conns) {
+            close(it.second.fd);
+        }
+        if (sfd >= 0) close(sfd);
+        if (lfd >= 0) close(lfd);
+        if (epfd >= 0) close(epfd);
+        if (!params.unix_path.empty()) {
+            unlink(params.unix_path.c_str());
+        }
+    }
+
+    void listen_and_serve();
+
+private:
+    void open_listener();
+    void add_fd(int fd, uint64_t id, uint32_t events);
+    void set_events(uint64_t id, connection & c);
+
+    // the most a connection buffers: one request of the largest allowed size
+    size_t in_limit() const { return MAX_HEADER_BYTES + params.max_body; }
+
+    void on_accept();
+    void on_readable(uint64_t id);
+    void on_writable(uint64_t id);
+    void on_completions();
+    void on_signal();
+    void close_conn(uint64_t id);
+    void reload_model();
+
+    bool parse_request(connection & c, http_request & req, int & status);
+    void process_requests(uint64_t id, connection & c);
+    void handle(uint64_t id, connection & c, const http_request & req, const char * body);
+
+    void respond(connection & c, int status, const char * content_type, const std::string & body);
+    void respond_error(connection & c, int status, const std::string & message);
+    void fill_stream(connection & c);
+    bool serialize_rows(connection & c, std::string & out);
+    std::string metrics_text() const;
+
+    server_params    params;
+    vecbox_batcher & batcher;
+    server_metrics   metrics;
+
+    std::shared_ptr<vecbox_completion_queue> completions;
+
+    int epfd = -1;
+    int lfd  = -1;
+    int sfd  = -1;
+
+    uint64_t next_id = ID_FIRST;
+    std::unordered_map<uint64_t, connection> conns;
+
+    std::thread       reload_thread;
+    std::atomic<bool> reloading{false};
+    bool              stopping = false;
+};
+
+const char * status_text(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 411: return "Length Required";
+        case 413: return "Payload Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        default:  return "Unknown";
+    }
+}
+
+bool iequals(const char * a, size_t n, const char * b) {
+    if (strlen(b) != n) {
+        return false;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (tolower((unsigned char) a[i]) != tolower((unsigned char) b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void append_chunk_header(std::string & out, size_t n) {
+    char buf[24];
+    const int len = snprintf(buf, sizeof(buf), "%zx\r\n", n);
+    out.append(buf, len);
+}
+
+void server::open_listener() {
+    if (!params.unix_path.empty()) {
+        sockaddr_un addr {};
+        if (params.unix_path.size() >= sizeof(addr.sun_path)) {
+            throw std::invalid_argument("unix socket path too long: " + params.unix_path);
+        }
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, params.unix_path.c_str(), params.unix_path.size() + 1);
+
+        lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (lfd < 0) {
+            throw std::runtime_error(std::string("socket: ") + strerror(errno));
+        }
+        unlink(params.unix_path.c_str());
+        if (bind(lfd, (const sockaddr *) &addr, sizeof(addr)) < 0) {
+            throw std::runtime_error("bind " + params.unix_path + ": " + strerror(errno));
+        }
+    } else {
+        addrinfo hints {};
+        hints.ai_family   = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags    = AI_PASSIVE;
+
+        addrinfo * res = nullptr;
+        const std::string port = std::to_string(params.port);
+        const int rc = getaddrinfo(params.host.c_str(), port.c_str(), &hints, &res);
+        if (rc != 0) {
+            throw std::runtime_error("getaddrinfo " + params.host + ": " + gai_strerror(rc));
+        }
+
+        std::string err = "no usable address";
+        for (addrinfo * ai = res; ai; ai = ai->ai_next) {
+            lfd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+            if (lfd < 0) {
+                continue;
+            }
+            const int one = 1;
+            setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (bind(lfd, ai->ai_addr, ai->ai_addrlen) == 0) {
+                break;
+            }
+            err = strerror(errno);
+            close(lfd);
+            lfd = -1;
+        }
+        freeaddrinfo(res);
+
+        if (lfd < 0) {
+            throw std::runtime_error("bind " + params.host + ":" + port + ": " + err);
+        }
+    }
+
+    if (listen(lfd, SOMAXCONN) < 0) {
+        throw std::runtime_error(std::string("listen: ") + strerror(errno));
+    }
+}
+
+void server::add_fd(int fd, uint64_t id, uint32_t events) {
+    epoll_event ev {};
+    ev.events   = events;
+    ev.data.u64 = id;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        throw std::runtime_error(std::string("epoll_ctl: ") + strerror(errno));
+    }
+}
+
+void server::set_events(uint64_t id, connection & c) {
+    uint32_t events = 0;
+    // a full input buffer stops reading until the requests in it are answered
+    if (!c.close_after && c.in.size() < in_limit()) {
+        events |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (c.out_off < c.out.size()) {
+        events |= EPOLLOUT;
+    }
+    if (events == c.events) {
+        return;
+    }
+    c.events = events;
+
+    epoll_event ev {};
+    ev.events   = events;
+    ev.data.u64 = id;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, c.fd, &ev);
+}
+
+void server::listen_and_serve() {
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        throw std::runtime_error(std::string("epoll_create1: ") + strerror(errno));
+    }
+
+    open_listener();
+    add_fd(lfd, ID_LISTEN, EPOLLIN);
+
+    add_fd(completions->fd(), ID_EVENT, EPOLLIN);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sfd < 0) {
+        throw std::runtime_error(std::string("signalfd: ") + strerror(errno));
+    }
+    add_fd(sfd, ID_SIGNAL, EPOLLIN);
+
+    if (params.unix_path.empty()) {
+        fprintf(stderr, "vecbox_server: listening on http://%s:%d\n", params.host.c_str(), params.port);
+    } else {
+        fprintf(stderr, "vecbox_server: listening on unix:%s\n", params.unix_path.c_str());
+    }
+
+    std::vector<epoll_event> events(256);
+    while (!stopping) {
+        const int n = epoll_wait(epfd, events.data(), (int) events.size(), -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("epoll_wait: ") + strerror(errno));
+        }
+
+        for (int i = 0; i < n; ++i) {
+            const uint64_t id = events[i].data.u64;
+            const uint32_t ev = events[i].events;
+
+            if (id == ID_LISTEN) {
+                on_accept();
+            } else if (id == ID_EVENT) {
+                on_completions();
+            } else if (id == ID_SIGNAL) {
+                on_signal();
+            } else {
+                if (ev & (EPOLLERR | EPOLLHUP)) {
+                    close_conn(id);
+                    continue;
+                }
+                if (ev & (EPOLLIN | EPOLLRDHUP)) {
+                    on_readable(id);
+                }
+                if (ev & EPOLLOUT) {
+                    on_writable(id);
+                }
+            }
+        }
+    }
+}
+
+void server::on_accept() {
+    while (true) {
+        const int fd = accept4(lfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                fprintf(stderr, "vecbox_server: accept: %s\n", strerror(errno));
+            }
+            return;
+        }
+
+        if (params.unix_path.empty()) {
+            const int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+
+        const uint64_t id = next_id++;
+        connection & c = conns[id];
+        c.fd = fd;
+        add_fd(fd, id, EPOLLIN | EPOLLRDHUP);
+        metrics.n_connections++;
+    }
+}
+
+void server::close_conn(uint64_t id) {
+    auto it = conns.find(id);
+    if (it == conns.end()) {
+        return;
+    }
+    epoll_ctl(epfd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+    close(it->second.fd);
+    conns.erase(it);
+}
+
+void server::on_readable(uint64_t id) {
+    auto it = conns.find(id);
+    if (it == conns.end()) {
+        return;
+    }
+    connection & c = it->second;
+
+    while (c.in.size() < in_limit()) {
+        const size_t old  = c.in.size();
+        const size_t want = std::min(READ_CHUNK, in_limit() - old);
+        c.in.resize(old + want);
+        const ssize_t n = recv(c.fd, &c.in[old], want, 0);
+        c.in.resize(old + (n > 0 ? n : 0));
+
+        if (n > 0) {
+            continue;
+        }
+        if (n == 0) {
+            // peer closed its side; finish what is in flight, then close
+            c.close_after = true;
+            break;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+        close_conn(id);
+        return;
+    }
+
+    process_requests(id, c);
+}
+
+void server::on_writable(uint64_t id) {
+    auto it = conns.find(id);
+    if (it == conns.end()) {
+        return;
+    }
+    connection & c = it->second;
+
+    while (true) {
+        if (c.out.size() - c.out_off < STREAM_LOW_WATER && c.stream) {
+            fill_stream(c);
+        }
+        if (c.out_off == c.out.size()) {
+            break;
+        }
+
+        const ssize_t n = send(c.fd, c.out.data() + c.out_off, c.out.size() - c.out_off, MSG_NOSIGNAL);
+        if (n > 0) {
+            c.out_off += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        close_conn(id);
+        return;
+    }
+
+    if (c.out_off == c.out.size()) {
+        c.out.clear();
+        c.out_off = 0;
+
+        if (!c.busy && (c.close_after || !c.keep_alive)) {
+            close_conn(id);
+            return;
+        }
+        // a pipelined request may have been waiting for this response
+        if (!c.busy && !c.in.empty()) {
+            process_requests(id, c);
+            return;
+        }
+    }
+
+    set_events(id, c);
+}
+
+// returns true once a complete request is buffered; on a protocol error sets status and returns false
+bool server::parse_request(connection & c, http_request & req, int & status) {
+    status = 0;
+
+    const size_t hdr_end = c.in.find("\r\n\r\n");
+    if (hdr_end == std::string::npos) {
+        if (c.in.size() > MAX_HEADER_BYTES) {
+            status = 431;
+        }
+        return false;
+    }
+    req.header_len = hdr_end + 4;
+    if (req.header_len > MAX_HEADER_BYTES) {
+        status = 431;
+        return false;
+    }
+
+    const char * p   = c.in.data();
+    const char * eol = p + c.in.find("\r\n");
+
+    // request line
+    const char * sp1 = (const char *) memchr(p, ' ', eol - p);
+    const char * sp2 = sp1 ? (const char *) memchr(sp1 + 1, ' ', eol - sp1 - 1) : nullptr;
+    if (!sp1 || !sp2) {
+        status = 400;
+        return false;
+    }
+    req.method.assign(p, sp1);
+    req.path.assign(sp1 + 1, sp2);
+    const std::string version(sp2 + 1, eol);
+    if (version == "HTTP/1.0") {
+        req.keep_alive = false;
+        req.http10     = true;
+    } else if (version != "HTTP/1.1") {
+        status = 400;
+        return false;
+    }
+
+    // strip the query string
+    const size_t q = req.path.find('?');
+    if (q != std::string::npos) {
+        req.path.resize(q);
+    }
+
+    // headers
+    const char * end = c.in.data() + hdr_end;
+    bool has_length = false;
+    for (const char * line = eol + 2; line < end; ) {
+        const char * le = (const char *) memmem(line, end + 2 - line, "\r\n", 2);
+        const char * colon = (const char *) memchr(line, ':', le - line);
+        if (!colon) {
+            status = 400;
+            return false;
+        }
+        const char * v = colon + 1;
+        while (v < le && (*v == ' ' || *v == '\t')) ++v;
+        const char * ve = le;
+        while (ve > v && (ve[-1] == ' ' || ve[-1] == '\t')) --ve;
+
+        if (iequals(line, colon - line, "content-length")) {
+            // digits only, and only once: a second or conflicting length could frame the body
+            // differently from a proxy in front of us
+            char * num_end = nullptr;
+            const unsigned long long len = strtoull(std::string(v, ve).c_str(), &num_end, 10);
+            if (ve == v || !std::all_of(v, ve, [](char ch) { return ch >= '0' && ch <= '9'; }) ||
+                *num_end != '\0' || has_length) {
+                status = 400;
+                return false;
+            }
+            has_length = true;
+            if (len > params.max_body) {
+                status = 413;
+                return false;
+            }
+            req.body_len = (size_t) len;
+        } else if (iequals(line, colon - line, "transfer-encoding")) {
+            status = 411; // chunked request bodies are not supported
+            return false;
+        } else if (iequals(line, colon - line, "connection")) {
+            if (iequals(v, ve - v, "close")) {
+                req.keep_alive = false;
+            } else if (iequals(v, ve - v, "keep-alive")) {
+                req.keep_alive = true;
+            }
+        }
+
+        line = le + 2;
+    }
+
+    return c.in.size() >= req.header_len + req.body_len;
+}
+
+void server::process_requests(uint64_t id, connection & c) {
+    while (!c.busy && c.out_off == c.out.size() && !c.in.empty()) {
+        http_request req;
+        int status = 0;
+        if (!parse_request(c, req, status)) {
+            if (status != 0) {
+                c.keep_alive = false;
+                c.in.clear();
+                respond_error(c, status, status_text(status));
+            }
+            break;
+        }
+
+        c.keep_alive = req.keep_alive;
+        c.http10     = req.http10;
+        handle(id, c, req, c.in.data() + req.header_len);
+        c.in.erase(0, req.header_len + req.body_len);
+
+        if (!c.keep_alive) {
+            c.in.clear();
+            break;
+        }
+    }
+
+    if (c.out_off < c.out.size()) {
+        on_writable(id);
+        return;
+    }
+    if (!c.busy && (c.close_after || !c.keep_alive)) {
+        close_conn(id);
+        return;
+    }
+    set_events(id, c);
+}
+
+void server::handle(uint64_t id, connection & c, const http_request & req, const char * body) {
+    metrics.n_requests++;
+
+    if (req.path == "/health") {
+        if (req.method != "GET") {
+            respond_error(c, 405, "use GET");
+            return;
+        }
+        respond(c, 200, "application/json", "{\"status\":\"ok\"}");
+        return;
+    }
+
+    if (req.path == "/metrics" && params.metrics) {
+        if (req.method != "GET") {
+            respond_error(c, 405, "use GET");
+            return;
+        }
+        respond(c, 200, "text/plain; version=0.0.4", metrics_text());
+        return;
+    }
+
+    if (req.path == "/embeddings" || req.path == "/v1/embeddings") {
+        if (req.method != "POST") {
+            respond_error(c, 405, "use POST");
+            return;
+        }
+
+        vecbox_embd_request parsed;
+        try {
+            parsed = vecbox_json_parse_embd_request(body, req.body_len);
+        } catch (const std::exception & e) {
+            respond_error(c, 400, e.what());
+            return;
+        }
+        if (parsed.input.empty()) {
+            respond_error(c, 400, "\"input\" is empty");
+            return;
+        }
+
+        auto job = std::make_shared<vecbox_embd_job>();
+        job->texts     = std::move(parsed.input);
+        job->normalize = parsed.normalize;
+        job->priority  = parsed.bulk ? VECBOX_PRIORITY_BULK : VECBOX_PRIORITY_INTERACTIVE;
+        job->tenant    = std::move(parsed.tenant);
+        // runs on the batcher thread: hand the job back to the event loop
+        const uint64_t seq = ++c.stream_seq;
+        job->on_done = [queue = completions, id, seq](vecbox_embd_job &) {
+            queue->push(id, seq);
+        };
+
+        c.busy         = true;
+        c.stream       = job;
+        c.stream_model  = parsed.model.empty() ? batcher.model()->path : parsed.model;
+        c.stream_base64 = parsed.base64;
+        c.stream_row   = 0;
+
+        batcher.submit(std::move(job));
+        return;
+    }
+
+    respond_error(c, 404, "not found");
+}
+
+void server::on_completions() {
+    for (const auto & comp : completions->drain()) {
+        auto it = conns.find(comp.tag);
+        if (it == conns.end()) {
+            continue; // client went away while its job was running
+        }
+        connection & c = it->second;
+        if (!c.busy || !c.stream || c.stream_seq != comp.id) {
+            continue;
+        }
+
+        c.busy = false;
+        const int64_t t_latency_us = vecbox_time_us() - c.stream->t_submit_us;
+        vecbox_metrics_observe(VECBOX_HIST_REQUEST, t_latency_us*1e-6);
+
+        if (!c.stream->error.empty()) {
+            const std::string error = c.stream->error;
+            c.stream.reset();
+            respond_error(c, 500, error);
+        } else if (c.http10) {
+            // HTTP/1.0 has no chunked encoding: serialize the whole body up front
+            std::string body;
+            c.stream_row = 0;
+            while (!serialize_rows(c, body)) {
+            }
+            c.stream.reset();
+            respond(c, 200, "application/json", body);
+        } else {
+            c.out += "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n";
+            c.out += c.keep_alive && !c.close_after ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+            c.stream_row = 0;
+            fill_stream(c);
+        }
+
+        on_writable(comp.tag);
+    }
+}
+
+// appends the next slice of the embedding response body to out, returns true after the last row
+bool server::serialize_rows(connection & c, std::string & out) {
+    vecbox_embd_job & job = *c.stream;
+    const size_t n_rows = job.texts.size();
+
+    const size_t start = out.size();
+    if (c.stream_row == 0) {
+        out += "{\"model\":";
+        vecbox_json_append_string(out, c.stream_model);
+        out += ",\"dimensions\":";
+        out += std::to_string(job.n_embd);
+        out += ",\"embeddings\":[";
+    }
+
+    while (c.stream_row < n_rows && out.size() - start < STREAM_LOW_WATER) {
+        if (c.stream_row > 0) {
+            out += ',';
+        }
+        const float * row = job.embd.data() + c.stream_row*job.n_embd;
+        if (c.stream_base64) {
+            out += '"';
+            vecbox_base64_encode((const uint8_t *) row, job.n_embd*sizeof(float), out);
+            out += '"';
+        } else {
+            const size_t off = out.size();
+            out.resize(off + vecbox_json_floats_max_size(job.n_embd));
+            char * end = vecbox_json_write_floats(&out[off], row, job.n_embd);
+            out.resize(end - out.data());
+        }
+        c.stream_row++;
+    }
+
+    const bool last = c.stream_row == n_rows;
+    if (last) {
+        out += "]}";
+    }
+    return last;
+}
+
+// serializes the next slice of the embedding response as one HTTP chunk
+void server::fill_stream(connection & c) {
+    std::string chunk;
+    const bool last = serialize_rows(c, chunk);
+
+    if (c.out_off > 0 && c.out_off == c.out.size()) {
+        c.out.clear();
+        c.out_off = 0;
+    }
+    append_chunk_header(c.out, chunk.size());
+    c.out += chunk;
+    c.out += "\r\n";
+
+    if (last) {
+        c.out += "0\r\n\r\n";
+        c.stream.reset();
+    }
+}
+
+void server::respond(connection & c, int status, const char * content_type, const std::string & body) {
+    char head[256];
+    const int n = snprintf(head, sizeof(head),
+        "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: %s\r\n\r\n",
+        status, status_text(status), content_type, body.size(),
+        c.keep_alive && !c.close_after ? "keep-alive" : "close");
+    c.out.append(head, n);
+    c.out += body;
+}
+
+void server::respond_error(connection & c, int status, const std::string & message) {
+    metrics.n_errors++;
+
+    std::string body = "{\"error\":";
+    vecbox_json_append_string(body, message);
+    body += '}';
+    respond(c, status, "application/json", body);
+}
+
+void server::on_signal() {
+    signalfd_siginfo si;
+    while (read(sfd, &si, sizeof(si)) == (ssize_t) sizeof(si)) {
+        if (si.ssi_signo == SIGHUP) {
+            reload_model();
+        } else {
+            fprintf(stderr, "vecbox_server: shutting down\n");
+            stopping = true;
+        }
+    }
+}
+
+void server::reload_model() {
+    if (reloading.exchange(true)) {
+        fprintf(stderr, "vecbox_server: reload already in progress\n");
+        return;
+    }
+    if (reload_thread.joinable()) {
+        reload_thread.join();
+    }
+
+    // load and warm off the event loop; requests keep flowing to the old model until the swap,
+    // and the ones already queued finish on it
+    reload_thread = std::thread([this] {
+        try {
+            auto model = vecbox_model_load_warm(params.model, { "warmup" }, params.model_params);
+            if (params.warmup_seq_len > 0) {
+                warmup_model(*model, params);
+            }
+            batcher.swap_model(model);
+            fprintf(stderr, "vecbox_server: reloaded %s\n", params.model.c_str());
+        } catch (const std::exception & e) {
+            fprintf(stderr, "vecbox_server: reload failed, still serving the previous model: %s\n", e.what());
+        }
+        reloading = false;
+    });
+}
+
+std::string server::metrics_text() const {
+    std::string out;
+    char buf[256];
+    auto metric = [&](const char * name, const char * type, const char * help, double value) {
+        const int n = snprintf(buf, sizeof(buf), "# HELP %s %s\n# TYPE %s %s\n%s %.17g\n",
+            name, help, name, type, name, value);
+        out.append(buf, n);
+    };
+
+    metric("vecbox_http_requests_total",          "counter", "HTTP requests handled",              (double) metrics.n_requests);
+    metric("vecbox_http_errors_total",            "counter", "HTTP requests answered with an error", (double) metrics.n_errors);
+    metric("vecbox_http_connections_total",       "counter", "connections accepted",               (double) metrics.n_connections);
+    metric("vecbox_http_connections_open",        "gauge",   "connections currently open",         (double) conns.size());
+
+    // embedding requests and their latency are in the request_seconds histogram, the batcher's
+    // jobs, texts, batches and compute time in the shared counters and histograms below
+    vecbox_metrics_write_prometheus(out, vecbox_metrics_collect());
+
+    return out;
+}
+
+void print_usage(const char * argv0) {
+    fprintf(stderr,
+        "usage: %s --model PATH [options]\n"
+        "\n"
+        "  --model PATH         GGUF embedding model\n"
+        "  --host HOST          address to bind (default: 127.0.0.1)\n"
+        "  --port N             TCP port (default: 8080)\n"
+        "  --unix PATH          listen on a Unix domain socket instead of TCP\n"
+        "  --shm PATH           also serve the shared-memory transport on this control socket\n"
+        "  --max-batch N        texts per model call (default: 32)\n"
+        "  --max-wait-us N      how long a partial batch waits to fill (default: 2000)\n"
+        "  --max-bulk-batch N   texts per bulk-only model call, 0 = --max-batch (default: 0)\n"
+        "  --max-body BYTES     largest accepted request body (default: 16777216)\n"
+        "  --truncate N         return the first N dimensions (Matryoshka models)\n"
+        "  --projection PATH    project embeddings with a fitted PCA (.vbproj file)\n"
+        "  --warmup N           before serving, touch the tokenizer pages and run one batch of\n"
+        "                       --max-batch texts of N tokens (default: 0, off)\n"
+        "  --no-metrics         do not serve GET /metrics\n",
+        argv0);
+}
+
+bool parse_args(int argc, char ** argv, server_params & params) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            return false;
+        }
+        if (arg == "--no-metrics") {
+            params.metrics = false;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "error: missing value for %s\n", arg.c_str());
+            return false;
+        }
+        const char * value = argv[++i];
+
+        if      (arg == "--model" || arg == "-m") params.model     = value;
+        else if (arg == "--host")                 params.host      = value;
+        else if (arg == "--port")                 params.port      = atoi(value);
+        else if (arg == "--unix")                 params.unix_path = value;
+        else if (arg == "--shm")                  params.shm_path  = value;
+        else if (arg == "--max-batch")            params.batch.max_batch   = atoi(value);
+        else if (arg == "--max-wait-us")          params.batch.max_wait_us = atoi(value);
+        else if (arg == "--max-bulk-batch")       params.batch.max_bulk_batch = atoi(value);
+        else if (arg == "--max-body")             params.max_body  = strtoull(value, nullptr, 10);
+        else if (arg == "--truncate")             params.model_params.truncate = atoi(value);
+        else if (arg == "--projection")           params.projection = value;
+        else if (arg == "--warmup")               params.warmup_seq_len = atoi(value);
+        else {
+            fprintf(stderr, "error: unknown argument %s\n", arg.c_str());
+            return false;
+        }
+    }
+
+    if (params.model.empty()) {
+        fprintf(stderr, "error: --model is required\n");
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char ** argv) {
+    server_params params;
+    if (!parse_args(argc, argv, params)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    // block the shutdown signals before any thread starts so they are only seen through the signalfd
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+
+    try {
+        if (!params.projection.empty()) {
+            params.model_params.projection = vecbox_projection_load(params.projection);
+        }
+
+        auto model = start_model(params);
+
+        vecbox_batcher batcher(std::move(model), params.batch);
+
+        std::unique_ptr<vecbox_shm_server> shm;
+        if (!params.shm_path.empty()) {
+            shm = std::make_unique<vecbox_shm_server>(batcher, params.shm_path);
+            fprintf(stderr, "vecbox_server: shared-memory transport on unix:%s\n", params.shm_path.c_str());
+        }
+
+        server srv(params, batcher);
+        srv.listen_and_serve();
+    } catch (const std::exception & e) {
+        fprintf(stderr, "vecbox_server: %s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,190 @@
+#include "vecbox-base64.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define VECBOX_BASE64_AVX2
+#endif
+
+static const char k_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// 6-bit value of each character, 0xFF for characters outside the alphabet
+struct base64_table {
+    uint8_t v[256];
+
+    base64_table() {
+        memset(v, 0xFF, sizeof(v));
+        for (int i = 0; i < 64; ++i) {
+            v[(uint8_t) k_alphabet[i]] = (uint8_t) i;
+        }
+    }
+};
+
+static const base64_table k_table;
+
+int64_t vecbox_base64_decoded_size(const char * src, size_t len) {
+    if (len % 4 != 0) {
+        return -1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    size_t pad = 0;
+    if (src[len - 1] == '=') pad++;
+    if (src[len - 2] == '=') pad++;
+
+    return (int64_t) (len/4*3 - pad);
+}
+
+// decodes groups of 4 characters; the last group may carry padding
+static int64_t base64_decode_scalar(const char * src, size_t len, uint8_t * dst) {
+    uint8_t * out = dst;
+
+    for (size_t i = 0; i < len; i += 4) {
+        const uint8_t * s = (const uint8_t *) src + i;
+
+        const bool last = i + 4 == len;
+        const int  pad  = last ? (s[3] == '=') + (s[2] == '=') : 0;
+
+        const uint32_t a = k_table.v[s[0]];
+        const uint32_t b = k_table.v[s[1]];
+        const uint32_t c = pad >= 2 ? 0 : k_table.v[s[2]];
+        const uint32_t d = pad >= 1 ? 0 : k_table.v[s[3]];
+        if ((a | b | c | d) & 0x80) {
+            return -1;
+        }
+
+        const uint32_t v = a << 18 | b << 12 | c << 6 | d;
+        *out++ = (uint8_t) (v >> 16);
+        if (pad < 2) *out++ = (uint8_t) (v >> 8);
+        if (pad < 1) *out++ = (uint8_t) v;
+    }
+
+    return out - dst;
+}
+
+#ifdef VECBOX_BASE64_AVX2
+
+// vectorized lookup in the style of Muła & Lemire: classify each byte by its nibbles,
+// reject anything outside the alphabet, then pack 4 x 6 bits into 3 bytes with madd
+// 32 characters -> 24 bytes per iteration
+__attribute__((target("avx2")))
+static size_t base64_decode_avx2(const char * src, size_t len, uint8_t * dst, bool & ok) {
+    const __m256i lut_lo = _mm256_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+
+    const __m256i pack_shuf = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i pack_perm = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+
+    size_t i = 0;
+    size_t o = 0;
+
+    // the 32-byte store writes 8 bytes past the 24 decoded ones, so keep one block of slack
+    // and leave the final (possibly padded) group to the scalar tail
+    while (i + 32 + 4 <= len) {
+        __m256i in = _mm256_loadu_si256((const __m256i *) (src + i));
+
+        const __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask_2f);
+        const __m256i lo_nibbles = _mm256_and_si256(in, mask_2f);
+        const __m256i lo         = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+        const __m256i eq_2f      = _mm256_cmpeq_epi8(in, mask_2f);
+        const __m256i hi         = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        const __m256i roll       = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+
+        if (!_mm256_testz_si256(lo, hi)) {
+            ok = false;
+            return o;
+        }
+
+        in = _mm256_add_epi8(in, roll);
+
+        const __m256i merged = _mm256_maddubs_epi16(in, _mm256_set1_epi32(0x01400140));
+        __m256i       packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        packed = _mm256_shuffle_epi8(packed, pack_shuf);
+        packed = _mm256_permutevar8x32_epi32(packed, pack_perm);
+
+        // 16 more characters decode to at least 10 more bytes, so dst has room for 8 extra
+        if (i + 32 + 16 <= len) {
+            _mm256_storeu_si256((__m256i *) (dst + o), packed);
+        } else {
+            // near the end the full store could run past dst
+            alignas(32) uint8_t tmp[32];
+            _mm256_store_si256((__m256i *) tmp, packed);
+            memcpy(dst + o, tmp, 24);
+        }
+
+        i += 32;
+        o += 24;
+    }
+
+    ok = true;
+    return i;
+}
+
+static bool base64_has_avx2() {
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+}
+
+#endif
+
+int64_t vecbox_base64_decode(const char * src, size_t len, uint8_t * dst) {
+    if (vecbox_base64_decoded_size(src, len) < 0) {
+        return -1;
+    }
+
+    size_t done_src = 0;
+    size_t done_dst = 0;
+
+#ifdef VECBOX_BASE64_AVX2
+    if (base64_has_avx2()) {
+        bool ok;
+        done_src = base64_decode_avx2(src, len, dst, ok);
+        if (!ok) {
+            return -1;
+        }
+        done_dst = done_src/4*3;
+    }
+#endif
+
+    const int64_t n = base64_decode_scalar(src + done_src, len - done_src, dst + done_dst);
+    return n < 0 ? -1 : (int64_t) done_dst + n;
+}
+
+void vecbox_base64_encode(const uint8_t * src, size_t n, std::string & out) {
+    const size_t start = out.size();
+    out.resize(start + (n + 2)/3*4);
+    char * p = &out[start];
+
+    size_t i = 0;
+    for (; i + 3 <= n; i += 3) {
+        const uint32_t v = (uint32_t) src[i] << 16 | (uint32_t) src[i + 1] << 8 | src[i + 2];
+        *p++ = k_alphabet[v >> 18];
+        *p++ = k_alphabet[(v >> 12) & 0x3F];
+        *p++ = k_alphabet[(v >> 6) & 0x3F];
+        *p++ = k_alphabet[v & 0x3F];
+    }
+
+    if (i < n) {
+        uint32_t v = (uint32_t) src[i] << 16;
+        if (i + 1 < n) {
+            v |= (uint32_t) src[i + 1] << 8;
+        }
+        *p++ = k_alphabet[v >> 18];
+        *p++ = k_alphabet[(v >> 12) & 0x3F];
+        *p++ = i + 1 < n ? k_alphabet[(v >> 6) & 0x3F] : '=';
+        *p++ = '=';
+    }
+}
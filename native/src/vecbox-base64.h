@@ -0,0 +1,19 @@
+#pragma once
+
+// base64 (RFC 4648, standard alphabet) for packed little-endian float32 embeddings,
+// the OpenAI `encoding_format: "base64"` wire format
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// exact number of bytes encoded by src, or -1 if the length or padding is invalid
+int64_t vecbox_base64_decoded_size(const char * src, size_t len);
+
+// decodes src into dst, which must hold vecbox_base64_decoded_size(src, len) bytes
+// returns the number of bytes written, or -1 on an invalid character
+// uses AVX2 when the CPU has it
+int64_t vecbox_base64_decode(const char * src, size_t len, uint8_t * dst);
+
+// appends the base64 encoding of n bytes to out
+void vecbox_base64_encode(const uint8_t * src, size_t n, std::string & out);
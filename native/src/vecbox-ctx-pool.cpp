@@ -0,0 +1,161 @@
+#include "vecbox-ctx-pool.h"
+#include "vecbox-metrics.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+//
+// key
+//
+
+vecbox_graph_key::vecbox_graph_key(std::initializer_list<int64_t> parts) {
+    if (parts.size() > MAX_PARTS) {
+        throw std::invalid_argument("graph key has too many parts");
+    }
+    std::copy(parts.begin(), parts.end(), this->parts.begin());
+    n_parts = parts.size();
+}
+
+bool vecbox_graph_key::operator==(const vecbox_graph_key & other) const {
+    return n_parts == other.n_parts && std::equal(parts.begin(), parts.begin() + n_parts, other.parts.begin());
+}
+
+struct vecbox_ctx_pool::slot {
+    ggml_context   * ctx    = nullptr;
+    ggml_cgraph    * gf     = nullptr; // kept graph, valid while the context is not reset
+    vecbox_graph_key key;
+    uint64_t         used   = 0;       // pool clock at the last lease
+    bool             leased = false;
+
+    ~slot() {
+        if (ctx) {
+            ggml_free(ctx);
+        }
+    }
+};
+
+//
+// lease
+//
+
+vecbox_ctx_pool::lease::lease(lease && other) noexcept : pool(other.pool), s(other.s) {
+    other.pool = nullptr;
+    other.s    = nullptr;
+}
+
+vecbox_ctx_pool::lease & vecbox_ctx_pool::lease::operator=(lease && other) noexcept {
+    if (this != &other) {
+        if (pool) {
+            pool->release(s);
+        }
+        pool = other.pool;
+        s    = other.s;
+        other.pool = nullptr;
+        other.s    = nullptr;
+    }
+    return *this;
+}
+
+vecbox_ctx_pool::lease::~lease() {
+    if (pool) {
+        pool->release(s);
+    }
+}
+
+ggml_context * vecbox_ctx_pool::lease::ctx() const {
+    return s->ctx;
+}
+
+ggml_cgraph * vecbox_ctx_pool::lease::graph() const {
+    return s->gf;
+}
+
+ggml_cgraph * vecbox_ctx_pool::lease::new_graph() {
+    return ggml_new_graph_custom(s->ctx, pool->params.graph_size, false);
+}
+
+void vecbox_ctx_pool::lease::keep(ggml_cgraph * gf) {
+    s->gf = gf;
+}
+
+//
+// pool
+//
+
+vecbox_ctx_pool::vecbox_ctx_pool(const vecbox_ctx_pool_params & params)
+    : params(params),
+      ctx_size(params.n_tensors*ggml_tensor_overhead() + ggml_graph_overhead_custom(params.graph_size, false)) {}
+
+vecbox_ctx_pool::~vecbox_ctx_pool() = default;
+
+vecbox_ctx_pool::lease vecbox_ctx_pool::acquire(const vecbox_graph_key & key) {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // every context is leased and the pool may not grow: wait for one to come back
+    released.wait(lock, [&] {
+        if (params.max_contexts == 0 || slots.size() < params.max_contexts) {
+            return true;
+        }
+        return std::any_of(slots.begin(), slots.end(), [](const std::unique_ptr<slot> & s) { return !s->leased; });
+    });
+
+    // the context holding this key's graph, else the free one whose graph is the oldest
+    slot * best = nullptr;
+    for (auto & s : slots) {
+        if (s->leased) {
+            continue;
+        }
+        if (s->gf && s->key == key) {
+            best = s.get();
+            break;
+        }
+        if (!best || (best->gf && (!s->gf || s->used < best->used))) {
+            best = s.get();
+        }
+    }
+
+    if (best && best->gf && best->key == key) {
+        vecbox_metrics_add(VECBOX_COUNTER_GRAPH_CACHE_HITS);
+    } else {
+        vecbox_metrics_add(VECBOX_COUNTER_GRAPH_CACHE_MISSES);
+        // another shape: keep the graphs there are while the pool is below n_graphs
+        if (!best || (best->gf && slots.size() < params.n_graphs)) {
+            ggml_init_params ip = {
+                /*.mem_size   =*/ ctx_size,
+                /*.mem_buffer =*/ nullptr,
+                /*.no_alloc   =*/ true,
+            };
+            auto s = std::make_unique<slot>();
+            s->ctx = ggml_init(ip);
+            if (!s->ctx) {
+                throw std::runtime_error("failed to create a pooled graph context");
+            }
+            best = s.get();
+            slots.push_back(std::move(s));
+        }
+        ggml_reset(best->ctx);
+        best->gf  = nullptr;
+        best->key = key;
+    }
+
+    best->leased = true;
+    best->used   = ++clock;
+    return lease(this, best);
+}
+
+void vecbox_ctx_pool::release(slot * s) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        s->leased = false;
+    }
+    released.notify_one();
+}
+
+size_t vecbox_ctx_pool::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return slots.size();
+}
+
+size_t vecbox_ctx_pool::mem_size() const {
+    return ctx_size;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+// pooled ggml contexts for per-batch graph metadata
+//
+// every graph build needs a no_alloc ggml_context for its tensor and graph objects. creating one
+// per batch costs a ggml_init (the context and an aligned malloc of its memory) and a ggml_free.
+// the pool creates its contexts once, at a fixed size, and leases them out. a context is recycled
+// with ggml_reset, which only forgets the object list, so it is O(1) whatever was built in it.
+// each context also remembers the graph last built in it under a caller key, normally the batch
+// shape: acquiring that key again returns the graph untouched, so a batch of a shape seen before
+// only rebinds its tensor data. keys are compared value by value, so two shapes never share a
+// graph. the pool grows past n_graphs only while more leases than that are held at once, and never
+// past max_contexts: an acquire beyond it waits for a lease to be released, so a caller must not
+// hold two leases of a bounded pool at once. once the pool is at its peak neither path allocates.
+
+#include "ggml.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct vecbox_ctx_pool_params {
+    size_t n_tensors    = 256; // tensor objects per context, besides the graph
+    size_t graph_size   = 256; // nodes of the single graph a context holds
+    size_t n_graphs     = 8;   // contexts kept with their graphs before the least recently used is reset
+    size_t max_contexts = 64;  // contexts at most, leases beyond it wait; 0 for no limit
+};
+
+// the values that determine a graph's shape, e.g. { n_tokens, n_embd }
+struct vecbox_graph_key {
+    static constexpr size_t MAX_PARTS = 8;
+
+    vecbox_graph_key() = default;
+    // throws std::invalid_argument with more than MAX_PARTS values
+    vecbox_graph_key(std::initializer_list<int64_t> parts);
+
+    bool operator==(const vecbox_graph_key & other) const;
+
+    std::array<int64_t, MAX_PARTS> parts {};
+    size_t                         n_parts = 0;
+};
+
+class vecbox_ctx_pool {
+    struct slot;
+
+public:
+    // a context held by one caller until the lease is destroyed
+    class lease {
+    public:
+        lease(lease && other) noexcept;
+        lease & operator=(lease && other) noexcept;
+        ~lease();
+
+        ggml_context * ctx() const;
+
+        // graph kept under this lease's key, nullptr if the context was reset for it; in that case
+        // build with new_graph() and keep() the result
+        ggml_cgraph * graph() const;
+
+        // a graph sized for the pool, in this context
+        ggml_cgraph * new_graph();
+
+        // hands the graph back with the context, for the next acquire of the same key; without it
+        // the context is reset before its next use
+        void keep(ggml_cgraph * gf);
+
+    private:
+        friend class vecbox_ctx_pool;
+        lease(vecbox_ctx_pool * pool, slot * s) : pool(pool), s(s) {}
+
+        vecbox_ctx_pool * pool = nullptr;
+        slot            * s    = nullptr;
+    };
+
+    explicit vecbox_ctx_pool(const vecbox_ctx_pool_params & params = {});
+    ~vecbox_ctx_pool();
+
+    vecbox_ctx_pool(const vecbox_ctx_pool &) = delete;
+    vecbox_ctx_pool & operator=(const vecbox_ctx_pool &) = delete;
+
+    // a context, preferably one that still holds the graph of key; waits while max_contexts are
+    // leased, throws std::runtime_error if a new context is needed and cannot be created
+    lease acquire(const vecbox_graph_key & key);
+
+    size_t size() const;     // contexts created
+    size_t mem_size() const; // bytes of context memory per context
+
+private:
+    void release(slot * s);
+
+    vecbox_ctx_pool_params params;
+    size_t                 ctx_size;
+
+    mutable std::mutex                 mutex;
+    std::condition_variable            released;
+    std::vector<std::unique_ptr<slot>> slots;
+    uint64_t                           clock = 0; // lease count, for least-recently-used eviction of kept graphs
+};
@@ -0,0 +1,332 @@
+#include "vecbox-dedup.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define VECBOX_DEDUP_AVX2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define VECBOX_DEDUP_NEON
+#endif
+
+static uint64_t dedup_splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30))*0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27))*0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+//
+// shingles
+//
+
+static bool dedup_is_word_byte(unsigned char c) {
+    // bytes of multi-byte UTF-8 sequences count as letters, so non-ASCII words stay whole
+    return c >= 0x80 || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// one 32-bit hash per run of `shingle` consecutive words; a text shorter than that is one shingle
+static void dedup_shingles(const std::string & text, int32_t shingle, std::vector<uint32_t> & out) {
+    std::vector<uint64_t> words;
+    const unsigned char * p = (const unsigned char *) text.data();
+    const size_t len = text.size();
+
+    for (size_t i = 0; i < len; ) {
+        if (!dedup_is_word_byte(p[i])) {
+            ++i;
+            continue;
+        }
+        uint64_t h = 0xcbf29ce484222325ull; // FNV-1a over the lowercased word
+        for (; i < len && dedup_is_word_byte(p[i]); ++i) {
+            unsigned char c = p[i];
+            if (c >= 'A' && c <= 'Z') {
+                c += 'a' - 'A';
+            }
+            h = (h ^ c)*0x100000001b3ull;
+        }
+        words.push_back(h);
+    }
+
+    out.clear();
+    if (words.empty()) {
+        return;
+    }
+
+    const size_t n = words.size() > (size_t) shingle ? words.size() - shingle + 1 : 1;
+    const size_t w = std::min(words.size(), (size_t) shingle);
+    out.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t h = 0;
+        for (size_t j = 0; j < w; ++j) {
+            h = dedup_splitmix64(h ^ words[i + j]);
+        }
+        out.push_back((uint32_t) (h ^ (h >> 32)));
+    }
+}
+
+//
+// minhash
+//
+
+// bijective on 32 bits, so distinct shingles keep distinct values under every hash function
+static inline uint32_t dedup_mix32(uint32_t v) {
+    v ^= v >> 16;
+    v *= 0x85ebca6bu;
+    v ^= v >> 13;
+    return v;
+}
+
+static void dedup_minhash_scalar(const uint32_t * x, size_t n, const uint32_t * a, const uint32_t * b,
+                                 int32_t begin, int32_t end, uint32_t * sig) {
+    for (int32_t p = begin; p < end; ++p) {
+        uint32_t m = UINT32_MAX;
+        for (size_t i = 0; i < n; ++i) {
+            m = std::min(m, dedup_mix32(a[p]*x[i] + b[p]));
+        }
+        sig[p] = m;
+    }
+}
+
+#ifdef VECBOX_DEDUP_AVX2
+// eight hash functions per register, one shingle broadcast at a time; returns the first
+// hash function left for the scalar tail
+__attribute__((target("avx2")))
+static int32_t dedup_minhash_avx2(const uint32_t * x, size_t n, const uint32_t * a, const uint32_t * b,
+                                  int32_t num_perm, uint32_t * sig) {
+    const __m256i c = _mm256_set1_epi32((int) 0x85ebca6bu);
+
+    int32_t p = 0;
+    for (; p + 8 <= num_perm; p += 8) {
+        const __m256i va = _mm256_loadu_si256((const __m256i *) (a + p));
+        const __m256i vb = _mm256_loadu_si256((const __m256i *) (b + p));
+        __m256i m = _mm256_set1_epi32(-1);
+        for (size_t i = 0; i < n; ++i) {
+            __m256i v = _mm256_add_epi32(_mm256_mullo_epi32(va, _mm256_set1_epi32((int) x[i])), vb);
+            v = _mm256_xor_si256(v, _mm256_srli_epi32(v, 16));
+            v = _mm256_mullo_epi32(v, c);
+            v = _mm256_xor_si256(v, _mm256_srli_epi32(v, 13));
+            m = _mm256_min_epu32(m, v);
+        }
+        _mm256_storeu_si256((__m256i *) (sig + p), m);
+    }
+    return p;
+}
+
+static bool dedup_has_avx2() {
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+}
+#endif
+
+#ifdef VECBOX_DEDUP_NEON
+static int32_t dedup_minhash_neon(const uint32_t * x, size_t n, const uint32_t * a, const uint32_t * b,
+                                  int32_t num_perm, uint32_t * sig) {
+    const uint32x4_t c = vdupq_n_u32(0x85ebca6bu);
+
+    int32_t p = 0;
+    for (; p + 4 <= num_perm; p += 4) {
+        const uint32x4_t va = vld1q_u32(a + p);
+        const uint32x4_t vb = vld1q_u32(b + p);
+        uint32x4_t m = vdupq_n_u32(UINT32_MAX);
+        for (size_t i = 0; i < n; ++i) {
+            uint32x4_t v = vmlaq_u32(vb, va, vdupq_n_u32(x[i]));
+            v = veorq_u32(v, vshrq_n_u32(v, 16));
+            v = vmulq_u32(v, c);
+            v = veorq_u32(v, vshrq_n_u32(v, 13));
+            m = vminq_u32(m, v);
+        }
+        vst1q_u32(sig + p, m);
+    }
+    return p;
+}
+#endif
+
+//
+// index
+//
+
+vecbox_dedup_index::vecbox_dedup_index(const vecbox_dedup_params & params) : prm(params) {
+    if (prm.num_perm <= 0 || prm.bands <= 0 || prm.num_perm % prm.bands != 0) {
+        throw std::invalid_argument("bands must divide num_perm");
+    }
+    if (prm.shingle <= 0) {
+        throw std::invalid_argument("shingle must be at least 1 word");
+    }
+    if (!(prm.threshold >= 0.0f && prm.threshold <= 1.0f)) {
+        throw std::invalid_argument("threshold must be in [0, 1]");
+    }
+    if (prm.capacity < 0) {
+        throw std::invalid_argument("capacity must not be negative");
+    }
+    rows = prm.num_perm/prm.bands;
+
+    perm_a.resize(prm.num_perm);
+    perm_b.resize(prm.num_perm);
+    uint64_t state = prm.seed;
+    for (int32_t p = 0; p < prm.num_perm; ++p) {
+        state = dedup_splitmix64(state);
+        perm_a[p] = (uint32_t) state | 1u; // odd, so x -> a*x + b is a permutation
+        perm_b[p] = (uint32_t) (state >> 32);
+    }
+
+    buckets.resize(prm.bands);
+}
+
+bool vecbox_dedup_index::signature(const std::string & text, uint32_t * sig) const {
+    static thread_local std::vector<uint32_t> shingles;
+    dedup_shingles(text, prm.shingle, shingles);
+    if (shingles.empty()) {
+        // every entry would be UINT32_MAX, equal to any other text without words
+        std::fill(sig, sig + prm.num_perm, UINT32_MAX);
+        return false;
+    }
+
+    int32_t p = 0;
+#ifdef VECBOX_DEDUP_AVX2
+    if (dedup_has_avx2()) {
+        p = dedup_minhash_avx2(shingles.data(), shingles.size(), perm_a.data(), perm_b.data(), prm.num_perm, sig);
+    }
+#endif
+#ifdef VECBOX_DEDUP_NEON
+    p = dedup_minhash_neon(shingles.data(), shingles.size(), perm_a.data(), perm_b.data(), prm.num_perm, sig);
+#endif
+    dedup_minhash_scalar(shingles.data(), shingles.size(), perm_a.data(), perm_b.data(), p, prm.num_perm, sig);
+    return true;
+}
+
+uint64_t vecbox_dedup_index::band_key(const uint32_t * sig, int32_t band) const {
+    uint64_t h = (uint64_t) band;
+    for (int32_t r = 0; r < rows; ++r) {
+        h = dedup_splitmix64(h ^ sig[band*rows + r]);
+    }
+    return h;
+}
+
+vecbox_dedup_match vecbox_dedup_index::find_locked(const uint32_t * sig) const {
+    static thread_local std::vector<size_t> cand;
+    cand.clear();
+    for (int32_t band = 0; band < prm.bands; ++band) {
+        auto it = buckets[band].find(band_key(sig, band));
+        if (it != buckets[band].end()) {
+            cand.insert(cand.end(), it->second.begin(), it->second.end());
+        }
+    }
+    std::sort(cand.begin(), cand.end());
+    cand.erase(std::unique(cand.begin(), cand.end()), cand.end());
+
+    // bucket collisions are only candidates; the full signatures decide
+    vecbox_dedup_match best;
+    for (size_t slot : cand) {
+        const uint32_t * other = sigs.data() + slot*prm.num_perm;
+        int32_t equal = 0;
+        for (int32_t p = 0; p < prm.num_perm; ++p) {
+            equal += sig[p] == other[p];
+        }
+        const float jaccard = (float) equal/prm.num_perm;
+        if (jaccard >= prm.threshold && jaccard > best.jaccard) {
+            best.id = slot_id[slot];
+            best.jaccard = jaccard;
+        }
+    }
+    return best;
+}
+
+void vecbox_dedup_index::insert_locked(int64_t id, const uint32_t * sig, const float * e) {
+    if (prm.n_embd > 0 && e == nullptr) {
+        throw std::invalid_argument("this index keeps embeddings, insert needs one");
+    }
+
+    size_t slot;
+    if (prm.capacity == 0 || (int64_t) slot_id.size() < prm.capacity) {
+        slot = slot_id.size();
+        slot_id.push_back(id);
+        sigs.resize(sigs.size() + prm.num_perm);
+        embd.resize(embd.size() + prm.n_embd);
+    } else {
+        // full: the oldest document leaves its buckets and gives up its slot
+        slot = next_slot;
+        next_slot = (next_slot + 1) % (size_t) prm.capacity;
+
+        const uint32_t * old = sigs.data() + slot*prm.num_perm;
+        for (int32_t band = 0; band < prm.bands; ++band) {
+            auto it = buckets[band].find(band_key(old, band));
+            if (it == buckets[band].end()) {
+                continue;
+            }
+            it->second.erase(std::remove(it->second.begin(), it->second.end(), slot), it->second.end());
+            if (it->second.empty()) {
+                buckets[band].erase(it);
+            }
+        }
+        slots.erase(slot_id[slot]);
+        slot_id[slot] = id;
+    }
+
+    std::copy(sig, sig + prm.num_perm, sigs.begin() + slot*prm.num_perm);
+    if (prm.n_embd > 0) {
+        std::copy(e, e + prm.n_embd, embd.begin() + slot*prm.n_embd);
+    }
+    slots[id] = slot;
+    for (int32_t band = 0; band < prm.bands; ++band) {
+        buckets[band][band_key(sig, band)].push_back(slot);
+    }
+}
+
+vecbox_dedup_match vecbox_dedup_index::find(const uint32_t * sig) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return find_locked(sig);
+}
+
+int64_t vecbox_dedup_index::insert(const uint32_t * sig, const float * e) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const int64_t id = next_id;
+    insert_locked(id, sig, e);
+    ++next_id;
+    return id;
+}
+
+vecbox_dedup_match vecbox_dedup_index::add(const std::string & text) {
+    std::vector<uint32_t> sig(prm.num_perm);
+    const bool has_words = signature(text, sig.data());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    const int64_t id = next_id++;
+    if (!has_words) {
+        return {};
+    }
+    vecbox_dedup_match match = find_locked(sig.data());
+    if (match.id < 0) {
+        insert_locked(id, sig.data(), nullptr);
+    }
+    return match;
+}
+
+bool vecbox_dedup_index::embedding(int64_t id, float * out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = slots.find(id);
+    if (prm.n_embd <= 0 || it == slots.end()) {
+        return false;
+    }
+    std::copy(embd.begin() + it->second*prm.n_embd, embd.begin() + (it->second + 1)*prm.n_embd, out);
+    return true;
+}
+
+int64_t vecbox_dedup_index::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return (int64_t) slot_id.size();
+}
+
+void vecbox_dedup_index::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    next_slot = 0;
+    slot_id.clear();
+    sigs.clear();
+    embd.clear();
+    slots.clear();
+    for (auto & bucket : buckets) {
+        bucket.clear();
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+// near-duplicate detection for ingestion, run before inference
+//
+// documents that differ only by a timestamp or a footer hash differently but share almost all of
+// their word shingles. each document gets a MinHash signature: for num_perm hash functions, the
+// minimum hash over its shingles, so the fraction of equal entries between two signatures
+// estimates the Jaccard similarity of their shingle sets. the hash functions are evaluated 8 (AVX2)
+// or 4 (NEON) at a time per shingle. signatures are indexed by LSH: split into bands of
+// num_perm/bands rows, each band hashed into a bucket, and only documents sharing a bucket are
+// compared. a pair of similarity s shares a bucket with probability 1 - (1 - s^rows)^bands, so
+// the defaults (16 bands of 8) catch s >= 0.8 almost surely and rarely compare pairs below 0.5.
+//
+// a text without words has no shingles and so no signature to compare: it is never reported as
+// a duplicate and never indexed. the index holds at most `capacity` documents, the oldest are
+// evicted first.
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct vecbox_dedup_params {
+    int32_t  num_perm  = 128;  // signature length
+    int32_t  bands     = 16;   // must divide num_perm
+    int32_t  shingle   = 3;    // words per shingle
+    float    threshold = 0.9f; // estimated Jaccard similarity from which a document is a duplicate
+    int32_t  n_embd    = 0;    // > 0: keep each document's embedding so duplicates can reuse it
+    int64_t  capacity  = 65536; // documents kept, 0 = unlimited
+    uint64_t seed      = 42;
+};
+
+struct vecbox_dedup_match {
+    int64_t id      = -1; // earlier document, -1 if none reaches the threshold
+    float   jaccard = 0.0f;
+};
+
+class vecbox_dedup_index {
+public:
+    // throws std::invalid_argument unless num_perm > 0, bands divides num_perm, shingle > 0,
+    // threshold is in [0, 1] and capacity >= 0
+    explicit vecbox_dedup_index(const vecbox_dedup_params & params);
+
+    const vecbox_dedup_params & params() const { return prm; }
+
+    // MinHash of the text's lowercased word shingles, [num_perm]; false if the text has no words,
+    // then sig must not be passed to find or insert
+    bool signature(const std::string & text, uint32_t * sig) const;
+
+    // most similar indexed document at or above the threshold
+    vecbox_dedup_match find(const uint32_t * sig) const;
+
+    // indexes a document, evicting the oldest one when full, and returns its id; embd ([n_embd])
+    // is required when n_embd > 0
+    int64_t insert(const uint32_t * sig, const float * embd = nullptr);
+
+    // signature, find, and insert if no duplicate was found; for indexes without embeddings.
+    // every call takes the next id, so ids count the texts passed to add from 0
+    vecbox_dedup_match add(const std::string & text);
+
+    // copies the [n_embd] embedding of an indexed document to out; false if the document was
+    // evicted or embeddings are not kept
+    bool embedding(int64_t id, float * out) const;
+
+    // documents currently indexed
+    int64_t size() const;
+
+    // forget every document, e.g. when the model whose embeddings were kept is replaced
+    void clear();
+
+private:
+    vecbox_dedup_match find_locked(const uint32_t * sig) const;
+    void insert_locked(int64_t id, const uint32_t * sig, const float * embd);
+    uint64_t band_key(const uint32_t * sig, int32_t band) const;
+
+    vecbox_dedup_params prm;
+    int32_t             rows; // signature entries per band
+
+    // hash function i maps a shingle hash x to mix(perm_a[i]*x + perm_b[i]) mod 2^32
+    std::vector<uint32_t> perm_a;
+    std::vector<uint32_t> perm_b;
+
+    mutable std::mutex mutex;
+    int64_t               next_id   = 0;
+    size_t                next_slot = 0; // the oldest slot once the index is full
+    std::vector<int64_t>  slot_id;       // [n_slots] id of the document in each slot
+    std::vector<uint32_t> sigs;          // [n_slots, num_perm]
+    std::vector<float>    embd;          // [n_slots, n_embd]
+    std::unordered_map<int64_t, size_t> slots; // id -> slot
+    std::vector<std::unordered_map<uint64_t, std::vector<size_t>>> buckets; // per band, slots
+};
@@ -0,0 +1,649 @@
+#include "vecbox-engine.h"
+#include "vecbox-metrics.h"
+#include "vecbox-projection.h"
+#include "vecbox-tokenizer.h"
+
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <random>
+#include <stdexcept>
+
+int64_t vecbox_time_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void vecbox_file_identity(const std::string & path, uint64_t & size, int64_t & mtime_ns) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        size     = 0;
+        mtime_ns = 0;
+        return;
+    }
+    size = (uint64_t) st.st_size;
+#if defined(_WIN32)
+    mtime_ns = (int64_t) st.st_mtime*1000000000;
+#elif defined(__APPLE__)
+    mtime_ns = (int64_t) st.st_mtimespec.tv_sec*1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    // with whole seconds a file rewritten within the second it was indexed would look unchanged
+    mtime_ns = (int64_t) st.st_mtim.tv_sec*1000000000 + st.st_mtim.tv_nsec;
+#endif
+}
+
+FILE * vecbox_open_temp(const std::string & path, std::string & tmp) {
+#ifdef _WIN32
+    static std::atomic<uint64_t> n_temp{0};
+    tmp = path + "." + std::to_string(_getpid()) + "." + std::to_string(n_temp++) + ".tmp";
+    return fopen(tmp.c_str(), "wb");
+#else
+    std::vector<char> name(path.begin(), path.end());
+    for (char c : std::string(".XXXXXX")) {
+        name.push_back(c);
+    }
+    name.push_back('\0');
+
+    const int fd = mkstemp(name.data());
+    if (fd < 0) {
+        tmp = path + ".XXXXXX";
+        return nullptr;
+    }
+    tmp = name.data();
+
+    // mkstemp creates the file private to the owner; the renamed file is read by other processes
+    fchmod(fd, 0644);
+    FILE * f = fdopen(fd, "wb");
+    if (!f) {
+        close(fd);
+        remove(tmp.c_str());
+    }
+    return f;
+#endif
+}
+
+//
+// model
+//
+
+std::shared_ptr<vecbox_model> vecbox_model_load(const std::string & path, const vecbox_model_params & params) {
+    auto model = std::make_shared<vecbox_model>();
+    model->path          = path;
+    model->n_embd_pooled = 768;
+    model->n_embd        = model->n_embd_pooled;
+
+    if (params.projection && params.truncate > 0) {
+        throw std::invalid_argument("use either a projection or truncation, not both");
+    }
+    if (params.truncate > 0) {
+        model->projection = vecbox_projection_truncate(model->n_embd_pooled, params.truncate);
+        model->n_embd     = params.truncate;
+    }
+    if (params.projection) {
+        if (params.projection->n_in != model->n_embd_pooled) {
+            throw std::invalid_argument("projection takes " + std::to_string(params.projection->n_in) +
+                                        " dimensions, model pools to " + std::to_string(model->n_embd_pooled));
+        }
+        model->projection = params.projection;
+        model->n_embd     = params.projection->n_out;
+    }
+
+    model->tokenizer = vecbox_tokenizer_load(path);
+
+    return model;
+}
+
+// serializes warmups of one model
+struct vecbox_model::warm_state {
+    std::mutex mutex;
+};
+
+vecbox_model::vecbox_model() : warm(std::make_unique<warm_state>()) {}
+
+vecbox_model::~vecbox_model() = default;
+
+size_t vecbox_model::tokenizer_projection_bytes() const {
+    size_t bytes = 0;
+    if (tokenizer) {
+        bytes += 3*sizeof(int32_t)*(size_t) tokenizer->n_states;
+    }
+    if (projection) {
+        bytes += sizeof(float)*(projection->mean.size() + projection->components.size() +
+                                projection->variance.size() + projection->bias.size());
+    }
+    return bytes;
+}
+
+void vecbox_model::tokenize(const std::string & text, std::vector<int32_t> & tokens) const {
+    if (tokenizer) {
+        tokenizer->tokenize(text, tokens);
+        return;
+    }
+
+    // placeholder tokenizer: one token per byte
+    tokens.resize(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        tokens[i] = (int32_t) text[i];
+    }
+}
+
+void vecbox_model::encode(const std::vector<int32_t> * tokens, size_t n, float * out) const {
+    // placeholder encoder: deterministic hash-based embeddings until the GGUF encoder is wired in
+    for (size_t t = 0; t < n; ++t) {
+        float * row = out + t*n_embd_pooled;
+        for (int32_t i = 0; i < n_embd_pooled; ++i) {
+            float value = 0.0f;
+            for (int32_t id : tokens[t]) {
+                value += (float) id * (i + 1) * 0.001f;
+            }
+            row[i] = sinf(value) * 0.1f;
+        }
+    }
+}
+
+void vecbox_model::embed(const std::string * texts, size_t n, float * out) const {
+    if (n == 0) {
+        return;
+    }
+
+    const int64_t t_start_us = vecbox_time_us();
+
+    std::vector<std::vector<int32_t>> tokens(n);
+    size_t n_tokens = 0;
+    size_t n_ctx    = 0;
+    for (size_t t = 0; t < n; ++t) {
+        tokenize(texts[t], tokens[t]);
+        n_tokens += tokens[t].size();
+        n_ctx     = std::max(n_ctx, tokens[t].size());
+    }
+
+    const int64_t t_tokenized_us = vecbox_time_us();
+
+    if (projection) {
+        thread_local std::vector<float> pooled;
+        pooled.resize(n*n_embd_pooled);
+        encode(tokens.data(), n, pooled.data());
+        projection->apply(pooled.data(), n, out);
+    } else {
+        encode(tokens.data(), n, out);
+    }
+
+    const int64_t t_end_us = vecbox_time_us();
+
+    const size_t n_padded = n*n_ctx;
+
+    vecbox_metrics_add(VECBOX_COUNTER_BATCHES);
+    vecbox_metrics_add(VECBOX_COUNTER_TEXTS, n);
+    vecbox_metrics_add(VECBOX_COUNTER_TOKENS, n_tokens);
+    vecbox_metrics_add(VECBOX_COUNTER_PADDING_TOKENS, n_padded - n_tokens);
+    vecbox_metrics_observe(VECBOX_HIST_BATCH_SIZE,    (double) n);
+    vecbox_metrics_observe(VECBOX_HIST_BATCH_TOKENS,  (double) n_padded);
+    vecbox_metrics_observe(VECBOX_HIST_PADDING_RATIO, n_padded > 0 ? (double) (n_padded - n_tokens)/n_padded : 0.0);
+    vecbox_metrics_observe(VECBOX_HIST_TOKENIZE, (t_tokenized_us - t_start_us)*1e-6);
+    vecbox_metrics_observe(VECBOX_HIST_COMPUTE,  (t_end_us - t_tokenized_us)*1e-6);
+}
+
+std::shared_ptr<vecbox_model> vecbox_model_load_warm(const std::string & path, const std::vector<std::string> & texts,
+                                                     const vecbox_model_params & params) {
+    auto model = vecbox_model_load(path, params);
+
+    if (!texts.empty()) {
+        std::vector<float> out(texts.size()*model->n_embd);
+        model->embed(texts.data(), texts.size(), out.data());
+    }
+
+    return model;
+}
+
+//
+// warmup
+//
+
+// reads one int per page of the tokenizer's trie, so the first batches do not fault its pages in
+// one miss at a time, e.g. right after the sidecar was mapped; returns the bytes touched
+static size_t vecbox_prefault_tokenizer(const vecbox_tokenizer & tok) {
+    const size_t n    = (size_t) tok.n_states;
+    const size_t step = 4096/sizeof(int32_t);
+
+    int32_t sum = 0;
+    for (const int32_t * arr : { tok.base, tok.check, tok.value }) {
+        const volatile int32_t * p = arr;
+        for (size_t i = 0; i < n; i += step) {
+            sum ^= p[i];
+        }
+    }
+    (void) sum;
+
+    return 3*n*sizeof(int32_t);
+}
+
+vecbox_warmup_report vecbox_model::warmup(const vecbox_warmup_params & params) {
+    if (params.max_batch <= 0 || params.max_seq_len <= 0) {
+        throw std::invalid_argument("warmup needs max_batch and max_seq_len greater than 0");
+    }
+
+    std::lock_guard<std::mutex> lock(warm->mutex);
+
+    vecbox_warmup_report report;
+
+    int64_t t0 = vecbox_time_us();
+    if (tokenizer) {
+        report.prefault_bytes = vecbox_prefault_tokenizer(*tokenizer);
+    }
+    report.t_prefault_us = vecbox_time_us() - t0;
+
+    // one token per byte without a vocab; with one, a one-letter word is one piece (or unknown)
+    // and [CLS] and [SEP] take two more
+    t0 = vecbox_time_us();
+    {
+        std::string text(params.max_seq_len, 'a');
+        if (tokenizer) {
+            text.clear();
+            for (int32_t i = 0; i < std::max(params.max_seq_len - 2, 1); ++i) {
+                text += "a ";
+            }
+        }
+        std::vector<std::string> texts(params.max_batch, text);
+        std::vector<float> out((size_t) params.max_batch*n_embd);
+        embed(texts.data(), texts.size(), out.data());
+    }
+    report.t_dummy_pass_us = vecbox_time_us() - t0;
+
+    return report;
+}
+
+void vecbox_embd_normalize(float * embd, int32_t n_embd) {
+    double sum = 0.0;
+    for (int32_t i = 0; i < n_embd; ++i) {
+        sum += (double) embd[i]*embd[i];
+    }
+
+    const float norm = sum > 0.0 ? (float) (1.0/std::sqrt(sum)) : 0.0f;
+    for (int32_t i = 0; i < n_embd; ++i) {
+        embd[i] *= norm;
+    }
+}
+
+//
+// shadow model
+//
+
+vecbox_shadow::vecbox_shadow(std::shared_ptr<vecbox_model> model, double sample_rate, size_t max_queue)
+    : mdl(std::move(model)), sample_rate(sample_rate), max_queue(std::max<size_t>(max_queue, 1)) {
+    if (!mdl) {
+        throw std::invalid_argument("shadow requires a model");
+    }
+    if (!(sample_rate >= 0.0 && sample_rate <= 1.0)) {
+        throw std::invalid_argument("shadow sample rate must be in [0, 1]");
+    }
+    thread = std::thread([this] { worker(); });
+}
+
+vecbox_shadow::~vecbox_shadow() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        queue.clear();
+    }
+    cv.notify_all();
+    thread.join();
+}
+
+void vecbox_shadow::observe(const std::string * texts, size_t n, const float * embd, int32_t n_embd) {
+    thread_local std::minstd_rand rng(std::random_device{}());
+    if (n == 0 || mdl->n_embd != n_embd || std::uniform_real_distribution<double>(0.0, 1.0)(rng) >= sample_rate) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue.size() >= max_queue) {
+            st.n_dropped += 1;
+            vecbox_metrics_add(VECBOX_COUNTER_SHADOW_DROPPED);
+            return;
+        }
+        sample s;
+        s.texts.assign(texts, texts + n);
+        s.embd.assign(embd, embd + n*n_embd);
+        queue.push_back(std::move(s));
+    }
+    cv.notify_one();
+}
+
+void vecbox_shadow::worker() {
+    while (true) {
+        sample s;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping) {
+                return;
+            }
+            s = std::move(queue.front());
+            queue.pop_front();
+        }
+        try {
+            compare(s);
+        } catch (const std::exception &) {
+            // a broken candidate must not take the serving path down
+        }
+    }
+}
+
+void vecbox_shadow::compare(const sample & s) {
+    const size_t  n      = s.texts.size();
+    const int32_t n_embd = mdl->n_embd;
+
+    std::vector<float> out(n*n_embd);
+    mdl->embed(s.texts.data(), n, out.data());
+
+    vecbox_shadow_stats batch;
+    for (size_t t = 0; t < n; ++t) {
+        const float * a = s.embd.data() + t*n_embd;
+        const float * b = out.data() + t*n_embd;
+
+        double dot = 0.0, na = 0.0, nb = 0.0;
+        for (int32_t i = 0; i < n_embd; ++i) {
+            dot += (double) a[i]*b[i];
+            na  += (double) a[i]*a[i];
+            nb  += (double) b[i]*b[i];
+        }
+        const double cos = na > 0.0 && nb > 0.0 ? dot/std::sqrt(na*nb) : 0.0;
+
+        batch.n_texts += 1;
+        batch.sum_cos += cos;
+        batch.min_cos  = std::min(batch.min_cos, cos);
+        vecbox_metrics_observe(VECBOX_HIST_SHADOW_COSINE, cos);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    st.n_texts += batch.n_texts;
+    st.sum_cos += batch.sum_cos;
+    st.min_cos  = std::min(st.min_cos, batch.min_cos);
+}
+
+vecbox_shadow_stats vecbox_shadow::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return st;
+}
+
+//
+// dynamic batcher
+//
+
+vecbox_batcher::vecbox_batcher(std::shared_ptr<vecbox_model> model, const vecbox_batcher_params & params)
+    : mdl(std::move(model)), params(params) {
+    if (!mdl) {
+        throw std::invalid_argument("batcher requires a model");
+    }
+    if (this->params.max_batch < 1) {
+        this->params.max_batch = 1;
+    }
+    vecbox_metrics_gauge_add(VECBOX_GAUGE_WORKER_THREADS, 1);
+    thread = std::thread([this] { worker(); });
+}
+
+vecbox_batcher::~vecbox_batcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    thread.join();
+
+    vecbox_metrics_gauge_add(VECBOX_GAUGE_WORKER_THREADS, -1);
+    vecbox_metrics_gauge_add(VECBOX_GAUGE_BATCH_SCRATCH_BYTES, -(int64_t) scratch_bytes);
+}
+
+std::shared_ptr<vecbox_model> vecbox_batcher::model() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return mdl;
+}
+
+void vecbox_batcher::swap_model(std::shared_ptr<vecbox_model> model) {
+    if (!model) {
+        throw std::invalid_argument("batcher requires a model");
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (model->n_embd != mdl->n_embd) {
+        throw std::invalid_argument("cannot swap to a model with " + std::to_string(model->n_embd) +
+                                    " dimensions, serving " + std::to_string(mdl->n_embd));
+    }
+    mdl = std::move(model);
+}
+
+void vecbox_batcher::set_shadow(std::shared_ptr<vecbox_shadow> shadow) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->shadow = std::move(shadow);
+}
+
+void vecbox_batcher::submit(std::shared_ptr<vecbox_embd_job> job) {
+    const int32_t n_texts = (int32_t) job->texts.size();
+
+    job->model       = model();
+    job->n_embd      = job->model->n_embd;
+    job->t_submit_us = vecbox_time_us();
+    job->n_pending.store(n_texts);
+
+    if (n_texts == 0) {
+        if (job->on_done) {
+            job->on_done(*job);
+        }
+        return;
+    }
+
+    job->embd.resize((size_t) n_texts*job->n_embd);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        class_queue & q = queues[job->priority == VECBOX_PRIORITY_BULK ? VECBOX_PRIORITY_BULK : VECBOX_PRIORITY_INTERACTIVE];
+        for (int32_t i = 0; i < n_texts; ++i) {
+            q.push(job, i, job->t_submit_us);
+        }
+        st.n_jobs  += 1;
+        st.n_texts += n_texts;
+    }
+    cv.notify_one();
+
+    vecbox_metrics_add(VECBOX_COUNTER_JOBS);
+}
+
+vecbox_batcher_stats vecbox_batcher::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return st;
+}
+
+void vecbox_batcher::class_queue::push(const std::shared_ptr<vecbox_embd_job> & job, int32_t idx, int64_t t_enqueue_us) {
+    tenant_queue & tq = tenants[job->tenant];
+
+    // each text costs 1/weight of virtual time, starting no earlier than the class clock
+    const double start = std::max(vtime, tq.finish);
+    tq.finish = start + 1.0/std::max(job->weight, 1e-3f);
+    tq.items.push_back({ job, idx, t_enqueue_us, start });
+
+    size++;
+}
+
+vecbox_batcher::item vecbox_batcher::class_queue::pop() {
+    auto next = tenants.end();
+    for (auto it = tenants.begin(); it != tenants.end(); ++it) {
+        if (next == tenants.end() || it->second.items.front().start < next->second.items.front().start) {
+            next = it;
+        }
+    }
+
+    item it = std::move(next->second.items.front());
+    next->second.items.pop_front();
+    if (next->second.items.empty()) {
+        tenants.erase(next);
+    }
+
+    vtime = it.start;
+    size--;
+
+    return it;
+}
+
+int64_t vecbox_batcher::class_queue::oldest_us() const {
+    int64_t oldest = INT64_MAX;
+    for (const auto & it : tenants) {
+        oldest = std::min(oldest, it.second.items.front().t_enqueue_us);
+    }
+    return oldest;
+}
+
+void vecbox_batcher::worker() {
+    std::vector<item> batch;
+    batch.reserve(params.max_batch);
+
+    int64_t t_idle_us = vecbox_time_us();
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            class_queue & interactive = queues[VECBOX_PRIORITY_INTERACTIVE];
+            class_queue & bulk        = queues[VECBOX_PRIORITY_BULK];
+
+            cv.wait(lock, [&] { return stopping || interactive.size > 0 || bulk.size > 0; });
+            if (stopping && interactive.size == 0 && bulk.size == 0) {
+                return;
+            }
+
+            const bool    is_bulk = interactive.size == 0;
+            class_queue & q       = is_bulk ? bulk : interactive;
+            const size_t  n_max   = is_bulk && params.max_bulk_batch > 0 ? params.max_bulk_batch : params.max_batch;
+
+            // give a partial batch until its oldest text has waited max_wait_us to fill up
+            const auto deadline = std::chrono::steady_clock::now() +
+                std::chrono::microseconds(std::max<int64_t>(0, q.oldest_us() + params.max_wait_us - vecbox_time_us()));
+
+            cv.wait_until(lock, deadline, [&] {
+                return stopping || q.size >= n_max || (is_bulk && interactive.size > 0);
+            });
+
+            // interactive work arrived while bulk was filling: batch that first
+            if (is_bulk && interactive.size > 0) {
+                continue;
+            }
+
+            const size_t n = std::min(q.size, n_max);
+            for (size_t i = 0; i < n; ++i) {
+                batch.push_back(q.pop());
+            }
+        }
+
+        const int64_t t_busy_us = vecbox_time_us();
+        vecbox_metrics_add(VECBOX_COUNTER_WORKER_IDLE_US, t_busy_us - t_idle_us);
+
+        run_batch(batch);
+        batch.clear();
+
+        t_idle_us = vecbox_time_us();
+        vecbox_metrics_add(VECBOX_COUNTER_WORKER_BUSY_US, t_idle_us - t_busy_us);
+    }
+}
+
+void vecbox_batcher::reserve_scratch(size_t n, int32_t n_embd) {
+    texts.resize(n);
+    out.resize(n*n_embd);
+
+    const size_t bytes = out.capacity()*sizeof(float);
+    if (bytes != scratch_bytes) {
+        vecbox_metrics_gauge_add(VECBOX_GAUGE_BATCH_SCRATCH_BYTES, (int64_t) bytes - (int64_t) scratch_bytes);
+        scratch_bytes = bytes;
+    }
+}
+
+void vecbox_batcher::run_batch(std::vector<item> & batch) {
+    // swaps keep n_embd, so every job in the batch agrees on it
+    const int32_t n_embd = batch[0].job->n_embd;
+    const size_t  n      = batch.size();
+
+    const int64_t t_start_us = vecbox_time_us();
+
+    reserve_scratch(n, n_embd);
+    for (size_t i = 0; i < n; ++i) {
+        texts[i] = batch[i].job->texts[batch[i].idx];
+        const bool is_bulk = batch[i].job->priority == VECBOX_PRIORITY_BULK;
+        vecbox_metrics_observe(is_bulk ? VECBOX_HIST_QUEUE_WAIT_BULK : VECBOX_HIST_QUEUE_WAIT, (t_start_us - batch[i].t_enqueue_us)*1e-6);
+    }
+
+    // one model call per run of texts submitted to the same model; only a swap splits a batch
+    std::vector<std::string> errors(n);
+    const int64_t t_embed_us = vecbox_time_us();
+    for (size_t i0 = 0; i0 < n; ) {
+        const vecbox_model * model = batch[i0].job->model.get();
+
+        size_t i1 = i0 + 1;
+        while (i1 < n && batch[i1].job->model.get() == model) {
+            ++i1;
+        }
+
+        try {
+            model->embed(texts.data() + i0, i1 - i0, out.data() + i0*n_embd);
+        } catch (const std::exception & e) {
+            std::fill(errors.begin() + i0, errors.begin() + i1, std::string(e.what()));
+            vecbox_metrics_add(VECBOX_COUNTER_BATCH_ERRORS);
+        }
+        i0 = i1;
+    }
+    const int64_t t_computed_us = vecbox_time_us();
+
+    std::shared_ptr<vecbox_shadow> shadow;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        st.n_batches    += 1;
+        st.t_compute_us += t_computed_us - t_embed_us;
+        shadow = this->shadow;
+    }
+
+    bool failed = false;
+    for (size_t i = 0; i < n; ++i) {
+        vecbox_embd_job & job = *batch[i].job;
+
+        if (errors[i].empty()) {
+            float * dst = job.embd.data() + (size_t) batch[i].idx*n_embd;
+            std::copy(out.begin() + i*n_embd, out.begin() + (i + 1)*n_embd, dst);
+            if (job.normalize) {
+                vecbox_embd_normalize(dst, n_embd);
+            }
+        } else {
+            failed = true;
+            if (job.error.empty()) {
+                job.error = errors[i];
+            }
+        }
+    }
+
+    vecbox_metrics_observe(VECBOX_HIST_POOL, (vecbox_time_us() - t_computed_us)*1e-6);
+
+    // the last text of a job completes it
+    for (size_t i = 0; i < n; ++i) {
+        vecbox_embd_job & job = *batch[i].job;
+        if (job.n_pending.fetch_sub(1) == 1 && job.on_done) {
+            job.on_done(job);
+        }
+    }
+
+    // queues a copy for the shadow thread, or drops it when that thread is behind
+    if (shadow && !failed) {
+        try {
+            shadow->observe(texts.data(), n, out.data(), n_embd);
+        } catch (const std::exception &) {
+        }
+    }
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+int64_t vecbox_time_us();
+
+// size and modification time in nanoseconds of the file at path, both 0 if it does not exist;
+// identifies the version of a model file that a sidecar was built from
+void vecbox_file_identity(const std::string & path, uint64_t & size, int64_t & mtime_ns);
+
+// opens a new file next to path to be written and then renamed over it: path plus a unique
+// suffix, so concurrent writers of the same path never share one. sets tmp to its name; nullptr
+// if it cannot be created
+FILE * vecbox_open_temp(const std::string & path, std::string & tmp);
+
+// fn(thread, begin, end) over [0, n) split evenly between up to n_threads threads
+template <typename F>
+void vecbox_parallel_for(int n_threads, int64_t n, F && fn) {
+    n_threads = (int) std::max<int64_t>(1, std::min<int64_t>(n_threads, n));
+    if (n_threads == 1) {
+        fn(0, (int64_t) 0, n);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(n_threads);
+    for (int t = 0; t < n_threads; ++t) {
+        threads.emplace_back([&fn, t, n, n_threads] { fn(t, n*t/n_threads, n*(t + 1)/n_threads); });
+    }
+    for (auto & thread : threads) {
+        thread.join();
+    }
+}
+
+//
+// model
+//
+
+struct vecbox_projection;
+struct vecbox_tokenizer;
+
+struct vecbox_model_params {
+    // applied to the pooled embeddings inside embed, so callers only see the reduced vectors
+    std::shared_ptr<const vecbox_projection> projection;
+    int32_t truncate = 0; // > 0: Matryoshka truncation to this many dimensions instead
+};
+
+struct vecbox_warmup_params {
+    int32_t max_batch   = 32;  // texts in the dummy batch
+    int32_t max_seq_len = 512; // tokens per text in the dummy batch
+};
+
+// time spent per warmup step
+struct vecbox_warmup_report {
+    int64_t t_prefault_us    = 0;
+    int64_t t_dummy_pass_us  = 0;
+
+    size_t  prefault_bytes = 0; // tokenizer trie pages touched
+};
+
+struct vecbox_model {
+    std::string path;
+    int32_t     n_embd        = 0; // output dimensions, after the projection if there is one
+    int32_t     n_embd_pooled = 0; // dimensions the encoder pools to
+
+    std::shared_ptr<const vecbox_projection> projection;
+
+    // compiled from the GGUF vocab or mapped from its sidecar, see vecbox-tokenizer.h; nullptr
+    // without a WordPiece vocab, then texts are tokenized one token per byte
+    std::shared_ptr<const vecbox_tokenizer> tokenizer;
+
+    vecbox_model();
+    ~vecbox_model();
+
+    // embed n texts into out, row-major [n, n_embd]
+    // the batch is padded to its longest sequence; tokens, padding and stage times go to the metrics
+    void embed(const std::string * texts, size_t n, float * out) const;
+
+    void tokenize(const std::string & text, std::vector<int32_t> & tokens) const;
+
+    // bytes of the tokenizer trie and the projection, the only state the model builds at load.
+    // not the GGUF tensors or compute buffers: the placeholder encoder has neither
+    size_t tokenizer_projection_bytes() const;
+
+    // moves the first-request costs out of the request path: touches every page of the tokenizer
+    // trie and runs one batch of max_batch x max_seq_len tokens. the placeholder encoder has no
+    // weights or compute buffers to pre-fault or reserve yet. safe to call while the model serves
+    vecbox_warmup_report warmup(const vecbox_warmup_params & params);
+
+private:
+    // tokens[t] -> row t of out
+    void encode(const std::vector<int32_t> * tokens, size_t n, float * out) const;
+
+    struct warm_state;
+    std::unique_ptr<warm_state> warm;
+};
+
+// throws std::runtime_error if the model cannot be loaded, std::invalid_argument if the
+// projection does not take the model's pooled dimensions or both reductions are asked for
+std::shared_ptr<vecbox_model> vecbox_model_load(const std::string & path, const vecbox_model_params & params = {});
+
+// vecbox_model_load, then runs texts through the model once so the first live batch does not
+// pay for page faults and lazy initialization
+std::shared_ptr<vecbox_model> vecbox_model_load_warm(const std::string & path, const std::vector<std::string> & texts,
+                                                     const vecbox_model_params & params = {});
+
+// in-place L2 normalization of one embedding
+void vecbox_embd_normalize(float * embd, int32_t n_embd);
+
+//
+// shadow model
+//
+
+struct vecbox_shadow_stats {
+    uint64_t n_texts   = 0;   // texts compared
+    uint64_t n_dropped = 0;   // sampled batches dropped because the queue was full
+    double   sum_cos   = 0.0; // cosine similarity between serving and shadow embeddings
+    double   min_cos   = 1.0;
+};
+
+// a candidate model run next to the serving one on a sample of live traffic, to check that a
+// new quantization agrees with the current one before switching to it
+//
+// the shadow model runs on its own thread behind a queue of at most max_queue sampled batches;
+// when it falls behind, new samples are dropped instead of slowing the serving path
+class vecbox_shadow {
+public:
+    // throws std::invalid_argument if the model is missing or sample_rate is outside [0, 1]
+    vecbox_shadow(std::shared_ptr<vecbox_model> model, double sample_rate, size_t max_queue = 4);
+    ~vecbox_shadow(); // drops the queued samples, waits for the one being compared
+
+    vecbox_shadow(const vecbox_shadow &) = delete;
+    vecbox_shadow & operator=(const vecbox_shadow &) = delete;
+
+    // with probability sample_rate, copies texts and embd, the serving model's output for them
+    // ([n, n_embd], before normalization), for the shadow thread to embed and compare
+    void observe(const std::string * texts, size_t n, const float * embd, int32_t n_embd);
+
+    const std::shared_ptr<vecbox_model> & model() const { return mdl; }
+
+    vecbox_shadow_stats stats() const;
+
+private:
+    struct sample {
+        std::vector<std::string> texts;
+        std::vector<float>       embd;
+    };
+
+    void worker();
+    void compare(const sample & s);
+
+    std::shared_ptr<vecbox_model> mdl;
+    double                        sample_rate;
+    size_t                        max_queue;
+
+    mutable std::mutex      mutex;
+    std::condition_variable cv;
+    std::deque<sample>      queue;
+    bool                    stopping = false;
+    vecbox_shadow_stats     st;
+
+    std::thread thread;
+};
+
+//
+// dynamic batcher
+//
+
+enum vecbox_priority {
+    VECBOX_PRIORITY_INTERACTIVE = 0, // latency-sensitive queries, always batched first
+    VECBOX_PRIORITY_BULK        = 1, // throughput work such as re-indexing, runs on capacity interactive traffic leaves idle
+    VECBOX_PRIORITY_COUNT,
+};
+
+// one caller request: a group of texts whose embeddings are returned together
+// on_done runs on the batcher thread once every text has been embedded (or on error)
+struct vecbox_embd_job {
+    std::vector<std::string> texts;
+    bool                     normalize = false;
+
+    std::shared_ptr<vecbox_model> model; // set by submit; every text of the job runs on it
+
+    vecbox_priority priority = VECBOX_PRIORITY_INTERACTIVE;
+    std::string     tenant;         // texts of one class are shared fairly between tenants
+    float           weight = 1.0f;  // the tenant's share relative to the others in its class
+
+    std::vector<float> embd;  // [texts.size(), n_embd], filled by the batcher
+    int32_t            n_embd = 0;
+    std::string        error;
+
+    std::function<void(vecbox_embd_job &)> on_done;
+
+    // internal
+    std::atomic<int32_t> n_pending{0};
+    int64_t              t_submit_us = 0;
+};
+
+struct vecbox_batcher_params {
+    int32_t max_batch      = 32;   // texts per model call
+    int32_t max_wait_us    = 2000; // how long a partial batch waits for more texts
+    int32_t max_bulk_batch = 0;    // texts per bulk-only model call, 0 = max_batch; smaller preempts bulk sooner
+};
+
+struct vecbox_batcher_stats {
+    uint64_t n_jobs    = 0;
+    uint64_t n_texts   = 0;
+    uint64_t n_batches = 0;
+    uint64_t t_compute_us = 0;
+};
+
+// Collects texts from concurrent jobs into batches of up to max_batch and runs them on the model
+// from a single worker thread. A partial batch is flushed once its oldest text has waited
+// max_wait_us, so a lone request pays at most that much extra latency.
+//
+// Batches hold one priority class. Interactive texts always go first; bulk texts only run when no
+// interactive text is waiting, so a large bulk job yields at every batch boundary and interactive
+// latency is bounded by one bulk batch. Within a class, tenants share batches in proportion to
+// their weight (start-time fair queuing), so one tenant's backlog cannot starve the others.
+//
+// The model can be swapped while serving: jobs submitted afterwards run on the new model, jobs
+// already queued finish on the one they were submitted to, and the old model is freed once the
+// last of them completes.
+class vecbox_batcher {
+public:
+    vecbox_batcher(std::shared_ptr<vecbox_model> model, const vecbox_batcher_params & params);
+    ~vecbox_batcher();
+
+    vecbox_batcher(const vecbox_batcher &) = delete;
+    vecbox_batcher & operator=(const vecbox_batcher &) = delete;
+
+    void submit(std::shared_ptr<vecbox_embd_job> job);
+
+    std::shared_ptr<vecbox_model> model() const;
+
+    // switches new jobs to model; throws std::invalid_argument if its n_embd differs
+    void swap_model(std::shared_ptr<vecbox_model> model);
+
+    // compare a candidate model on sampled batches; nullptr stops
+    void set_shadow(std::shared_ptr<vecbox_shadow> shadow);
+
+    vecbox_batcher_stats stats() const;
+
+private:
+    struct item {
+        std::shared_ptr<vecbox_embd_job> job;
+        int32_t                          idx;
+        int64_t                          t_enqueue_us;
+        double                           start; // virtual start tag within its class
+    };
+
+    struct tenant_queue {
+        std::deque<item> items;
+        double           finish = 0.0; // virtual finish tag of the last queued text
+    };
+
+    // one priority class; tenants are dropped once drained
+    struct class_queue {
+        std::unordered_map<std::string, tenant_queue> tenants;
+        double vtime = 0.0;
+        size_t size  = 0;
+
+        void push(const std::shared_ptr<vecbox_embd_job> & job, int32_t idx, int64_t t_enqueue_us);
+        item pop();
+        int64_t oldest_us() const;
+    };
+
+    void worker();
+    void run_batch(std::vector<item> & batch);
+    void reserve_scratch(size_t n, int32_t n_embd);
+
+    std::shared_ptr<vecbox_model>  mdl;
+    std::shared_ptr<vecbox_shadow> shadow;
+    vecbox_batcher_params          params;
+
+    mutable std::mutex      mutex;
+    std::condition_variable cv;
+    class_queue             queues[VECBOX_PRIORITY_COUNT];
+    bool                    stopping = false;
+
+    vecbox_batcher_stats st;
+
+    // worker-only: model outputs of the current batch, kept across batches
+    std::vector<std::string> texts;
+    std::vector<float>       out;
+    size_t                   scratch_bytes = 0;
+
+    std::thread thread;
+};
@@ -0,0 +1,49 @@
+#include "vecbox-event.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+vecbox_completion_queue::vecbox_completion_queue() {
+    efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd < 0) {
+        throw std::runtime_error(std::string("eventfd: ") + strerror(errno));
+    }
+}
+
+vecbox_completion_queue::~vecbox_completion_queue() {
+    close(efd);
+}
+
+void vecbox_completion_queue::push(uint64_t tag, uint64_t id) {
+    bool was_empty;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        was_empty = entries.empty();
+        entries.push_back({ tag, id });
+    }
+
+    // the loop drains everything on one wakeup, so only the first entry needs to signal
+    if (was_empty) {
+        const uint64_t one = 1;
+        ssize_t rc = write(efd, &one, sizeof(one));
+        (void) rc;
+    }
+}
+
+std::vector<vecbox_completion_queue::entry> vecbox_completion_queue::drain() {
+    uint64_t value;
+    ssize_t rc = read(efd, &value, sizeof(value));
+    (void) rc;
+
+    std::vector<entry> out;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        out.swap(entries);
+    }
+    return out;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+// completion handoff from the batcher thread to an epoll event loop (Linux only)
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// on_done callbacks should capture a shared_ptr to the queue: a job that finishes after its
+// event loop is gone then lands in a queue nobody reads instead of in freed memory
+class vecbox_completion_queue {
+public:
+    struct entry {
+        uint64_t tag; // which connection/channel
+        uint64_t id;  // which request on it
+    };
+
+    // throws std::runtime_error if the eventfd cannot be created
+    vecbox_completion_queue();
+    ~vecbox_completion_queue();
+
+    vecbox_completion_queue(const vecbox_completion_queue &) = delete;
+    vecbox_completion_queue & operator=(const vecbox_completion_queue &) = delete;
+
+    // readable whenever entries are pending
+    int fd() const { return efd; }
+
+    // any thread
+    void push(uint64_t tag, uint64_t id);
+
+    // event loop thread: takes all pending entries and resets the eventfd
+    std::vector<entry> drain();
+
+private:
+    int efd = -1;
+
+    std::mutex         mutex;
+    std::vector<entry> entries;
+};
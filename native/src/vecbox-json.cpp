@@ -0,0 +1,329 @@
+#include "vecbox-json.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+struct json_reader {
+    const char * p;
+    const char * end;
+
+    [[noreturn]] void fail(const char * what) const {
+        throw std::invalid_argument(std::string("invalid JSON: ") + what);
+    }
+
+    void ws() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            ++p;
+        }
+    }
+
+    bool peek(char c) {
+        ws();
+        return p < end && *p == c;
+    }
+
+    void expect(char c) {
+        ws();
+        if (p >= end || *p != c) {
+            char msg[32];
+            snprintf(msg, sizeof(msg), "expected '%c'", c);
+            fail(msg);
+        }
+        ++p;
+    }
+
+    bool literal(const char * lit) {
+        const size_t n = strlen(lit);
+        if ((size_t) (end - p) >= n && memcmp(p, lit, n) == 0) {
+            p += n;
+            return true;
+        }
+        return false;
+    }
+
+    uint32_t hex4() {
+        if (end - p < 4) {
+            fail("truncated \\u escape");
+        }
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) {
+            const char c = *p++;
+            v <<= 4;
+            if      (c >= '0' && c <= '9') v |= c - '0';
+            else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+            else fail("bad \\u escape");
+        }
+        return v;
+    }
+
+    static void put_utf8(std::string & out, uint32_t cp) {
+        if (cp < 0x80) {
+            out += (char) cp;
+        } else if (cp < 0x800) {
+            out += (char) (0xC0 | (cp >> 6));
+            out += (char) (0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += (char) (0xE0 | (cp >> 12));
+            out += (char) (0x80 | ((cp >> 6) & 0x3F));
+            out += (char) (0x80 | (cp & 0x3F));
+        } else {
+            out += (char) (0xF0 | (cp >> 18));
+            out += (char) (0x80 | ((cp >> 12) & 0x3F));
+            out += (char) (0x80 | ((cp >> 6) & 0x3F));
+            out += (char) (0x80 | (cp & 0x3F));
+        }
+    }
+
+    std::string string() {
+        expect('"');
+        std::string out;
+        while (true) {
+            // copy runs of plain bytes in one go
+            const char * run = p;
+            while (p < end && *p != '"' && *p != '\\' && (unsigned char) *p >= 0x20) {
+                ++p;
+            }
+            out.append(run, p - run);
+
+            if (p >= end) {
+                fail("unterminated string");
+            }
+            const char c = *p++;
+            if (c == '"') {
+                return out;
+            }
+            if (c != '\\') {
+                fail("control character in string");
+            }
+            if (p >= end) {
+                fail("unterminated escape");
+            }
+            switch (*p++) {
+                case '"':  out += '"';  break;
+                case '\\': out += '\\'; break;
+                case '/':  out += '/';  break;
+                case 'b':  out += '\b'; break;
+                case 'f':  out += '\f'; break;
+                case 'n':  out += '\n'; break;
+                case 'r':  out += '\r'; break;
+                case 't':  out += '\t'; break;
+                case 'u': {
+                    uint32_t cp = hex4();
+                    if (cp >= 0xD800 && cp <= 0xDBFF) {
+                        if (!literal("\\u")) {
+                            fail("unpaired surrogate");
+                        }
+                        const uint32_t lo = hex4();
+                        if (lo < 0xDC00 || lo > 0xDFFF) {
+                            fail("unpaired surrogate");
+                        }
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                        fail("unpaired surrogate");
+                    }
+                    put_utf8(out, cp);
+                } break;
+                default:
+                    fail("bad escape");
+            }
+        }
+    }
+
+    bool boolean() {
+        ws();
+        if (literal("true"))  return true;
+        if (literal("false")) return false;
+        fail("expected boolean");
+    }
+
+    void skip_value(int depth = 0) {
+        if (depth > 64) {
+            fail("nesting too deep");
+        }
+        ws();
+        if (p >= end) {
+            fail("unexpected end");
+        }
+        switch (*p) {
+            case '"': string(); return;
+            case '{': {
+                ++p;
+                if (peek('}')) { ++p; return; }
+                do {
+                    string();
+                    expect(':');
+                    skip_value(depth + 1);
+                } while (next_member('}'));
+            } return;
+            case '[': {
+                ++p;
+                if (peek(']')) { ++p; return; }
+                do {
+                    skip_value(depth + 1);
+                } while (next_member(']'));
+            } return;
+            default: {
+                if (literal("true") || literal("false") || literal("null")) {
+                    return;
+                }
+                const char * start = p;
+                while (p < end && (strchr("+-.eE", *p) || (*p >= '0' && *p <= '9'))) {
+                    ++p;
+                }
+                if (p == start) {
+                    fail("unexpected character");
+                }
+            }
+        }
+    }
+
+    // after a member: true if another one follows, false if the container closed
+    bool next_member(char close) {
+        ws();
+        if (p < end && *p == ',') {
+            ++p;
+            return true;
+        }
+        expect(close);
+        return false;
+    }
+};
+
+} // namespace
+
+vecbox_embd_request vecbox_json_parse_embd_request(const char * data, size_t size) {
+    json_reader r { data, data + size };
+    vecbox_embd_request req;
+    bool has_input = false;
+
+    r.expect('{');
+    if (r.peek('}')) {
+        ++r.p;
+    } else {
+        do {
+            const std::string key = r.string();
+            r.expect(':');
+            if (key == "input") {
+                if (r.peek('[')) {
+                    ++r.p;
+                    if (r.peek(']')) {
+                        ++r.p;
+                    } else {
+                        do {
+                            req.input.push_back(r.string());
+                        } while (r.next_member(']'));
+                    }
+                } else {
+                    req.input.push_back(r.string());
+                }
+                has_input = true;
+            } else if (key == "model") {
+                if (r.peek('"')) {
+                    req.model = r.string();
+                } else {
+                    r.skip_value();
+                }
+            } else if (key == "normalize") {
+                req.normalize = r.boolean();
+            } else if (key == "encoding_format") {
+                const std::string format = r.string();
+                if (format == "base64") {
+                    req.base64 = true;
+                } else if (format != "float") {
+                    throw std::invalid_argument("unsupported encoding_format: " + format);
+                }
+            } else if (key == "priority") {
+                const std::string priority = r.string();
+                if (priority == "bulk") {
+                    req.bulk = true;
+                } else if (priority != "interactive") {
+                    throw std::invalid_argument("unsupported priority: " + priority);
+                }
+            } else if (key == "tenant") {
+                req.tenant = r.string();
+            } else {
+                r.skip_value();
+            }
+        } while (r.next_member('}'));
+    }
+
+    r.ws();
+    if (r.p != r.end) {
+        r.fail("trailing characters");
+    }
+    if (!has_input) {
+        throw std::invalid_argument("missing \"input\"");
+    }
+
+    return req;
+}
+
+void vecbox_json_append_string(std::string & out, const std::string & s) {
+    static const char hex[] = "0123456789abcdef";
+
+    out += '"';
+    for (unsigned char c : s) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n";  break;
+            case '\r': out += "\\r";  break;
+            case '\t': out += "\\t";  break;
+            default:
+                if (c < 0x20) {
+                    out += "\\u00";
+                    out += hex[c >> 4];
+                    out += hex[c & 0xF];
+                } else {
+                    out += (char) c;
+                }
+        }
+    }
+    out += '"';
+}
+
+// longest shortest-form float is "-1.17549435e-38"; fixed notation can need 39 integer digits
+#define VECBOX_JSON_FLOAT_SHORTEST_MAX 15
+#define VECBOX_JSON_FLOAT_FIXED_MAX    41
+#define VECBOX_JSON_FLOAT_PREC_MAX     9
+
+size_t vecbox_json_floats_max_size(size_t n, int precision) {
+    const size_t per_value = precision < 0
+        ? VECBOX_JSON_FLOAT_SHORTEST_MAX
+        : VECBOX_JSON_FLOAT_FIXED_MAX + std::min(precision, VECBOX_JSON_FLOAT_PREC_MAX);
+
+    return 2 + n*(per_value + 1);
+}
+
+char * vecbox_json_write_floats(char * dst, const float * x, size_t n, int precision) {
+    precision = std::min(precision, VECBOX_JSON_FLOAT_PREC_MAX);
+
+    const size_t per_value = vecbox_json_floats_max_size(1, precision) - 3;
+
+    *dst++ = '[';
+    for (size_t i = 0; i < n; ++i) {
+        if (i > 0) {
+            *dst++ = ',';
+        }
+        if (!std::isfinite(x[i])) {
+            memcpy(dst, "null", 4);
+            dst += 4;
+            continue;
+        }
+        const std::to_chars_result res = precision < 0
+            ? std::to_chars(dst, dst + per_value, x[i])
+            : std::to_chars(dst, dst + per_value, x[i], std::chars_format::fixed, precision);
+        dst = res.ptr;
+    }
+    *dst++ = ']';
+
+    return dst;
+}
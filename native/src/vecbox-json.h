@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// minimal JSON helpers for the embedding wire protocol
+// only what the server needs: parse one request object and escape strings on the way out
+
+struct vecbox_embd_request {
+    std::string              model;
+    std::vector<std::string> input;
+    bool                     normalize = false;
+    bool                     base64    = false; // "encoding_format": "base64"
+    bool                     bulk      = false; // "priority": "bulk"
+    std::string              tenant;
+};
+
+// parses {"model": str, "input": str | [str], "normalize": bool, "encoding_format": "float" | "base64",
+//         "priority": "interactive" | "bulk", "tenant": str}
+// unknown fields are skipped
+// throws std::invalid_argument on malformed JSON or a missing/mistyped "input"
+vecbox_embd_request vecbox_json_parse_embd_request(const char * data, size_t size);
+
+// appends s to out as a quoted JSON string
+void vecbox_json_append_string(std::string & out, const std::string & s);
+
+// upper bound on what vecbox_json_write_floats writes for n values
+size_t vecbox_json_floats_max_size(size_t n, int precision = -1);
+
+// writes x as a JSON array "[a,b,...]" into dst and returns the end; dst must hold
+// vecbox_json_floats_max_size(n, precision) bytes. precision < 0 gives the shortest text that
+// parses back to the same float, otherwise fixed notation with that many decimals (at most 9).
+// non-finite values are written as null
+char * vecbox_json_write_floats(char * dst, const float * x, size_t n, int precision = -1);
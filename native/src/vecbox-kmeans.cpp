@@ -0,0 +1,432 @@
+#include "vecbox-kmeans.h"
+#include "vecbox-engine.h"
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+static float vecbox_dot(const float * a, const float * b, int32_t n) {
+    float sum = 0.0f;
+    for (int32_t i = 0; i < n; ++i) {
+        sum += a[i]*b[i];
+    }
+    return sum;
+}
+
+namespace {
+
+// best[i] = max over centroids of x[i]·c - ||c||^2/2 (x[i]·c in spherical mode), labels[i] = its argmax
+class vecbox_kmeans_assigner {
+public:
+    vecbox_kmeans_assigner(int32_t n_embd, int32_t k, int64_t block_rows, int n_threads) : n_embd(n_embd), k(k) {
+        ggml_init_params params = {
+            /*.mem_size   =*/ ggml_row_size(GGML_TYPE_F32, n_embd)*(k + block_rows) + sizeof(float)*k*(block_rows + 1) +
+                              sizeof(int32_t)*block_rows + 5*ggml_tensor_overhead() + ggml_graph_overhead() + 1024,
+            /*.mem_buffer =*/ nullptr,
+            /*.no_alloc   =*/ false,
+        };
+        ctx = ggml_init(params);
+        if (!ctx) {
+            throw std::runtime_error("failed to allocate the k-means context");
+        }
+
+        x      = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, n_embd, block_rows);
+        c      = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, n_embd, k);
+        bias   = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, k);
+        scores = ggml_add_inplace(ctx, ggml_mul_mat(ctx, c, x), bias);
+        labels = ggml_argmax(ctx, scores);
+
+        gf = ggml_new_graph(ctx);
+        ggml_build_forward_expand(gf, labels);
+
+        // one pool for the whole run: without it every block would start and join its own threads
+        ggml_threadpool_params tpp = ggml_threadpool_params_default(n_threads);
+        threadpool = ggml_threadpool_new(&tpp);
+        if (!threadpool) {
+            ggml_free(ctx);
+            throw std::runtime_error("failed to create the k-means threadpool");
+        }
+
+        plan = ggml_graph_plan(gf, n_threads, threadpool);
+        work.resize(plan.work_size);
+        plan.work_data = work.data();
+
+        x_own = x->data;
+    }
+
+    ~vecbox_kmeans_assigner() {
+        ggml_threadpool_free(threadpool);
+        ggml_free(ctx);
+    }
+
+    vecbox_kmeans_assigner(const vecbox_kmeans_assigner &) = delete;
+    vecbox_kmeans_assigner & operator=(const vecbox_kmeans_assigner &) = delete;
+
+    void set_centroids(const float * centroids, bool spherical) {
+        memcpy(c->data, centroids, sizeof(float)*k*n_embd);
+        float * b = (float *) bias->data;
+        for (int32_t j = 0; j < k; ++j) {
+            b[j] = spherical ? 0.0f : -0.5f*vecbox_dot(centroids + j*n_embd, centroids + j*n_embd, n_embd);
+        }
+    }
+
+    void assign(const float * rows, int64_t n, int32_t * out_labels, float * out_best) {
+        const int64_t blk = x->ne[1];
+        for (int64_t i0 = 0; i0 < n; i0 += blk) {
+            const int64_t n_blk = std::min(blk, n - i0);
+            if (n_blk == blk) {
+                // full blocks are read in place, straight from the caller's (possibly mapped) rows
+                x->data = (void *) (rows + i0*n_embd);
+            } else {
+                x->data = x_own;
+                memcpy(x_own, rows + i0*n_embd, sizeof(float)*n_blk*n_embd);
+                memset((float *) x_own + n_blk*n_embd, 0, sizeof(float)*(blk - n_blk)*n_embd);
+            }
+
+            if (ggml_graph_compute(gf, &plan) != GGML_STATUS_SUCCESS) {
+                ggml_threadpool_pause(threadpool);
+                throw std::runtime_error("k-means assignment failed");
+            }
+
+            const int32_t * idx = (const int32_t *) labels->data;
+            for (int64_t i = 0; i < n_blk; ++i) {
+                const float * row = (const float *) ((const char *) scores->data + i*scores->nb[1]);
+                out_labels[i0 + i] = idx[i];
+                out_best[i0 + i]   = row[idx[i]];
+            }
+        }
+        x->data = x_own;
+
+        // the workers would otherwise keep polling while the centroids are updated; the next
+        // compute resumes them
+        ggml_threadpool_pause(threadpool);
+    }
+
+private:
+    int32_t n_embd;
+    int32_t k;
+
+    ggml_context * ctx    = nullptr;
+    ggml_tensor  * x      = nullptr;
+    ggml_tensor  * c      = nullptr;
+    ggml_tensor  * bias   = nullptr;
+    ggml_tensor  * scores = nullptr;
+    ggml_tensor  * labels = nullptr;
+    ggml_cgraph  * gf     = nullptr;
+    void         * x_own  = nullptr;
+
+    ggml_threadpool    * threadpool = nullptr;
+    ggml_cplan           plan;
+    std::vector<uint8_t> work;
+};
+
+// per-thread centroid sums, reduced after each pass
+struct vecbox_kmeans_accum {
+    std::vector<double>  sums;   // [n_acc, k, n_embd]
+    std::vector<int64_t> counts; // [n_acc, k]
+    int                  n_acc = 1;
+};
+
+}
+
+// squared distance (1 - cos in spherical mode) of a row to its centroid, from the assignment score
+static double vecbox_kmeans_dist(float best, float norm2, bool spherical) {
+    if (spherical) {
+        return norm2 > 0.0f ? 1.0 - best/std::sqrt(norm2) : 1.0;
+    }
+    return std::max(0.0, (double) norm2 - 2.0*best);
+}
+
+// sums rows (normalized in spherical mode) into their clusters, one accumulator per thread; the
+// totals end up in the first accumulator. rows[i] is x + row(i)*n_embd
+template <typename R>
+static void vecbox_kmeans_accumulate(vecbox_kmeans_accum & acc, const float * x, int64_t n, R && row,
+                                     const int32_t * labels, const float * norm2, int32_t k, int32_t n_embd, bool spherical) {
+    std::fill(acc.sums.begin(), acc.sums.end(), 0.0);
+    std::fill(acc.counts.begin(), acc.counts.end(), 0);
+
+    const int n_used = (int) std::max<int64_t>(1, std::min<int64_t>(acc.n_acc, n));
+    vecbox_parallel_for(n_used, n, [&](int t, int64_t begin, int64_t end) {
+        double  * sums   = acc.sums.data()   + (size_t) t*k*n_embd;
+        int64_t * counts = acc.counts.data() + (size_t) t*k;
+        for (int64_t i = begin; i < end; ++i) {
+            const int64_t r   = row(i);
+            const float * src = x + r*n_embd;
+            double      * dst = sums + (size_t) labels[i]*n_embd;
+            const double  w   = spherical ? (norm2[r] > 0.0f ? 1.0/std::sqrt(norm2[r]) : 0.0) : 1.0;
+            for (int32_t d = 0; d < n_embd; ++d) {
+                dst[d] += w*src[d];
+            }
+            counts[labels[i]]++;
+        }
+    });
+
+    // reduce over centroids so the threads write disjoint ranges
+    vecbox_parallel_for(acc.n_acc, k, [&](int, int64_t begin, int64_t end) {
+        for (int t = 1; t < n_used; ++t) {
+            const double  * sums   = acc.sums.data()   + (size_t) t*k*n_embd;
+            const int64_t * counts = acc.counts.data() + (size_t) t*k;
+            for (int64_t j = begin; j < end; ++j) {
+                for (int32_t d = 0; d < n_embd; ++d) {
+                    acc.sums[j*n_embd + d] += sums[j*n_embd + d];
+                }
+                acc.counts[j] += counts[j];
+            }
+        }
+    });
+}
+
+// k-means++ seeding on a sample of the rows
+static void vecbox_kmeans_init(const float * x, int64_t n, int32_t n_embd, const float * norm2,
+                               const vecbox_kmeans_params & params, int n_threads, std::mt19937_64 & rng, float * centroids) {
+    const int32_t k = params.k;
+    const int64_t n_sample = std::min<int64_t>(n, params.init_sample > 0 ? params.init_sample : 64*(int64_t) k);
+
+    std::vector<int64_t> sample(n_sample);
+    if (n_sample == n) {
+        for (int64_t i = 0; i < n; ++i) {
+            sample[i] = i;
+        }
+    } else {
+        std::uniform_int_distribution<int64_t> pick(0, n - 1);
+        for (auto & s : sample) {
+            s = pick(rng);
+        }
+    }
+
+    auto dist = [&](int64_t r, const float * centroid, float c_norm2) {
+        const float dot = vecbox_dot(x + r*n_embd, centroid, n_embd);
+        if (params.spherical) {
+            return norm2[r] > 0.0f ? std::max(0.0f, 1.0f - dot/std::sqrt(norm2[r])) : 1.0f;
+        }
+        return std::max(0.0f, norm2[r] - 2.0f*dot + c_norm2);
+    };
+
+    auto set_centroid = [&](int32_t j, int64_t r) {
+        float * dst = centroids + (size_t) j*n_embd;
+        memcpy(dst, x + r*n_embd, sizeof(float)*n_embd);
+        if (params.spherical) {
+            vecbox_embd_normalize(dst, n_embd);
+        }
+        return vecbox_dot(dst, dst, n_embd);
+    };
+
+    std::vector<float> d2(n_sample, std::numeric_limits<float>::max());
+    int64_t next = sample[std::uniform_int_distribution<int64_t>(0, n_sample - 1)(rng)];
+    for (int32_t j = 0; j < k; ++j) {
+        const float c_norm2 = set_centroid(j, next);
+        if (j == k - 1) {
+            break;
+        }
+
+        const float * centroid = centroids + (size_t) j*n_embd;
+        vecbox_parallel_for(n_threads, n_sample, [&](int, int64_t begin, int64_t end) {
+            for (int64_t s = begin; s < end; ++s) {
+                d2[s] = std::min(d2[s], dist(sample[s], centroid, c_norm2));
+            }
+        });
+
+        // next centroid with probability proportional to d2; a uniform pick once every row is covered
+        double total = 0.0;
+        for (float v : d2) {
+            total += v;
+        }
+        if (total <= 0.0) {
+            next = sample[std::uniform_int_distribution<int64_t>(0, n_sample - 1)(rng)];
+            continue;
+        }
+        double target = std::uniform_real_distribution<double>(0.0, total)(rng);
+        int64_t s = 0;
+        for (; s < n_sample - 1; ++s) {
+            target -= d2[s];
+            if (target < 0.0) {
+                break;
+            }
+        }
+        next = sample[s];
+    }
+}
+
+vecbox_kmeans_result vecbox_kmeans(const float * x, int64_t n, int32_t n_embd, const vecbox_kmeans_params & params) {
+    const int32_t k = params.k;
+    if (k < 1 || k > n) {
+        throw std::invalid_argument("k-means needs 1 <= k <= rows, got k = " + std::to_string(k) + " for " + std::to_string(n) + " rows");
+    }
+    if (n_embd <= 0 || params.block_rows <= 0 || params.max_iter < 0 || params.batch_size < 0) {
+        throw std::invalid_argument("invalid k-means parameters");
+    }
+
+    const int n_threads = params.n_threads > 0 ? params.n_threads : (int) std::max(1u, std::thread::hardware_concurrency());
+    const bool spherical = params.spherical;
+
+    std::mt19937_64 rng(params.seed);
+
+    std::vector<float> norm2(n);
+    vecbox_parallel_for(n_threads, n, [&](int, int64_t begin, int64_t end) {
+        for (int64_t i = begin; i < end; ++i) {
+            norm2[i] = vecbox_dot(x + i*n_embd, x + i*n_embd, n_embd);
+        }
+    });
+
+    vecbox_kmeans_result result;
+    result.centroids.resize((size_t) k*n_embd);
+    result.labels.resize(n);
+    float * centroids = result.centroids.data();
+
+    vecbox_kmeans_init(x, n, n_embd, norm2.data(), params, n_threads, rng, centroids);
+
+    // accumulators are k x n_embd doubles each; past 64 MiB more threads only add memory traffic
+    vecbox_kmeans_accum acc;
+    const size_t acc_bytes = sizeof(double)*k*n_embd;
+    acc.n_acc = (int) std::max<size_t>(1, std::min<size_t>(n_threads, (64u << 20)/acc_bytes));
+    acc.sums.resize((size_t) acc.n_acc*k*n_embd);
+    acc.counts.resize((size_t) acc.n_acc*k);
+
+    vecbox_kmeans_assigner assigner(n_embd, k, std::min<int64_t>(params.block_rows, n), n_threads);
+    std::vector<float> best(n);
+
+    auto assign_all = [&] {
+        assigner.set_centroids(centroids, spherical);
+        assigner.assign(x, n, result.labels.data(), best.data());
+
+        double inertia = 0.0;
+        for (int64_t i = 0; i < n; ++i) {
+            inertia += vecbox_kmeans_dist(best[i], norm2[i], spherical);
+        }
+        return inertia;
+    };
+
+    std::uniform_int_distribution<int64_t> pick(0, n - 1);
+
+    if (params.batch_size == 0) {
+        // Lloyd: the labels and inertia returned always belong to the returned centroids
+        double prev = std::numeric_limits<double>::infinity();
+        for (int32_t iter = 0; ; ++iter) {
+            const double inertia = assign_all();
+            result.inertia = inertia;
+            if (iter == params.max_iter || (iter > 0 && prev - inertia <= params.tol*prev)) {
+                break;
+            }
+            prev = inertia;
+
+            vecbox_kmeans_accumulate(acc, x, n, [](int64_t i) { return i; }, result.labels.data(), norm2.data(), k, n_embd, spherical);
+            for (int32_t j = 0; j < k; ++j) {
+                float * dst = centroids + (size_t) j*n_embd;
+                if (acc.counts[j] == 0) {
+                    // empty cluster: restart it on a random row
+                    memcpy(dst, x + pick(rng)*n_embd, sizeof(float)*n_embd);
+                } else {
+                    for (int32_t d = 0; d < n_embd; ++d) {
+                        dst[d] = (float) (acc.sums[(size_t) j*n_embd + d]/acc.counts[j]);
+                    }
+                }
+                if (spherical) {
+                    vecbox_embd_normalize(dst, n_embd);
+                }
+            }
+            result.n_iter = iter + 1;
+        }
+        return result;
+    }
+
+    // mini-batch (Sculley 2010): each centroid moves towards the batch mean of its rows with a
+    // learning rate of 1 / rows seen so far
+    const int64_t batch = std::min<int64_t>(params.batch_size, n);
+    std::vector<int64_t> rows(batch);
+    std::vector<float>   xb((size_t) batch*n_embd);
+    std::vector<float>   best_b(batch);
+    std::vector<int32_t> labels_b(batch);
+    std::vector<int64_t> seen(k, 0);
+
+    for (int32_t iter = 0; iter < params.max_iter; ++iter) {
+        for (int64_t i = 0; i < batch; ++i) {
+            rows[i] = pick(rng);
+            memcpy(xb.data() + i*n_embd, x + rows[i]*n_embd, sizeof(float)*n_embd);
+        }
+
+        assigner.set_centroids(centroids, spherical);
+        assigner.assign(xb.data(), batch, labels_b.data(), best_b.data());
+
+        vecbox_kmeans_accumulate(acc, x, batch, [&](int64_t i) { return rows[i]; }, labels_b.data(), norm2.data(), k, n_embd, spherical);
+        for (int32_t j = 0; j < k; ++j) {
+            if (acc.counts[j] == 0) {
+                continue;
+            }
+            float * dst = centroids + (size_t) j*n_embd;
+            const double total = (double) (seen[j] + acc.counts[j]);
+            for (int32_t d = 0; d < n_embd; ++d) {
+                dst[d] = (float) ((seen[j]*(double) dst[d] + acc.sums[(size_t) j*n_embd + d])/total);
+            }
+            if (spherical) {
+                vecbox_embd_normalize(dst, n_embd);
+            }
+            seen[j] += acc.counts[j];
+        }
+        result.n_iter = iter + 1;
+    }
+
+    result.inertia = assign_all();
+    return result;
+}
+
+//
+// mapped rows
+//
+
+#ifndef _WIN32
+
+vecbox_mapped_rows::vecbox_mapped_rows(const std::string & path, int32_t n_embd) {
+    if (n_embd <= 0) {
+        throw std::invalid_argument("mapped rows need a positive dimension count");
+    }
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open " + path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0 || st.st_size % (sizeof(float)*n_embd) != 0) {
+        close(fd);
+        throw std::runtime_error(path + " is not a whole number of " + std::to_string(n_embd) + "-dimensional float32 rows");
+    }
+
+    size = (size_t) st.st_size;
+    addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        addr = nullptr;
+        throw std::runtime_error("cannot map " + path);
+    }
+    rows = (int64_t) (size/(sizeof(float)*n_embd));
+}
+
+vecbox_mapped_rows::~vecbox_mapped_rows() {
+    if (addr) {
+        munmap(addr, size);
+    }
+}
+
+#else
+
+vecbox_mapped_rows::vecbox_mapped_rows(const std::string &, int32_t) {
+    throw std::runtime_error("mapped rows are not supported on this platform");
+}
+
+vecbox_mapped_rows::~vecbox_mapped_rows() = default;
+
+#endif
@@ -0,0 +1,57 @@
+#pragma once
+
+// k-means over embeddings, for topic grouping and IVF training
+//
+// assignment is one ggml graph per block of rows: scores = C x X^T minus ||c||^2/2 per centroid,
+// then argmax, which picks the nearest centroid without ever forming a distance matrix (||x||^2
+// is the same for every centroid; it is precomputed once and only used for the inertia). the
+// graph is planned once on a threadpool kept for the whole run, and its input points straight at
+// the caller's rows, so a memory-mapped file is read in place. centroid sums go into one accumulator per thread, reduced at the end of
+// each pass. spherical mode normalizes rows and centroids and clusters by cosine similarity.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct vecbox_kmeans_params {
+    int32_t k           = 8;
+    int32_t max_iter    = 25;     // Lloyd passes over the data, or mini-batches
+    double  tol         = 1e-4;   // stop once the inertia improves by less than this fraction
+    int32_t batch_size  = 0;      // > 0: mini-batch k-means with batches of this many rows
+    int32_t init_sample = 0;      // rows k-means++ seeds from, 0 = min(n, 64*k)
+    bool    spherical   = false;  // cosine k-means on normalized rows
+    int32_t n_threads   = 0;      // 0 = hardware concurrency
+    int32_t block_rows  = 4096;   // rows per assignment GEMM
+    uint64_t seed       = 42;
+};
+
+struct vecbox_kmeans_result {
+    std::vector<float>   centroids; // [k, n_embd]
+    std::vector<int32_t> labels;    // [n]
+    double               inertia = 0.0; // sum of squared distances, or of 1 - cos in spherical mode
+    int32_t              n_iter  = 0;
+};
+
+// clusters the rows of x ([n, n_embd] float32, read only and never copied as a whole)
+// throws std::invalid_argument if k is not in [1, n]
+vecbox_kmeans_result vecbox_kmeans(const float * x, int64_t n, int32_t n_embd, const vecbox_kmeans_params & params);
+
+// float32 rows mapped read-only from a file of packed little-endian float32, e.g. a dump of a
+// vector store; the pages are read on demand, so the file can be larger than memory
+class vecbox_mapped_rows {
+public:
+    // throws std::runtime_error if the file cannot be mapped or its size is not a multiple of a row
+    vecbox_mapped_rows(const std::string & path, int32_t n_embd);
+    ~vecbox_mapped_rows();
+
+    vecbox_mapped_rows(const vecbox_mapped_rows &) = delete;
+    vecbox_mapped_rows & operator=(const vecbox_mapped_rows &) = delete;
+
+    const float * data() const { return (const float *) addr; }
+    int64_t n_rows() const { return rows; }
+
+private:
+    void *  addr = nullptr;
+    size_t  size = 0;
+    int64_t rows = 0;
+};
@@ -0,0 +1,319 @@
+#include "vecbox-metrics.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+namespace {
+
+struct counter_info {
+    const char * name;
+    const char * help;
+};
+
+const counter_info COUNTERS[VECBOX_COUNTER_COUNT] = {
+    { "jobs_total",               "jobs submitted to a batcher" },
+    { "texts_total",              "texts run through the model" },
+    { "batches_total",            "model calls" },
+    { "batch_errors_total",       "model calls that failed" },
+    { "tokens_total",             "real tokens in model calls" },
+    { "padding_tokens_total",     "padding tokens in model calls" },
+    { "worker_busy_seconds_total","time batcher workers spent running batches" },
+    { "worker_idle_seconds_total","time batcher workers spent waiting for texts" },
+    { "near_duplicates_total",    "texts matched to an earlier near-duplicate instead of embedded" },
+    { "graph_cache_hits_total",   "pooled graph contexts handed out with their graph intact" },
+    { "graph_cache_misses_total", "pooled graph contexts reset for a new graph" },
+    { "shadow_dropped_total",     "sampled batches not compared because the shadow queue was full" },
+};
+
+// the worker time counters are kept in microseconds and exported in seconds
+bool counter_is_us(int i) {
+    return i == VECBOX_COUNTER_WORKER_BUSY_US || i == VECBOX_COUNTER_WORKER_IDLE_US;
+}
+
+const counter_info GAUGES[VECBOX_GAUGE_COUNT] = {
+    { "worker_threads",       "live batcher workers" },
+    { "batch_scratch_bytes",  "output vectors batchers keep across model calls" },
+};
+
+#define VECBOX_HIST_MAX_BOUNDS 16
+
+struct hist_info {
+    const char * name;
+    const char * help;
+    int          n_bounds;
+    double       bounds[VECBOX_HIST_MAX_BOUNDS];
+};
+
+#define VECBOX_LATENCY_BOUNDS 14, { 50e-6, 100e-6, 250e-6, 500e-6, 1e-3, 2.5e-3, 5e-3, 10e-3, 25e-3, 50e-3, 100e-3, 250e-3, 500e-3, 1.0 }
+
+const hist_info HISTS[VECBOX_HIST_COUNT] = {
+    { "queue_wait_seconds",      "time interactive texts wait from submit to the start of their batch", VECBOX_LATENCY_BOUNDS },
+    { "queue_wait_bulk_seconds", "time bulk texts wait from submit to the start of their batch", VECBOX_LATENCY_BOUNDS },
+    { "batch_size",            "texts per model call",             11, { 1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024 } },
+    { "batch_tokens",          "padded tokens per model call",     13, { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768, 65536 } },
+    { "padding_ratio",         "padding tokens over padded tokens", 10, { 0.0, 0.05, 0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.8, 0.9 } },
+    { "tokenize_seconds",      "tokenization time per batch",      VECBOX_LATENCY_BOUNDS },
+    { "compute_seconds",       "model compute time per batch",     VECBOX_LATENCY_BOUNDS },
+    { "pool_seconds",          "pooling, normalization and copy-out time per batch", VECBOX_LATENCY_BOUNDS },
+    { "request_seconds",       "server request latency, submit to response", VECBOX_LATENCY_BOUNDS },
+    { "shadow_cosine",         "cosine similarity between serving and shadow model outputs", 10, { 0.5, 0.8, 0.9, 0.95, 0.98, 0.99, 0.995, 0.999, 0.9999, 1.0 } },
+};
+
+// written only by the owning thread; other threads only load
+struct shard_hist {
+    std::atomic<uint64_t> buckets[VECBOX_HIST_MAX_BOUNDS + 1];
+    std::atomic<uint64_t> count;
+    std::atomic<double>   sum;
+};
+
+struct shard {
+    std::atomic<uint64_t> counters[VECBOX_COUNTER_COUNT];
+    shard_hist            hists[VECBOX_HIST_COUNT];
+
+    shard() {
+        for (auto & c : counters) {
+            c.store(0, std::memory_order_relaxed);
+        }
+        for (auto & h : hists) {
+            for (auto & b : h.buckets) {
+                b.store(0, std::memory_order_relaxed);
+            }
+            h.count.store(0, std::memory_order_relaxed);
+            h.sum.store(0.0, std::memory_order_relaxed);
+        }
+    }
+};
+
+// totals of shards whose threads have exited
+struct totals {
+    uint64_t counters[VECBOX_COUNTER_COUNT] = {};
+    uint64_t buckets[VECBOX_HIST_COUNT][VECBOX_HIST_MAX_BOUNDS + 1] = {};
+    uint64_t count[VECBOX_HIST_COUNT] = {};
+    double   sum[VECBOX_HIST_COUNT]   = {};
+
+    void add(const shard & s) {
+        for (int i = 0; i < VECBOX_COUNTER_COUNT; ++i) {
+            counters[i] += s.counters[i].load(std::memory_order_relaxed);
+        }
+        for (int h = 0; h < VECBOX_HIST_COUNT; ++h) {
+            for (int b = 0; b <= HISTS[h].n_bounds; ++b) {
+                buckets[h][b] += s.hists[h].buckets[b].load(std::memory_order_relaxed);
+            }
+            count[h] += s.hists[h].count.load(std::memory_order_relaxed);
+            sum[h]   += s.hists[h].sum.load(std::memory_order_relaxed);
+        }
+    }
+};
+
+struct registry {
+    std::mutex                          mutex;
+    std::vector<std::unique_ptr<shard>> shards;
+    totals                              retired;
+
+    std::atomic<int64_t> gauges[VECBOX_GAUGE_COUNT];
+
+    const std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+
+    registry() {
+        for (auto & g : gauges) {
+            g.store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+// never destroyed, so threads exiting during static destruction can still retire their shard
+registry & get_registry() {
+    static registry * reg = new registry();
+    return *reg;
+}
+
+struct shard_owner {
+    shard * s = nullptr;
+
+    ~shard_owner() {
+        if (!s) {
+            return;
+        }
+        registry & reg = get_registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.retired.add(*s);
+        for (size_t i = 0; i < reg.shards.size(); ++i) {
+            if (reg.shards[i].get() == s) {
+                reg.shards[i] = std::move(reg.shards.back());
+                reg.shards.pop_back();
+                break;
+            }
+        }
+    }
+};
+
+thread_local shard_owner tls_shard;
+
+shard & local_shard() {
+    if (!tls_shard.s) {
+        registry & reg = get_registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.shards.push_back(std::make_unique<shard>());
+        tls_shard.s = reg.shards.back().get();
+    }
+    return *tls_shard.s;
+}
+
+// single writer: no read-modify-write instruction needed
+inline void bump(std::atomic<uint64_t> & a, uint64_t v) {
+    a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+}
+
+int64_t resident_bytes() {
+#ifdef __linux__
+    FILE * f = fopen("/proc/self/statm", "r");
+    if (!f) {
+        return 0;
+    }
+    long long pages_total = 0;
+    long long pages_rss   = 0;
+    const int n = fscanf(f, "%lld %lld", &pages_total, &pages_rss);
+    fclose(f);
+    return n == 2 ? (int64_t) pages_rss*sysconf(_SC_PAGESIZE) : 0;
+#else
+    return 0;
+#endif
+}
+
+} // namespace
+
+void vecbox_metrics_add(vecbox_counter counter, uint64_t value) {
+    bump(local_shard().counters[counter], value);
+}
+
+void vecbox_metrics_observe(vecbox_hist hist, double value) {
+    const hist_info & info = HISTS[hist];
+    shard_hist      & h    = local_shard().hists[hist];
+
+    int b = 0;
+    while (b < info.n_bounds && value > info.bounds[b]) {
+        ++b;
+    }
+    bump(h.buckets[b], 1);
+    bump(h.count, 1);
+    h.sum.store(h.sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void vecbox_metrics_gauge_add(vecbox_gauge gauge, int64_t delta) {
+    get_registry().gauges[gauge].fetch_add(delta, std::memory_order_relaxed);
+}
+
+double vecbox_metrics_snapshot::worker_utilization() const {
+    const double busy = (double) counters[VECBOX_COUNTER_WORKER_BUSY_US];
+    const double idle = (double) counters[VECBOX_COUNTER_WORKER_IDLE_US];
+    return busy + idle > 0.0 ? busy/(busy + idle) : 0.0;
+}
+
+vecbox_metrics_snapshot vecbox_metrics_collect() {
+    registry & reg = get_registry();
+
+    totals t;
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        t = reg.retired;
+        for (const auto & s : reg.shards) {
+            t.add(*s);
+        }
+    }
+
+    vecbox_metrics_snapshot snapshot;
+    for (int i = 0; i < VECBOX_COUNTER_COUNT; ++i) {
+        snapshot.counters[i] = t.counters[i];
+    }
+    for (int i = 0; i < VECBOX_GAUGE_COUNT; ++i) {
+        snapshot.gauges[i] = reg.gauges[i].load(std::memory_order_relaxed);
+    }
+    for (int h = 0; h < VECBOX_HIST_COUNT; ++h) {
+        const hist_info & info = HISTS[h];
+        vecbox_histogram_snapshot & hs = snapshot.hists[h];
+
+        hs.bounds.assign(info.bounds, info.bounds + info.n_bounds);
+        hs.counts.resize(info.n_bounds + 1);
+
+        uint64_t cum = 0;
+        for (int b = 0; b <= info.n_bounds; ++b) {
+            cum += t.buckets[h][b];
+            hs.counts[b] = cum;
+        }
+        // count is loaded separately from the buckets; keep +Inf and _count consistent
+        hs.count = cum;
+        hs.sum   = t.sum[h];
+    }
+
+    snapshot.rss_bytes = resident_bytes();
+    snapshot.uptime_s  = std::chrono::duration<double>(std::chrono::steady_clock::now() - reg.t_start).count();
+
+    return snapshot;
+}
+
+const char * vecbox_counter_name(vecbox_counter counter) {
+    return COUNTERS[counter].name;
+}
+
+const char * vecbox_hist_name(vecbox_hist hist) {
+    return HISTS[hist].name;
+}
+
+const char * vecbox_gauge_name(vecbox_gauge gauge) {
+    return GAUGES[gauge].name;
+}
+
+void vecbox_metrics_write_prometheus(std::string & out, const vecbox_metrics_snapshot & snapshot) {
+    char buf[256];
+    auto header = [&](const char * name, const char * type, const char * help) {
+        const int n = snprintf(buf, sizeof(buf), "# HELP vecbox_%s %s\n# TYPE vecbox_%s %s\n", name, help, name, type);
+        out.append(buf, n);
+    };
+    auto sample = [&](const char * name, const char * suffix, const char * le, double value) {
+        const int n = le
+            ? snprintf(buf, sizeof(buf), "vecbox_%s%s{le=\"%s\"} %.17g\n", name, suffix, le, value)
+            : snprintf(buf, sizeof(buf), "vecbox_%s%s %.17g\n", name, suffix, value);
+        out.append(buf, n);
+    };
+
+    for (int i = 0; i < VECBOX_COUNTER_COUNT; ++i) {
+        const double value = counter_is_us(i) ? snapshot.counters[i]*1e-6 : (double) snapshot.counters[i];
+        header(COUNTERS[i].name, "counter", COUNTERS[i].help);
+        sample(COUNTERS[i].name, "", nullptr, value);
+    }
+
+    for (int i = 0; i < VECBOX_GAUGE_COUNT; ++i) {
+        header(GAUGES[i].name, "gauge", GAUGES[i].help);
+        sample(GAUGES[i].name, "", nullptr, (double) snapshot.gauges[i]);
+    }
+
+    header("worker_utilization", "gauge", "fraction of batcher worker time spent running batches");
+    sample("worker_utilization", "", nullptr, snapshot.worker_utilization());
+
+    header("resident_memory_bytes", "gauge", "resident set size of the process");
+    sample("resident_memory_bytes", "", nullptr, (double) snapshot.rss_bytes);
+
+    header("uptime_seconds", "gauge", "time since metrics were first recorded");
+    sample("uptime_seconds", "", nullptr, snapshot.uptime_s);
+
+    for (int h = 0; h < VECBOX_HIST_COUNT; ++h) {
+        const vecbox_histogram_snapshot & hs = snapshot.hists[h];
+        header(HISTS[h].name, "histogram", HISTS[h].help);
+
+        char le[32];
+        for (size_t b = 0; b < hs.bounds.size(); ++b) {
+            snprintf(le, sizeof(le), "%g", hs.bounds[b]);
+            sample(HISTS[h].name, "_bucket", le, (double) hs.counts[b]);
+        }
+        sample(HISTS[h].name, "_bucket", "+Inf", (double) hs.count);
+        sample(HISTS[h].name, "_sum",    nullptr, hs.sum);
+        sample(HISTS[h].name, "_count",  nullptr, (double) hs.count);
+    }
+}
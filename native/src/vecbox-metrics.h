@@ -0,0 +1,83 @@
+#pragma once
+
+// process-wide engine metrics
+//
+// counters and histograms are recorded into a shard owned by the calling thread: a relaxed
+// load/store pair on memory no other thread writes, so the hot path takes no lock and bounces
+// no cache line. collecting walks every shard under the registry mutex and sums them; shards of
+// threads that have exited are folded into a retired total. gauges change rarely and are plain
+// process-wide atomics.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum vecbox_counter {
+    VECBOX_COUNTER_JOBS,               // jobs submitted to a batcher
+    VECBOX_COUNTER_TEXTS,              // texts run through the model
+    VECBOX_COUNTER_BATCHES,            // model calls
+    VECBOX_COUNTER_BATCH_ERRORS,       // model calls that failed
+    VECBOX_COUNTER_TOKENS,             // real tokens in model calls
+    VECBOX_COUNTER_PADDING_TOKENS,     // padding tokens in model calls
+    VECBOX_COUNTER_WORKER_BUSY_US,     // batcher workers running batches
+    VECBOX_COUNTER_WORKER_IDLE_US,     // batcher workers waiting for texts
+    VECBOX_COUNTER_NEAR_DUPLICATES,    // texts matched to an earlier near-duplicate instead of embedded
+    VECBOX_COUNTER_GRAPH_CACHE_HITS,   // pooled graph contexts handed out with their graph intact
+    VECBOX_COUNTER_GRAPH_CACHE_MISSES, // pooled graph contexts reset for a new graph
+    VECBOX_COUNTER_SHADOW_DROPPED,     // sampled batches not compared because the shadow queue was full
+    VECBOX_COUNTER_COUNT,
+};
+
+enum vecbox_hist {
+    VECBOX_HIST_QUEUE_WAIT,      // seconds from submit to the start of the batch, interactive texts
+    VECBOX_HIST_QUEUE_WAIT_BULK, // same for bulk texts
+    VECBOX_HIST_BATCH_SIZE,    // texts per model call
+    VECBOX_HIST_BATCH_TOKENS,  // padded tokens per model call
+    VECBOX_HIST_PADDING_RATIO, // padding tokens / padded tokens
+    VECBOX_HIST_TOKENIZE,      // seconds per batch
+    VECBOX_HIST_COMPUTE,       // seconds per batch
+    VECBOX_HIST_POOL,          // seconds per batch: pooling, normalization and copy-out
+    VECBOX_HIST_REQUEST,       // seconds per request on the servers, submit to response
+    VECBOX_HIST_SHADOW_COSINE, // cosine similarity between serving and shadow model outputs
+    VECBOX_HIST_COUNT,
+};
+
+enum vecbox_gauge {
+    VECBOX_GAUGE_WORKER_THREADS,       // live batcher workers
+    VECBOX_GAUGE_BATCH_SCRATCH_BYTES,  // output vectors batchers keep across model calls
+    VECBOX_GAUGE_COUNT,
+};
+
+void vecbox_metrics_add(vecbox_counter counter, uint64_t value = 1);
+void vecbox_metrics_observe(vecbox_hist hist, double value);
+
+void vecbox_metrics_gauge_add(vecbox_gauge gauge, int64_t delta);
+
+struct vecbox_histogram_snapshot {
+    std::vector<double>   bounds; // upper bounds, +Inf implied after the last
+    std::vector<uint64_t> counts; // cumulative, bounds.size() + 1 entries
+    uint64_t              count = 0;
+    double                sum   = 0.0;
+};
+
+struct vecbox_metrics_snapshot {
+    uint64_t                  counters[VECBOX_COUNTER_COUNT] = {};
+    int64_t                   gauges[VECBOX_GAUGE_COUNT]     = {};
+    vecbox_histogram_snapshot hists[VECBOX_HIST_COUNT];
+
+    int64_t rss_bytes = 0;   // resident set of the whole process, 0 if unknown
+    double  uptime_s  = 0.0; // since the first metric was touched
+
+    // busy / (busy + idle) over the lifetime of all batcher workers
+    double worker_utilization() const;
+};
+
+vecbox_metrics_snapshot vecbox_metrics_collect();
+
+// Prometheus metric name without the vecbox_ prefix, e.g. "queue_wait_seconds"
+const char * vecbox_counter_name(vecbox_counter counter);
+const char * vecbox_hist_name(vecbox_hist hist);
+const char * vecbox_gauge_name(vecbox_gauge gauge);
+
+// appends the snapshot in Prometheus text exposition format
+void vecbox_metrics_write_prometheus(std::string & out, const vecbox_metrics_snapshot & snapshot);
@@ -0,0 +1,227 @@
+#include "vecbox-mmr.h"
+#include "vecbox-engine.h"
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define VECBOX_MMR_AVX2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define VECBOX_MMR_NEON
+#endif
+
+//
+// dot products
+//
+
+// four independent sums so the loop is not bound by the latency of one accumulator
+static float mmr_dot_scalar(const float * a, const float * b, int32_t n) {
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    int32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += a[i + 0]*b[i + 0];
+        s1 += a[i + 1]*b[i + 1];
+        s2 += a[i + 2]*b[i + 2];
+        s3 += a[i + 3]*b[i + 3];
+    }
+    for (; i < n; ++i) {
+        s0 += a[i]*b[i];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+#ifdef VECBOX_MMR_AVX2
+__attribute__((target("avx2,fma")))
+static float mmr_dot_avx2(const float * a, const float * b, int32_t n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+
+    int32_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i +  0), _mm256_loadu_ps(b + i +  0), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i +  8), _mm256_loadu_ps(b + i +  8), acc1);
+        acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), acc2);
+        acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), acc3);
+    }
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    }
+
+    const __m256 acc = _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3));
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+
+    float sum = _mm_cvtss_f32(s);
+    for (; i < n; ++i) {
+        sum += a[i]*b[i];
+    }
+    return sum;
+}
+
+static bool mmr_has_avx2() {
+    static const bool has = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return has;
+}
+#endif
+
+#ifdef VECBOX_MMR_NEON
+static float mmr_dot_neon(const float * a, const float * b, int32_t n) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    float32x4_t acc2 = vdupq_n_f32(0.0f);
+    float32x4_t acc3 = vdupq_n_f32(0.0f);
+
+    int32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i +  0), vld1q_f32(b + i +  0));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i +  4), vld1q_f32(b + i +  4));
+        acc2 = vfmaq_f32(acc2, vld1q_f32(a + i +  8), vld1q_f32(b + i +  8));
+        acc3 = vfmaq_f32(acc3, vld1q_f32(a + i + 12), vld1q_f32(b + i + 12));
+    }
+    for (; i + 4 <= n; i += 4) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+    }
+
+    float sum = vaddvq_f32(vaddq_f32(vaddq_f32(acc0, acc1), vaddq_f32(acc2, acc3)));
+    for (; i < n; ++i) {
+        sum += a[i]*b[i];
+    }
+    return sum;
+}
+#endif
+
+typedef float (*mmr_dot_fn)(const float *, const float *, int32_t);
+
+static mmr_dot_fn mmr_dot() {
+#ifdef VECBOX_MMR_AVX2
+    if (mmr_has_avx2()) {
+        return mmr_dot_avx2;
+    }
+#endif
+#ifdef VECBOX_MMR_NEON
+    return mmr_dot_neon;
+#endif
+    return mmr_dot_scalar;
+}
+
+//
+// selection
+//
+
+static void vecbox_mmr_validate(const vecbox_mmr_candidates & cand, const vecbox_mmr_params & params) {
+    if (params.k < 1) {
+        throw std::invalid_argument("k must be at least 1");
+    }
+    if (!(params.lambda >= 0.0f && params.lambda <= 1.0f)) {
+        throw std::invalid_argument("lambda must be in [0, 1]");
+    }
+    if (cand.ids == nullptr) {
+        return;
+    }
+    for (int64_t i = 0; i < cand.n_ids; ++i) {
+        if (cand.ids[i] < 0 || cand.ids[i] >= cand.n_rows) {
+            throw std::invalid_argument("candidate id " + std::to_string(cand.ids[i]) + " is out of range");
+        }
+    }
+}
+
+static vecbox_mmr_result vecbox_mmr_run(const float * query, int32_t n_embd, const vecbox_mmr_candidates & cand,
+                                        const vecbox_mmr_params & params) {
+    const mmr_dot_fn dot = mmr_dot();
+
+    const int64_t n = cand.ids ? cand.n_ids : cand.n_rows;
+    auto row = [&](int64_t i) { return cand.rows + (int64_t) (cand.ids ? cand.ids[i] : i)*n_embd; };
+
+    const float q_norm = std::sqrt(dot(query, query, n_embd));
+    const float q_inv  = q_norm > 0.0f ? 1.0f/q_norm : 0.0f;
+
+    // relevance and inverse norms once per candidate; max_sim grows as picks are made
+    std::vector<float> relevance(n);
+    std::vector<float> inv_norm(n);
+    std::vector<float> max_sim(n, -std::numeric_limits<float>::infinity());
+    std::vector<char>  picked(n, 0);
+
+    for (int64_t i = 0; i < n; ++i) {
+        const float * c = row(i);
+        const float norm = std::sqrt(dot(c, c, n_embd));
+        inv_norm[i]  = norm > 0.0f ? 1.0f/norm : 0.0f;
+        relevance[i] = dot(query, c, n_embd)*q_inv*inv_norm[i];
+    }
+
+    const float lambda = params.lambda;
+    const int64_t k = std::min<int64_t>(params.k, n);
+
+    vecbox_mmr_result result;
+    result.ids.reserve(k);
+    result.scores.reserve(k);
+
+    for (int64_t step = 0; step < k; ++step) {
+        // nothing selected yet: the redundancy term is zero and the pick is the most relevant
+        int64_t best = -1;
+        float best_score = -std::numeric_limits<float>::infinity();
+        for (int64_t i = 0; i < n; ++i) {
+            if (picked[i]) {
+                continue;
+            }
+            const float score = step == 0
+                ? lambda*relevance[i]
+                : lambda*relevance[i] - (1.0f - lambda)*max_sim[i];
+            if (best < 0 || score > best_score) {
+                best = i;
+                best_score = score;
+            }
+        }
+
+        picked[best] = 1;
+        result.ids.push_back(cand.ids ? cand.ids[best] : (int32_t) best);
+        result.scores.push_back(best_score);
+
+        if (step + 1 == k) {
+            break;
+        }
+
+        // only the newest pick can raise a candidate's max similarity to the selected set
+        const float * s = row(best);
+        for (int64_t i = 0; i < n; ++i) {
+            if (picked[i]) {
+                continue;
+            }
+            const float sim = dot(row(i), s, n_embd)*inv_norm[i]*inv_norm[best];
+            max_sim[i] = std::max(max_sim[i], sim);
+        }
+    }
+
+    return result;
+}
+
+vecbox_mmr_result vecbox_mmr(const float * query, int32_t n_embd, const vecbox_mmr_candidates & cand,
+                             const vecbox_mmr_params & params) {
+    vecbox_mmr_validate(cand, params);
+    return vecbox_mmr_run(query, n_embd, cand, params);
+}
+
+std::vector<vecbox_mmr_result> vecbox_mmr_batch(const float * queries, int64_t n_queries, int32_t n_embd,
+                                                const vecbox_mmr_candidates * cand, const vecbox_mmr_params & params) {
+    // validate up front, a throw inside a worker thread would terminate
+    for (int64_t q = 0; q < n_queries; ++q) {
+        vecbox_mmr_validate(cand[q], params);
+    }
+
+    const int n_threads = params.n_threads > 0 ? params.n_threads : (int) std::thread::hardware_concurrency();
+
+    std::vector<vecbox_mmr_result> results(n_queries);
+    vecbox_parallel_for(n_threads, n_queries, [&](int, int64_t begin, int64_t end) {
+        for (int64_t q = begin; q < end; ++q) {
+            results[q] = vecbox_mmr_run(queries + q*n_embd, n_embd, cand[q], params);
+        }
+    });
+
+    return results;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+// maximal marginal relevance re-ranking of search results
+//
+// greedily picks the candidate maximizing lambda*cos(q, c) - (1 - lambda)*max_s cos(c, s) over the
+// already selected s. the max-similarity term is kept per candidate and only updated against the
+// latest pick, so selecting k of n costs k*n dot products instead of k^2*n. candidates are rows of
+// a matrix picked by id, which is what an index search returns, so hits are re-ranked in place
+// without gathering their vectors first.
+
+#include <cstdint>
+#include <vector>
+
+struct vecbox_mmr_params {
+    int32_t k         = 10;
+    float   lambda    = 0.5f; // 1 = relevance only, 0 = diversity only
+    int32_t n_threads = 0;    // across queries of a batch, 0 = hardware concurrency
+};
+
+struct vecbox_mmr_candidates {
+    const float   * rows = nullptr; // [n_rows, n_embd]
+    int64_t       n_rows = 0;
+    const int32_t * ids  = nullptr; // rows to rank, nullptr = all rows
+    int64_t       n_ids  = 0;
+};
+
+struct vecbox_mmr_result {
+    std::vector<int32_t> ids;    // selected rows, in order of selection
+    std::vector<float>   scores; // MMR score of each pick at the time it was selected
+};
+
+// throws std::invalid_argument on k < 1, lambda outside [0, 1] or an id outside [0, n_rows)
+vecbox_mmr_result vecbox_mmr(const float * query, int32_t n_embd, const vecbox_mmr_candidates & cand,
+                             const vecbox_mmr_params & params);
+
+// queries [n_queries, n_embd], each ranked against its own candidates
+std::vector<vecbox_mmr_result> vecbox_mmr_batch(const float * queries, int64_t n_queries, int32_t n_embd,
+                                                const vecbox_mmr_candidates * cand, const vecbox_mmr_params & params);
@@ -0,0 +1,396 @@
+#include "vecbox-projection.h"
+#include "vecbox-ctx-pool.h"
+#include "vecbox-engine.h"
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+// graph metadata for the matmuls below; projections run per batch, so their graphs come from a
+// pool and a repeated shape reuses its graph
+static vecbox_ctx_pool & vecbox_gemm_pool() {
+    static vecbox_ctx_pool pool({ /*.n_tensors =*/ 8, /*.graph_size =*/ 8, /*.n_graphs =*/ 8 });
+    return pool;
+}
+
+// c [m, n] = a [m, k] x b [n, k]^T (+ bias [n] on every row), one ggml graph over the caller's buffers
+static void vecbox_gemm_nt(const float * a, int64_t m, const float * b, int64_t n, int64_t k, const float * bias,
+                           float * c, int n_threads) {
+    vecbox_ctx_pool::lease lease = vecbox_gemm_pool().acquire({ m, n, k, bias != nullptr });
+
+    ggml_cgraph * gf = lease.graph();
+    if (!gf) {
+        ggml_context * ctx = lease.ctx();
+
+        ggml_tensor * tb = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, k, n);
+        ggml_tensor * ta = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, k, m);
+
+        ggml_tensor * out = ggml_mul_mat(ctx, tb, ta);
+        if (bias) {
+            out = ggml_add_inplace(ctx, out, ggml_new_tensor_1d(ctx, GGML_TYPE_F32, n));
+        }
+
+        gf = lease.new_graph();
+        ggml_build_forward_expand(gf, out);
+        lease.keep(gf);
+    }
+
+    // bind this call's buffers; with a bias the add runs in place on the matmul output
+    ggml_tensor * out = ggml_graph_node(gf, -1);
+    ggml_tensor * mm  = bias ? out->src[0] : out;
+    mm->src[0]->data = (void *) b;
+    mm->src[1]->data = (void *) a;
+    mm->data = c;
+    if (bias) {
+        out->src[1]->data = (void *) bias;
+        out->data = c;
+    }
+
+    thread_local std::vector<uint8_t> work;
+    ggml_cplan plan = ggml_graph_plan(gf, n_threads, nullptr);
+    if (work.size() < plan.work_size) {
+        work.resize(plan.work_size);
+    }
+    plan.work_data = work.data();
+
+    if (ggml_graph_compute(gf, &plan) != GGML_STATUS_SUCCESS) {
+        throw std::runtime_error("projection matmul failed");
+    }
+}
+
+void vecbox_projection::apply(const float * x, size_t n, float * out) const {
+    if (n == 0) {
+        return;
+    }
+
+    if (type == VECBOX_PROJECTION_TRUNCATE) {
+        for (size_t t = 0; t < n; ++t) {
+            const float * src = x + t*n_in;
+            float       * dst = out + t*n_out;
+
+            double full = 0.0;
+            double head = 0.0;
+            for (int32_t i = 0; i < n_in; ++i) {
+                full += (double) src[i]*src[i];
+                if (i + 1 == n_out) {
+                    head = full;
+                }
+            }
+
+            // keep the norm of the full vector, so normalize: false still means the raw magnitude
+            const float scale = head > 0.0 ? (float) std::sqrt(full/head) : 0.0f;
+            for (int32_t i = 0; i < n_out; ++i) {
+                dst[i] = src[i]*scale;
+            }
+        }
+        return;
+    }
+
+    // runs on the batcher thread next to the model; at n_out x n_in per text it is a small part of a batch
+    vecbox_gemm_nt(x, (int64_t) n, components.data(), n_out, n_in, bias.data(), out, 1);
+}
+
+std::shared_ptr<vecbox_projection> vecbox_projection_truncate(int32_t n_in, int32_t n_out) {
+    if (n_out <= 0 || n_out > n_in) {
+        throw std::invalid_argument("cannot truncate " + std::to_string(n_in) + " dimensions to " + std::to_string(n_out));
+    }
+
+    auto proj = std::make_shared<vecbox_projection>();
+    proj->type  = VECBOX_PROJECTION_TRUNCATE;
+    proj->n_in  = n_in;
+    proj->n_out = n_out;
+    return proj;
+}
+
+//
+// PCA
+//
+
+// centering folded into the matmul: P (x - mean) = P x + bias
+static void vecbox_projection_init_bias(vecbox_projection & proj) {
+    proj.bias.resize(proj.n_out);
+    for (int32_t k = 0; k < proj.n_out; ++k) {
+        double dot = 0.0;
+        for (int32_t c = 0; c < proj.n_in; ++c) {
+            dot += (double) proj.components[(size_t) k*proj.n_in + c]*proj.mean[c];
+        }
+        proj.bias[k] = (float) -dot;
+    }
+}
+
+// Gram-Schmidt (twice, for stability) on the rows of q [n_rows, n_cols]; rows that collapse are zeroed
+static void vecbox_orthonormalize_rows(float * q, int64_t n_rows, int64_t n_cols) {
+    for (int64_t i = 0; i < n_rows; ++i) {
+        float * qi = q + i*n_cols;
+        for (int pass = 0; pass < 2; ++pass) {
+            for (int64_t j = 0; j < i; ++j) {
+                const float * qj = q + j*n_cols;
+                double dot = 0.0;
+                for (int64_t c = 0; c < n_cols; ++c) {
+                    dot += (double) qi[c]*qj[c];
+                }
+                for (int64_t c = 0; c < n_cols; ++c) {
+                    qi[c] -= (float) dot*qj[c];
+                }
+            }
+        }
+
+        double norm = 0.0;
+        for (int64_t c = 0; c < n_cols; ++c) {
+            norm += (double) qi[c]*qi[c];
+        }
+        const float scale = norm > 1e-20 ? (float) (1.0/std::sqrt(norm)) : 0.0f;
+        for (int64_t c = 0; c < n_cols; ++c) {
+            qi[c] *= scale;
+        }
+    }
+}
+
+// cyclic Jacobi on the symmetric a [n, n]: eigenvalues end up on its diagonal, eigenvectors in the columns of v
+static void vecbox_jacobi_eigen(std::vector<double> & a, int64_t n, std::vector<double> & v) {
+    v.assign(n*n, 0.0);
+    for (int64_t i = 0; i < n; ++i) {
+        v[i*n + i] = 1.0;
+    }
+
+    for (int sweep = 0; sweep < 64; ++sweep) {
+        double off  = 0.0;
+        double diag = 0.0;
+        for (int64_t p = 0; p < n; ++p) {
+            diag += a[p*n + p]*a[p*n + p];
+            for (int64_t q = p + 1; q < n; ++q) {
+                off += a[p*n + q]*a[p*n + q];
+            }
+        }
+        if (off <= 1e-24*diag) {
+            break;
+        }
+
+        for (int64_t p = 0; p < n; ++p) {
+            for (int64_t q = p + 1; q < n; ++q) {
+                const double apq = a[p*n + q];
+                if (apq == 0.0) {
+                    continue;
+                }
+
+                const double theta = (a[q*n + q] - a[p*n + p])/(2.0*apq);
+                const double t = (theta >= 0.0 ? 1.0 : -1.0)/(std::fabs(theta) + std::sqrt(theta*theta + 1.0));
+                const double c = 1.0/std::sqrt(t*t + 1.0);
+                const double s = t*c;
+
+                for (int64_t k = 0; k < n; ++k) {
+                    const double akp = a[k*n + p];
+                    const double akq = a[k*n + q];
+                    a[k*n + p] = c*akp - s*akq;
+                    a[k*n + q] = s*akp + c*akq;
+                }
+                for (int64_t k = 0; k < n; ++k) {
+                    const double apk = a[p*n + k];
+                    const double aqk = a[q*n + k];
+                    a[p*n + k] = c*apk - s*aqk;
+                    a[q*n + k] = s*apk + c*aqk;
+                }
+                for (int64_t k = 0; k < n; ++k) {
+                    const double vkp = v[k*n + p];
+                    const double vkq = v[k*n + q];
+                    v[k*n + p] = c*vkp - s*vkq;
+                    v[k*n + q] = s*vkp + c*vkq;
+                }
+            }
+        }
+    }
+}
+
+std::shared_ptr<vecbox_projection> vecbox_projection_fit_pca(const float * x, int64_t n, int32_t n_in, int32_t n_out,
+                                                             const vecbox_pca_params & params) {
+    if (n_out <= 0 || n_out > n_in || n_out > n) {
+        throw std::invalid_argument("PCA to " + std::to_string(n_out) + " components needs at least that many rows and dimensions, got " +
+                                    std::to_string(n) + " rows of " + std::to_string(n_in));
+    }
+
+    const int n_threads = params.n_threads > 0 ? params.n_threads : (int) std::max(1u, std::thread::hardware_concurrency());
+    const int64_t l = std::min<int64_t>(n_out + std::max(0, params.oversample), std::min<int64_t>(n, n_in));
+
+    auto proj = std::make_shared<vecbox_projection>();
+    proj->type  = VECBOX_PROJECTION_PCA;
+    proj->n_in  = n_in;
+    proj->n_out = n_out;
+
+    std::vector<double> mean(n_in, 0.0);
+    for (int64_t r = 0; r < n; ++r) {
+        for (int32_t i = 0; i < n_in; ++i) {
+            mean[i] += x[r*n_in + i];
+        }
+    }
+    proj->mean.resize(n_in);
+    for (int32_t i = 0; i < n_in; ++i) {
+        proj->mean[i] = (float) (mean[i]/n);
+    }
+
+    // centered rows, and their transpose for products with X^T
+    std::vector<float> xc(n*n_in);
+    std::vector<float> xt(n*n_in);
+    for (int64_t r = 0; r < n; ++r) {
+        for (int32_t i = 0; i < n_in; ++i) {
+            const float v = x[r*n_in + i] - proj->mean[i];
+            xc[r*n_in + i] = v;
+            xt[i*n + r]    = v;
+        }
+    }
+
+    std::mt19937_64 rng(params.seed);
+    std::normal_distribution<float> normal;
+    std::vector<float> omega(l*n_in);
+    for (auto & w : omega) {
+        w = normal(rng);
+    }
+
+    // q = basis of the range of X as rows [l, n], z = X^T q as rows [l, n_in]
+    std::vector<float> q(l*n);
+    std::vector<float> z(l*n_in);
+
+    vecbox_gemm_nt(omega.data(), l, xc.data(), n, n_in, nullptr, q.data(), n_threads);
+    vecbox_orthonormalize_rows(q.data(), l, n);
+    for (int32_t p = 0; p < params.power_iters; ++p) {
+        vecbox_gemm_nt(q.data(), l, xt.data(), n_in, n, nullptr, z.data(), n_threads);
+        vecbox_orthonormalize_rows(z.data(), l, n_in);
+        vecbox_gemm_nt(z.data(), l, xc.data(), n, n_in, nullptr, q.data(), n_threads);
+        vecbox_orthonormalize_rows(q.data(), l, n);
+    }
+
+    // B = Q^T X is small [l, n_in]; its right singular vectors are the components
+    std::vector<float> bt(l*n_in);
+    vecbox_gemm_nt(q.data(), l, xt.data(), n_in, n, nullptr, bt.data(), n_threads);
+
+    std::vector<float> gram(l*l);
+    vecbox_gemm_nt(bt.data(), l, bt.data(), l, n_in, nullptr, gram.data(), n_threads);
+
+    std::vector<double> a(gram.begin(), gram.end());
+    std::vector<double> u;
+    vecbox_jacobi_eigen(a, l, u);
+
+    std::vector<int64_t> order(l);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int64_t i, int64_t j) { return a[i*l + i] > a[j*l + j]; });
+
+    proj->components.assign((size_t) n_out*n_in, 0.0f);
+    proj->variance.resize(n_out);
+    for (int32_t k = 0; k < n_out; ++k) {
+        const int64_t e = order[k];
+        proj->variance[k] = (float) (std::max(0.0, a[e*l + e])/std::max<int64_t>(1, n - 1));
+
+        // v = B^T u / s, normalized directly
+        float * v = proj->components.data() + (size_t) k*n_in;
+        for (int64_t i = 0; i < l; ++i) {
+            const float w = (float) u[i*l + e];
+            for (int32_t c = 0; c < n_in; ++c) {
+                v[c] += w*bt[i*n_in + c];
+            }
+        }
+        vecbox_embd_normalize(v, n_in);
+
+        // deterministic sign: the largest coordinate is positive
+        int32_t top = 0;
+        for (int32_t c = 1; c < n_in; ++c) {
+            if (std::fabs(v[c]) > std::fabs(v[top])) {
+                top = c;
+            }
+        }
+        if (v[top] < 0.0f) {
+            for (int32_t c = 0; c < n_in; ++c) {
+                v[c] = -v[c];
+            }
+        }
+    }
+
+    vecbox_projection_init_bias(*proj);
+
+    return proj;
+}
+
+//
+// sidecar
+//
+
+std::string vecbox_projection_sidecar(const std::string & model_path) {
+    return model_path + ".vbproj";
+}
+
+// layout: magic, version, type, n_in, n_out (uint32 each), then for PCA
+// mean [n_in], components [n_out, n_in] and variance [n_out] as float32, all little-endian
+void vecbox_projection_save(const vecbox_projection & proj, const std::string & path) {
+    FILE * f = fopen(path.c_str(), "wb");
+    if (!f) {
+        throw std::runtime_error("cannot write " + path);
+    }
+
+    const uint32_t header[5] = {
+        VECBOX_PROJECTION_MAGIC, VECBOX_PROJECTION_VERSION, (uint32_t) proj.type, (uint32_t) proj.n_in, (uint32_t) proj.n_out,
+    };
+    bool ok = fwrite(header, sizeof(header), 1, f) == 1;
+    if (ok && proj.type == VECBOX_PROJECTION_PCA) {
+        ok = fwrite(proj.mean.data(),       sizeof(float), proj.mean.size(),       f) == proj.mean.size() &&
+             fwrite(proj.components.data(), sizeof(float), proj.components.size(), f) == proj.components.size() &&
+             fwrite(proj.variance.data(),   sizeof(float), proj.variance.size(),   f) == proj.variance.size();
+    }
+    if (fclose(f) != 0 || !ok) {
+        throw std::runtime_error("cannot write " + path);
+    }
+}
+
+std::shared_ptr<vecbox_projection> vecbox_projection_load(const std::string & path) {
+    FILE * f = fopen(path.c_str(), "rb");
+    if (!f) {
+        throw std::runtime_error("cannot open projection " + path);
+    }
+
+    auto fail = [&](const std::string & what) {
+        fclose(f);
+        return std::runtime_error("invalid projection " + path + ": " + what);
+    };
+
+    uint32_t header[5];
+    if (fread(header, sizeof(header), 1, f) != 1 || header[0] != VECBOX_PROJECTION_MAGIC) {
+        throw fail("bad magic");
+    }
+    if (header[1] != VECBOX_PROJECTION_VERSION) {
+        throw fail("unsupported version " + std::to_string(header[1]));
+    }
+
+    const int32_t n_in  = (int32_t) header[3];
+    const int32_t n_out = (int32_t) header[4];
+    if (n_in <= 0 || n_out <= 0 || n_out > n_in) {
+        throw fail("bad dimensions");
+    }
+
+    std::shared_ptr<vecbox_projection> proj;
+    if (header[2] == VECBOX_PROJECTION_TRUNCATE) {
+        proj = vecbox_projection_truncate(n_in, n_out);
+    } else if (header[2] == VECBOX_PROJECTION_PCA) {
+        proj = std::make_shared<vecbox_projection>();
+        proj->type  = VECBOX_PROJECTION_PCA;
+        proj->n_in  = n_in;
+        proj->n_out = n_out;
+        proj->mean.resize(n_in);
+        proj->components.resize((size_t) n_out*n_in);
+        proj->variance.resize(n_out);
+        if (fread(proj->mean.data(),       sizeof(float), proj->mean.size(),       f) != proj->mean.size() ||
+            fread(proj->components.data(), sizeof(float), proj->components.size(), f) != proj->components.size() ||
+            fread(proj->variance.data(),   sizeof(float), proj->variance.size(),   f) != proj->variance.size()) {
+            throw fail("truncated file");
+        }
+        vecbox_projection_init_bias(*proj);
+    } else {
+        throw fail("unknown type " + std::to_string(header[2]));
+    }
+
+    fclose(f);
+    return proj;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+// dimensionality reduction applied to embeddings right after pooling
+//
+// storage and search cost scale with the dimension, so the projection runs inside the engine and
+// callers only ever see the reduced vectors. two kinds:
+//   - truncation to the first n_out dims (Matryoshka models), rescaled to the norm of the full vector
+//   - PCA fitted on a sample with randomized SVD; applied as one matmul with the centering folded
+//     into a bias, and stored next to the model in a sidecar file
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define VECBOX_PROJECTION_MAGIC   0x6a706276u // "vbpj"
+#define VECBOX_PROJECTION_VERSION 1
+
+enum vecbox_projection_type : uint32_t {
+    VECBOX_PROJECTION_TRUNCATE = 0,
+    VECBOX_PROJECTION_PCA      = 1,
+};
+
+struct vecbox_projection {
+    vecbox_projection_type type = VECBOX_PROJECTION_TRUNCATE;
+    int32_t n_in  = 0;
+    int32_t n_out = 0;
+
+    // PCA only
+    std::vector<float> mean;       // [n_in]
+    std::vector<float> components; // [n_out, n_in], principal directions by decreasing variance
+    std::vector<float> variance;   // [n_out], explained variance per component
+    std::vector<float> bias;       // [n_out] = -components x mean
+
+    // out [n, n_out] from x [n, n_in]
+    void apply(const float * x, size_t n, float * out) const;
+};
+
+// throws std::invalid_argument unless 0 < n_out <= n_in
+std::shared_ptr<vecbox_projection> vecbox_projection_truncate(int32_t n_in, int32_t n_out);
+
+struct vecbox_pca_params {
+    int32_t  oversample  = 10; // extra random directions beyond n_out
+    int32_t  power_iters = 2;  // sharpen the range of X for slowly decaying spectra
+    uint64_t seed        = 42;
+    int32_t  n_threads   = 0;  // 0 = hardware concurrency
+};
+
+// top n_out principal components of the rows of x [n, n_in] by randomized SVD (Halko et al.):
+// the products with X run as ggml matmuls, only an (n_out + oversample)^2 eigenproblem is solved
+// directly. throws std::invalid_argument unless 0 < n_out <= min(n, n_in)
+std::shared_ptr<vecbox_projection> vecbox_projection_fit_pca(const float * x, int64_t n, int32_t n_in, int32_t n_out,
+                                                             const vecbox_pca_params & params = {});
+
+// sidecar file next to a model: <model path>.vbproj
+std::string vecbox_projection_sidecar(const std::string & model_path);
+
+// throw std::runtime_error on I/O errors or a malformed file
+void vecbox_projection_save(const vecbox_projection & proj, const std::string & path);
+std::shared_ptr<vecbox_projection> vecbox_projection_load(const std::string & path);
@@ -0,0 +1,250 @@
+#include "vecbox-registry.h"
+
+#include <algorithm>
+#include <future>
+#include <stdexcept>
+#include <utility>
+
+vecbox_model_registry::vecbox_model_registry(const vecbox_registry_params & params)
+    : params(params), used(std::make_shared<std::atomic<size_t>>(0)) {
+    thread = std::thread([this] { loader(); });
+}
+
+vecbox_model_registry::~vecbox_model_registry() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    thread.join();
+
+    // loads that never started
+    for (auto & it : entries) {
+        for (auto & cb : it.second.waiters) {
+            cb(nullptr, "model registry closed");
+        }
+    }
+}
+
+void vecbox_model_registry::add(const std::string & name, const std::string & path, bool pinned) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (entries.count(name)) {
+        throw std::invalid_argument("model already registered: " + name);
+    }
+    entry & e = entries[name];
+    e.generation = next_generation++;
+    e.path       = path;
+    e.pinned     = pinned;
+}
+
+void vecbox_model_registry::remove(const std::string & name) {
+    std::vector<acquire_cb> waiters;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(name);
+        if (it == entries.end()) {
+            return;
+        }
+        // the model's charge goes with its last holder; a load in flight finds the entry gone
+        waiters = std::move(it->second.waiters);
+        entries.erase(it);
+    }
+    for (auto & cb : waiters) {
+        cb(nullptr, "model removed: " + name);
+    }
+}
+
+void vecbox_model_registry::pin(const std::string & name, bool pinned) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(name);
+    if (it == entries.end()) {
+        throw std::invalid_argument("unknown model: " + name);
+    }
+    it->second.pinned = pinned;
+}
+
+std::shared_ptr<vecbox_model> vecbox_model_registry::get(const std::string & name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(name);
+    if (it == entries.end() || it->second.state != VECBOX_REGISTRY_LOADED) {
+        return nullptr;
+    }
+    it->second.t_last_used_us = vecbox_time_us();
+    return it->second.model;
+}
+
+void vecbox_model_registry::acquire(const std::string & name, acquire_cb cb) {
+    std::shared_ptr<vecbox_model> model;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(name);
+        if (it != entries.end()) {
+            entry & e = it->second;
+            e.t_last_used_us = vecbox_time_us();
+
+            if (e.state != VECBOX_REGISTRY_LOADED) {
+                e.waiters.push_back(std::move(cb));
+                if (e.state == VECBOX_REGISTRY_UNLOADED) {
+                    e.state = VECBOX_REGISTRY_LOADING;
+                    pending.emplace_back(name, e.generation);
+                    cv.notify_one();
+                }
+                return;
+            }
+            model = e.model;
+        }
+    }
+
+    if (!model) {
+        cb(nullptr, "unknown model: " + name);
+        return;
+    }
+    cb(model, "");
+}
+
+std::shared_ptr<vecbox_model> vecbox_model_registry::acquire_sync(const std::string & name) {
+    auto promise = std::make_shared<std::promise<std::shared_ptr<vecbox_model>>>();
+    auto future  = promise->get_future();
+
+    acquire(name, [promise](std::shared_ptr<vecbox_model> model, const std::string & error) {
+        if (error.empty()) {
+            promise->set_value(std::move(model));
+        } else {
+            promise->set_exception(std::make_exception_ptr(std::runtime_error(error)));
+        }
+    });
+
+    return future.get();
+}
+
+std::vector<vecbox_registry_entry_info> vecbox_model_registry::list() const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<vecbox_registry_entry_info> out;
+    out.reserve(entries.size());
+    for (const auto & it : entries) {
+        vecbox_registry_entry_info info;
+        info.name           = it.first;
+        info.path           = it.second.path;
+        info.state          = it.second.state;
+        info.pinned         = it.second.pinned;
+        info.bytes          = it.second.bytes;
+        info.t_last_used_us = it.second.t_last_used_us;
+        out.push_back(std::move(info));
+    }
+    return out;
+}
+
+size_t vecbox_model_registry::used_bytes() const {
+    return used->load();
+}
+
+bool vecbox_model_registry::make_room(size_t bytes) {
+    if (params.budget_bytes == 0) {
+        return true;
+    }
+
+    // only a model the registry alone holds frees its bytes when evicted
+    std::vector<std::unordered_map<std::string, entry>::iterator> idle;
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        const entry & e = it->second;
+        if (e.state == VECBOX_REGISTRY_LOADED && !e.pinned && e.model.use_count() == 1) {
+            idle.push_back(it);
+        }
+    }
+    std::sort(idle.begin(), idle.end(), [](const auto & a, const auto & b) {
+        return a->second.t_last_used_us < b->second.t_last_used_us;
+    });
+
+    // decide first, so a load that cannot fit evicts nothing
+    size_t       need   = used->load() + bytes;
+    const size_t budget = params.budget_bytes;
+    size_t       n_evict = 0;
+    while (need > budget && n_evict < idle.size()) {
+        need -= std::min(need, idle[n_evict++]->second.bytes);
+    }
+    if (need > budget) {
+        return false;
+    }
+
+    for (size_t i = 0; i < n_evict; ++i) {
+        entry & e = idle[i]->second;
+        e.bytes = 0;
+        e.state = VECBOX_REGISTRY_UNLOADED;
+        e.model.reset(); // the last reference: its deleter uncharges it
+    }
+    return true;
+}
+
+void vecbox_model_registry::loader() {
+    while (true) {
+        std::string name;
+        std::string path;
+        uint64_t    generation;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (stopping) {
+                return;
+            }
+            name       = std::move(pending.front().first);
+            generation = pending.front().second;
+            pending.pop_front();
+
+            // removed, or removed and added again, since it was queued
+            auto it = entries.find(name);
+            if (it == entries.end() || it->second.generation != generation || it->second.state != VECBOX_REGISTRY_LOADING) {
+                continue;
+            }
+            path = it->second.path;
+        }
+
+        std::string error;
+        std::shared_ptr<vecbox_model> model;
+        try {
+            model = vecbox_model_load(path);
+        } catch (const std::exception & e) {
+            error = e.what();
+        }
+
+        std::vector<acquire_cb> waiters;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = entries.find(name);
+            if (it == entries.end() || it->second.generation != generation) {
+                // removed while loading; the model was never charged and goes away here
+                continue;
+            }
+
+            entry & e = it->second;
+            const size_t bytes = model ? model->tokenizer_projection_bytes() : 0;
+            if (error.empty() && !make_room(bytes)) {
+                error = "model " + name + " (" + std::to_string(bytes) + " bytes) does not fit the budget of " +
+                        std::to_string(params.budget_bytes) + " bytes next to the pinned and in-use models";
+                model.reset();
+            }
+
+            if (error.empty()) {
+                // every holder shares this reference, so the charge is dropped with the last of them
+                used->fetch_add(bytes);
+                model = std::shared_ptr<vecbox_model>(model.get(), [model, used = used, bytes](vecbox_model *) mutable {
+                    model.reset();
+                    used->fetch_sub(bytes);
+                });
+
+                e.state          = VECBOX_REGISTRY_LOADED;
+                e.bytes          = bytes;
+                e.model          = model;
+                e.t_last_used_us = vecbox_time_us();
+            } else {
+                e.state = VECBOX_REGISTRY_UNLOADED;
+            }
+            waiters = std::move(e.waiters);
+            e.waiters.clear();
+        }
+
+        for (auto & cb : waiters) {
+            cb(error.empty() ? model : nullptr, error);
+        }
+    }
+}
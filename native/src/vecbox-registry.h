@@ -0,0 +1,116 @@
+#pragma once
+
+// several models served from one process under a memory budget
+//
+// a model is charged its tokenizer trie and projection once loaded
+// (vecbox_model::tokenizer_projection_bytes), for as long as anything holds it: a model that was
+// evicted or removed while a caller still uses it keeps its charge until the last holder releases it. loads run one at a time on a background thread, so a
+// request for a cold model never holds up requests for loaded ones; the model being loaded is
+// measured when it is done, so it can exceed the budget by its own size until then. to make room,
+// unpinned models nobody else holds are evicted least recently used first, and only if that
+// frees enough: a load that does not fit fails without evicting anything.
+
+#include "vecbox-engine.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct vecbox_registry_params {
+    size_t budget_bytes = 0; // 0 = unlimited
+};
+
+enum vecbox_registry_state {
+    VECBOX_REGISTRY_UNLOADED,
+    VECBOX_REGISTRY_LOADING,
+    VECBOX_REGISTRY_LOADED,
+};
+
+struct vecbox_registry_entry_info {
+    std::string           name;
+    std::string           path;
+    vecbox_registry_state state  = VECBOX_REGISTRY_UNLOADED;
+    bool                  pinned = false;
+    size_t                bytes  = 0; // charged while loaded
+    int64_t               t_last_used_us = 0;
+};
+
+class vecbox_model_registry {
+public:
+    // error is empty on success
+    using acquire_cb = std::function<void(std::shared_ptr<vecbox_model> model, const std::string & error)>;
+
+    explicit vecbox_model_registry(const vecbox_registry_params & params = {});
+    ~vecbox_model_registry();
+
+    vecbox_model_registry(const vecbox_model_registry &) = delete;
+    vecbox_model_registry & operator=(const vecbox_model_registry &) = delete;
+
+    // registers name -> path without loading it; throws std::invalid_argument if name is taken
+    void add(const std::string & name, const std::string & path, bool pinned = false);
+
+    // forgets the model; callers holding it keep it alive, and charged
+    void remove(const std::string & name);
+
+    // pinned models are never evicted
+    void pin(const std::string & name, bool pinned);
+
+    // the model if it is loaded, nullptr otherwise; counts as a use for LRU
+    std::shared_ptr<vecbox_model> get(const std::string & name);
+
+    // cb runs right away on the calling thread if the model is loaded, otherwise on the loader
+    // thread once the load finishes or fails. concurrent acquires of a cold model share one load
+    void acquire(const std::string & name, acquire_cb cb);
+
+    // blocks until the model is loaded; throws std::runtime_error if it cannot be
+    std::shared_ptr<vecbox_model> acquire_sync(const std::string & name);
+
+    std::vector<vecbox_registry_entry_info> list() const;
+
+    size_t used_bytes() const;
+
+private:
+    struct entry {
+        uint64_t              generation = 0; // tells a re-added name from the entry a load started for
+        std::string           path;
+        bool                  pinned = false;
+        vecbox_registry_state state  = VECBOX_REGISTRY_UNLOADED;
+        size_t                bytes  = 0;
+        int64_t               t_last_used_us = 0;
+
+        std::shared_ptr<vecbox_model> model;
+        std::vector<acquire_cb>       waiters;
+    };
+
+    void loader();
+
+    // evicts LRU unpinned models nobody else holds until `bytes` more fit; evicts nothing and
+    // returns false if they cannot
+    bool make_room(size_t bytes);
+
+    vecbox_registry_params params;
+
+    mutable std::mutex      mutex;
+    std::condition_variable cv;
+
+    std::unordered_map<std::string, entry>       entries;
+    std::deque<std::pair<std::string, uint64_t>> pending; // name, generation
+    uint64_t                                     next_generation = 1;
+    bool                                         stopping = false;
+
+    // bytes of the loaded models still alive, evicted and removed ones included. shared with the
+    // models' deleters, which run when the last holder releases a model, possibly after the
+    // registry is gone
+    std::shared_ptr<std::atomic<size_t>> used;
+
+    std::thread thread;
+};
@@ -0,0 +1,853 @@
+#include "vecbox-shm.h"
+#include "vecbox-metrics.h"
+
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VECBOX_SHM_PAUSE() _mm_pause()
+#elif defined(__aarch64__)
+#define VECBOX_SHM_PAUSE() __asm__ __volatile__("yield")
+#else
+#define VECBOX_SHM_PAUSE() ((void) 0)
+#endif
+
+#define VECBOX_SHM_PAGE      4096
+#define VECBOX_SHM_SPIN      4096 // polls of an empty ring before blocking on the eventfd
+#define VECBOX_SHM_MSG_ALIGN 8
+
+static_assert(sizeof(vecbox_shm_ring_header) <= VECBOX_SHM_PAGE, "ring header must fit in a page");
+static_assert(sizeof(vecbox_shm_msg_header) % VECBOX_SHM_MSG_ALIGN == 0, "message header must keep payloads aligned");
+
+static size_t shm_region_size(uint64_t capacity) {
+    return 3*VECBOX_SHM_PAGE + 2*capacity;
+}
+
+static void shm_map_rings(void * base, uint64_t capacity, vecbox_shm_ring & req, vecbox_shm_ring & res) {
+    uint8_t * p = (uint8_t *) base;
+
+    req.hdr      = (vecbox_shm_ring_header *) (p + VECBOX_SHM_PAGE);
+    req.data     = p + 2*VECBOX_SHM_PAGE;
+    req.capacity = capacity;
+
+    res.hdr      = (vecbox_shm_ring_header *) (p + 2*VECBOX_SHM_PAGE + capacity);
+    res.data     = p + 3*VECBOX_SHM_PAGE + capacity;
+    res.capacity = capacity;
+}
+
+static uint64_t shm_msg_bytes(size_t payload) {
+    return (sizeof(vecbox_shm_msg_header) + payload + VECBOX_SHM_MSG_ALIGN - 1) & ~(uint64_t) (VECBOX_SHM_MSG_ALIGN - 1);
+}
+
+static void shm_signal(int fd) {
+    const uint64_t one = 1;
+    ssize_t rc = write(fd, &one, sizeof(one));
+    (void) rc;
+}
+
+static void shm_clear(int fd) {
+    uint64_t value;
+    ssize_t rc = read(fd, &value, sizeof(value));
+    (void) rc;
+}
+
+//
+// ring
+//
+
+// a message never straddles the end of the ring: the writer pads to the end and wraps.
+// if fewer bytes than a message header are left before the end, both sides skip them implicitly.
+
+size_t vecbox_shm_ring::max_payload() const {
+    return capacity/2 - sizeof(vecbox_shm_msg_header);
+}
+
+uint8_t * vecbox_shm_ring::reserve(size_t size) {
+    if (size > max_payload()) {
+        return nullptr;
+    }
+
+    const uint64_t head = hdr->head.load(std::memory_order_relaxed);
+    const uint64_t tail = hdr->tail.load(std::memory_order_acquire);
+    const uint64_t need = shm_msg_bytes(size);
+
+    uint64_t pos       = head;
+    const uint64_t off = head & (capacity - 1);
+    if (capacity - off < need) {
+        pos += capacity - off; // wrap, padding the rest of the ring
+    }
+    if (pos + need - tail > capacity) {
+        return nullptr;
+    }
+
+    if (pos != head && capacity - off >= sizeof(vecbox_shm_msg_header)) {
+        vecbox_shm_msg_header pad {};
+        pad.type = VECBOX_SHM_MSG_PAD;
+        pad.size = (uint32_t) (capacity - off - sizeof(vecbox_shm_msg_header));
+        memcpy(data + off, &pad, sizeof(pad));
+    }
+
+    reserved_pos = pos;
+    return data + (pos & (capacity - 1)) + sizeof(vecbox_shm_msg_header);
+}
+
+void vecbox_shm_ring::commit(const vecbox_shm_msg_header & msg) {
+    memcpy(data + (reserved_pos & (capacity - 1)), &msg, sizeof(msg));
+    hdr->head.store(reserved_pos + shm_msg_bytes(msg.size), std::memory_order_release);
+}
+
+const vecbox_shm_msg_header * vecbox_shm_ring::peek() {
+    if (corrupt) {
+        return nullptr;
+    }
+
+    uint64_t       tail = hdr->tail.load(std::memory_order_relaxed);
+    const uint64_t head = hdr->head.load(std::memory_order_acquire);
+
+    // head and tail come from the peer, so neither a message nor a skip may run past head
+    if (head - tail > capacity) {
+        corrupt = true;
+        return nullptr;
+    }
+
+    while (tail != head) {
+        const uint64_t off  = tail & (capacity - 1);
+        const uint64_t left = capacity - off;
+        if (left < sizeof(vecbox_shm_msg_header) || ((const vecbox_shm_msg_header *) (data + off))->type == VECBOX_SHM_MSG_PAD) {
+            if (left > head - tail) {
+                corrupt = true;
+                return nullptr;
+            }
+            tail += left;
+            continue;
+        }
+        const vecbox_shm_msg_header * msg = (const vecbox_shm_msg_header *) (data + off);
+        const uint64_t bytes = shm_msg_bytes(msg->size);
+        if (bytes > left || bytes > head - tail) {
+            corrupt = true;
+            return nullptr;
+        }
+        if (tail != hdr->tail.load(std::memory_order_relaxed)) {
+            hdr->tail.store(tail, std::memory_order_release);
+        }
+        peeked_bytes = bytes;
+        return msg;
+    }
+
+    if (tail != hdr->tail.load(std::memory_order_relaxed)) {
+        hdr->tail.store(tail, std::memory_order_release);
+    }
+    return nullptr;
+}
+
+void vecbox_shm_ring::pop() {
+    // the size checked by peek(), not the header, which the peer may have rewritten since
+    const uint64_t tail = hdr->tail.load(std::memory_order_relaxed);
+    hdr->tail.store(tail + peeked_bytes, std::memory_order_release);
+    peeked_bytes = 0;
+}
+
+bool vecbox_shm_ring::empty() const {
+    return hdr->head.load(std::memory_order_acquire) == hdr->tail.load(std::memory_order_relaxed);
+}
+
+//
+// client
+//
+
+vecbox_shm_client::vecbox_shm_client(const std::string & path) {
+    sockaddr_un addr {};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("shm: control socket path too long: " + path);
+    }
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    ctl_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (ctl_fd < 0 || connect(ctl_fd, (const sockaddr *) &addr, sizeof(addr)) < 0) {
+        const std::string err = strerror(errno);
+        if (ctl_fd >= 0) close(ctl_fd);
+        throw std::runtime_error("shm: connect " + path + ": " + err);
+    }
+
+    // the server answers with the region memfd and the two eventfds
+    char  byte;
+    iovec iov { &byte, 1 };
+    alignas(cmsghdr) char cbuf[CMSG_SPACE(3*sizeof(int))];
+
+    msghdr msg {};
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    int fds[3] = { -1, -1, -1 };
+    const ssize_t n = recvmsg(ctl_fd, &msg, MSG_CMSG_CLOEXEC);
+    cmsghdr * cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : nullptr;
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(3*sizeof(int))) {
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    }
+    if (fds[0] < 0) {
+        close(ctl_fd);
+        throw std::runtime_error("shm: handshake with " + path + " failed");
+    }
+    server_fd = fds[1];
+    client_fd = fds[2];
+
+    struct stat st;
+    if (fstat(fds[0], &st) == 0 && st.st_size > 0) {
+        size = (size_t) st.st_size;
+        base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    }
+    close(fds[0]);
+
+    const vecbox_shm_region_header * region = base != nullptr && base != MAP_FAILED ? (const vecbox_shm_region_header *) base : nullptr;
+    if (!region || region->magic != VECBOX_SHM_MAGIC || region->version != VECBOX_SHM_VERSION ||
+        shm_region_size(region->capacity) != size) {
+        if (region) munmap(base, size);
+        base = nullptr;
+        close(server_fd);
+        close(client_fd);
+        close(ctl_fd);
+        throw std::runtime_error("shm: incompatible region from " + path);
+    }
+
+    shm_map_rings(base, region->capacity, req, res);
+}
+
+vecbox_shm_client::~vecbox_shm_client() {
+    if (base) munmap(base, size);
+    close(server_fd);
+    close(client_fd);
+    close(ctl_fd);
+}
+
+void vecbox_shm_client::wait_server() {
+    pollfd pfd[2] = {
+        { client_fd, POLLIN, 0 },
+        { ctl_fd,    POLLIN, 0 },
+    };
+
+    while (poll(pfd, 2, -1) < 0) {
+        if (errno != EINTR) {
+            throw std::runtime_error(std::string("shm: poll: ") + strerror(errno));
+        }
+    }
+    if (pfd[1].revents) {
+        // the server never writes to the control socket, so anything here is a hangup
+        throw std::runtime_error("shm: server closed the channel");
+    }
+    shm_clear(client_fd);
+}
+
+vecbox_shm_result vecbox_shm_client::embed(const std::vector<std::string> & texts, bool normalize, bool q8, bool bulk) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    size_t size = sizeof(uint32_t);
+    for (const auto & text : texts) {
+        size += sizeof(uint32_t) + text.size();
+    }
+    if (size > req.max_payload()) {
+        throw std::runtime_error("shm: request of " + std::to_string(size) + " bytes does not fit the ring");
+    }
+
+    // request: u32 n_texts, then per text u32 length + bytes
+    uint8_t * p;
+    while ((p = req.reserve(size)) == nullptr) {
+        req.hdr->producer_waiting.store(1);
+        if ((p = req.reserve(size)) != nullptr) {
+            req.hdr->producer_waiting.store(0);
+            break;
+        }
+        wait_server();
+    }
+
+    const uint32_t n_texts = (uint32_t) texts.size();
+    memcpy(p, &n_texts, sizeof(n_texts));
+    p += sizeof(n_texts);
+    for (const auto & text : texts) {
+        const uint32_t len = (uint32_t) text.size();
+        memcpy(p, &len, sizeof(len));
+        memcpy(p + sizeof(len), text.data(), len);
+        p += sizeof(len) + len;
+    }
+
+    vecbox_shm_msg_header msg {};
+    msg.size  = (uint32_t) size;
+    msg.type  = VECBOX_SHM_MSG_EMBED;
+    msg.flags = (normalize ? (uint32_t) VECBOX_SHM_FLAG_NORMALIZE : 0u) | (q8 ? (uint32_t) VECBOX_SHM_FLAG_Q8 : 0u) |
+                (bulk ? (uint32_t) VECBOX_SHM_FLAG_BULK : 0u);
+    msg.id    = next_id++;
+    req.commit(msg);
+
+    if (req.hdr->consumer_waiting.exchange(0)) {
+        shm_signal(server_fd);
+    }
+
+    // wait for the matching response: spin briefly, then sleep on the eventfd
+    const vecbox_shm_msg_header * rsp = nullptr;
+    for (int spin = 0; ; ++spin) {
+        rsp = res.peek();
+        if (res.corrupt) {
+            throw std::runtime_error("shm: corrupt response ring");
+        }
+        if (rsp && rsp->id != msg.id) {
+            res.pop(); // left over from a request whose caller gave up
+            continue;
+        }
+        if (rsp) {
+            break;
+        }
+        if (spin < VECBOX_SHM_SPIN) {
+            VECBOX_SHM_PAUSE();
+            continue;
+        }
+        res.hdr->consumer_waiting.store(1);
+        if (!res.empty()) {
+            res.hdr->consumer_waiting.store(0);
+            continue;
+        }
+        wait_server();
+    }
+
+    // the header lives in shared memory: work from a copy, with the size peek() checked
+    vecbox_shm_msg_header hdr;
+    memcpy(&hdr, rsp, sizeof(hdr));
+    hdr.size = (uint32_t) std::min<uint64_t>(hdr.size, res.peeked_bytes - sizeof(hdr));
+
+    vecbox_shm_result result;
+    std::string error;
+
+    const uint8_t * payload = (const uint8_t *) (rsp + 1);
+    if (hdr.type == VECBOX_SHM_MSG_EMBD) {
+        // response: u32 n, u32 n_embd, u32 format, u32 pad, then the rows
+        uint32_t head[4] = {};
+        if (hdr.size >= sizeof(head)) {
+            memcpy(head, payload, sizeof(head));
+            payload += sizeof(head);
+        }
+
+        // one row per text, and every row inside the message
+        const bool   q8_rows = head[2] == VECBOX_SHM_EMBD_Q8;
+        const size_t row     = q8_rows ? sizeof(float) + head[1] : (size_t) head[1]*sizeof(float);
+        if (hdr.size < sizeof(head) || (!q8_rows && head[2] != VECBOX_SHM_EMBD_F32) ||
+            head[0] != texts.size() || head[1] > INT32_MAX ||
+            (size_t) head[0]*row > hdr.size - sizeof(head)) {
+            error = "malformed response";
+        } else {
+            result.n      = (int32_t) head[0];
+            result.n_embd = (int32_t) head[1];
+            result.embd.resize((size_t) result.n*result.n_embd);
+
+            if (q8_rows) {
+                for (int32_t r = 0; r < result.n; ++r) {
+                    float scale;
+                    memcpy(&scale, payload, sizeof(scale));
+                    const int8_t * q = (const int8_t *) (payload + sizeof(scale));
+                    float * dst = result.embd.data() + (size_t) r*result.n_embd;
+                    for (int32_t i = 0; i < result.n_embd; ++i) {
+                        dst[i] = q[i]*scale;
+                    }
+                    payload += sizeof(scale) + result.n_embd;
+                }
+            } else {
+                memcpy(result.embd.data(), payload, result.embd.size()*sizeof(float));
+            }
+        }
+    } else {
+        error.assign((const char *) payload, hdr.size);
+    }
+
+    res.pop();
+    if (res.hdr->producer_waiting.exchange(0)) {
+        shm_signal(server_fd);
+    }
+
+    if (!error.empty() || hdr.type != VECBOX_SHM_MSG_EMBD) {
+        throw std::runtime_error("shm: " + (error.empty() ? std::string("unexpected message") : error));
+    }
+
+    return result;
+}
+
+//
+// server
+//
+
+struct vecbox_shm_server::channel {
+    uint64_t id;
+
+    int ctl_fd    = -1;
+    int server_fd = -1;
+    int client_fd = -1;
+
+    void   * base = nullptr;
+    size_t   size = 0;
+
+    vecbox_shm_ring req;
+    vecbox_shm_ring res;
+
+    struct pending {
+        uint64_t                         msg_id;
+        uint32_t                         flags;
+        std::shared_ptr<vecbox_embd_job> job;   // null for errors
+        std::string                      error;
+        bool                             done = false;
+    };
+
+    // responses go out in request order; a finished job waits behind earlier ones
+    std::deque<pending> out;
+
+    // set while the response ring has no room for the next finished response
+    bool res_full = false;
+
+    // requests stay in the request ring, and the client waits on it, while the channel already
+    // holds max_pending unanswered ones or cannot send the ones it has
+    bool can_read(uint32_t max_pending) const {
+        return out.size() < max_pending && !res_full;
+    }
+
+    ~channel() {
+        if (base) munmap(base, size);
+        if (ctl_fd    >= 0) close(ctl_fd);
+        if (server_fd >= 0) close(server_fd);
+        if (client_fd >= 0) close(client_fd);
+    }
+};
+
+// epoll tags: channels use (id << 1) for the eventfd and (id << 1 | 1) for the control socket
+#define VECBOX_SHM_TAG_LISTEN 0
+#define VECBOX_SHM_TAG_DONE   2
+#define VECBOX_SHM_TAG_STOP   4
+
+vecbox_shm_server::vecbox_shm_server(vecbox_batcher & batcher, const std::string & path, const vecbox_shm_server_params & params)
+    : batcher(batcher), path(path), params(params), completions(std::make_shared<vecbox_completion_queue>()) {
+    uint32_t cap = VECBOX_SHM_PAGE;
+    while (cap < params.ring_capacity) {
+        cap <<= 1;
+    }
+    this->params.ring_capacity = cap;
+    this->params.max_pending   = std::max(params.max_pending, 1u);
+
+    sockaddr_un addr {};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("shm: control socket path too long: " + path);
+    }
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    auto fail = [&](const char * what) {
+        const std::string err = std::string("shm: ") + what + ": " + strerror(errno);
+        if (lfd    >= 0) close(lfd);
+        if (epfd   >= 0) close(epfd);
+        if (stopfd >= 0) close(stopfd);
+        throw std::runtime_error(err);
+    };
+
+    lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (lfd < 0) {
+        fail("socket");
+    }
+    unlink(path.c_str());
+    if (bind(lfd, (const sockaddr *) &addr, sizeof(addr)) < 0) {
+        fail(("bind " + path).c_str());
+    }
+    if (listen(lfd, SOMAXCONN) < 0) {
+        fail("listen");
+    }
+
+    epfd   = epoll_create1(EPOLL_CLOEXEC);
+    stopfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epfd < 0 || stopfd < 0) {
+        fail("epoll");
+    }
+
+    const struct { int fd; uint64_t tag; } fixed[] = {
+        { lfd,                VECBOX_SHM_TAG_LISTEN },
+        { completions->fd(),  VECBOX_SHM_TAG_DONE   },
+        { stopfd,             VECBOX_SHM_TAG_STOP   },
+    };
+    for (const auto & f : fixed) {
+        epoll_event ev {};
+        ev.events   = EPOLLIN;
+        ev.data.u64 = f.tag;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, f.fd, &ev) < 0) {
+            fail("epoll_ctl");
+        }
+    }
+
+    // channel ids start past the fixed tags
+    next_id = 3;
+
+    thread = std::thread([this] { run(); });
+}
+
+vecbox_shm_server::~vecbox_shm_server() {
+    shm_signal(stopfd);
+    thread.join();
+
+    channels.clear();
+    close(lfd);
+    close(epfd);
+    close(stopfd);
+    unlink(path.c_str());
+}
+
+void vecbox_shm_server::run() {
+    epoll_event events[64];
+
+    while (true) {
+        const int n = epoll_wait(epfd, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "vecbox_shm_server: epoll_wait: %s\n", strerror(errno));
+            return;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            const uint64_t tag = events[i].data.u64;
+
+            if (tag == VECBOX_SHM_TAG_STOP) {
+                return;
+            }
+            if (tag == VECBOX_SHM_TAG_LISTEN) {
+                on_accept();
+                continue;
+            }
+            if (tag == VECBOX_SHM_TAG_DONE) {
+                on_completions();
+                continue;
+            }
+
+            const uint64_t id = tag >> 1;
+            auto it = channels.find(id);
+            if (it == channels.end()) {
+                continue;
+            }
+            if (tag & 1) {
+                close_channel(id); // control socket hung up
+                continue;
+            }
+
+            channel & ch = *it->second;
+            shm_clear(ch.server_fd);
+            if (!pump(ch)) {
+                close_channel(id);
+            }
+        }
+    }
+}
+
+void vecbox_shm_server::on_accept() {
+    while (true) {
+        const int fd = accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return;
+        }
+
+        auto ch = std::make_unique<channel>();
+        ch->id     = next_id++;
+        ch->ctl_fd = fd;
+        ch->size   = shm_region_size(params.ring_capacity);
+
+        const int mfd   = memfd_create("vecbox-shm", MFD_CLOEXEC);
+        ch->server_fd   = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        ch->client_fd   = eventfd(0, EFD_CLOEXEC);
+        if (mfd < 0 || ch->server_fd < 0 || ch->client_fd < 0 || ftruncate(mfd, ch->size) < 0) {
+            fprintf(stderr, "vecbox_shm_server: channel setup: %s\n", strerror(errno));
+            if (mfd >= 0) close(mfd);
+            continue;
+        }
+
+        ch->base = mmap(nullptr, ch->size, PROT_READ | PROT_WRITE, MAP_SHARED, mfd, 0);
+        if (ch->base == MAP_FAILED) {
+            ch->base = nullptr;
+            close(mfd);
+            continue;
+        }
+
+        // a fresh memfd is zero-filled, which is the empty state for both rings
+        vecbox_shm_region_header * region = (vecbox_shm_region_header *) ch->base;
+        region->magic    = VECBOX_SHM_MAGIC;
+        region->version  = VECBOX_SHM_VERSION;
+        region->capacity = params.ring_capacity;
+        region->n_embd   = (uint32_t) batcher.model()->n_embd;
+        shm_map_rings(ch->base, params.ring_capacity, ch->req, ch->res);
+
+        // the server sleeps in epoll, so clients must always signal at first. armed before the
+        // handover: a client can publish its first request before sendmsg() even returns
+        ch->req.hdr->consumer_waiting.store(1);
+
+        // hand the region and both eventfds to the client
+        char  byte = 0;
+        iovec iov { &byte, 1 };
+        alignas(cmsghdr) char cbuf[CMSG_SPACE(3*sizeof(int))] = {};
+
+        msghdr msg {};
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = cbuf;
+        msg.msg_controllen = sizeof(cbuf);
+
+        cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type  = SCM_RIGHTS;
+        cmsg->cmsg_len   = CMSG_LEN(3*sizeof(int));
+        const int fds[3] = { mfd, ch->server_fd, ch->client_fd };
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+        const ssize_t rc = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        close(mfd);
+        if (rc != 1) {
+            continue;
+        }
+
+        epoll_event ev {};
+        ev.events   = EPOLLIN;
+        ev.data.u64 = ch->id << 1;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, ch->server_fd, &ev);
+
+        ev.events   = EPOLLRDHUP | EPOLLIN;
+        ev.data.u64 = ch->id << 1 | 1;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, ch->ctl_fd, &ev);
+
+        channels.emplace(ch->id, std::move(ch));
+    }
+}
+
+bool vecbox_shm_server::on_requests(channel & ch) {
+    const int32_t n_embd   = batcher.model()->n_embd;
+    const size_t  max_out  = ch.res.max_payload();
+
+    while (true) {
+        ch.req.hdr->consumer_waiting.store(0);
+
+        const vecbox_shm_msg_header * shared;
+        while (ch.can_read(params.max_pending) && (shared = ch.req.peek()) != nullptr) {
+            // the client can still write to the ring: work from a copy of the checked header
+            vecbox_shm_msg_header hdr;
+            memcpy(&hdr, shared, sizeof(hdr));
+            hdr.size = (uint32_t) std::min<uint64_t>(hdr.size, ch.req.peeked_bytes - sizeof(hdr));
+            const vecbox_shm_msg_header * msg = &hdr;
+
+            channel::pending p;
+            p.msg_id = msg->id;
+            p.flags  = msg->flags;
+
+            const uint8_t * payload = (const uint8_t *) (shared + 1);
+            const uint8_t * end     = payload + msg->size;
+
+            uint32_t n_texts = 0;
+            if (msg->type != VECBOX_SHM_MSG_EMBED || msg->size < sizeof(n_texts)) {
+                p.error = "malformed request";
+            } else {
+                memcpy(&n_texts, payload, sizeof(n_texts));
+                payload += sizeof(n_texts);
+
+                const size_t row = (msg->flags & VECBOX_SHM_FLAG_Q8) ? sizeof(float) + n_embd : n_embd*sizeof(float);
+                if (4*sizeof(uint32_t) + (size_t) n_texts*row > max_out) {
+                    p.error = "response for " + std::to_string(n_texts) + " texts does not fit the ring";
+                } else {
+                    auto job = std::make_shared<vecbox_embd_job>();
+                    job->texts.reserve(n_texts);
+                    for (uint32_t i = 0; i < n_texts; ++i) {
+                        uint32_t len;
+                        if (end - payload < (ptrdiff_t) sizeof(len)) {
+                            break;
+                        }
+                        memcpy(&len, payload, sizeof(len));
+                        payload += sizeof(len);
+                        if ((size_t) (end - payload) < len) {
+                            break;
+                        }
+                        job->texts.emplace_back((const char *) payload, len);
+                        payload += len;
+                    }
+
+                    if (job->texts.size() != n_texts) {
+                        p.error = "malformed request";
+                    } else {
+                        job->normalize = (msg->flags & VECBOX_SHM_FLAG_NORMALIZE) != 0;
+                        job->priority  = (msg->flags & VECBOX_SHM_FLAG_BULK) ? VECBOX_PRIORITY_BULK : VECBOX_PRIORITY_INTERACTIVE;
+                        job->tenant    = "shm:" + std::to_string(ch.id); // each client connection is its own tenant
+                        job->on_done   = [queue = completions, id = ch.id, msg_id = msg->id](vecbox_embd_job &) {
+                            queue->push(id, msg_id);
+                        };
+                        p.job = job;
+                    }
+                }
+            }
+
+            if (!p.job) {
+                p.done = true;
+            }
+            ch.out.push_back(p);
+            ch.req.pop();
+
+            if (p.job) {
+                batcher.submit(p.job);
+            }
+        }
+
+        if (ch.req.corrupt) {
+            fprintf(stderr, "vecbox_shm_server: channel %llu: corrupt request ring, closing\n", (unsigned long long) ch.id);
+            return false;
+        }
+
+        if (ch.req.hdr->producer_waiting.exchange(0)) {
+            shm_signal(ch.client_fd);
+        }
+
+        // paused: pump() reads on once a completion or the client freeing response room wakes us
+        if (!ch.can_read(params.max_pending)) {
+            break;
+        }
+
+        // arm before the final check so a request published in between still signals us
+        ch.req.hdr->consumer_waiting.store(1);
+        if (ch.req.empty()) {
+            break;
+        }
+    }
+
+    return true;
+}
+
+void vecbox_shm_server::on_completions() {
+    for (const auto & comp : completions->drain()) {
+        auto it = channels.find(comp.tag);
+        if (it == channels.end()) {
+            continue; // client went away while its job was running
+        }
+        channel & ch = *it->second;
+        for (auto & p : ch.out) {
+            if (p.msg_id == comp.id) {
+                p.done = true;
+                vecbox_metrics_observe(VECBOX_HIST_REQUEST, (vecbox_time_us() - p.job->t_submit_us)*1e-6);
+                break;
+            }
+        }
+        if (!pump(ch)) {
+            close_channel(comp.tag);
+        }
+    }
+}
+
+void vecbox_shm_server::flush(channel & ch) {
+    bool sent = false;
+
+    while (!ch.out.empty() && ch.out.front().done) {
+        channel::pending & p = ch.out.front();
+
+        std::string error = p.error;
+        if (error.empty() && !p.job->error.empty()) {
+            error = p.job->error;
+        }
+
+        const bool     q8     = (p.flags & VECBOX_SHM_FLAG_Q8) != 0;
+        const uint32_t n      = error.empty() ? (uint32_t) p.job->texts.size() : 0;
+        const uint32_t n_embd = error.empty() ? (uint32_t) p.job->n_embd : 0;
+        const size_t   size   = error.empty()
+            ? 4*sizeof(uint32_t) + (size_t) n*(q8 ? sizeof(float) + n_embd : n_embd*sizeof(float))
+            : std::min(error.size(), ch.res.max_payload());
+
+        uint8_t * dst = ch.res.reserve(size);
+        if (!dst) {
+            // full: the client signals once it has consumed something
+            ch.res.hdr->producer_waiting.store(1);
+            if ((dst = ch.res.reserve(size)) == nullptr) {
+                ch.res_full = true;
+                break;
+            }
+            ch.res.hdr->producer_waiting.store(0);
+        }
+        ch.res_full = false;
+
+        vecbox_shm_msg_header msg {};
+        msg.size = (uint32_t) size;
+        msg.id   = p.msg_id;
+
+        if (!error.empty()) {
+            msg.type = VECBOX_SHM_MSG_ERROR;
+            memcpy(dst, error.data(), size);
+        } else {
+            msg.type = VECBOX_SHM_MSG_EMBD;
+            const uint32_t head[4] = { n, n_embd, q8 ? VECBOX_SHM_EMBD_Q8 : VECBOX_SHM_EMBD_F32, 0 };
+            memcpy(dst, head, sizeof(head));
+            dst += sizeof(head);
+
+            const float * src = p.job->embd.data();
+            if (!q8) {
+                memcpy(dst, src, (size_t) n*n_embd*sizeof(float));
+            } else {
+                // symmetric per-row int8
+                for (uint32_t r = 0; r < n; ++r, src += n_embd) {
+                    float amax = 0.0f;
+                    for (uint32_t i = 0; i < n_embd; ++i) {
+                        amax = std::max(amax, std::fabs(src[i]));
+                    }
+                    const float scale = amax/127.0f;
+                    const float inv   = scale > 0.0f ? 1.0f/scale : 0.0f;
+
+                    memcpy(dst, &scale, sizeof(scale));
+                    int8_t * q = (int8_t *) (dst + sizeof(scale));
+                    for (uint32_t i = 0; i < n_embd; ++i) {
+                        q[i] = (int8_t) std::lrintf(src[i]*inv);
+                    }
+                    dst += sizeof(scale) + n_embd;
+                }
+            }
+        }
+
+        ch.res.commit(msg);
+        ch.out.pop_front();
+        sent = true;
+    }
+
+    if (sent && ch.res.hdr->consumer_waiting.exchange(0)) {
+        shm_signal(ch.client_fd);
+    }
+}
+
+bool vecbox_shm_server::pump(channel & ch) {
+    do {
+        if (!on_requests(ch)) {
+            return false;
+        }
+        flush(ch);
+        // flushing may have made room to read the requests left in the ring
+    } while (ch.can_read(params.max_pending) && !ch.req.empty());
+    return true;
+}
+
+void vecbox_shm_server::close_channel(uint64_t id) {
+    auto it = channels.find(id);
+    if (it == channels.end()) {
+        return;
+    }
+    epoll_ctl(epfd, EPOLL_CTL_DEL, it->second->server_fd, nullptr);
+    epoll_ctl(epfd, EPOLL_CTL_DEL, it->second->ctl_fd, nullptr);
+    channels.erase(it);
+}
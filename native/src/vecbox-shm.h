@@ -0,0 +1,193 @@
+#pragma once
+
+// shared-memory transport between a client process and an embedding sidecar
+//
+// each client gets its own channel: a memfd region holding two SPSC byte rings (requests
+// client -> server, responses server -> client) plus one eventfd per direction. the channel
+// is handed over a Unix domain control socket with SCM_RIGHTS; closing the control socket
+// tears the channel down. wakeups only cost a syscall when the peer is actually asleep.
+//
+// Linux only
+
+#include "vecbox-engine.h"
+#include "vecbox-event.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define VECBOX_SHM_MAGIC   0x76627368u // "vbsh"
+#define VECBOX_SHM_VERSION 1
+
+#define VECBOX_SHM_RING_DEFAULT (8u*1024*1024)
+
+enum vecbox_shm_msg_type : uint32_t {
+    VECBOX_SHM_MSG_PAD   = 0, // filler up to the end of the ring, skipped by the reader
+    VECBOX_SHM_MSG_EMBED = 1, // client -> server: texts to embed
+    VECBOX_SHM_MSG_EMBD  = 2, // server -> client: embeddings
+    VECBOX_SHM_MSG_ERROR = 3, // server -> client: error string
+};
+
+// layout of the embeddings in a VECBOX_SHM_MSG_EMBD payload
+enum vecbox_shm_embd_format : uint32_t {
+    VECBOX_SHM_EMBD_F32 = 0, // [n, n_embd] float32
+    VECBOX_SHM_EMBD_Q8  = 1, // per row: float32 scale, then n_embd int8 (x = q*scale)
+};
+
+enum vecbox_shm_flags : uint32_t {
+    VECBOX_SHM_FLAG_NORMALIZE = 1u << 0,
+    VECBOX_SHM_FLAG_Q8        = 1u << 1,
+    VECBOX_SHM_FLAG_BULK      = 1u << 2, // schedule as bulk work
+};
+
+struct vecbox_shm_msg_header {
+    uint32_t size;  // payload bytes
+    uint32_t type;  // vecbox_shm_msg_type
+    uint32_t flags;
+    uint32_t pad;
+    uint64_t id;
+};
+
+// one direction; head and tail are free-running byte counters
+// a side that is about to block sets its waiting flag and re-checks the ring; the other side
+// only signals the eventfd when it finds the flag set
+struct vecbox_shm_ring_header {
+    alignas(64) std::atomic<uint64_t> head;             // written by the producer
+    alignas(64) std::atomic<uint64_t> tail;             // written by the consumer
+    alignas(64) std::atomic<uint32_t> consumer_waiting; // ring was empty
+    alignas(64) std::atomic<uint32_t> producer_waiting; // ring was full
+};
+
+// region layout: [page: region header][page: request ring header][capacity bytes]
+//                [page: response ring header][capacity bytes]
+struct vecbox_shm_region_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity; // data bytes per ring
+    uint32_t n_embd;
+};
+
+// view of one ring inside a mapped region
+struct vecbox_shm_ring {
+    vecbox_shm_ring_header * hdr      = nullptr;
+    uint8_t                * data     = nullptr;
+    uint64_t                 capacity = 0;
+
+    // producer-local state between reserve() and commit()
+    uint64_t reserved_pos = 0;
+
+    // consumer-local: ring bytes of the message returned by peek(), consumed by pop()
+    uint64_t peeked_bytes = 0;
+
+    // set by peek() when the peer published counters or a message size that do not fit the
+    // ring; the ring is unusable from then on and the channel must be closed
+    bool corrupt = false;
+
+    // largest payload that fits in one message
+    size_t max_payload() const;
+
+    // producer side: reserve room for a payload of `size` bytes, fill it in place, then commit
+    // returns nullptr if the ring has no room right now
+    uint8_t * reserve(size_t size);
+    void      commit(const vecbox_shm_msg_header & msg);
+
+    // consumer side: pointer to the next message (payload follows the header) or nullptr if empty
+    // or corrupt. the returned size has been checked against the ring, but the header lives in
+    // shared memory: copy it before use, the peer can still write to it
+    const vecbox_shm_msg_header * peek();
+    void                          pop();
+
+    bool empty() const;
+};
+
+//
+// client
+//
+
+struct vecbox_shm_result {
+    int32_t            n      = 0;
+    int32_t            n_embd = 0;
+    std::vector<float> embd;   // [n, n_embd], dequantized if the server sent int8
+};
+
+// not thread-safe on its own; embed() serializes callers with a mutex
+class vecbox_shm_client {
+public:
+    // connects to a server's control socket; throws std::runtime_error on failure
+    explicit vecbox_shm_client(const std::string & path);
+    ~vecbox_shm_client();
+
+    vecbox_shm_client(const vecbox_shm_client &) = delete;
+    vecbox_shm_client & operator=(const vecbox_shm_client &) = delete;
+
+    // blocks until the embeddings are back; throws std::runtime_error on server errors
+    vecbox_shm_result embed(const std::vector<std::string> & texts, bool normalize, bool q8 = false, bool bulk = false);
+
+private:
+    // blocks until the server signals; throws if the server has gone away
+    void wait_server();
+
+    int ctl_fd    = -1;
+    int server_fd = -1; // eventfd: wake the server
+    int client_fd = -1; // eventfd: woken by the server
+
+    void   * base = nullptr;
+    size_t   size = 0;
+
+    vecbox_shm_ring req;
+    vecbox_shm_ring res;
+
+    std::mutex mutex;
+    uint64_t   next_id = 1;
+};
+
+//
+// server
+//
+
+struct vecbox_shm_server_params {
+    uint32_t ring_capacity = VECBOX_SHM_RING_DEFAULT; // bytes per direction, rounded up to a power of two
+    uint32_t max_pending   = 256; // requests read but not answered yet, per channel; past it the client waits on its ring
+};
+
+// accepts channels on a Unix socket and feeds their requests into a batcher from its own thread
+class vecbox_shm_server {
+public:
+    // throws std::runtime_error if the control socket cannot be created
+    vecbox_shm_server(vecbox_batcher & batcher, const std::string & path, const vecbox_shm_server_params & params = {});
+    ~vecbox_shm_server();
+
+    vecbox_shm_server(const vecbox_shm_server &) = delete;
+    vecbox_shm_server & operator=(const vecbox_shm_server &) = delete;
+
+private:
+    struct channel;
+
+    void run();
+    void on_accept();
+    bool on_requests(channel & ch); // false if the channel is corrupt and must be closed
+    void on_completions();
+    void flush(channel & ch);
+    bool pump(channel & ch);        // on_requests + flush until nothing more can be read
+    void close_channel(uint64_t id);
+
+    vecbox_batcher &         batcher;
+    std::string              path;
+    vecbox_shm_server_params params;
+
+    std::shared_ptr<vecbox_completion_queue> completions;
+
+    int epfd   = -1;
+    int lfd    = -1;
+    int stopfd = -1;
+
+    uint64_t next_id = 1;
+    std::unordered_map<uint64_t, std::unique_ptr<channel>> channels;
+
+    std::thread thread;
+};
@@ -0,0 +1,278 @@
+#include "vecbox-similarity.h"
+#include "vecbox-engine.h"
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// rows [first, first + n) of m as float32
+static void vecbox_sim_load(const vecbox_sim_rows & m, int64_t first, int64_t n, float * dst) {
+    const int64_t n_embd = m.n_embd;
+    switch (m.type) {
+        case VECBOX_SIM_F32:
+            memcpy(dst, (const float *) m.data + first*n_embd, n*n_embd*sizeof(float));
+            break;
+        case VECBOX_SIM_F16:
+            ggml_fp16_to_fp32_row((const ggml_fp16_t *) m.data + first*n_embd, dst, n*n_embd);
+            break;
+        case VECBOX_SIM_I8: {
+            const int8_t * src = (const int8_t *) m.data + first*n_embd;
+            for (int64_t k = 0; k < n*n_embd; ++k) {
+                dst[k] = (float) src[k];
+            }
+            break;
+        }
+    }
+}
+
+// the GEMM runs at the precision of the side held in src0
+static ggml_type vecbox_sim_gemm_type(const vecbox_sim_rows & m) {
+    switch (m.type) {
+        case VECBOX_SIM_F16:
+            return GGML_TYPE_F16;
+        case VECBOX_SIM_I8:
+            return m.n_embd % ggml_blck_size(GGML_TYPE_Q8_0) == 0 ? GGML_TYPE_Q8_0 : GGML_TYPE_F16;
+        default:
+            return GGML_TYPE_F32;
+    }
+}
+
+namespace {
+
+// one fixed-size block GEMM, scores[n_a, n_b] = a x b^T, planned once on its own threadpool and
+// reused for every pair of blocks; partial blocks are zero-padded
+class vecbox_sim_gemm {
+public:
+    vecbox_sim_gemm(ggml_type type, int32_t n_embd, int64_t n_b, int64_t n_a, int n_threads) : n_embd(n_embd) {
+        ggml_init_params params = {
+            /*.mem_size   =*/ ggml_row_size(type, n_embd)*n_b + ggml_row_size(GGML_TYPE_F32, n_embd)*n_a +
+                              sizeof(float)*n_a*n_b + 3*ggml_tensor_overhead() + ggml_graph_overhead() + 1024,
+            /*.mem_buffer =*/ nullptr,
+            /*.no_alloc   =*/ false,
+        };
+        ctx = ggml_init(params);
+        if (!ctx) {
+            throw std::runtime_error("failed to allocate the similarity context");
+        }
+
+        b      = ggml_new_tensor_2d(ctx, type,          n_embd, n_b);
+        a      = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, n_embd, n_a);
+        scores = ggml_mul_mat(ctx, b, a);
+
+        gf = ggml_new_graph(ctx);
+        ggml_build_forward_expand(gf, scores);
+
+        ggml_threadpool_params tpp = ggml_threadpool_params_default(n_threads);
+        threadpool = ggml_threadpool_new(&tpp);
+        if (!threadpool) {
+            ggml_free(ctx);
+            throw std::runtime_error("failed to create the similarity threadpool");
+        }
+
+        plan = ggml_graph_plan(gf, n_threads, threadpool);
+        work.resize(plan.work_size);
+        plan.work_data = work.data();
+
+        a_own = a->data;
+    }
+
+    ~vecbox_sim_gemm() {
+        ggml_threadpool_free(threadpool);
+        ggml_free(ctx);
+    }
+
+    vecbox_sim_gemm(const vecbox_sim_gemm &) = delete;
+    vecbox_sim_gemm & operator=(const vecbox_sim_gemm &) = delete;
+
+    void set_b(const float * rows, int64_t n) {
+        const size_t row_size = ggml_row_size(b->type, n_embd);
+        switch (b->type) {
+            case GGML_TYPE_F16:
+                ggml_fp32_to_fp16_row(rows, (ggml_fp16_t *) b->data, n*n_embd);
+                break;
+            case GGML_TYPE_Q8_0:
+                ggml_quantize_chunk(GGML_TYPE_Q8_0, rows, b->data, 0, n, n_embd, nullptr);
+                break;
+            default:
+                memcpy(b->data, rows, n*row_size);
+                break;
+        }
+        memset((char *) b->data + n*row_size, 0, (b->ne[1] - n)*row_size);
+    }
+
+    // a full block is read in place; rows must stay valid until compute()
+    void set_a(const float * rows, int64_t n) {
+        if (n == a->ne[1]) {
+            a->data = (void *) rows;
+            return;
+        }
+        a->data = a_own;
+        memcpy(a_own, rows, n*n_embd*sizeof(float));
+        memset((float *) a_own + n*n_embd, 0, (a->ne[1] - n)*n_embd*sizeof(float));
+    }
+
+    // row i of the result holds a[i] against every row of b
+    float * compute() {
+        if (ggml_graph_compute(gf, &plan) != GGML_STATUS_SUCCESS) {
+            throw std::runtime_error("similarity GEMM failed");
+        }
+        return (float *) scores->data;
+    }
+
+    int64_t stride() const {
+        return scores->nb[1]/sizeof(float);
+    }
+
+private:
+    int32_t n_embd;
+
+    ggml_context * ctx    = nullptr;
+    ggml_tensor  * b      = nullptr;
+    ggml_tensor  * a      = nullptr;
+    ggml_tensor  * scores = nullptr;
+    ggml_cgraph  * gf     = nullptr;
+    void         * a_own  = nullptr;
+
+    ggml_threadpool    * threadpool = nullptr;
+    ggml_cplan           plan;
+    std::vector<uint8_t> work;
+};
+
+}
+
+// runs fn(i0, n_a, j0, n_b, scores, stride) for every pair of blocks of a x b, or for the blocks
+// on and above the diagonal of a x a when b is null
+template <typename F>
+static void vecbox_sim_blocks(const vecbox_sim_rows & a, const vecbox_sim_rows * b, const vecbox_sim_params & params, F && fn) {
+    const vecbox_sim_rows & rb = b ? *b : a;
+    if (a.n_embd <= 0 || a.n_embd != rb.n_embd) {
+        throw std::invalid_argument("similarity inputs must have the same number of dimensions, got " +
+                                    std::to_string(a.n_embd) + " and " + std::to_string(rb.n_embd));
+    }
+    if (a.n_rows < 0 || rb.n_rows < 0 || a.n_rows > INT32_MAX || rb.n_rows > INT32_MAX) {
+        throw std::invalid_argument("similarity inputs must have at most 2^31 - 1 rows");
+    }
+    if (params.block_rows <= 0) {
+        throw std::invalid_argument("similarity block_rows must be positive");
+    }
+    if (a.n_rows == 0 || rb.n_rows == 0) {
+        return;
+    }
+
+    const int32_t n_embd = a.n_embd;
+    const int64_t blk_a  = std::min<int64_t>(params.block_rows, a.n_rows);
+    const int64_t blk_b  = std::min<int64_t>(params.block_rows, rb.n_rows);
+
+    const int n_threads = params.n_threads > 0 ? params.n_threads : (int) std::max(1u, std::thread::hardware_concurrency());
+
+    // a is never normalized itself: each row of scores is divided by the norm of its row of a,
+    // computed once here, instead of renormalizing every block of a for every block of b
+    std::vector<float> inv_norm_a;
+    if (params.normalize) {
+        inv_norm_a.resize(a.n_rows);
+        vecbox_parallel_for(n_threads, a.n_rows, [&](int, int64_t begin, int64_t end) {
+            std::vector<float> row(n_embd);
+            for (int64_t r = begin; r < end; ++r) {
+                vecbox_sim_load(a, r, 1, row.data());
+                double sum = 0.0;
+                for (int32_t d = 0; d < n_embd; ++d) {
+                    sum += (double) row[d]*row[d];
+                }
+                inv_norm_a[r] = sum > 0.0 ? (float) (1.0/std::sqrt(sum)) : 0.0f;
+            }
+        });
+    }
+
+    vecbox_sim_gemm gemm(vecbox_sim_gemm_type(rb), n_embd, blk_b, blk_a, n_threads);
+
+    std::vector<float> rows_b(blk_b*n_embd);
+    std::vector<float> rows_a(a.type == VECBOX_SIM_F32 ? 0 : blk_a*n_embd);
+
+    // b is converted and normalized once per block and stays put while the blocks of a stream past it
+    for (int64_t j0 = 0; j0 < rb.n_rows; j0 += blk_b) {
+        const int64_t n_b = std::min(blk_b, rb.n_rows - j0);
+        vecbox_sim_load(rb, j0, n_b, rows_b.data());
+        if (params.normalize) {
+            for (int64_t r = 0; r < n_b; ++r) {
+                vecbox_embd_normalize(rows_b.data() + r*n_embd, n_embd);
+            }
+        }
+        gemm.set_b(rows_b.data(), n_b);
+
+        // a x a: blocks below the diagonal mirror ones already computed
+        const int64_t i_end = b ? a.n_rows : std::min(a.n_rows, j0 + n_b);
+        for (int64_t i0 = 0; i0 < i_end; i0 += blk_a) {
+            const int64_t n_a = std::min(blk_a, a.n_rows - i0);
+            // float32 rows of a go to the GEMM as they are; other types only need converting
+            if (a.type == VECBOX_SIM_F32) {
+                gemm.set_a((const float *) a.data + i0*n_embd, n_a);
+            } else {
+                vecbox_sim_load(a, i0, n_a, rows_a.data());
+                gemm.set_a(rows_a.data(), n_a);
+            }
+
+            float * scores = gemm.compute();
+            const int64_t stride = gemm.stride();
+            if (params.normalize) {
+                for (int64_t i = 0; i < n_a; ++i) {
+                    const float scale = inv_norm_a[i0 + i];
+                    for (int64_t j = 0; j < n_b; ++j) {
+                        scores[i*stride + j] *= scale;
+                    }
+                }
+            }
+
+            fn(i0, n_a, j0, n_b, (const float *) scores, stride);
+        }
+    }
+}
+
+void vecbox_similarity_matrix(const vecbox_sim_rows & a, const vecbox_sim_rows * b, float * out,
+                              const vecbox_sim_params & params) {
+    const int64_t n_cols = b ? b->n_rows : a.n_rows;
+
+    vecbox_sim_blocks(a, b, params, [&](int64_t i0, int64_t n_a, int64_t j0, int64_t n_b, const float * scores, int64_t stride) {
+        for (int64_t i = 0; i < n_a; ++i) {
+            memcpy(out + (i0 + i)*n_cols + j0, scores + i*stride, n_b*sizeof(float));
+        }
+        if (!b) {
+            // on the diagonal block only the upper triangle is mirrored, so the result is symmetric
+            // and holds the same scores as threshold mode even when b is rounded to f16 or Q8_0
+            for (int64_t i = 0; i < n_a; ++i) {
+                for (int64_t j = i0 == j0 ? i + 1 : 0; j < n_b; ++j) {
+                    out[(j0 + j)*n_cols + i0 + i] = scores[i*stride + j];
+                }
+            }
+        }
+    });
+}
+
+void vecbox_similarity_threshold(const vecbox_sim_rows & a, const vecbox_sim_rows * b, float threshold,
+                                 const vecbox_sim_pairs_cb & cb, const vecbox_sim_params & params) {
+    std::vector<vecbox_sim_pair> pairs;
+
+    vecbox_sim_blocks(a, b, params, [&](int64_t i0, int64_t n_a, int64_t j0, int64_t n_b, const float * scores, int64_t stride) {
+        pairs.clear();
+        for (int64_t i = 0; i < n_a; ++i) {
+            const float * row = scores + i*stride;
+            // a x a: only j > i on the diagonal block
+            const int64_t j_begin = (!b && i0 == j0) ? i + 1 : 0;
+            for (int64_t j = j_begin; j < n_b; ++j) {
+                if (row[j] >= threshold) {
+                    pairs.push_back({ (int32_t) (i0 + i), (int32_t) (j0 + j), row[j] });
+                }
+            }
+        }
+        if (!pairs.empty()) {
+            cb(pairs.data(), pairs.size());
+        }
+    });
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+// all-pairs similarity between two sets of embeddings
+//
+// rows are multiplied block by block with ggml_mul_mat on the CPU, so an N x M problem costs one
+// multithreaded GEMM per pair of blocks and never more than one block of scores in memory. the
+// rows of b are normalized as each block is converted; those of a keep their values (float32 ones
+// are read in place) and each row of scores is divided by the norm of its row of a instead. in threshold mode only the pairs above the cutoff leave the block, which is
+// what dedup and clustering want for large N.
+
+#include <cstdint>
+#include <functional>
+
+enum vecbox_sim_type {
+    VECBOX_SIM_F32 = 0,
+    VECBOX_SIM_F16 = 1, // IEEE half bits
+    VECBOX_SIM_I8  = 2, // quantized rows; multiplied as Q8_0 when n_embd is a multiple of 32
+};
+
+// row-major [n_rows, n_embd], not owned
+struct vecbox_sim_rows {
+    const void *    data   = nullptr;
+    vecbox_sim_type type   = VECBOX_SIM_F32;
+    int64_t         n_rows = 0;
+    int32_t         n_embd = 0;
+};
+
+struct vecbox_sim_params {
+    bool    normalize  = true; // cosine similarity; false gives raw dot products
+    int32_t block_rows = 1024; // rows of each side per GEMM
+    int32_t n_threads  = 0;    // 0 = hardware concurrency
+};
+
+struct vecbox_sim_pair {
+    int32_t i; // row of a
+    int32_t j; // row of b
+    float   score;
+};
+
+// called once per block with the pairs found in it, in no particular order
+using vecbox_sim_pairs_cb = std::function<void(const vecbox_sim_pair * pairs, size_t n)>;
+
+// out[i*b.n_rows + j] = sim(a[i], b[j]); b == nullptr compares a with itself and computes only
+// the upper triangle, mirrored into the lower one
+// throws std::invalid_argument if the inputs do not have the same n_embd
+void vecbox_similarity_matrix(const vecbox_sim_rows & a, const vecbox_sim_rows * b, float * out,
+                              const vecbox_sim_params & params = {});
+
+// every pair with sim(a[i], b[j]) >= threshold; b == nullptr compares a with itself and reports
+// each pair once, with i < j
+void vecbox_similarity_threshold(const vecbox_sim_rows & a, const vecbox_sim_rows * b, float threshold,
+                                 const vecbox_sim_pairs_cb & cb, const vecbox_sim_params & params = {});
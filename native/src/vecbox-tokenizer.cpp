@@ -0,0 +1,603 @@
+#include "vecbox-tokenizer.h"
+#include "vecbox-engine.h"
+
+#include "gguf.h"
+
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+// longer words are unknown as a whole, as in BERT
+#define VECBOX_WORD_MAX_CHARS 100
+
+struct vecbox_tokenizer_header {
+    uint32_t magic;
+    uint32_t version;
+    int32_t  n_vocab;
+    int32_t  n_states;
+    int32_t  cont_root;
+    int32_t  unk;
+    int32_t  cls;
+    int32_t  sep;
+    int32_t  lower_case;
+    int32_t  reserved;
+    uint64_t vocab_hash;
+    uint64_t model_size;
+    int64_t  model_mtime;
+    // base, check, value: int32 [n_states] each
+};
+
+//
+// tokenize
+//
+
+// ASCII controls count as whitespace, so they separate words and are dropped
+static inline bool vecbox_tok_is_space(uint8_t c) {
+    return c <= ' ' || c == 0x7f;
+}
+
+static inline bool vecbox_tok_is_punct(uint8_t c) {
+    return (c >= '!' && c <= '/') || (c >= ':' && c <= '@') || (c >= '[' && c <= '`') || (c >= '{' && c <= '~');
+}
+
+static inline uint8_t vecbox_tok_lower(uint8_t c) {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+// pieces of one word, longest first; false if some part of it is no piece
+static bool vecbox_tok_word(const vecbox_tokenizer & tok, const uint8_t * w, size_t n, std::vector<int32_t> & tokens) {
+    size_t n_chars = 0;
+    for (size_t i = 0; i < n; ++i) {
+        n_chars += (w[i] & 0xc0) != 0x80;
+    }
+    if (n_chars > VECBOX_WORD_MAX_CHARS) {
+        return false;
+    }
+
+    int32_t from = 0;
+    for (size_t pos = 0; pos < n; ) {
+        if (from < 0) {
+            return false;
+        }
+
+        int32_t s        = from;
+        int32_t best     = -1;
+        size_t  best_end = pos;
+        for (size_t i = pos; i < n; ++i) {
+            const int32_t t = tok.base[s] + (tok.lower_case ? vecbox_tok_lower(w[i]) : w[i]) + 1;
+            if (tok.check[t] != s) {
+                break;
+            }
+            s = t;
+            if (tok.value[t] >= 0) {
+                best     = tok.value[t];
+                best_end = i + 1;
+            }
+        }
+        if (best < 0) {
+            return false;
+        }
+
+        tokens.push_back(best);
+        pos  = best_end;
+        from = tok.cont_root;
+    }
+    return true;
+}
+
+void vecbox_tokenizer::tokenize(const std::string & text, std::vector<int32_t> & tokens) const {
+    tokens.clear();
+    if (special.cls >= 0) {
+        tokens.push_back(special.cls);
+    }
+
+    const uint8_t * p = (const uint8_t *) text.data();
+    const size_t    n = text.size();
+    for (size_t i = 0; i < n; ) {
+        if (vecbox_tok_is_space(p[i])) {
+            ++i;
+            continue;
+        }
+
+        // a punctuation character is a word by itself
+        size_t end = i + 1;
+        if (!vecbox_tok_is_punct(p[i])) {
+            while (end < n && !vecbox_tok_is_space(p[end]) && !vecbox_tok_is_punct(p[end])) {
+                ++end;
+            }
+        }
+
+        const size_t start = tokens.size();
+        if (!vecbox_tok_word(*this, p + i, end - i, tokens)) {
+            tokens.resize(start);
+            if (special.unk >= 0) {
+                tokens.push_back(special.unk);
+            }
+        }
+        i = end;
+    }
+
+    if (special.sep >= 0) {
+        tokens.push_back(special.sep);
+    }
+}
+
+int32_t vecbox_tokenizer::find(const std::string & piece) const {
+    int32_t s = 0;
+    for (unsigned char c : piece) {
+        const int32_t t = base[s] + c + 1;
+        if (check[t] != s) {
+            return -1;
+        }
+        s = t;
+    }
+    return piece.empty() ? -1 : value[s];
+}
+
+//
+// compile
+//
+
+static uint64_t vecbox_vocab_hash(const std::vector<std::string> & tokens, const vecbox_tokenizer_special & special,
+                                  bool lower_case) {
+    // FNV-1a over the length and bytes of every token, then the special ids and the casing
+    uint64_t h = 0xcbf29ce484222325ull;
+    auto mix = [&h](const void * data, size_t n) {
+        const uint8_t * p = (const uint8_t *) data;
+        for (size_t i = 0; i < n; ++i) {
+            h = (h ^ p[i])*0x100000001b3ull;
+        }
+    };
+    for (const std::string & token : tokens) {
+        const uint32_t len = (uint32_t) token.size();
+        mix(&len, sizeof(len));
+        mix(token.data(), token.size());
+    }
+    mix(&special, sizeof(special));
+    const uint8_t lower = lower_case;
+    mix(&lower, sizeof(lower));
+    return h;
+}
+
+static void vecbox_tokenizer_bind(vecbox_tokenizer & tok, const int32_t * arrays) {
+    tok.base  = arrays;
+    tok.check = arrays + tok.n_states;
+    tok.value = arrays + 2*(size_t) tok.n_states;
+}
+
+std::shared_ptr<vecbox_tokenizer> vecbox_tokenizer_compile(const std::vector<std::string> & tokens,
+                                                           const vecbox_tokenizer_special & special, bool lower_case) {
+    const int32_t n_vocab = (int32_t) tokens.size();
+    if (n_vocab == 0) {
+        throw std::invalid_argument("cannot compile an empty vocab");
+    }
+    for (int32_t id : { special.unk, special.cls, special.sep }) {
+        if (id >= n_vocab) {
+            throw std::invalid_argument("special token " + std::to_string(id) + " is not in the vocab");
+        }
+    }
+
+    // plain trie first, children sorted by byte
+    struct node {
+        std::vector<std::pair<uint8_t, int32_t>> next;
+        int32_t value = -1;
+    };
+    std::vector<node> nodes(1);
+    for (int32_t id = 0; id < n_vocab; ++id) {
+        int32_t cur = 0;
+        for (unsigned char c : tokens[id]) {
+            auto & next = nodes[cur].next;
+            auto it = std::lower_bound(next.begin(), next.end(), std::make_pair(c, (int32_t) 0),
+                [](const std::pair<uint8_t, int32_t> & a, const std::pair<uint8_t, int32_t> & b) { return a.first < b.first; });
+            if (it == next.end() || it->first != c) {
+                it = next.insert(it, { c, (int32_t) nodes.size() });
+                nodes.emplace_back();
+            }
+            cur = it->second;
+        }
+        if (cur != 0 && nodes[cur].value < 0) {
+            nodes[cur].value = id;
+        }
+    }
+
+    // then each node's children placed at the lowest base where all their slots are free, breadth
+    // first so the states near the root, which every word walks through, end up close together.
+    // free[i] leads to the first free slot >= i, so the search skips occupied runs
+    std::vector<int32_t> base, check, value, free;
+    std::vector<uint8_t> used;
+    auto reserve = [&](size_t n) {
+        if (used.size() < n) {
+            const size_t old = used.size();
+            n = std::max(n, old*2);
+            base.resize(n, 0);
+            check.resize(n, -1);
+            value.resize(n, -1);
+            used.resize(n, 0);
+            free.resize(n);
+            for (size_t i = old; i < n; ++i) {
+                free[i] = (int32_t) i;
+            }
+        }
+    };
+    auto next_free = [&](size_t i) {
+        reserve(i + 1);
+        size_t root = i;
+        while ((size_t) free[root] != root) {
+            root = free[root];
+            reserve(root + 1);
+        }
+        while (i != root) {
+            const size_t up = free[i];
+            free[i] = (int32_t) root;
+            i = up;
+        }
+        return root;
+    };
+    auto take = [&](size_t i) {
+        used[i] = 1;
+        free[i] = (int32_t) i + 1;
+    };
+    reserve(1024);
+    take(0);
+
+    std::vector<std::pair<int32_t, int32_t>> queue = { { 0, 0 } }; // node, state
+    int32_t max_base  = 0;
+    int32_t max_state = 0;
+    for (size_t q = 0; q < queue.size(); ++q) {
+        const int32_t n = queue[q].first;
+        const int32_t s = queue[q].second;
+        const auto & next = nodes[n].next;
+        if (next.empty()) {
+            continue;
+        }
+
+        // the first child's slot is free by construction, the others are checked
+        int32_t b = 0;
+        for (size_t pos = next_free((size_t) next[0].first + 1); ; pos = next_free(pos + 1)) {
+            b = (int32_t) (pos - next[0].first - 1);
+            reserve((size_t) b + 257);
+            bool fits = true;
+            for (const auto & e : next) {
+                if (used[b + e.first + 1]) {
+                    fits = false;
+                    break;
+                }
+            }
+            if (fits) {
+                break;
+            }
+        }
+
+        base[s]  = b;
+        max_base = std::max(max_base, b);
+        for (const auto & e : next) {
+            const int32_t t = b + e.first + 1;
+            take(t);
+            check[t] = s;
+            value[t] = nodes[e.second].value;
+            max_state = std::max(max_state, t);
+            queue.push_back({ e.second, t });
+        }
+    }
+
+    // every base + byte stays inside the arrays, so lookups need no bounds check
+    const int32_t n_states = std::max(max_state + 1, max_base + 257);
+
+    auto tok = std::make_shared<vecbox_tokenizer>();
+    tok->n_vocab    = n_vocab;
+    tok->n_states   = n_states;
+    tok->special    = special;
+    tok->lower_case = lower_case;
+    tok->vocab_hash = vecbox_vocab_hash(tokens, special, lower_case);
+    tok->own.resize(3*(size_t) n_states);
+    std::copy(base.begin(),  base.begin()  + n_states, tok->own.begin());
+    std::copy(check.begin(), check.begin() + n_states, tok->own.begin() + n_states);
+    std::copy(value.begin(), value.begin() + n_states, tok->own.begin() + 2*(size_t) n_states);
+    vecbox_tokenizer_bind(*tok, tok->own.data());
+
+    const std::string cont = "##";
+    int32_t s = 0;
+    for (unsigned char c : cont) {
+        const int32_t t = s < 0 ? -1 : tok->base[s] + c + 1;
+        s = t >= 0 && tok->check[t] == s ? t : -1;
+    }
+    tok->cont_root = s;
+
+    return tok;
+}
+
+//
+// sidecar
+//
+
+std::string vecbox_tokenizer_sidecar(const std::string & model_path) {
+    return model_path + ".vbtok";
+}
+
+std::vector<uint8_t> vecbox_tokenizer_image(const vecbox_tokenizer & tok) {
+    const vecbox_tokenizer_header header = {
+        VECBOX_TOKENIZER_MAGIC, VECBOX_TOKENIZER_VERSION, tok.n_vocab, tok.n_states, tok.cont_root,
+        tok.special.unk, tok.special.cls, tok.special.sep, tok.lower_case, 0, tok.vocab_hash, tok.model_size, tok.model_mtime,
+    };
+    const size_t n = (size_t) tok.n_states*sizeof(int32_t);
+
+    std::vector<uint8_t> image(sizeof(header) + 3*n);
+    memcpy(image.data(), &header, sizeof(header));
+    memcpy(image.data() + sizeof(header),       tok.base,  n);
+    memcpy(image.data() + sizeof(header) + n,   tok.check, n);
+    memcpy(image.data() + sizeof(header) + 2*n, tok.value, n);
+    return image;
+}
+
+void vecbox_tokenizer_save(const vecbox_tokenizer & tok, const std::string & path) {
+    const std::vector<uint8_t> image = vecbox_tokenizer_image(tok);
+
+    // written aside and renamed, so a process loading meanwhile never maps a partial file
+    std::string tmp;
+    FILE * f = vecbox_open_temp(path, tmp);
+    if (!f) {
+        throw std::runtime_error("cannot write " + tmp);
+    }
+    const bool ok = fwrite(image.data(), 1, image.size(), f) == image.size();
+    if (fclose(f) != 0 || !ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        remove(tmp.c_str());
+        throw std::runtime_error("cannot write " + path);
+    }
+}
+
+std::shared_ptr<vecbox_tokenizer> vecbox_tokenizer_view(const void * data, size_t size, std::shared_ptr<void> owner,
+                                                        const std::string & name) {
+    auto fail = [&](const std::string & what) {
+        return std::runtime_error("invalid tokenizer " + name + ": " + what);
+    };
+
+    vecbox_tokenizer_header header;
+    if (size < sizeof(header)) {
+        throw fail("truncated file");
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != VECBOX_TOKENIZER_MAGIC) {
+        throw fail("bad magic");
+    }
+    if (header.version != VECBOX_TOKENIZER_VERSION) {
+        throw fail("unsupported version " + std::to_string(header.version));
+    }
+    if (header.n_vocab <= 0 || header.n_states <= 256 ||
+        size != sizeof(header) + 3*sizeof(int32_t)*(size_t) header.n_states) {
+        throw fail("truncated file");
+    }
+
+    auto tok = std::make_shared<vecbox_tokenizer>();
+    tok->n_vocab     = header.n_vocab;
+    tok->n_states    = header.n_states;
+    tok->cont_root   = header.cont_root;
+    tok->special     = { header.unk, header.cls, header.sep };
+    tok->lower_case  = header.lower_case != 0;
+    tok->vocab_hash  = header.vocab_hash;
+    tok->model_size  = header.model_size;
+    tok->model_mtime = header.model_mtime;
+    tok->mapping     = std::move(owner);
+    vecbox_tokenizer_bind(*tok, (const int32_t *) ((const uint8_t *) data + sizeof(header)));
+
+    // lookups index without bounds checks, so every state is checked once here
+    for (int32_t id : { tok->special.unk, tok->special.cls, tok->special.sep }) {
+        if (id < -1 || id >= tok->n_vocab) {
+            throw fail("bad special token");
+        }
+    }
+    if (tok->cont_root < -1 || tok->cont_root >= tok->n_states) {
+        throw fail("bad continuation state");
+    }
+    for (int32_t s = 0; s < tok->n_states; ++s) {
+        if (tok->base[s] < 0 || tok->base[s] > tok->n_states - 257 ||
+            tok->check[s] < -1 || tok->check[s] >= tok->n_states || tok->value[s] < -1 || tok->value[s] >= tok->n_vocab) {
+            throw fail("bad state " + std::to_string(s));
+        }
+    }
+
+    return tok;
+}
+
+std::shared_ptr<vecbox_tokenizer> vecbox_tokenizer_map(const std::string & path) {
+#ifdef _WIN32
+    FILE * f = fopen(path.c_str(), "rb");
+    if (!f) {
+        throw std::runtime_error("cannot open tokenizer " + path);
+    }
+    std::vector<uint8_t> bytes;
+    uint8_t chunk[65536];
+    for (size_t got; (got = fread(chunk, 1, sizeof(chunk), f)) > 0; ) {
+        bytes.insert(bytes.end(), chunk, chunk + got);
+    }
+    fclose(f);
+    // int32-aligned copy for the arrays
+    auto own = std::make_shared<std::vector<int32_t>>((bytes.size() + sizeof(int32_t) - 1)/sizeof(int32_t));
+    memcpy(own->data(), bytes.data(), bytes.size());
+    return vecbox_tokenizer_view(own->data(), bytes.size(), own, path);
+#else
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open tokenizer " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        throw std::runtime_error("invalid tokenizer " + path + ": truncated file");
+    }
+    const size_t size = (size_t) st.st_size;
+
+    void * addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        throw std::runtime_error("cannot map tokenizer " + path);
+    }
+    std::shared_ptr<void> mapping(addr, [size](void * p) { munmap(p, size); });
+    return vecbox_tokenizer_view(addr, size, mapping, path);
+#endif
+}
+
+//
+// load
+//
+
+static int32_t vecbox_gguf_token_id(const gguf_context * ctx, const char * key, const std::vector<std::string> & tokens,
+                                    const char * text) {
+    const int64_t i = gguf_find_key(ctx, key);
+    if (i >= 0 && gguf_get_kv_type(ctx, i) == GGUF_TYPE_UINT32) {
+        return (int32_t) gguf_get_val_u32(ctx, i);
+    }
+    if (i >= 0 && gguf_get_kv_type(ctx, i) == GGUF_TYPE_INT32) {
+        return gguf_get_val_i32(ctx, i);
+    }
+    // older conversions only have the token itself
+    auto it = std::find(tokens.begin(), tokens.end(), text);
+    return it == tokens.end() ? -1 : (int32_t) (it - tokens.begin());
+}
+
+// false if the file is no GGUF or its tokenizer is not WordPiece
+static bool vecbox_gguf_read_vocab(const std::string & path, std::vector<std::string> & tokens,
+                                   vecbox_tokenizer_special & special, bool & lower_case) {
+    // gguf_init_from_file logs an error for anything that is not a GGUF, such as the placeholder
+    // paths models are created with in tests, so those are told apart by their magic first
+    {
+        FILE * f = fopen(path.c_str(), "rb");
+        char magic[4] = {};
+        const bool is_gguf = f && fread(magic, 1, sizeof(magic), f) == sizeof(magic) && memcmp(magic, GGUF_MAGIC, 4) == 0;
+        if (f) {
+            fclose(f);
+        }
+        if (!is_gguf) {
+            return false;
+        }
+    }
+
+    gguf_init_params params = {
+        /*.no_alloc =*/ true,
+        /*.ctx      =*/ nullptr,
+    };
+    gguf_context * ctx = gguf_init_from_file(path.c_str(), params);
+    if (!ctx) {
+        return false;
+    }
+
+    const int64_t i_model  = gguf_find_key(ctx, "tokenizer.ggml.model");
+    const int64_t i_tokens = gguf_find_key(ctx, "tokenizer.ggml.tokens");
+    if (i_model < 0 || gguf_get_kv_type(ctx, i_model) != GGUF_TYPE_STRING ||
+        strcmp(gguf_get_val_str(ctx, i_model), "bert") != 0 || i_tokens < 0) {
+        gguf_free(ctx);
+        return false;
+    }
+    if (gguf_get_kv_type(ctx, i_tokens) != GGUF_TYPE_ARRAY || gguf_get_arr_type(ctx, i_tokens) != GGUF_TYPE_STRING) {
+        gguf_free(ctx);
+        throw std::runtime_error("invalid vocab in " + path + ": tokenizer.ggml.tokens is not a string array");
+    }
+
+    const size_t n = gguf_get_arr_n(ctx, i_tokens);
+    tokens.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        tokens[i] = gguf_get_arr_str(ctx, i_tokens, i);
+    }
+
+    special.unk = vecbox_gguf_token_id(ctx, "tokenizer.ggml.unknown_token_id",   tokens, "[UNK]");
+    special.cls = vecbox_gguf_token_id(ctx, "tokenizer.ggml.cls_token_id",       tokens, "[CLS]");
+    special.sep = vecbox_gguf_token_id(ctx, "tokenizer.ggml.seperator_token_id", tokens, "[SEP]");
+
+    // BERT's do_lower_case; conversions that do not record it are taken as cased when a piece other
+    // than a bracketed special token ("[CLS]", "<s>") has an uppercase ASCII letter
+    const int64_t i_lower = gguf_find_key(ctx, "tokenizer.ggml.do_lower_case");
+    if (i_lower >= 0 && gguf_get_kv_type(ctx, i_lower) == GGUF_TYPE_BOOL) {
+        lower_case = gguf_get_val_bool(ctx, i_lower);
+    } else {
+        lower_case = true;
+        for (const std::string & token : tokens) {
+            const bool bracketed = token.size() > 2 && ((token.front() == '[' && token.back() == ']') ||
+                                                        (token.front() == '<' && token.back() == '>'));
+            if (!bracketed && std::any_of(token.begin(), token.end(), [](char c) { return c >= 'A' && c <= 'Z'; })) {
+                lower_case = false;
+                break;
+            }
+        }
+    }
+    gguf_free(ctx);
+
+    for (int32_t id : { special.unk, special.cls, special.sep }) {
+        if (id < -1 || id >= (int32_t) n) {
+            throw std::runtime_error("invalid vocab in " + path + ": special token " + std::to_string(id) + " out of range");
+        }
+    }
+    return n > 0;
+}
+
+std::shared_ptr<vecbox_tokenizer> vecbox_tokenizer_load(const std::string & model_path, vecbox_tokenizer_report * report) {
+    vecbox_tokenizer_report rep;
+    const std::string sidecar = vecbox_tokenizer_sidecar(model_path);
+
+    uint64_t model_size;
+    int64_t  model_mtime;
+    vecbox_file_identity(model_path, model_size, model_mtime);
+
+    // an unreadable or malformed sidecar is compiled over
+    int64_t t0 = vecbox_time_us();
+    std::shared_ptr<vecbox_tokenizer> mapped;
+    try {
+        mapped = vecbox_tokenizer_map(sidecar);
+    } catch (const std::runtime_error &) {
+    }
+    rep.t_map_us = vecbox_time_us() - t0;
+
+    if (mapped && model_size != 0 && mapped->model_size == model_size && mapped->model_mtime == model_mtime) {
+        rep.mapped = true;
+        if (report) {
+            *report = rep;
+        }
+        return mapped;
+    }
+
+    t0 = vecbox_time_us();
+    std::vector<std::string> tokens;
+    vecbox_tokenizer_special special;
+    bool lower_case = true;
+    const bool has_vocab = vecbox_gguf_read_vocab(model_path, tokens, special, lower_case);
+    rep.vocab_read = true;
+    rep.t_vocab_us = vecbox_time_us() - t0;
+    if (!has_vocab) {
+        if (report) {
+            *report = rep;
+        }
+        return nullptr;
+    }
+
+    std::shared_ptr<vecbox_tokenizer> tok;
+    if (mapped && mapped->n_vocab == (int32_t) tokens.size() && mapped->vocab_hash == vecbox_vocab_hash(tokens, special, lower_case)) {
+        tok = mapped;
+        rep.mapped = true;
+    } else {
+        t0 = vecbox_time_us();
+        tok = vecbox_tokenizer_compile(tokens, special, lower_case);
+        rep.t_compile_us = vecbox_time_us() - t0;
+    }
+
+    // recorded for the next load, which can then skip reading the vocab
+    tok->model_size  = model_size;
+    tok->model_mtime = model_mtime;
+    t0 = vecbox_time_us();
+    try {
+        vecbox_tokenizer_save(*tok, sidecar);
+    } catch (const std::runtime_error &) {
+    }
+    rep.t_save_us = vecbox_time_us() - t0;
+
+    if (report) {
+        *report = rep;
+    }
+    return tok;
+}
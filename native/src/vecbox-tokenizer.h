@@ -0,0 +1,97 @@
+#pragma once
+
+// compiled WordPiece tokenizer
+//
+// the vocab of a BERT-style GGUF (tokenizer.ggml.tokens) is compiled into a double-array trie over
+// bytes: the transition from state s on byte c goes to t = base[s] + c + 1 when check[t] == s, and
+// value[t] is the token spelled by the path to t, or -1. a word is split greedily, longest piece
+// first, with one walk down the trie per piece instead of a hash lookup per candidate substring.
+// continuation pieces ("##ing") are the subtree below "##", so later pieces start from that state.
+//
+// compiling visits every byte of the vocab, so the three arrays are saved next to the model
+// (<model path>.vbtok) with a hash of the vocab and the size and mtime of the model file. a later
+// load maps the file as is: without reading the vocab when the model file is unchanged, otherwise
+// after checking the vocab hash, e.g. for a requantized model. a stale file is compiled over.
+//
+// text is split on whitespace and ASCII punctuation, and ASCII is lowercased for uncased vocabs
+// (do_lower_case); other UTF-8 bytes are matched as they are, without normalization or accent
+// stripping.
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define VECBOX_TOKENIZER_MAGIC   0x6b746276u // "vbtk"
+#define VECBOX_TOKENIZER_VERSION 2
+
+struct vecbox_tokenizer_special {
+    int32_t unk = -1; // for words no pieces spell, -1 drops them
+    int32_t cls = -1; // put around every text when >= 0
+    int32_t sep = -1;
+};
+
+struct vecbox_tokenizer {
+    int32_t  n_vocab   = 0;
+    int32_t  n_states  = 0;  // entries of base, check and value
+    int32_t  cont_root = -1; // state after "##", -1 if the vocab has no continuation pieces
+    uint64_t vocab_hash = 0;
+
+    vecbox_tokenizer_special special;
+    bool lower_case = true; // ASCII letters of the text are lowercased before matching
+
+    // size and mtime (nanoseconds) of the model file the tokenizer was compiled for, 0 if unknown
+    uint64_t model_size  = 0;
+    int64_t  model_mtime = 0;
+
+    // into own after compiling, into the memory mapping keeps alive after vecbox_tokenizer_view
+    const int32_t * base  = nullptr;
+    const int32_t * check = nullptr;
+    const int32_t * value = nullptr;
+
+    std::vector<int32_t>  own;
+    std::shared_ptr<void> mapping;
+
+    // token ids of text, replacing the contents of tokens
+    void tokenize(const std::string & text, std::vector<int32_t> & tokens) const;
+
+    // id of a vocab entry, -1 if there is none
+    int32_t find(const std::string & piece) const;
+};
+
+// tokens[i] is the text of token i; duplicates keep the lowest id. throws std::invalid_argument on
+// an empty vocab
+std::shared_ptr<vecbox_tokenizer> vecbox_tokenizer_compile(const std::vector<std::string> & tokens,
+                                                           const vecbox_tokenizer_special & special,
+                                                           bool lower_case = true);
+
+// sidecar file next to a model: <model path>.vbtok
+std::string vecbox_tokenizer_sidecar(const std::string & model_path);
+
+// the sidecar contents: a header, then base, check and value
+std::vector<uint8_t> vecbox_tokenizer_image(const vecbox_tokenizer & tok);
+
+// a tokenizer over an image in memory that owner keeps alive, such as a mapped sidecar; nothing is
+// copied. name is for errors. throws std::runtime_error if the image is malformed
+std::shared_ptr<vecbox_tokenizer> vecbox_tokenizer_view(const void * data, size_t size, std::shared_ptr<void> owner,
+                                                        const std::string & name);
+
+// throw std::runtime_error on I/O errors or a malformed file
+void vecbox_tokenizer_save(const vecbox_tokenizer & tok, const std::string & path);
+std::shared_ptr<vecbox_tokenizer> vecbox_tokenizer_map(const std::string & path);
+
+// how vecbox_tokenizer_load got its tokenizer
+struct vecbox_tokenizer_report {
+    bool    mapped     = false; // from the sidecar, otherwise compiled
+    bool    vocab_read = false; // the GGUF vocab was read, to compile or to check the sidecar's hash
+    int64_t t_vocab_us   = 0;
+    int64_t t_compile_us = 0;
+    int64_t t_map_us     = 0;
+    int64_t t_save_us    = 0;
+};
+
+// the tokenizer of the model at model_path: its sidecar when that still matches, else compiled
+// from the GGUF vocab and saved as the sidecar (best effort, e.g. on a read-only directory).
+// nullptr if the file has no WordPiece vocab; throws std::runtime_error if the vocab is malformed
+std::shared_ptr<vecbox_tokenizer> vecbox_tokenizer_load(const std::string & model_path,
+                                                        vecbox_tokenizer_report * report = nullptr);
@@ -0,0 +1,93 @@
+#!/usr/bin/env node
+
+/**
+ * Embedding Wire Format Benchmark
+ *
+ * Compares decoding a batch of embeddings from JSON number arrays (JSON.parse)
+ * against base64 little-endian float32 (Buffer and, when built, the native SIMD decoder),
+ * and serializing them with JSON.stringify against the native shortest round-trip writer.
+ *
+ * Usage: node scripts/bench-encoding.cjs [rows] [dims]
+ */
+
+const path = require('path');
+
+const rows = parseInt(process.argv[2] || '256', 10);
+const dims = parseInt(process.argv[3] || '768', 10);
+const iterations = 20;
+
+let native = null;
+try {
+  native = require(path.join(__dirname, '../native/build/Release/llama_embedding.node'));
+} catch (error) {
+  console.log('⚠️  Native module not built - skipping native decoder');
+}
+
+// Build one response body in each format
+const vectors = [];
+for (let r = 0; r < rows; r++) {
+  const v = new Float32Array(dims);
+  for (let i = 0; i < dims; i++) {
+    v[i] = Math.sin(r * dims + i) * 0.1;
+  }
+  vectors.push(v);
+}
+
+const jsonBody = JSON.stringify({ embeddings: vectors.map(v => Array.from(v)) });
+const base64Body = JSON.stringify({
+  embeddings: vectors.map(v => Buffer.from(v.buffer, v.byteOffset, v.byteLength).toString('base64')),
+});
+
+function decodeBuffer(data) {
+  const bytes = Buffer.from(data, 'base64');
+  if (bytes.byteOffset % 4 === 0) {
+    return new Float32Array(bytes.buffer, bytes.byteOffset, bytes.length / 4);
+  }
+  return new Float32Array(bytes.buffer.slice(bytes.byteOffset, bytes.byteOffset + bytes.length));
+}
+
+function bench(name, bytes, fn) {
+  fn(); // warmup
+  const start = process.hrtime.bigint();
+  for (let i = 0; i < iterations; i++) {
+    fn();
+  }
+  const seconds = Number(process.hrtime.bigint() - start) / 1e9;
+  const mbPerSec = (bytes * iterations) / seconds / 1e6;
+  const rowsPerSec = (rows * iterations) / seconds;
+  console.log(`${name.padEnd(28)} ${(bytes / 1e6).toFixed(2).padStart(8)} MB  ${mbPerSec.toFixed(0).padStart(7)} MB/s  ${rowsPerSec.toFixed(0).padStart(9)} rows/s`);
+}
+
+console.log(`📊 ${rows} embeddings x ${dims} dims`);
+
+bench('JSON.parse (number[])', jsonBody.length, () => {
+  JSON.parse(jsonBody).embeddings;
+});
+
+bench('base64 + Buffer', base64Body.length, () => {
+  JSON.parse(base64Body).embeddings.map(decodeBuffer);
+});
+
+if (native && native.decodeBase64F32) {
+  bench('base64 + native SIMD', base64Body.length, () => {
+    native.decodeBase64F32(JSON.parse(base64Body).embeddings);
+  });
+}
+
+console.log('');
+
+const numberRows = vectors.map(v => Array.from(v));
+bench('JSON.stringify (number[])', jsonBody.length, () => {
+  JSON.stringify(numberRows);
+});
+
+if (native && native.writeEmbeddingsJson) {
+  const target = Buffer.allocUnsafe(native.embeddingsJsonMaxSize(rows, dims));
+  const written = native.writeEmbeddingsJson(vectors, target);
+  bench('native writer (shortest)', written, () => {
+    native.writeEmbeddingsJson(vectors, target);
+  });
+  bench('native writer (6 decimals)', written, () => {
+    native.writeEmbeddingsJson(vectors, target, 6);
+  });
+}
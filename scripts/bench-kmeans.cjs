@@ -0,0 +1,107 @@
+#!/usr/bin/env node
+
+/**
+ * Native k-means Benchmark
+ *
+ * Writes rows x dims float32 vectors drawn around random centers to a temporary file,
+ * then clusters the memory-mapped file with full-batch (Lloyd) and mini-batch k-means.
+ * Reports assignment throughput in rows/s and GFLOP/s (2 * rows * k * dims per pass), and checks
+ * the labels of sampled rows against a brute-force nearest-centroid reference.
+ *
+ * Usage: node scripts/bench-kmeans.cjs [rows] [dims] [k]
+ */
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+const rows = parseInt(process.argv[2] || '1000000', 10);
+const dims = parseInt(process.argv[3] || '768', 10);
+const k = parseInt(process.argv[4] || '256', 10);
+const iterations = 5;
+
+let native = null;
+try {
+  native = require(path.join(__dirname, '../native/build/Release/llama_embedding.node'));
+} catch (error) {
+  console.log('⚠️  Native module not built - nothing to benchmark');
+  process.exit(0);
+}
+
+// Rows around 64 random centers, written in chunks so the whole set never sits in the heap
+const file = path.join(os.tmpdir(), `vecbox-kmeans-${rows}x${dims}.f32`);
+if (!fs.existsSync(file)) {
+  const centers = new Float32Array(64 * dims);
+  for (let i = 0; i < centers.length; i++) {
+    centers[i] = Math.random() * 2 - 1;
+  }
+  const fd = fs.openSync(file, 'w');
+  const chunkRows = 16384;
+  const chunk = new Float32Array(chunkRows * dims);
+  for (let r0 = 0; r0 < rows; r0 += chunkRows) {
+    const n = Math.min(chunkRows, rows - r0);
+    for (let r = 0; r < n; r++) {
+      const center = ((r0 + r) % 64) * dims;
+      for (let i = 0; i < dims; i++) {
+        chunk[r * dims + i] = centers[center + i] + (Math.random() - 0.5) * 0.5;
+      }
+    }
+    fs.writeSync(fd, chunk, 0, n * dims * 4);
+  }
+  fs.closeSync(fd);
+}
+
+// Nearest centroid of each sampled row, computed directly; exits non-zero if a label differs from it
+function checkLabels(name, result, spherical) {
+  const fd = fs.openSync(file, 'r');
+  const row = new Float32Array(dims);
+  const samples = 1000;
+  let mismatches = 0;
+  for (let s = 0; s < samples; s++) {
+    const r = Math.floor(Math.random() * rows);
+    fs.readSync(fd, new Uint8Array(row.buffer), 0, dims * 4, r * dims * 4);
+
+    const dist = new Float64Array(k);
+    for (let j = 0; j < k; j++) {
+      let d = 0;
+      for (let i = 0; i < dims; i++) {
+        const c = result.centroids[j * dims + i];
+        // spherical centroids are unit length, so the smallest -x·c is the largest cosine
+        d += spherical ? -row[i] * c : (row[i] - c) * (row[i] - c);
+      }
+      dist[j] = d;
+    }
+    const best = Math.min(...dist);
+    if (dist[result.labels[r]] - best > 1e-3 * (1 + Math.abs(best))) {
+      mismatches++;
+    }
+  }
+  fs.closeSync(fd);
+
+  if (mismatches > 0) {
+    console.log(`❌ ${name}: ${mismatches} of ${samples} sampled labels are not the nearest centroid`);
+    process.exitCode = 1;
+  }
+}
+
+async function bench(name, options) {
+  const start = process.hrtime.bigint();
+  const result = await native.kmeans(file, { k, dimensions: dims, ...options });
+  const seconds = Number(process.hrtime.bigint() - start) / 1e9;
+
+  // Lloyd assigns every row once per iteration plus once at the end; mini-batch assigns its
+  // batches and then every row once
+  const assigned = options.batchSize
+    ? options.batchSize * result.iterations + rows
+    : rows * (result.iterations + 1);
+  const gflops = (2 * assigned * k * dims) / seconds / 1e9;
+  checkLabels(name, result, !!options.spherical);
+  console.log(`${name.padEnd(24)} ${seconds.toFixed(2).padStart(7)} s  ${String(result.iterations).padStart(3)} iters  ${(assigned / seconds).toFixed(0).padStart(9)} rows/s  ${gflops.toFixed(1).padStart(6)} GFLOP/s  inertia ${result.inertia.toExponential(3)}`);
+}
+
+(async () => {
+  console.log(`📊 ${rows} rows x ${dims} dims, k = ${k}, ${os.cpus().length} CPUs`);
+  await bench('Lloyd', { maxIter: iterations, tol: 0 });
+  await bench('Lloyd (spherical)', { maxIter: iterations, tol: 0, spherical: true });
+  await bench('mini-batch (4096)', { batchSize: 4096, maxIter: 100 });
+})();
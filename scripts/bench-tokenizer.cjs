@@ -0,0 +1,145 @@
+#!/usr/bin/env node
+
+/**
+ * Native Tokenizer Benchmark
+ *
+ * Loads a model three times: with no tokenizer sidecar (the vocab is read and compiled into a
+ * double-array trie, then saved as <model>.vbtok), with the sidecar (mapped, the vocab is not
+ * read), and after touching the model file (the vocab is read again to check the sidecar's
+ * hash). Then reports tokenize throughput over the repository's own sources.
+ *
+ * Without a model path, writes a tensor-less GGUF with a WordPiece vocab of the most frequent
+ * words and suffixes in those sources, which the placeholder engine loads like a model.
+ *
+ * Usage: node scripts/bench-tokenizer.cjs [model.gguf]
+ */
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+let native = null;
+try {
+  native = require(path.join(__dirname, '../native/build/Release/llama_embedding.node'));
+} catch (error) {
+  console.log('⚠️  Native module not built - nothing to benchmark');
+  process.exit(0);
+}
+
+// Corpus: every source file under src/, cut into 2 KB texts
+const texts = [];
+(function collect(dir) {
+  for (const entry of fs.readdirSync(dir, { withFileTypes: true })) {
+    const file = path.join(dir, entry.name);
+    if (entry.isDirectory() && entry.name !== 'node_modules' && entry.name !== 'build') {
+      collect(file);
+    } else if (/\.(ts|js|cjs|cpp|h|md)$/.test(entry.name)) {
+      const text = fs.readFileSync(file, 'utf8');
+      for (let i = 0; i < text.length; i += 2048) {
+        texts.push(text.slice(i, i + 2048));
+      }
+    }
+  }
+})(path.join(__dirname, '..', 'src'));
+// Enough text for a stable measurement
+const sources = texts.slice();
+while (texts.length < 8192 && sources.length > 0) {
+  texts.push(...sources);
+}
+const corpusBytes = texts.reduce((n, t) => n + Buffer.byteLength(t), 0);
+
+// Minimal GGUF v3 writer: metadata only, no tensors
+function writeVocabGguf(file, tokens) {
+  const parts = [];
+  const u32 = (v) => { const b = Buffer.alloc(4); b.writeUInt32LE(v); parts.push(b); };
+  const u64 = (v) => { const b = Buffer.alloc(8); b.writeBigUInt64LE(BigInt(v)); parts.push(b); };
+  const str = (s) => { const b = Buffer.from(s, 'utf8'); u64(b.length); parts.push(b); };
+  const GGUF_TYPE_UINT32 = 4, GGUF_TYPE_BOOL = 7, GGUF_TYPE_STRING = 8, GGUF_TYPE_ARRAY = 9;
+
+  parts.push(Buffer.from('GGUF'));
+  u32(3);
+  u64(0);
+  u64(6);
+  str('tokenizer.ggml.model'); u32(GGUF_TYPE_STRING); str('bert');
+  str('tokenizer.ggml.tokens'); u32(GGUF_TYPE_ARRAY); u32(GGUF_TYPE_STRING); u64(tokens.length);
+  tokens.forEach(str);
+  str('tokenizer.ggml.unknown_token_id'); u32(GGUF_TYPE_UINT32); u32(tokens.indexOf('[UNK]'));
+  str('tokenizer.ggml.cls_token_id'); u32(GGUF_TYPE_UINT32); u32(tokens.indexOf('[CLS]'));
+  str('tokenizer.ggml.seperator_token_id'); u32(GGUF_TYPE_UINT32); u32(tokens.indexOf('[SEP]'));
+  // the single-character pieces include uppercase letters, which would otherwise mark the vocab as cased
+  str('tokenizer.ggml.do_lower_case'); u32(GGUF_TYPE_BOOL); parts.push(Buffer.from([1]));
+  fs.writeFileSync(file, Buffer.concat(parts));
+}
+
+function syntheticVocab() {
+  const words = new Map();
+  const suffixes = new Map();
+  for (const text of texts) {
+    for (const word of text.toLowerCase().match(/[a-z]+/g) || []) {
+      words.set(word, (words.get(word) || 0) + 1);
+      for (let k = 2; k <= 5 && k + 2 < word.length; k++) {
+        const piece = '##' + word.slice(-k);
+        suffixes.set(piece, (suffixes.get(piece) || 0) + 1);
+      }
+    }
+  }
+  const byCount = (map) => [...map.entries()].sort((a, b) => b[1] - a[1]).map(([w]) => w);
+
+  const vocab = ['[PAD]', '[UNK]', '[CLS]', '[SEP]', '[MASK]'];
+  for (let c = 33; c < 127; c++) {
+    vocab.push(String.fromCharCode(c));
+    vocab.push('##' + String.fromCharCode(c).toLowerCase());
+  }
+  const seen = new Set(vocab);
+  for (const piece of [...byCount(suffixes).slice(0, 4000), ...byCount(words)]) {
+    if (vocab.length >= 30522) {
+      break;
+    }
+    if (!seen.has(piece)) {
+      seen.add(piece);
+      vocab.push(piece);
+    }
+  }
+  return vocab;
+}
+
+let modelPath = process.argv[2];
+if (!modelPath) {
+  modelPath = path.join(os.tmpdir(), 'vecbox-bench-vocab.gguf');
+  const vocab = syntheticVocab();
+  writeVocabGguf(modelPath, vocab);
+  console.log(`📝 synthetic WordPiece vocab of ${vocab.length} tokens in ${modelPath}`);
+}
+const sidecar = `${modelPath}.vbtok`;
+
+function load(name) {
+  const start = process.hrtime.bigint();
+  const model = native.createModel(modelPath);
+  const ms = Number(process.hrtime.bigint() - start) / 1e6;
+  console.log(`${name.padEnd(32)} ${ms.toFixed(2).padStart(9)} ms`);
+  return model;
+}
+
+fs.rmSync(sidecar, { force: true });
+native.destroyModel(load('load, compile and save'));
+native.destroyModel(load('load, sidecar mapped'));
+const now = new Date();
+fs.utimesSync(modelPath, now, new Date(now.getTime() + 1000));
+const model = load('load, sidecar checked by hash');
+
+if (!fs.existsSync(sidecar)) {
+  console.log('⚠️  No WordPiece vocab in the model - timing the byte tokenizer');
+}
+
+let tokens = 0;
+for (const text of texts.slice(0, 256)) {
+  native.tokenize(model, text);
+}
+const start = process.hrtime.bigint();
+for (const text of texts) {
+  tokens += native.tokenize(model, text).length;
+}
+const seconds = Number(process.hrtime.bigint() - start) / 1e9;
+console.log(`tokenize ${(corpusBytes / 1e6).toFixed(1)} MB in ${texts.length} texts: ${(corpusBytes / seconds / 1e6).toFixed(1)} MB/s, ${(tokens / seconds / 1e6).toFixed(2)} M tokens/s`);
+
+native.destroyModel(model);
@@ -13,6 +13,19 @@ if (!fs.existsSync(nativeDir)) {
   process.exit(1);
 }
 
+// The addon links the ggml/llama.cpp core as a static library
+const coreDir = path.join(__dirname, '../core');
+const coreBuildDir = path.join(coreDir, 'build');
+
+try {
+  console.log('🏗️  Building core library...');
+  execSync(`cmake -S "${coreDir}" -B "${coreBuildDir}" -DCMAKE_BUILD_TYPE=Release -DLLAMACPP_CORE_BUILD_TESTS=OFF`, { stdio: 'inherit' });
+  execSync(`cmake --build "${coreBuildDir}" --config Release`, { stdio: 'inherit' });
+} catch (error) {
+  console.error('❌ Core library build failed:', error.message);
+  process.exit(1);
+}
+
 // Change to native directory
 process.chdir(nativeDir);
 
@@ -1,4 +1,9 @@
 import type { EmbedConfig, EmbedInput, EmbedResult, BatchEmbedResult } from '@src/types/index';
+import { runBatched, withRetry } from '@src/util/batching';
+import type { BatchLimits, BatchedResult, ChunkResult } from '@src/util/batching';
+import { countTokens } from '@src/util/tokens';
+
+const DEFAULT_MAX_RETRIES = 3;
 
 export abstract class EmbeddingProvider {
   protected config: EmbedConfig;
@@ -17,6 +22,52 @@ export abstract class EmbeddingProvider {
     return this.config.model || 'default';
   }
 
+  /**
+   * Per-request limits of the provider's API; config overrides apply on top
+   */
+  protected getBatchLimits(): BatchLimits {
+    return { maxItems: 96, maxTokens: 100000, concurrency: 4 };
+  }
+
+  /**
+   * Tokens the provider's model sees for text, for the maxTokens budget; an estimate unless
+   * the provider has its model's tokenizer at hand
+   */
+  protected countTokens(text: string): number {
+    return countTokens(text);
+  }
+
+  /**
+   * Run one API call, retrying rate limits and server errors
+   */
+  protected async withRetry<T>(fn: () => Promise<T>): Promise<T> {
+    return withRetry(fn, { maxRetries: this.config.maxRetries ?? DEFAULT_MAX_RETRIES, signal: this.config.signal });
+  }
+
+  /**
+   * Split texts into API-sized requests, run them with bounded concurrency and
+   * retries, and return the embeddings in input order
+   */
+  protected async embedInBatches(
+    texts: string[],
+    embedChunk: (chunk: string[]) => Promise<ChunkResult>
+  ): Promise<BatchedResult> {
+    const defaults = this.getBatchLimits();
+    const limits: BatchLimits = {
+      maxItems: this.config.maxBatchSize ?? defaults.maxItems,
+      maxTokens: this.config.maxBatchTokens ?? defaults.maxTokens,
+      concurrency: this.config.maxConcurrency ?? defaults.concurrency,
+    };
+
+    return runBatched(
+      texts,
+      limits,
+      { maxRetries: this.config.maxRetries ?? DEFAULT_MAX_RETRIES, signal: this.config.signal },
+      embedChunk,
+      text => this.countTokens(text)
+    );
+  }
+
   protected async readInput(input: EmbedInput): Promise<string> {
     if (input.text) {
       return input.text;
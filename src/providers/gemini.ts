@@ -1,6 +1,7 @@
 import { GoogleGenerativeAI } from '@google/generative-ai';
 import { EmbeddingProvider } from '@providers/base/EmbeddingProvider';
 import type { EmbedConfig, EmbedInput, EmbedResult, BatchEmbedResult } from '@src/types/index';
+import type { BatchLimits } from '@src/util/batching';
 import { Logger } from '@src/util/logger';
 
 const logger = Logger.createModuleLogger('gemini');
@@ -30,7 +31,7 @@ export class GeminiProvider extends EmbeddingProvider {
       });
 
       // Use the embedding task
-      const result = await model.embedContent(text);
+      const result = await this.withRetry(() => model.embedContent(text, this.requestOptions()));
       const embedding = result.embedding;
 
       return {
@@ -54,11 +55,15 @@ export class GeminiProvider extends EmbeddingProvider {
         model: this.getModel() 
       });
 
-      const results = await Promise.all(
-        texts.map(text => model.embedContent(text))
-      );
+      // One batchEmbedContents call per chunk instead of one request per text
+      const result = await this.embedInBatches(texts, async (chunk) => {
+        const response = await model.batchEmbedContents({
+          requests: chunk.map(text => ({ content: { role: 'user', parts: [{ text }] } })),
+        }, this.requestOptions());
+        return { embeddings: response.embeddings.map(embedding => embedding.values) };
+      });
 
-      const embeddings = results.map((result: { embedding: { values: number[] } }) => result.embedding.values);
+      const embeddings = result.embeddings;
 
       return {
         embeddings,
@@ -72,6 +77,15 @@ export class GeminiProvider extends EmbeddingProvider {
     }
   }
 
+  private requestOptions(): { signal?: AbortSignal } {
+    return this.config.signal ? { signal: this.config.signal } : {};
+  }
+
+  protected getBatchLimits(): BatchLimits {
+    // batchEmbedContents takes at most 100 requests
+    return { maxItems: 100, maxTokens: 200000, concurrency: 4 };
+  }
+
   getDimensions(): number {
     const model = this.getModel();
     if (model.includes('gemini-embedding-001')) return 3072;
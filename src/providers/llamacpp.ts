@@ -2,12 +2,14 @@ import { access, constants } from 'fs/promises';
 import { join, resolve } from 'path';
 import { EmbeddingProvider } from '@providers/base/EmbeddingProvider';
 import type { EmbedConfig, EmbedInput, EmbedResult, BatchEmbedResult } from '@src/types/index';
+import type { BatchLimits } from '@src/util/batching';
 import { logger } from '@src/util/logger';
 import * as fs from 'fs';
 import { PATHS } from './paths';
 
 // HTTP client for fallback
 import { HttpClient } from '../util/http-client';
+import { decodeEmbedding, registerNativeBase64Decoder } from '../util/base64';
 
 /**
  * Llama.cpp Provider - Local embeddings using llama.cpp directly
@@ -73,6 +75,7 @@ export class LlamaCppProvider extends EmbeddingProvider {
           if (module.default || module) {
             nativeModule = module.default || module;
             this.useNative = !!nativeModule;
+            registerNativeBase64Decoder(nativeModule.decodeBase64F32);
             logger.info(`Using native Llama.cpp module from: ${path}`);
             
             // Initialize native model
@@ -236,16 +239,18 @@ export class LlamaCppProvider extends EmbeddingProvider {
       model: this.getModel(),
       input: text,
       normalize: true,
+      encoding_format: 'base64',
     };
 
-    const response = await this.httpClient.post(`${this.httpEndpoint}/embeddings`, payload);
+    const response = await this.httpClient.post(`${this.httpEndpoint}/embeddings`, payload, this.config.signal);
     
     // Validate response
     if (!response.embeddings || !Array.isArray(response.embeddings)) {
       throw new Error('Invalid response from HTTP endpoint');
     }
     
-    const embedding = response.embeddings[0];
+    // Servers that ignore encoding_format still answer with number arrays
+    const embedding = decodeEmbedding(response.embeddings[0]);
     if (!Array.isArray(embedding) || embedding.length === 0) {
       throw new Error('Invalid embedding from HTTP endpoint');
     }
@@ -334,20 +339,25 @@ export class LlamaCppProvider extends EmbeddingProvider {
       throw new Error('No valid texts to embed');
     }
 
-    const payload = {
-      model: this.getModel(),
-      input: texts,
-      normalize: true,
-    };
+    // Server-sized requests, counted with the model's own tokenizer when it is loaded natively
+    const result = await this.embedInBatches(texts, async (chunk) => {
+      const payload = {
+        model: this.getModel(),
+        input: chunk,
+        normalize: true,
+        encoding_format: 'base64',
+      };
 
-    const response = await this.httpClient.post('/embeddings', payload);
-    
-    // Validate response
-    if (!response.embeddings || !Array.isArray(response.embeddings)) {
-      throw new Error('Invalid response from HTTP endpoint');
-    }
-    
-    const embeddings = response.embeddings;
+      const response = await this.httpClient.post(`${this.httpEndpoint}/embeddings`, payload, this.config.signal);
+
+      // Validate response
+      if (!response.embeddings || !Array.isArray(response.embeddings)) {
+        throw new Error('Invalid response from HTTP endpoint');
+      }
+      return { embeddings: response.embeddings.map(decodeEmbedding) };
+    });
+
+    const embeddings = result.embeddings;
     if (embeddings.length === 0) {
       throw new Error('No embeddings returned from HTTP endpoint');
     }
@@ -371,6 +381,19 @@ export class LlamaCppProvider extends EmbeddingProvider {
     };
   }
 
+  protected getBatchLimits(): BatchLimits {
+    // A local server batches a few hundred inputs of up to 512 tokens at a time
+    return { maxItems: 256, maxTokens: 65536, concurrency: 2 };
+  }
+
+  protected countTokens(text: string): number {
+    // Exact WordPiece count from the native tokenizer once the model is loaded
+    if (this.nativeModel && typeof nativeModule?.tokenize === 'function') {
+      return nativeModule.tokenize(this.nativeModel, text).length;
+    }
+    return super.countTokens(text);
+  }
+
   // Cleanup method
   async cleanup(): Promise<void> {
     if (this.useNative && this.nativeModel) {
@@ -1,6 +1,7 @@
 import { Mistral } from '@mistralai/mistralai';
 import { EmbeddingProvider } from '@providers/base/EmbeddingProvider';
 import type { EmbedConfig, EmbedInput, EmbedResult, BatchEmbedResult } from '@src/types/index';
+import type { BatchLimits } from '@src/util/batching';
 import { Logger } from '@src/util/logger';
 
 const logger = Logger.createModuleLogger('mistral');
@@ -33,10 +34,10 @@ export class MistralProvider extends EmbeddingProvider {
       const text = await this.readInput(input);
       logger.debug(`Embedding text with model: ${this.getModel()}`);
 
-      const response = await this.client.embeddings.create({
+      const response = await this.withRetry(() => this.client.embeddings.create({
         model: this.getModel(),
         inputs: [text],
-      });
+      }, this.requestOptions()));
 
       const embedding = response.data[0];
       if (!embedding) {
@@ -64,25 +65,32 @@ export class MistralProvider extends EmbeddingProvider {
       const texts = await Promise.all(inputs.map(input => this.readInput(input)));
       logger.debug(`Batch embedding ${texts.length} texts with model: ${this.getModel()}`);
 
-      const response = await this.client.embeddings.create({
-        model: this.getModel(),
-        inputs: texts,
-      });
-
-      const embeddings = response.data.map((item) => {
-        if (!item.embedding) throw new Error('No embedding returned from Mistral API');
-        return item.embedding as number[];
+      let model = this.getModel();
+      const result = await this.embedInBatches(texts, async (chunk) => {
+        const response = await this.client.embeddings.create({
+          model: this.getModel(),
+          inputs: chunk,
+        }, this.requestOptions());
+        model = response.model;
+
+        const embeddings = response.data.map((item) => {
+          if (!item.embedding) throw new Error('No embedding returned from Mistral API');
+          return item.embedding as number[];
+        });
+
+        return {
+          embeddings,
+          promptTokens: response.usage?.promptTokens ?? undefined,
+          totalTokens: response.usage?.totalTokens ?? undefined,
+        };
       });
 
       return {
-        embeddings,
-        dimensions: embeddings[0]?.length || 0,
-        model: response.model,
+        embeddings: result.embeddings,
+        dimensions: result.embeddings[0]?.length || 0,
+        model,
         provider: 'mistral',
-        usage: response.usage?.promptTokens && response.usage?.totalTokens ? {
-          promptTokens: response.usage.promptTokens,
-          totalTokens: response.usage.totalTokens,
-        } : undefined,
+        usage: result.usage,
       };
     } catch (error: unknown) {
       logger.error(`Mistral batch embedding failed: ${(error instanceof Error ? error.message : String(error))}`);
@@ -90,6 +98,15 @@ export class MistralProvider extends EmbeddingProvider {
     }
   }
 
+  private requestOptions(): { fetchOptions?: { signal: AbortSignal } } {
+    return this.config.signal ? { fetchOptions: { signal: this.config.signal } } : {};
+  }
+
+  protected getBatchLimits(): BatchLimits {
+    // mistral-embed accepts up to 16k tokens per request
+    return { maxItems: 128, maxTokens: 16000, concurrency: 4 };
+  }
+
   getDimensions(): number {
     // Mistral embedding dimensions
     const model = this.getModel();
@@ -1,7 +1,9 @@
 import OpenAI from 'openai';
 import { EmbeddingProvider } from '@providers/base/EmbeddingProvider';
 import type { EmbedConfig, EmbedInput, EmbedResult, BatchEmbedResult } from '@src/types/index';
+import type { BatchLimits } from '@src/util/batching';
 import { Logger } from '@src/util/logger';
+import { decodeEmbedding } from '@src/util/base64';
 
 const logger = Logger.createModuleLogger('openai');
 
@@ -19,6 +21,7 @@ export class OpenAIProvider extends EmbeddingProvider {
       apiKey: config.apiKey,
       baseURL: config.baseUrl,
       timeout: config.timeout || 30000,
+      maxRetries: 0, // retries are handled by EmbeddingProvider with the configured maxRetries
     });
 
     logger.info('OpenAI provider initialized');
@@ -29,19 +32,24 @@ export class OpenAIProvider extends EmbeddingProvider {
       const text = await this.readInput(input);
       logger.debug(`Embedding text with model: ${this.getModel()}`);
 
-      const response = await this.client.embeddings.create({
+      // The SDK already requests base64 when no format is given, then decodes it itself;
+      // asking explicitly hands the raw string to our decoder (SIMD when the native module is built)
+      const response = await this.withRetry(() => this.client.embeddings.create({
         model: this.getModel(),
         input: text,
-      });
+        encoding_format: 'base64',
+      }, this.requestOptions()));
 
-      const embedding = response.data[0];
-      if (!embedding) {
+      const item = response.data[0];
+      if (!item) {
         throw new Error('No embedding returned from OpenAI API');
       }
 
+      const embedding = decodeEmbedding(item.embedding as unknown as string | number[]);
+
       return {
-        embedding: embedding.embedding || [],
-        dimensions: embedding.embedding?.length || 0,
+        embedding,
+        dimensions: embedding.length,
         model: response.model,
         provider: 'openai',
         usage: response.usage ? {
@@ -60,22 +68,42 @@ export class OpenAIProvider extends EmbeddingProvider {
       const texts = await Promise.all(inputs.map(input => this.readInput(input)));
       logger.debug(`Batch embedding ${texts.length} texts with model: ${this.getModel()}`);
 
-      const response = await this.client.embeddings.create({
-        model: this.getModel(),
-        input: texts,
+      let model = this.getModel();
+      const result = await this.embedInBatches(texts, async (chunk) => {
+        const response = await this.client.embeddings.create({
+          model: this.getModel(),
+          input: chunk,
+          encoding_format: 'base64',
+        }, this.requestOptions());
+        model = response.model;
+
+        // Items carry their position within the request; each one must be answered exactly once
+        const embeddings: number[][] = new Array(chunk.length);
+        for (const item of response.data) {
+          if (!Number.isInteger(item.index) || item.index < 0 || item.index >= chunk.length || embeddings[item.index]) {
+            throw new Error(`OpenAI returned an embedding for index ${item.index} of a ${chunk.length}-input request`);
+          }
+          embeddings[item.index] = decodeEmbedding(item.embedding as unknown as string | number[]);
+        }
+        for (let i = 0; i < chunk.length; i++) {
+          if (!embeddings[i]) {
+            throw new Error(`OpenAI returned no embedding for input ${i} of ${chunk.length}`);
+          }
+        }
+
+        return {
+          embeddings,
+          promptTokens: response.usage?.prompt_tokens,
+          totalTokens: response.usage?.total_tokens,
+        };
       });
 
-      const embeddings = response.data.map(item => item.embedding);
-
       return {
-        embeddings,
-        dimensions: embeddings[0]?.length || 0,
-        model: response.model,
+        embeddings: result.embeddings,
+        dimensions: result.embeddings[0]?.length || 0,
+        model,
         provider: 'openai',
-        usage: response.usage ? {
-          promptTokens: response.usage.prompt_tokens,
-          totalTokens: response.usage.total_tokens,
-        } : undefined,
+        usage: result.usage,
       };
     } catch (error: unknown) {
       logger.error(`OpenAI batch embedding failed: ${(error instanceof Error ? error.message : String(error))}`);
@@ -83,6 +111,15 @@ export class OpenAIProvider extends EmbeddingProvider {
     }
   }
 
+  private requestOptions(): { signal?: AbortSignal } {
+    return this.config.signal ? { signal: this.config.signal } : {};
+  }
+
+  protected getBatchLimits(): BatchLimits {
+    // 2048 inputs and 300k tokens per request
+    return { maxItems: 2048, maxTokens: 300000, concurrency: 4 };
+  }
+
   getDimensions(): number {
     // Common OpenAI embedding dimensions
     const model = this.getModel();
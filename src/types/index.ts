@@ -11,6 +11,18 @@ export interface EmbedConfig {
   baseUrl?: string;
   timeout?: number;
   maxRetries?: number;
+  maxBatchSize?: number;    // inputs per API request (defaults to the provider's limit)
+  maxBatchTokens?: number;  // estimated tokens per API request
+  maxConcurrency?: number;  // API requests in flight during embedBatch
+  signal?: AbortSignal;     // cancels in-flight requests and pending retries
+}
+
+export interface AutoEmbedOptions {
+  hedge?: boolean;            // race the next provider when the preferred one is slow
+  hedgePercentile?: number;   // latency percentile that triggers a hedge (default 0.95)
+  hedgeDelayMs?: number;      // hedge delay before enough latencies are known (default 1000)
+  maxHedges?: number;         // extra providers that may be fired (default 1)
+  latencySloMs?: number;      // providers whose typical latency exceeds this are tried last
 }
 
 export interface EmbedInput {
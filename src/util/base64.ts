@@ -0,0 +1,87 @@
+/**
+ * Base64 float32 embeddings (`encoding_format: "base64"`)
+ * Packed little-endian float32 decodes without per-float parsing. Against a server that
+ * would otherwise send full-precision JSON numbers it is also ~4x smaller on the wire
+ * (768 dims: 4 KB against ~16 KB).
+ */
+
+import { createRequire } from 'module';
+import { join, resolve } from 'path';
+import { cwd } from 'process';
+import { PATHS } from '../providers/paths';
+
+type NativeBase64Decoder = (data: string) => Float32Array;
+
+let nativeDecoder: NativeBase64Decoder | null = null;
+let nativeProbed = false;
+
+const littleEndian = new Uint8Array(new Uint32Array([1]).buffer)[0] === 1;
+
+/**
+ * Use the native SIMD decoder once the native module has been loaded
+ */
+export function registerNativeBase64Decoder(decoder: NativeBase64Decoder | null | undefined): void {
+  nativeDecoder = decoder || null;
+  nativeProbed = true;
+}
+
+/**
+ * Look for the native decoder on first use, so every provider gets it, not only the ones
+ * that load the native module themselves
+ */
+function probeNativeDecoder(): void {
+  nativeProbed = true;
+  const requireNative = createRequire(join(cwd(), 'index.js'));
+  for (const path of PATHS.NATIVE_MODULE_PATHS) {
+    try {
+      const module = requireNative(resolve(path));
+      if (typeof module?.decodeBase64F32 === 'function') {
+        nativeDecoder = module.decodeBase64F32;
+        return;
+      }
+    } catch (e) {
+      // Not built here, try the next path
+    }
+  }
+}
+
+/**
+ * Decode base64 little-endian float32 into a Float32Array
+ */
+export function decodeFloat32Base64(data: string): Float32Array {
+  if (!nativeProbed) {
+    probeNativeDecoder();
+  }
+  if (nativeDecoder && littleEndian) {
+    return nativeDecoder(data);
+  }
+
+  const bytes = Buffer.from(data, 'base64');
+  if (bytes.length % 4 !== 0) {
+    throw new Error(`Invalid base64 float32 data: ${bytes.length} bytes`);
+  }
+
+  const count = bytes.length / 4;
+  if (littleEndian && bytes.byteOffset % 4 === 0) {
+    return new Float32Array(bytes.buffer, bytes.byteOffset, count);
+  }
+
+  // Unaligned (pooled) buffer or big-endian host
+  const result = new Float32Array(count);
+  for (let i = 0; i < count; i++) {
+    result[i] = bytes.readFloatLE(i * 4);
+  }
+  return result;
+}
+
+/**
+ * Decode an embedding that may arrive either as base64 or as a number array
+ * Results carry number[], so the decoded floats are copied once into a plain array; base64
+ * plus that copy still takes about a third of the time JSON.parse needs for the same vector.
+ */
+export function decodeEmbedding(embedding: string | number[]): number[] {
+  if (typeof embedding !== 'string') {
+    return embedding;
+  }
+  return Array.from(decodeFloat32Base64(embedding));
+}
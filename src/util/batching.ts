@@ -0,0 +1,232 @@
+import { Logger } from './logger';
+import { countTokens } from './tokens';
+import type { TokenCounter } from './tokens';
+
+const logger = Logger.createModuleLogger('batching');
+
+/**
+ * Per-request limits of a remote embedding API
+ */
+export interface BatchLimits {
+  maxItems: number;       // inputs per request
+  maxTokens: number;      // total tokens per request
+  concurrency: number;    // requests in flight
+}
+
+export interface RetryOptions {
+  maxRetries: number;
+  baseDelayMs?: number;
+  maxDelayMs?: number;
+  signal?: AbortSignal | undefined;
+}
+
+export interface ChunkResult {
+  embeddings: number[][];
+  promptTokens?: number | undefined;
+  totalTokens?: number | undefined;
+}
+
+export interface BatchedResult {
+  embeddings: number[][];
+  usage?: {
+    promptTokens?: number;
+    totalTokens?: number;
+  } | undefined;
+}
+
+/**
+ * Split texts into chunks that respect maxItems and maxTokens, keeping input order.
+ * A single text over the token budget still gets a chunk of its own and is left to the provider.
+ * Tokens are counted with count, the estimate of countTokens unless the provider has its tokenizer.
+ */
+export function splitBatch(
+  texts: string[],
+  limits: Pick<BatchLimits, 'maxItems' | 'maxTokens'>,
+  count: TokenCounter = countTokens
+): number[][] {
+  const chunks: number[][] = [];
+  let current: number[] = [];
+  let tokens = 0;
+
+  for (let i = 0; i < texts.length; i++) {
+    const n = count(texts[i] ?? '');
+    if (current.length > 0 && (current.length >= limits.maxItems || tokens + n > limits.maxTokens)) {
+      chunks.push(current);
+      current = [];
+      tokens = 0;
+    }
+    current.push(i);
+    tokens += n;
+  }
+
+  if (current.length > 0) {
+    chunks.push(current);
+  }
+  return chunks;
+}
+
+/**
+ * HTTP status carried by an SDK or fetch error, if any
+ */
+function getErrorStatus(error: unknown): number | undefined {
+  if (!error || typeof error !== 'object') {
+    return undefined;
+  }
+
+  const e = error as { status?: unknown; statusCode?: unknown; response?: { status?: unknown }; message?: unknown };
+  for (const status of [e.status, e.statusCode, e.response?.status]) {
+    if (typeof status === 'number') {
+      return status;
+    }
+  }
+
+  // HttpClient ("HTTP 429: Too Many Requests") and some SDKs ("[429 Too Many Requests]",
+  // "status code 503") only put the status in the message; a bare number is not a status
+  if (typeof e.message !== 'string') {
+    return undefined;
+  }
+  const match = /^HTTP (\d{3})\b/.exec(e.message) ||
+    /\[(\d{3}) [A-Z][A-Za-z -]*\]/.exec(e.message) ||
+    /\bstatus(?: code)?:? (\d{3})\b/i.exec(e.message);
+  const status = match ? Number(match[1]) : NaN;
+  return status >= 100 && status <= 599 ? status : undefined;
+}
+
+/**
+ * Rate limits, server errors and dropped connections are worth retrying
+ */
+export function isRetryableError(error: unknown): boolean {
+  const status = getErrorStatus(error);
+  if (status !== undefined) {
+    return status === 408 || status === 429 || status >= 500;
+  }
+
+  const code = (error as { code?: unknown })?.code;
+  return code === 'ECONNRESET' || code === 'ETIMEDOUT' || code === 'ECONNREFUSED' || code === 'UND_ERR_SOCKET';
+}
+
+/**
+ * Server-requested delay from a Retry-After header, in milliseconds
+ */
+function getRetryAfterMs(error: unknown): number | undefined {
+  const headers = (error as { headers?: unknown })?.headers;
+  if (!headers) {
+    return undefined;
+  }
+
+  const value = typeof (headers as { get?: unknown }).get === 'function'
+    ? (headers as { get(name: string): string | null }).get('retry-after')
+    : (headers as Record<string, string | undefined>)['retry-after'];
+  if (!value) {
+    return undefined;
+  }
+
+  const seconds = Number(value);
+  if (!Number.isNaN(seconds)) {
+    return seconds * 1000;
+  }
+  const date = Date.parse(value);
+  return Number.isNaN(date) ? undefined : Math.max(0, date - Date.now());
+}
+
+/**
+ * Wait ms, waking early (and rejecting) if signal aborts
+ */
+function sleep(ms: number, signal?: AbortSignal): Promise<void> {
+  return new Promise((resolve, reject) => {
+    if (signal?.aborted) {
+      reject(new Error('Request aborted'));
+      return;
+    }
+    const onAbort = () => {
+      clearTimeout(timer);
+      reject(new Error('Request aborted'));
+    };
+    const timer = setTimeout(() => {
+      signal?.removeEventListener('abort', onAbort);
+      resolve();
+    }, ms);
+    signal?.addEventListener('abort', onAbort, { once: true });
+  });
+}
+
+/**
+ * Run fn, retrying retryable failures with full-jitter exponential backoff
+ */
+export async function withRetry<T>(fn: () => Promise<T>, options: RetryOptions): Promise<T> {
+  const baseDelayMs = options.baseDelayMs ?? 500;
+  const maxDelayMs = options.maxDelayMs ?? 20000;
+
+  for (let attempt = 0; ; attempt++) {
+    try {
+      return await fn();
+    } catch (error: unknown) {
+      if (attempt >= options.maxRetries || options.signal?.aborted || !isRetryableError(error)) {
+        throw error;
+      }
+
+      const backoff = Math.random() * Math.min(maxDelayMs, baseDelayMs * 2 ** attempt);
+      const delay = Math.min(maxDelayMs, Math.max(backoff, getRetryAfterMs(error) ?? 0));
+      logger.warn(`Request failed (${error instanceof Error ? error.message : String(error)}), retry ${attempt + 1}/${options.maxRetries} in ${Math.round(delay)}ms`);
+      await sleep(delay, options.signal);
+    }
+  }
+}
+
+/**
+ * Embed texts in provider-sized chunks with at most `concurrency` requests in flight.
+ * Chunks may finish in any order; embeddings come back in input order.
+ */
+export async function runBatched(
+  texts: string[],
+  limits: BatchLimits,
+  retry: RetryOptions,
+  embedChunk: (chunk: string[]) => Promise<ChunkResult>,
+  count: TokenCounter = countTokens
+): Promise<BatchedResult> {
+  const chunks = splitBatch(texts, limits, count);
+  const embeddings: number[][] = new Array(texts.length);
+  let promptTokens = 0;
+  let totalTokens = 0;
+  let hasUsage = false;
+  let failed = false;
+  let next = 0;
+
+  logger.debug(`Embedding ${texts.length} texts in ${chunks.length} requests (concurrency ${limits.concurrency})`);
+
+  const worker = async (): Promise<void> => {
+    // Stop handing out chunks once any of them has failed for good
+    while (!failed && next < chunks.length) {
+      const indices = chunks[next++]!;
+      let result: ChunkResult;
+      try {
+        result = await withRetry(() => embedChunk(indices.map(i => texts[i]!)), retry);
+      } catch (error: unknown) {
+        failed = true;
+        throw error;
+      }
+
+      if (result.embeddings.length !== indices.length) {
+        failed = true;
+        throw new Error(`Provider returned ${result.embeddings.length} embeddings for ${indices.length} inputs`);
+      }
+      indices.forEach((index, j) => {
+        embeddings[index] = result.embeddings[j]!;
+      });
+
+      if (result.promptTokens !== undefined || result.totalTokens !== undefined) {
+        hasUsage = true;
+        promptTokens += result.promptTokens ?? 0;
+        totalTokens += result.totalTokens ?? 0;
+      }
+    }
+  };
+
+  const workers = Math.max(1, Math.min(limits.concurrency, chunks.length));
+  await Promise.all(Array.from({ length: workers }, worker));
+
+  return {
+    embeddings,
+    usage: hasUsage ? { promptTokens, totalTokens } : undefined,
+  };
+}
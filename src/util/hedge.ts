@@ -0,0 +1,101 @@
+/**
+ * Hedged requests across providers
+ * Starts the preferred candidate and fires the next one when it fails or runs past its usual
+ * latency. The first success wins and every other request in flight is aborted.
+ */
+
+import { Logger } from './logger';
+import { providerHealth } from './provider-health';
+import type { HealthTarget, ProviderHealth } from './provider-health';
+
+const logger = Logger.createModuleLogger('hedge');
+
+export interface HedgeOptions {
+  percentile: number;       // latency percentile of the running candidate that triggers a hedge
+  fallbackDelayMs: number;  // hedge delay before enough latencies are known
+  maxHedges: number;        // extra candidates that may be fired on a timer
+}
+
+/**
+ * Runs candidates in order until one succeeds. run gets a signal that is aborted once another
+ * candidate has won; failures hand over to the next candidate at once and do not count as hedges.
+ * Rejects when every candidate has failed.
+ */
+export function hedge<C extends HealthTarget, T>(
+  candidates: C[],
+  run: (candidate: C, signal: AbortSignal) => Promise<T>,
+  options: HedgeOptions,
+  health: ProviderHealth = providerHealth
+): Promise<T> {
+  return new Promise((resolve, reject) => {
+    const controllers: AbortController[] = [];
+    let next = 0;
+    let inFlight = 0;
+    let hedges = 0;
+    let settled = false;
+    let hedgeTimer: ReturnType<typeof setTimeout> | undefined;
+
+    const finish = () => {
+      settled = true;
+      clearTimeout(hedgeTimer);
+      for (const controller of controllers) {
+        controller.abort();
+      }
+    };
+
+    const launch = () => {
+      const candidate = candidates[next++];
+      if (!candidate) {
+        return;
+      }
+
+      const controller = new AbortController();
+      controllers.push(controller);
+      inFlight++;
+      logger.info(`Trying provider: ${candidate.provider}${inFlight > 1 ? ' (hedge)' : ''}`);
+
+      run(candidate, controller.signal).then(
+        result => {
+          if (settled) {
+            return;
+          }
+          finish();
+          resolve(result);
+        },
+        (error: unknown) => {
+          inFlight--;
+          if (settled) {
+            return;
+          }
+          const errorMessage = error instanceof Error ? error.message : String(error);
+          logger.warn(`Provider ${candidate.provider} failed: ${errorMessage}`);
+
+          // A failure hands over straight away rather than waiting for the hedge delay
+          if (next < candidates.length) {
+            clearTimeout(hedgeTimer);
+            launch();
+          } else if (inFlight === 0) {
+            finish();
+            reject(new Error('No available embedding provider found'));
+          }
+        }
+      );
+
+      if (hedges < options.maxHedges && next < candidates.length) {
+        clearTimeout(hedgeTimer);
+        hedgeTimer = setTimeout(() => {
+          if (!settled && next < candidates.length) {
+            hedges++;
+            launch();
+          }
+        }, health.hedgeDelay(candidate, options.percentile, options.fallbackDelayMs));
+      }
+    };
+
+    if (candidates.length === 0) {
+      reject(new Error('No available embedding provider found'));
+      return;
+    }
+    launch();
+  });
+}
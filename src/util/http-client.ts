@@ -13,13 +13,15 @@ export class HttpClient {
     this.timeout = timeout;
   }
 
-  async post(endpoint: string, data: any): Promise<any> {
+  async post(endpoint: string, data: any, signal?: AbortSignal): Promise<any> {
     const url = `${this.baseUrl}${endpoint}`;
     
     logger.debug(`HTTP POST to: ${url}`);
     
     const controller = new AbortController();
     const timeoutId = setTimeout(() => controller.abort(), this.timeout);
+    const onAbort = () => controller.abort();
+    signal?.addEventListener('abort', onAbort, { once: true });
 
     try {
       const response = await fetch(url, {
@@ -44,11 +46,16 @@ export class HttpClient {
       clearTimeout(timeoutId);
       
       if (error instanceof Error && error.name === 'AbortError') {
+        if (signal?.aborted) {
+          throw new Error('HTTP request aborted');
+        }
         throw new Error(`HTTP request timeout after ${this.timeout}ms`);
       }
       
       logger.error(`HTTP request failed to ${url}: ${error}`);
       throw error;
+    } finally {
+      signal?.removeEventListener('abort', onAbort);
     }
   }
 
@@ -0,0 +1,139 @@
+/**
+ * Provider health and latency tracking shared across calls
+ * Feeds provider ordering and hedge delays in autoEmbed. Stats are kept per provider and model,
+ * since two models behind one provider can have very different latencies.
+ */
+
+const EWMA_ALPHA = 0.2;
+const LATENCY_WINDOW = 64;        // recent samples kept for percentiles
+const MIN_HEDGE_SAMPLES = 5;      // below this, hedge after the fallback delay
+const FAILURE_THRESHOLD = 3;      // consecutive failures before a provider is benched
+const BASE_COOLDOWN_MS = 5000;
+const MAX_COOLDOWN_MS = 60000;
+
+/**
+ * What health is tracked for: an EmbedConfig fits
+ */
+export interface HealthTarget {
+  provider: string;
+  model?: string | undefined;
+}
+
+export interface ProviderHealthSnapshot {
+  provider: string;
+  model: string | undefined;
+  ewmaMs: number | null;
+  p50Ms: number | null;
+  p95Ms: number | null;
+  samples: number;
+  consecutiveFailures: number;
+  healthy: boolean;
+}
+
+class ProviderStats {
+  constructor(readonly provider: string, readonly model: string | undefined) {}
+
+  ewmaMs: number | null = null;
+  latencies: number[] = [];
+  cursor = 0;
+  consecutiveFailures = 0;
+  benchedUntil = 0;
+
+  percentile(p: number): number | null {
+    if (this.latencies.length === 0) {
+      return null;
+    }
+    const sorted = [...this.latencies].sort((a, b) => a - b);
+    const index = Math.min(sorted.length - 1, Math.floor(p * sorted.length));
+    return sorted[index] ?? null;
+  }
+}
+
+export class ProviderHealth {
+  private stats = new Map<string, ProviderStats>();
+
+  private static key(target: HealthTarget): string {
+    return `${target.provider}\u0000${target.model ?? ''}`;
+  }
+
+  // Lookups leave targets without records out of snapshot()
+  private find(target: HealthTarget): ProviderStats | undefined {
+    return this.stats.get(ProviderHealth.key(target));
+  }
+
+  private get(target: HealthTarget): ProviderStats {
+    let stats = this.find(target);
+    if (!stats) {
+      stats = new ProviderStats(target.provider, target.model);
+      this.stats.set(ProviderHealth.key(target), stats);
+    }
+    return stats;
+  }
+
+  recordSuccess(target: HealthTarget, latencyMs: number): void {
+    const stats = this.get(target);
+    stats.ewmaMs = stats.ewmaMs === null ? latencyMs : stats.ewmaMs + EWMA_ALPHA * (latencyMs - stats.ewmaMs);
+
+    if (stats.latencies.length < LATENCY_WINDOW) {
+      stats.latencies.push(latencyMs);
+    } else {
+      stats.latencies[stats.cursor] = latencyMs;
+      stats.cursor = (stats.cursor + 1) % LATENCY_WINDOW;
+    }
+
+    stats.consecutiveFailures = 0;
+    stats.benchedUntil = 0;
+  }
+
+  recordFailure(target: HealthTarget): void {
+    const stats = this.get(target);
+    stats.consecutiveFailures++;
+
+    // Back off exponentially while a provider keeps failing
+    if (stats.consecutiveFailures >= FAILURE_THRESHOLD) {
+      const cooldown = Math.min(MAX_COOLDOWN_MS, BASE_COOLDOWN_MS * 2 ** (stats.consecutiveFailures - FAILURE_THRESHOLD));
+      stats.benchedUntil = Date.now() + cooldown;
+    }
+  }
+
+  isHealthy(target: HealthTarget): boolean {
+    return Date.now() >= (this.find(target)?.benchedUntil ?? 0);
+  }
+
+  /**
+   * Smoothed latency, or null before the first success
+   */
+  expectedLatency(target: HealthTarget): number | null {
+    return this.find(target)?.ewmaMs ?? null;
+  }
+
+  /**
+   * How long to wait on target before hedging: its recent latency at the given percentile
+   */
+  hedgeDelay(target: HealthTarget, percentile: number, fallbackMs: number): number {
+    const stats = this.find(target);
+    if (!stats || stats.latencies.length < MIN_HEDGE_SAMPLES) {
+      return fallbackMs;
+    }
+    return stats.percentile(percentile) ?? fallbackMs;
+  }
+
+  snapshot(): ProviderHealthSnapshot[] {
+    return Array.from(this.stats.values()).map(stats => ({
+      provider: stats.provider,
+      model: stats.model,
+      ewmaMs: stats.ewmaMs,
+      p50Ms: stats.percentile(0.5),
+      p95Ms: stats.percentile(0.95),
+      samples: stats.latencies.length,
+      consecutiveFailures: stats.consecutiveFailures,
+      healthy: Date.now() >= stats.benchedUntil,
+    }));
+  }
+
+  reset(): void {
+    this.stats.clear();
+  }
+}
+
+export const providerHealth = new ProviderHealth();
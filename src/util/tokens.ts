@@ -0,0 +1,62 @@
+/**
+ * Token counting for request budgeting
+ * A conservative BPE estimate: Latin words of up to 4 characters are one token, longer
+ * words one token per 4 characters, every punctuation mark or symbol its own token, and
+ * every other non-Latin code point (CJK, kana, Hangul, Cyrillic, emoji, ...) at least one
+ * token, since BPE vocabularies split those scripts about that finely or finer.
+ * Providers with an exact tokenizer pass their own counter to the batching helpers.
+ */
+
+export type TokenCounter = (text: string) => number;
+
+/**
+ * Letters and digits that BPE merges into multi-character tokens: ASCII alphanumerics,
+ * Latin-1 and Latin Extended letters, and combining accents
+ */
+function isLatinWordChar(code: number): boolean {
+  return (code >= 48 && code <= 57) ||            // 0-9
+    (code >= 65 && code <= 90) ||                 // A-Z
+    (code >= 97 && code <= 122) ||                // a-z
+    (code >= 0xc0 && code <= 0x24f && code !== 0xd7 && code !== 0xf7) || // Latin-1 and Extended-A/B letters
+    (code >= 0x300 && code <= 0x36f) ||           // combining diacritics
+    (code >= 0x1e00 && code <= 0x1eff);           // Latin Extended Additional
+}
+
+function isSpace(code: number): boolean {
+  return code === 32 || code === 9 || code === 10 || code === 13 ||
+    code === 0xa0 || (code >= 0x2000 && code <= 0x200b) || code === 0x3000;
+}
+
+/**
+ * Estimate the number of tokens a remote provider will bill for text
+ */
+export function countTokens(text: string): number {
+  let tokens = 0;
+  let word = 0;
+
+  for (let i = 0; i < text.length; i++) {
+    // Whole code points, so a character outside the BMP counts once
+    const code = text.codePointAt(i)!;
+    if (code > 0xffff) {
+      i++;
+    }
+
+    if (isLatinWordChar(code)) {
+      word++;
+      continue;
+    }
+    if (word > 0) {
+      tokens += Math.ceil(word / 4);
+      word = 0;
+    }
+    // Whitespace folds into the next word; punctuation, symbols and other scripts count per code point
+    if (!isSpace(code)) {
+      tokens++;
+    }
+  }
+
+  if (word > 0) {
+    tokens += Math.ceil(word / 4);
+  }
+  return tokens;
+}
@@ -0,0 +1,206 @@
+import { describe, it, expect } from 'vitest';
+import { splitBatch, withRetry, runBatched, isRetryableError } from '../src/util/batching';
+import type { ChunkResult } from '../src/util/batching';
+
+const fast = { maxRetries: 3, baseDelayMs: 1, maxDelayMs: 1 };
+
+function httpError(status: number, message = `status ${status}`): Error {
+  return Object.assign(new Error(message), { status });
+}
+
+describe('splitBatch', () => {
+  it('keeps input order and respects maxItems', () => {
+    expect(splitBatch(['a', 'b', 'c', 'd', 'e'], { maxItems: 2, maxTokens: 1000 })).toEqual([[0, 1], [2, 3], [4]]);
+  });
+
+  it('respects maxTokens', () => {
+    const texts = ['one two', 'three', 'four five six', 'seven'];
+    const count = (text: string) => text.split(' ').length;
+    expect(splitBatch(texts, { maxItems: 100, maxTokens: 3 }, count)).toEqual([[0, 1], [2], [3]]);
+  });
+
+  it('gives a text over the budget a chunk of its own', () => {
+    const count = (text: string) => text.length;
+    expect(splitBatch(['ab', 'abcdefgh', 'cd'], { maxItems: 10, maxTokens: 4 }, count)).toEqual([[0], [1], [2]]);
+  });
+
+  it('returns no chunks for no texts', () => {
+    expect(splitBatch([], { maxItems: 2, maxTokens: 10 })).toEqual([]);
+  });
+});
+
+describe('isRetryableError', () => {
+  it('retries rate limits, timeouts, server errors and dropped connections', () => {
+    expect(isRetryableError(httpError(429))).toBe(true);
+    expect(isRetryableError(httpError(408))).toBe(true);
+    expect(isRetryableError(httpError(503))).toBe(true);
+    expect(isRetryableError(Object.assign(new Error('reset'), { code: 'ECONNRESET' }))).toBe(true);
+  });
+
+  it('does not retry client errors', () => {
+    expect(isRetryableError(httpError(400))).toBe(false);
+    expect(isRetryableError(httpError(401))).toBe(false);
+  });
+
+  it('reads the status from known message formats only', () => {
+    expect(isRetryableError(new Error('HTTP 502: Bad Gateway'))).toBe(true);
+    expect(isRetryableError(new Error('[GoogleGenerativeAI Error]: [429 Too Many Requests] quota'))).toBe(true);
+    expect(isRetryableError(new Error('Request failed with status code 503'))).toBe(true);
+    expect(isRetryableError(new Error('input [500 items] exceeds the limit'))).toBe(false);
+    expect(isRetryableError(new Error('batch [503] rejected by validation'))).toBe(false);
+    expect(isRetryableError(new Error('model has 768 dimensions'))).toBe(false);
+  });
+});
+
+describe('withRetry', () => {
+  it('retries retryable failures until one succeeds', async () => {
+    let calls = 0;
+    const result = await withRetry(async () => {
+      calls++;
+      if (calls < 3) {
+        throw httpError(429);
+      }
+      return 'ok';
+    }, fast);
+    expect(result).toBe('ok');
+    expect(calls).toBe(3);
+  });
+
+  it('gives up after maxRetries', async () => {
+    let calls = 0;
+    await expect(withRetry(async () => {
+      calls++;
+      throw httpError(503);
+    }, fast)).rejects.toThrow('status 503');
+    expect(calls).toBe(4);
+  });
+
+  it('does not retry errors that are not retryable', async () => {
+    let calls = 0;
+    await expect(withRetry(async () => {
+      calls++;
+      throw httpError(400);
+    }, fast)).rejects.toThrow('status 400');
+    expect(calls).toBe(1);
+  });
+
+  it('stops when the signal aborts during the backoff', async () => {
+    const controller = new AbortController();
+    let calls = 0;
+    const promise = withRetry(async () => {
+      calls++;
+      throw Object.assign(httpError(429), { headers: { 'retry-after': '10' } });
+    }, { maxRetries: 5, baseDelayMs: 1, maxDelayMs: 10000, signal: controller.signal });
+    setTimeout(() => controller.abort(), 10);
+    await expect(promise).rejects.toThrow('Request aborted');
+    expect(calls).toBe(1);
+  });
+
+  it('waits at least as long as Retry-After asks', async () => {
+    let calls = 0;
+    const start = Date.now();
+    await withRetry(async () => {
+      calls++;
+      if (calls === 1) {
+        throw Object.assign(httpError(429), { headers: { 'retry-after': '0.05' } });
+      }
+      return 'ok';
+    }, { maxRetries: 1, baseDelayMs: 1, maxDelayMs: 1000 });
+    expect(Date.now() - start).toBeGreaterThanOrEqual(45);
+  });
+});
+
+describe('runBatched', () => {
+  const limits = { maxItems: 2, maxTokens: 1000, concurrency: 2 };
+  const embed = (text: string) => [text.length];
+
+  it('returns embeddings in input order when chunks finish out of order', async () => {
+    const texts = ['a', 'bb', 'ccc', 'dddd', 'eeeee'];
+    const result = await runBatched(texts, limits, fast, async (chunk): Promise<ChunkResult> => {
+      // Earlier chunks take longer
+      await new Promise(resolve => setTimeout(resolve, 30 - chunk[0]!.length * 5));
+      return { embeddings: chunk.map(embed) };
+    });
+    expect(result.embeddings).toEqual(texts.map(embed));
+    expect(result.usage).toBeUndefined();
+  });
+
+  it('keeps at most concurrency requests in flight', async () => {
+    let inFlight = 0;
+    let peak = 0;
+    const texts = Array.from({ length: 12 }, (_, i) => `t${i}`);
+    await runBatched(texts, limits, fast, async (chunk) => {
+      inFlight++;
+      peak = Math.max(peak, inFlight);
+      await new Promise(resolve => setTimeout(resolve, 5));
+      inFlight--;
+      return { embeddings: chunk.map(embed) };
+    });
+    expect(peak).toBe(2);
+  });
+
+  it('sums usage across chunks', async () => {
+    const result = await runBatched(['a', 'b', 'c'], limits, fast, async (chunk) => ({
+      embeddings: chunk.map(embed),
+      promptTokens: chunk.length,
+      totalTokens: chunk.length * 2,
+    }));
+    expect(result.usage).toEqual({ promptTokens: 3, totalTokens: 6 });
+  });
+
+  it('retries a failed chunk without repeating the others', async () => {
+    const calls = new Map<string, number>();
+    const result = await runBatched(['a', 'b', 'c', 'd'], limits, fast, async (chunk) => {
+      const key = chunk.join();
+      calls.set(key, (calls.get(key) ?? 0) + 1);
+      if (key === 'c,d' && calls.get(key) === 1) {
+        throw httpError(500);
+      }
+      return { embeddings: chunk.map(embed) };
+    });
+    expect(result.embeddings).toHaveLength(4);
+    expect(calls.get('a,b')).toBe(1);
+    expect(calls.get('c,d')).toBe(2);
+  });
+
+  it('stops handing out chunks after a permanent failure', async () => {
+    let started = 0;
+    const texts = Array.from({ length: 20 }, (_, i) => `t${i}`);
+    await expect(runBatched(texts, { ...limits, concurrency: 1 }, fast, async () => {
+      started++;
+      throw httpError(400);
+    })).rejects.toThrow('status 400');
+    expect(started).toBe(1);
+  });
+
+  it('rejects a chunk with the wrong number of embeddings', async () => {
+    await expect(runBatched(['a', 'b'], limits, fast, async () => ({ embeddings: [[1]] })))
+      .rejects.toThrow('Provider returned 1 embeddings for 2 inputs');
+  });
+
+  it('stops handing out chunks after a chunk with the wrong number of embeddings', async () => {
+    let started = 0;
+    const texts = Array.from({ length: 20 }, (_, i) => `t${i}`);
+    await expect(runBatched(texts, limits, fast, async (chunk) => {
+      started++;
+      if (chunk[0] === 't0') {
+        return { embeddings: [[1]] };
+      }
+      await new Promise(resolve => setTimeout(resolve, 5));
+      return { embeddings: chunk.map(embed) };
+    })).rejects.toThrow('Provider returned 1 embeddings for 2 inputs');
+
+    // The other worker finishes its chunk and takes no more
+    await new Promise(resolve => setTimeout(resolve, 30));
+    expect(started).toBe(2);
+  });
+
+  it('splits with the counter it is given', async () => {
+    const sizes: number[] = [];
+    await runBatched(['a', 'b', 'c', 'd'], { maxItems: 10, maxTokens: 10, concurrency: 1 }, fast, async (chunk) => {
+      sizes.push(chunk.length);
+      return { embeddings: chunk.map(embed) };
+    }, () => 5);
+    expect(sizes).toEqual([2, 2]);
+  });
+});
@@ -0,0 +1,152 @@
+import { describe, it, expect } from 'vitest';
+import { hedge } from '../src/util/hedge';
+import { ProviderHealth } from '../src/util/provider-health';
+
+const options = { percentile: 0.95, fallbackDelayMs: 20, maxHedges: 1 };
+
+interface Candidate {
+  provider: string;
+  model?: string;
+  delayMs: number;
+  fails?: boolean;
+}
+
+interface Call {
+  provider: string;
+  signal: AbortSignal;
+  startedAt: number;
+}
+
+// resolves with the candidate's name after delayMs (or rejects), and rejects early when aborted
+function runner(calls: Call[]) {
+  const start = Date.now();
+  return (candidate: Candidate, signal: AbortSignal) => {
+    calls.push({ provider: candidate.provider, signal, startedAt: Date.now() - start });
+    return new Promise<string>((resolve, reject) => {
+      const timer = setTimeout(() => {
+        if (candidate.fails) {
+          reject(new Error(`${candidate.provider} failed`));
+        } else {
+          resolve(candidate.provider);
+        }
+      }, candidate.delayMs);
+      signal.addEventListener('abort', () => {
+        clearTimeout(timer);
+        reject(new Error('aborted'));
+      });
+    });
+  };
+}
+
+describe('hedge', () => {
+  it('does not hedge when the preferred candidate answers in time', async () => {
+    const calls: Call[] = [];
+    const candidates = [{ provider: 'a', delayMs: 1 }, { provider: 'b', delayMs: 1 }];
+    expect(await hedge(candidates, runner(calls), options, new ProviderHealth())).toBe('a');
+
+    await new Promise(resolve => setTimeout(resolve, 40));
+    expect(calls.map(call => call.provider)).toEqual(['a']);
+  });
+
+  it('fires the next candidate after the hedge delay and aborts the loser', async () => {
+    const calls: Call[] = [];
+    const candidates = [{ provider: 'slow', delayMs: 500 }, { provider: 'fast', delayMs: 1 }];
+    expect(await hedge(candidates, runner(calls), options, new ProviderHealth())).toBe('fast');
+
+    expect(calls.map(call => call.provider)).toEqual(['slow', 'fast']);
+    expect(calls[1]!.startedAt).toBeGreaterThanOrEqual(15);
+    expect(calls[0]!.signal.aborted).toBe(true);
+    expect(calls[1]!.signal.aborted).toBe(true);
+  });
+
+  it('hedges after the recorded latency percentile of the running provider and model', async () => {
+    const health = new ProviderHealth();
+    for (let i = 0; i < 10; i++) {
+      health.recordSuccess({ provider: 'p', model: 'quick' }, 5);
+      health.recordSuccess({ provider: 'p', model: 'big' }, 5000);
+    }
+
+    const calls: Call[] = [];
+    const candidates = [{ provider: 'p', model: 'quick', delayMs: 300 }, { provider: 'q', delayMs: 1 }];
+    expect(await hedge(candidates, runner(calls), { ...options, fallbackDelayMs: 1000 }, health)).toBe('q');
+    expect(calls[1]!.startedAt).toBeLessThan(200);
+  });
+
+  it('falls back at once when a candidate fails, without using up a hedge', async () => {
+    const calls: Call[] = [];
+    const candidates = [
+      { provider: 'a', delayMs: 1, fails: true },
+      { provider: 'b', delayMs: 1, fails: true },
+      { provider: 'c', delayMs: 1 },
+    ];
+    expect(await hedge(candidates, runner(calls), { ...options, fallbackDelayMs: 1000, maxHedges: 0 }, new ProviderHealth())).toBe('c');
+
+    expect(calls.map(call => call.provider)).toEqual(['a', 'b', 'c']);
+    expect(calls[2]!.startedAt).toBeLessThan(200);
+  });
+
+  it('fires at most maxHedges candidates on the timer', async () => {
+    const calls: Call[] = [];
+    const candidates = [
+      { provider: 'a', delayMs: 150 },
+      { provider: 'b', delayMs: 150 },
+      { provider: 'c', delayMs: 1 },
+    ];
+    expect(await hedge(candidates, runner(calls), { ...options, maxHedges: 1 }, new ProviderHealth())).toBe('a');
+    expect(calls.map(call => call.provider)).toEqual(['a', 'b']);
+  });
+
+  it('keeps waiting on a hedged candidate after the other one fails', async () => {
+    const calls: Call[] = [];
+    const candidates = [{ provider: 'a', delayMs: 100 }, { provider: 'b', delayMs: 1, fails: true }];
+    expect(await hedge(candidates, runner(calls), options, new ProviderHealth())).toBe('a');
+  });
+
+  it('rejects once every candidate has failed', async () => {
+    const calls: Call[] = [];
+    const candidates = [{ provider: 'a', delayMs: 1, fails: true }, { provider: 'b', delayMs: 30, fails: true }];
+    await expect(hedge(candidates, runner(calls), options, new ProviderHealth())).rejects.toThrow('No available embedding provider found');
+    expect(calls).toHaveLength(2);
+  });
+
+  it('rejects without candidates', async () => {
+    await expect(hedge([], runner([]), options, new ProviderHealth())).rejects.toThrow('No available embedding provider found');
+  });
+});
+
+describe('ProviderHealth', () => {
+  it('keeps separate stats per model of a provider', () => {
+    const health = new ProviderHealth();
+    health.recordSuccess({ provider: 'openai', model: 'small' }, 50);
+    health.recordSuccess({ provider: 'openai', model: 'large' }, 400);
+
+    expect(health.expectedLatency({ provider: 'openai', model: 'small' })).toBe(50);
+    expect(health.expectedLatency({ provider: 'openai', model: 'large' })).toBe(400);
+    expect(health.expectedLatency({ provider: 'openai' })).toBe(null);
+    expect(health.snapshot().map(entry => [entry.provider, entry.model])).toEqual([['openai', 'small'], ['openai', 'large']]);
+  });
+
+  it('benches a model after repeated failures and not its siblings', () => {
+    const health = new ProviderHealth();
+    for (let i = 0; i < 3; i++) {
+      health.recordFailure({ provider: 'gemini', model: 'a' });
+    }
+
+    expect(health.isHealthy({ provider: 'gemini', model: 'a' })).toBe(false);
+    expect(health.isHealthy({ provider: 'gemini', model: 'b' })).toBe(true);
+
+    health.recordSuccess({ provider: 'gemini', model: 'a' }, 10);
+    expect(health.isHealthy({ provider: 'gemini', model: 'a' })).toBe(true);
+  });
+
+  it('uses the fallback hedge delay until enough latencies are recorded', () => {
+    const health = new ProviderHealth();
+    const target = { provider: 'mistral', model: 'mistral-embed' };
+    expect(health.hedgeDelay(target, 0.95, 123)).toBe(123);
+
+    for (let i = 1; i <= 20; i++) {
+      health.recordSuccess(target, i * 10);
+    }
+    expect(health.hedgeDelay(target, 0.5, 123)).toBe(110);
+  });
+});
@@ -0,0 +1,31 @@
+import { describe, it, expect } from 'vitest';
+import { countTokens } from '../src/util/tokens';
+
+describe('countTokens', () => {
+  it('counts Latin words by length and punctuation per mark', () => {
+    expect(countTokens('')).toBe(0);
+    expect(countTokens('hello world')).toBe(4);
+    expect(countTokens('the cat')).toBe(2);
+    expect(countTokens('internationalization')).toBe(5);
+    expect(countTokens('a, b.')).toBe(4);
+    expect(countTokens('café crème')).toBe(3);
+  });
+
+  it('counts every CJK and other non-Latin code point as at least one token', () => {
+    expect(countTokens('你好世界')).toBe(4);
+    expect(countTokens('こんにちは')).toBe(5);
+    expect(countTokens('안녕하세요')).toBe(5);
+    expect(countTokens('привет')).toBe(6);
+    expect(countTokens('東京 tower')).toBe(4);
+  });
+
+  it('counts a character outside the BMP once', () => {
+    expect(countTokens('👍')).toBe(1);
+    expect(countTokens('𠀀𠀁')).toBe(2);
+  });
+
+  it('does not count whitespace', () => {
+    expect(countTokens('  \t\n ')).toBe(0);
+    expect(countTokens('日本　語')).toBe(3);
+  });
+});